@@ -98,6 +98,18 @@ namespace d2dx
 			_textureCategory_primitiveType_combiners |= ((uint8_t)alphaCombine << 1) & 0x02;
 		}
 
+		inline PrimitiveType GetPrimitiveType() const noexcept
+		{
+			return (PrimitiveType)((_textureCategory_primitiveType_combiners >> 2) & 0x07);
+		}
+
+		inline void SetPrimitiveType(PrimitiveType primitiveType) noexcept
+		{
+			assert((int32_t)primitiveType >= 0 && (int32_t)primitiveType < (int32_t)PrimitiveType::Count);
+			_textureCategory_primitiveType_combiners &= ~0x1C;
+			_textureCategory_primitiveType_combiners |= ((uint8_t)primitiveType << 2) & 0x1C;
+		}
+
 		inline int32_t GetTextureWidth() const noexcept
 		{
 			return 1 << (((_textureHeight_textureWidth_alphaBlend >> 2) & 7) + 1);
@@ -120,6 +132,21 @@ namespace d2dx
 			_textureHeight_textureWidth_alphaBlend |= (w - 1) << 2;
 		}
 
+		/* The texture cache that textures of this size go in: one per size of the longest side from
+		   8 to 256, and one of its own for 256x128. */
+		inline int32_t GetTextureCacheIndex() const noexcept
+		{
+			const int32_t w = (_textureHeight_textureWidth_alphaBlend >> 2) & 7;
+			const int32_t h = (_textureHeight_textureWidth_alphaBlend >> 5) & 7;
+
+			if (w == 7 && h == 6)
+			{
+				return 6;
+			}
+
+			return (w > h ? w : h) - 2;
+		}
+
 		inline AlphaBlend GetAlphaBlend() const noexcept
 		{
 			return (AlphaBlend)(_textureHeight_textureWidth_alphaBlend & 3);
@@ -188,7 +215,20 @@ namespace d2dx
 		inline void SetTextureAtlas(uint32_t textureAtlas) noexcept
 		{
 			assert(textureAtlas < 8);
-			_textureAtlas = textureAtlas & 7;
+			_textureAtlas &= ~7;
+			_textureAtlas |= textureAtlas & 7;
+		}
+
+		inline uint32_t GetTextureTile() const noexcept
+		{
+			return (uint32_t)(_textureAtlas >> 3);
+		}
+
+		inline void SetTextureTile(uint32_t textureTile) noexcept
+		{
+			assert(textureTile < 32);
+			_textureAtlas &= 7;
+			_textureAtlas |= (textureTile << 3) & 0xF8;
 		}
 
 		inline uint32_t GetTextureIndex() const noexcept
@@ -247,8 +287,8 @@ namespace d2dx
 		uint16_t _startVertexHigh_textureIndex;					// VVVVAAAA AAAAAAAA
 		uint8_t _textureHeight_textureWidth_alphaBlend;			// HHHWWWBB
 		uint8_t _isChromaKeyEnabled_gameAddress_paletteIndex;	// CGGGPPPP
-		uint8_t _textureCategory_primitiveType_combiners;		// TTT.PPCC
-		uint8_t _textureAtlas;									// .....AAA
+		uint8_t _textureCategory_primitiveType_combiners;		// TTTPPPCC
+		uint8_t _textureAtlas;									// TTTTTAAA
 	};
 
 	static_assert(sizeof(Batch) == 16, "sizeof(Batch)");
@@ -0,0 +1,104 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "BatchMerger.h"
+#include "Utils.h"
+
+using namespace d2dx;
+using namespace std;
+
+_Use_decl_annotations_
+uint64_t BatchMerger::GetMergeKey(
+	const Batch& batch,
+	bool isMultiAtlasEnabled) noexcept
+{
+	/* Quads are drawn indexed, sprites instanced and triangle lists neither, so they can't share a
+	   draw call. Points and lines are triangle lists by now. */
+	const PrimitiveType primitiveType = batch.GetPrimitiveType();
+	const uint64_t drawKind = primitiveType == PrimitiveType::Sprites ? 2 : primitiveType == PrimitiveType::Quads ? 1 : 0;
+	const uint64_t key = (uint64_t)batch.GetAlphaBlend() | (drawKind << 2);
+
+	if (isMultiAtlasEnabled)
+	{
+		return key;
+	}
+
+	return ((uint64_t)batch.GetTextureCacheIndex() << 8) | (batch.GetTextureAtlas() << 4) | key;
+}
+
+_Use_decl_annotations_
+int32_t BatchMerger::GetTextureSelector(
+	const Batch& batch) noexcept
+{
+	assert(batch.GetTextureAtlas() < D2DX_MAX_ATLASES_PER_TEXTURE_CACHE);
+	return batch.GetTextureCacheIndex() * D2DX_MAX_ATLASES_PER_TEXTURE_CACHE + batch.GetTextureAtlas();
+}
+
+_Use_decl_annotations_
+uint32_t BatchMerger::DrawBatches(
+	IRenderContext* renderContext,
+	const Batch* batches,
+	uint32_t batchCount,
+	uint32_t startVertexLocation)
+{
+	const bool isMultiAtlasEnabled = renderContext->IsMultiAtlasEnabled();
+
+	Batch mergedBatch;
+	uint64_t mergedBatchKey = 0;
+	uint32_t drawCalls = 0;
+
+	for (uint32_t i = 0; i < batchCount; ++i)
+	{
+		const Batch& batch = batches[i];
+
+		if (!batch.IsValid())
+		{
+			D2DX_DEBUG_LOG("Skipping batch %u, it is invalid.", i);
+			continue;
+		}
+
+		const uint64_t mergeKey = GetMergeKey(batch, isMultiAtlasEnabled);
+
+		if (!mergedBatch.IsValid())
+		{
+			mergedBatch = batch;
+			mergedBatchKey = mergeKey;
+		}
+		else if (mergeKey != mergedBatchKey ||
+			((mergedBatch.GetVertexCount() + batch.GetVertexCount()) > 65535))
+		{
+			renderContext->Draw(mergedBatch, startVertexLocation);
+			++drawCalls;
+			mergedBatch = batch;
+			mergedBatchKey = mergeKey;
+		}
+		else
+		{
+			mergedBatch.SetVertexCount(mergedBatch.GetVertexCount() + batch.GetVertexCount());
+		}
+	}
+
+	if (mergedBatch.IsValid())
+	{
+		renderContext->Draw(mergedBatch, startVertexLocation);
+		++drawCalls;
+	}
+
+	return drawCalls;
+}
@@ -0,0 +1,55 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Batch.h"
+#include "IRenderContext.h"
+#include "TextureCache.h"
+
+/* One texture selector per atlas of each of the seven texture caches. */
+#define D2DX_MAX_TEXTURE_SELECTORS (D2DX_TEXTURE_CACHE_COUNT * D2DX_MAX_ATLASES_PER_TEXTURE_CACHE)
+
+namespace d2dx
+{
+	/* Decides which batches share a draw call. Normally a draw call binds a single atlas of a single
+	   texture cache, so consecutive batches are merged only if they use the same atlas, blend mode
+	   and kind of primitive (quads, sprites or triangle lists). In multi-atlas mode the render
+	   context binds all atlases of all caches at once and each vertex carries a texture selector,
+	   so only the blend mode and the kind of primitive split draw calls. */
+	class BatchMerger final
+	{
+	public:
+		/* Consecutive batches with equal merge keys can be drawn together. */
+		static uint64_t GetMergeKey(
+			_In_ const Batch& batch,
+			_In_ bool isMultiAtlasEnabled) noexcept;
+
+		/* The value for Vertex::SetTextureSelector: the texture cache and atlas of the batch. */
+		static int32_t GetTextureSelector(
+			_In_ const Batch& batch) noexcept;
+
+		/* Draws the valid batches in order, merging consecutive ones where possible. The vertices
+		   of the batches must follow each other. Returns the number of draw calls made. */
+		static uint32_t DrawBatches(
+			_In_ IRenderContext* renderContext,
+			_In_reads_(batchCount) const Batch* batches,
+			_In_ uint32_t batchCount,
+			_In_ uint32_t startVertexLocation);
+	};
+}
@@ -0,0 +1,245 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "BatchReorderer.h"
+
+using namespace d2dx;
+using namespace std;
+
+#define D2DX_BATCH_REORDER_CELL_SHIFT 6
+#define D2DX_BATCH_REORDER_GRID_SIZE 64
+#define D2DX_BATCH_REORDER_MAX_KEYS 256
+
+_Use_decl_annotations_
+BatchReorderer::BatchReorderer(
+	uint32_t batchCapacity,
+	uint32_t vertexCapacity) :
+	_batches{ batchCapacity },
+	_vertices{ vertexCapacity },
+	_runMergeKeys{ batchCapacity },
+	_runVertexCounts{ batchCapacity },
+	_runFirstBatches{ batchCapacity },
+	_runLastBatches{ batchCapacity },
+	_nextBatches{ batchCapacity },
+	_lastRunKeys{ D2DX_BATCH_REORDER_MAX_KEYS },
+	_lastRuns{ D2DX_BATCH_REORDER_MAX_KEYS },
+	_cellRuns{ D2DX_BATCH_REORDER_GRID_SIZE * D2DX_BATCH_REORDER_GRID_SIZE }
+{
+}
+
+_Use_decl_annotations_
+bool BatchReorderer::Reorder(
+	const Batch* batches,
+	const uint64_t* mergeKeys,
+	uint32_t batchCount,
+	const Vertex* vertices,
+	Size gameSize,
+	Offset cameraOffset)
+{
+	assert(batchCount <= _batches.capacity);
+
+	/* 64x64 pixel cells; anything beyond the grid shares the last row or column. */
+	const int32_t gridWidth = max(1, min(D2DX_BATCH_REORDER_GRID_SIZE, (gameSize.width + 63) >> D2DX_BATCH_REORDER_CELL_SHIFT));
+	const int32_t gridHeight = max(1, min(D2DX_BATCH_REORDER_GRID_SIZE, (gameSize.height + 63) >> D2DX_BATCH_REORDER_CELL_SHIFT));
+
+	for (int32_t i = 0; i < gridWidth * gridHeight; ++i)
+	{
+		_cellRuns.items[i] = -1;
+	}
+
+	for (int32_t i = 0; i < D2DX_BATCH_REORDER_MAX_KEYS; ++i)
+	{
+		_lastRuns.items[i] = -1;
+	}
+
+	int32_t runCount = 0;
+	uint32_t drawCallsBefore = 0;
+	uint64_t previousMergeKey = 0;
+	uint32_t previousVertexCount = 0;
+	bool isReordered = false;
+
+	for (uint32_t i = 0; i < batchCount; ++i)
+	{
+		const Batch& batch = batches[i];
+
+		if (!batch.IsValid())
+		{
+			continue;
+		}
+
+		const uint64_t mergeKey = mergeKeys[i];
+		const uint32_t vertexCount = batch.GetVertexCount();
+
+		/* Same rule as DrawBatches, to count the draw calls without reordering. */
+		if (drawCallsBefore == 0 || mergeKey != previousMergeKey || (previousVertexCount + vertexCount) > 65535)
+		{
+			++drawCallsBefore;
+			previousVertexCount = 0;
+		}
+
+		previousMergeKey = mergeKey;
+		previousVertexCount += vertexCount;
+
+		const Vertex* batchVertices = vertices + batch.GetStartVertex();
+		int32_t minX = INT_MAX;
+		int32_t minY = INT_MAX;
+		int32_t maxX = INT_MIN;
+		int32_t maxY = INT_MIN;
+
+		for (uint32_t j = 0; j < vertexCount; ++j)
+		{
+			const int32_t x = batchVertices[j].GetX();
+			const int32_t y = batchVertices[j].GetY();
+			minX = min(minX, x);
+			minY = min(minY, y);
+			maxX = max(maxX, x);
+			maxY = max(maxY, y);
+		}
+
+		/* SurfaceIdTracker enables the camera offset per batch, so the first vertex decides. */
+		if (batchVertices[0].IsCameraOffsetEnabled())
+		{
+			minX += cameraOffset.x;
+			minY += cameraOffset.y;
+			maxX += cameraOffset.x;
+			maxY += cameraOffset.y;
+		}
+
+		const int32_t cellX0 = max(0, min(gridWidth - 1, minX >> D2DX_BATCH_REORDER_CELL_SHIFT));
+		const int32_t cellY0 = max(0, min(gridHeight - 1, minY >> D2DX_BATCH_REORDER_CELL_SHIFT));
+		const int32_t cellX1 = max(cellX0, min(gridWidth - 1, maxX >> D2DX_BATCH_REORDER_CELL_SHIFT));
+		const int32_t cellY1 = max(cellY0, min(gridHeight - 1, maxY >> D2DX_BATCH_REORDER_CELL_SHIFT));
+
+		int32_t lastOverlappingRun = -1;
+
+		for (int32_t cellY = cellY0; cellY <= cellY1; ++cellY)
+		{
+			for (int32_t cellX = cellX0; cellX <= cellX1; ++cellX)
+			{
+				lastOverlappingRun = max(lastOverlappingRun, _cellRuns.items[cellY * gridWidth + cellX]);
+			}
+		}
+
+		int32_t run = FindLastRun(mergeKey);
+
+		if (run < 0 || run < lastOverlappingRun || (_runVertexCounts.items[run] + vertexCount) > 65535)
+		{
+			run = runCount++;
+			_runMergeKeys.items[run] = mergeKey;
+			_runVertexCounts.items[run] = 0;
+			_runFirstBatches.items[run] = (int32_t)i;
+			SetLastRun(mergeKey, run);
+		}
+		else
+		{
+			isReordered |= run != (runCount - 1);
+			_nextBatches.items[_runLastBatches.items[run]] = (int32_t)i;
+		}
+
+		_runLastBatches.items[run] = (int32_t)i;
+		_runVertexCounts.items[run] += vertexCount;
+		_nextBatches.items[i] = -1;
+
+		for (int32_t cellY = cellY0; cellY <= cellY1; ++cellY)
+		{
+			for (int32_t cellX = cellX0; cellX <= cellX1; ++cellX)
+			{
+				int32_t& cellRun = _cellRuns.items[cellY * gridWidth + cellX];
+				cellRun = max(cellRun, run);
+			}
+		}
+	}
+
+	_drawCallsBefore = drawCallsBefore;
+	_drawCallsAfter = (uint32_t)runCount;
+
+	if (!isReordered)
+	{
+		return false;
+	}
+
+	uint32_t outBatchCount = 0;
+	uint32_t outVertexCount = 0;
+
+	for (int32_t run = 0; run < runCount; ++run)
+	{
+		for (int32_t i = _runFirstBatches.items[run]; i >= 0; i = _nextBatches.items[i])
+		{
+			Batch batch = batches[i];
+			const uint32_t vertexCount = batch.GetVertexCount();
+
+			assert((outVertexCount + vertexCount) <= _vertices.capacity);
+			memcpy(_vertices.items + outVertexCount, vertices + batch.GetStartVertex(), sizeof(Vertex) * vertexCount);
+
+			batch.SetStartVertex(outVertexCount);
+			_batches.items[outBatchCount++] = batch;
+			outVertexCount += vertexCount;
+		}
+	}
+
+	_batchCount = outBatchCount;
+	_vertexCount = outVertexCount;
+	return true;
+}
+
+_Use_decl_annotations_
+int32_t BatchReorderer::FindLastRun(
+	uint64_t mergeKey) const
+{
+	uint32_t position = (uint32_t)((mergeKey * 0x9E3779B97F4A7C15ULL) >> 56);
+
+	for (int32_t probe = 0; probe < D2DX_BATCH_REORDER_MAX_KEYS; ++probe)
+	{
+		if (_lastRuns.items[position] < 0)
+		{
+			return -1;
+		}
+
+		if (_lastRunKeys.items[position] == mergeKey)
+		{
+			return _lastRuns.items[position];
+		}
+
+		position = (position + 1) & (D2DX_BATCH_REORDER_MAX_KEYS - 1);
+	}
+
+	return -1;
+}
+
+_Use_decl_annotations_
+void BatchReorderer::SetLastRun(
+	uint64_t mergeKey,
+	int32_t run)
+{
+	uint32_t position = (uint32_t)((mergeKey * 0x9E3779B97F4A7C15ULL) >> 56);
+
+	for (int32_t probe = 0; probe < D2DX_BATCH_REORDER_MAX_KEYS; ++probe)
+	{
+		if (_lastRuns.items[position] < 0 || _lastRunKeys.items[position] == mergeKey)
+		{
+			_lastRunKeys.items[position] = mergeKey;
+			_lastRuns.items[position] = run;
+			return;
+		}
+
+		position = (position + 1) & (D2DX_BATCH_REORDER_MAX_KEYS - 1);
+	}
+
+	/* The table is full; the key won't be merged out of order, which is always safe. */
+}
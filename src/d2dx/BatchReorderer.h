@@ -0,0 +1,97 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Batch.h"
+#include "Buffer.h"
+#include "Types.h"
+#include "Vertex.h"
+
+namespace d2dx
+{
+	/* Reorders the batches of a frame so that more of them can be merged into one draw call.
+
+	   A batch may be moved back to the most recent run of batches that it can be merged with, as
+	   long as it doesn't overlap anything drawn after that run. Overlap is tested on a coarse screen
+	   grid that records, per cell, the last run that drew into it. Batches that overlap on screen
+	   therefore stay in their original order, and the blended result is unchanged. */
+	class BatchReorderer final
+	{
+	public:
+		BatchReorderer(
+			_In_ uint32_t batchCapacity,
+			_In_ uint32_t vertexCapacity);
+		~BatchReorderer() noexcept {}
+
+		/* Batches with equal merge keys can be drawn together if their vertices are contiguous.
+		   Invalid batches are dropped. Returns true if the order changed, in which case the batches
+		   and their vertices, rewritten in the new order, are in GetBatches and GetVertices.
+		   The camera offset is where the render context will draw vertices that have it enabled. */
+		bool Reorder(
+			_In_reads_(batchCount) const Batch* batches,
+			_In_reads_(batchCount) const uint64_t* mergeKeys,
+			_In_ uint32_t batchCount,
+			_In_ const Vertex* vertices,
+			_In_ Size gameSize,
+			_In_ Offset cameraOffset);
+
+		Buffer<Batch>& GetBatches() { return _batches; }
+
+		uint32_t GetBatchCount() const { return _batchCount; }
+
+		Buffer<Vertex>& GetVertices() { return _vertices; }
+
+		uint32_t GetVertexCount() const { return _vertexCount; }
+
+		/* Draw calls for the last frame, in the original order and after reordering. */
+		uint32_t GetDrawCallsBefore() const { return _drawCallsBefore; }
+
+		uint32_t GetDrawCallsAfter() const { return _drawCallsAfter; }
+
+	private:
+		int32_t FindLastRun(
+			_In_ uint64_t mergeKey) const;
+
+		void SetLastRun(
+			_In_ uint64_t mergeKey,
+			_In_ int32_t run);
+
+		Buffer<Batch> _batches;
+		uint32_t _batchCount = 0;
+		Buffer<Vertex> _vertices;
+		uint32_t _vertexCount = 0;
+		uint32_t _drawCallsBefore = 0;
+		uint32_t _drawCallsAfter = 0;
+
+		/* Per run, and the batches of each run as a linked list. */
+		Buffer<uint64_t> _runMergeKeys;
+		Buffer<uint32_t> _runVertexCounts;
+		Buffer<int32_t> _runFirstBatches;
+		Buffer<int32_t> _runLastBatches;
+		Buffer<int32_t> _nextBatches;
+
+		/* The last run per merge key, open-addressed. Only the last run can be joined: an earlier
+		   run with the same key is further back, and so overlaps at least as much. */
+		Buffer<uint64_t> _lastRunKeys;
+		Buffer<int32_t> _lastRuns;
+
+		/* The last run that drew into each grid cell, or -1. */
+		Buffer<int32_t> _cellRuns;
+	};
+}
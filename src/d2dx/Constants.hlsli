@@ -22,6 +22,7 @@ cbuffer Constants : register(b0)
 	float2 c_screenSize : packoffset(c0);
 	float2 c_invScreenSize : packoffset(c0.z);
 	uint4 flagsx : packoffset(c1);
+	float2 c_cameraOffset : packoffset(c2);
 };
 
 SamplerState PointSampler : register(s0);
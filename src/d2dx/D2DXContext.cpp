@@ -18,11 +18,16 @@
 */
 #include "pch.h"
 #include "D2DXContext.h"
+#include "BatchMerger.h"
 #include "Detours.h"
 #include "BuiltinResMod.h"
+#include "NullRenderContext.h"
 #include "RenderContext.h"
+#include "SoftwareRenderContext.h"
+#include "SpriteEncoder.h"
 #include "GameHelper.h"
 #include "SimdSse2.h"
+#include "TextureAtlasPacker.h"
 #include "Metrics.h"
 #include "Utils.h"
 #include "Vertex.h"
@@ -53,9 +58,20 @@ D2DXContext::D2DXContext(
 	const std::shared_ptr<IGameHelper>& gameHelper,
 	const std::shared_ptr<ISimd>& simd,
 	const std::shared_ptr<CompatibilityModeDisabler>& compatibilityModeDisabler) :
+	D2DXContext{ gameHelper, simd, compatibilityModeDisabler, GetCommandLineOptions() }
+{
+}
+
+_Use_decl_annotations_
+D2DXContext::D2DXContext(
+	const std::shared_ptr<IGameHelper>& gameHelper,
+	const std::shared_ptr<ISimd>& simd,
+	const std::shared_ptr<CompatibilityModeDisabler>& compatibilityModeDisabler,
+	const Options& options) :
 	_gameHelper{ gameHelper },
 	_simd{ simd },
 	_compatibilityModeDisabler{ compatibilityModeDisabler },
+	_textureHasher{ simd },
 	_frame(0),
 	_majorGameState(MajorGameState::Unknown),
 	_paletteKeys(D2DX_MAX_PALETTES, true),
@@ -63,13 +79,15 @@ D2DXContext::D2DXContext(
 	_batches(D2DX_MAX_BATCHES_PER_FRAME),
 	_vertexCount(0),
 	_vertices(D2DX_MAX_VERTICES_PER_FRAME),
+	_batchMergeKeys(D2DX_MAX_BATCHES_PER_FRAME),
+	_batchReorderer(D2DX_MAX_BATCHES_PER_FRAME, D2DX_MAX_VERTICES_PER_FRAME),
 	_customGameSize{ 0,0 },
 	_suggestedGameSize{ 0, 0 },
-	_options{ GetCommandLineOptions() },
+	_options{ options },
 	_lastScreenOpenMode{ 0 },
 	_surfaceIdTracker{ gameHelper },
 	_textMotionPredictor{ gameHelper },
-	_unitMotionPredictor{ gameHelper },
+	_unitMotionPredictor{ gameHelper, simd },
 	_weatherMotionPredictor{ gameHelper },
 	_featureFlags{ 0 }
 {
@@ -84,6 +102,7 @@ D2DXContext::D2DXContext(
 	auto actualWindowsVersion = GetActualWindowsVersion();
 	D2DX_LOG("Apparent Windows version: %u.%u (build %u).", apparentWindowsVersion.major, apparentWindowsVersion.minor, apparentWindowsVersion.build);
 	D2DX_LOG("Actual Windows version: %u.%u (build %u).", actualWindowsVersion.major, actualWindowsVersion.minor, actualWindowsVersion.build);
+	D2DX_LOG("Using %s texture hashing.", _textureHasher.GetEngine() == TextureHashEngine::Crc32c ? "CRC32C" : "FNV-1a");
 
 	if (!_options.GetFlag(OptionsFlag::NoResMod))
 	{
@@ -101,6 +120,16 @@ D2DXContext::D2DXContext(
 		}
 	}
 
+	if (_options.GetFlag(OptionsFlag::DbgRecordTrace))
+	{
+		_glideTraceRecorder = std::make_unique<GlideTraceRecorder>("d2dx_trace.bin");
+	}
+
+	if (_options.GetFlag(OptionsFlag::DbgRecordTextureBinds))
+	{
+		_textureBindRecorder = std::make_unique<TextureBindRecorder>("d2dx_texturebinds.bin");
+	}
+
 	if (!_options.GetFlag(OptionsFlag::NoFpsFix))
 	{
 		_gameHelper->TryApplyInGameFpsFix();
@@ -182,6 +211,11 @@ void D2DXContext::OnSstWinOpen(
 {
 	_threadId = GetCurrentThreadId();
 
+	if (_glideTraceRecorder)
+	{
+		_glideTraceRecorder->RecordSstWinOpen(width, height);
+	}
+
 	Size windowSize = _gameHelper->GetConfiguredGameSize();
 	if (!_options.GetFlag(OptionsFlag::NoResMod))
 	{
@@ -207,13 +241,60 @@ void D2DXContext::OnSstWinOpen(
 			ScreenMode::Windowed :
 			ScreenMode::FullscreenDefault;
 
-		_renderContext = std::make_shared<RenderContext>(
-			(HWND)hWnd,
-			gameSize,
-			windowSize * _options.GetWindowScale(),
-			initialScreenMode,
-			this,
-			_simd);
+		if (_options.GetFlag(OptionsFlag::DbgNullRenderer))
+		{
+			_renderContext = std::make_shared<NullRenderContext>(
+				(HWND)hWnd,
+				gameSize,
+				windowSize * _options.GetWindowScale(),
+				initialScreenMode,
+				this,
+				_simd,
+				_options.GetTextureCachePolicy(),
+				_options.GetFlag(OptionsFlag::MultiAtlas));
+		}
+		else if (_options.GetFlag(OptionsFlag::DbgSoftwareRenderer))
+		{
+			_renderContext = std::make_shared<SoftwareRenderContext>(
+				(HWND)hWnd,
+				gameSize,
+				windowSize * _options.GetWindowScale(),
+				initialScreenMode,
+				this,
+				_simd,
+				0,
+				_options.GetTextureCachePolicy());
+		}
+		else
+		{
+			try
+			{
+				_renderContext = std::make_shared<RenderContext>(
+					(HWND)hWnd,
+					gameSize,
+					windowSize * _options.GetWindowScale(),
+					initialScreenMode,
+					this,
+					_simd);
+			}
+			catch (const ComException& e)
+			{
+				/* Better a slow picture than none, but the player should know why the game is slow. */
+				D2DX_LOG("Failed to create the D3D11 render context (%s), falling back to software rendering.", e.what());
+				MessageBoxA(NULL, "D2DX could not initialize Direct3D 11 and will draw the game on the CPU instead, which is much slower. "
+					"Please make sure that your graphics drivers are up to date.", "D2DX", MB_OK);
+
+				_renderContext = std::make_shared<SoftwareRenderContext>(
+					(HWND)hWnd,
+					gameSize,
+					windowSize * _options.GetWindowScale(),
+					initialScreenMode,
+					this,
+					_simd,
+					0,
+					_options.GetTextureCachePolicy());
+			}
+		}
 	}
 	else
 	{
@@ -262,14 +343,19 @@ void D2DXContext::OnTexDownload(
 		return;
 	}
 
-	_textureHasher.Invalidate(startAddress);
+	if (_glideTraceRecorder)
+	{
+		_glideTraceRecorder->RecordTexDownload(startAddress, width, height, sourceAddress);
+	}
 
 	uint32_t memRequired = (uint32_t)(width * height);
 
-	auto pStart = _glideState.tmuMemory.items + startAddress;
 	auto pEnd = _glideState.tmuMemory.items + startAddress + memRequired;
 	assert(pEnd <= (_glideState.tmuMemory.items + _glideState.tmuMemory.capacity));
-	memcpy_s(pStart, _glideState.tmuMemory.capacity - startAddress, sourceAddress, memRequired);
+	memRequired = min(memRequired, _glideState.tmuMemory.capacity - startAddress);
+
+	/* Hash while copying, when the bytes are already in cache, instead of re-reading them in OnTexSource. */
+	_textureHasher.CopyAndHash(startAddress, _glideState.tmuMemory.items, _glideState.tmuMemory.capacity, sourceAddress, memRequired);
 }
 
 _Use_decl_annotations_
@@ -285,6 +371,11 @@ void D2DXContext::OnTexSource(
 		return;
 	}
 
+	if (_glideTraceRecorder)
+	{
+		_glideTraceRecorder->RecordTexSource(startAddress, width, height);
+	}
+
 	_readVertexState.isDirty = true;
 
 	uint8_t* pixels = _glideState.tmuMemory.items + startAddress;
@@ -296,8 +387,16 @@ void D2DXContext::OnTexSource(
 
 	uint32_t hash = _textureHasher.GetHash(startAddress, pixels, pixelsSize);
 
+	/* The hardcoded texture hashes are FNV-1a, which may not be the engine GetHash uses. */
+	const uint32_t compatibilityHash = _textureHasher.GetCompatibilityHash(hash, pixels, pixelsSize);
+
+	if (compatibilityHash == 0x4bea7b80)
+	{
+		_titleScreenTextureHash = hash;
+	}
+
 	/* Patch the '5' to not look like '6'. */
-	if (hash == 0x8a12f6bb)
+	if (compatibilityHash == 0x8a12f6bb)
 	{
 		pixels[1 + 10 * 16] = 181;
 		pixels[2 + 10 * 16] = 181;
@@ -310,12 +409,12 @@ void D2DXContext::OnTexSource(
 
 	if (_scratchBatch.GetTextureCategory() == TextureCategory::Unknown)
 	{
-		_scratchBatch.SetTextureCategory(_gameHelper->GetTextureCategoryFromHash(hash));
+		_scratchBatch.SetTextureCategory(_gameHelper->GetTextureCategoryFromHash(compatibilityHash));
 	}
 
 	if (_options.GetFlag(OptionsFlag::DbgDumpTextures))
 	{
-		DumpTexture(hash, width, height, pixels, pixelsSize, (uint32_t)_scratchBatch.GetTextureCategory(), _glideState.palettes.items + _scratchBatch.GetPaletteIndex() * 256);
+		DumpTexture(compatibilityHash, width, height, pixels, pixelsSize, (uint32_t)_scratchBatch.GetTextureCategory(), _glideState.palettes.items + _scratchBatch.GetPaletteIndex() * 256);
 	}
 }
 
@@ -342,7 +441,7 @@ void D2DXContext::CheckMajorGameState()
 			const Batch& batch = _batches.items[i];
 			const int32_t y0 = _vertices.items[batch.GetStartVertex()].GetY();
 
-			if (batch.GetHash() == 0x4bea7b80 && y0 >= 550)
+			if (_titleScreenTextureHash && batch.GetHash() == _titleScreenTextureHash && y0 >= 550)
 			{
 				_majorGameState = MajorGameState::TitleScreen;
 				break;
@@ -352,87 +451,66 @@ void D2DXContext::CheckMajorGameState()
 }
 
 _Use_decl_annotations_
-void D2DXContext::DrawBatches(
-	uint32_t startVertexLocation)
+void D2DXContext::ReorderBatches(
+	Offset cameraOffset)
 {
-	const int32_t batchCount = (int32_t)_batchCount;
+	const bool isMultiAtlasEnabled = _renderContext->IsMultiAtlasEnabled();
 
-	Batch mergedBatch;
-	int32_t drawCalls = 0;
-
-	for (int32_t i = 0; i < batchCount; ++i)
+	for (uint32_t i = 0; i < _batchCount; ++i)
 	{
 		const Batch& batch = _batches.items[i];
 
-		if (!batch.IsValid())
-		{
-			D2DX_DEBUG_LOG("Skipping batch %i, it is invalid.", i);
-			continue;
-		}
-
-		if (!mergedBatch.IsValid())
-		{
-			mergedBatch = batch;
-		}
-		else
-		{
-			if (_renderContext->GetTextureCache(batch) != _renderContext->GetTextureCache(mergedBatch) ||
-				batch.GetTextureAtlas() != mergedBatch.GetTextureAtlas() ||
-				batch.GetAlphaBlend() != mergedBatch.GetAlphaBlend() ||
-				((mergedBatch.GetVertexCount() + batch.GetVertexCount()) > 65535))
-			{
-				_renderContext->Draw(mergedBatch, startVertexLocation);
-				++drawCalls;
-				mergedBatch = batch;
-			}
-			else
-			{
-				mergedBatch.SetVertexCount(mergedBatch.GetVertexCount() + batch.GetVertexCount());
-			}
-		}
+		_batchMergeKeys.items[i] = batch.IsValid() ? BatchMerger::GetMergeKey(batch, isMultiAtlasEnabled) : 0;
 	}
 
-	if (mergedBatch.IsValid())
+	if (_batchReorderer.Reorder(_batches.items, _batchMergeKeys.items, _batchCount, _vertices.items, _gameSize, cameraOffset))
 	{
-		_renderContext->Draw(mergedBatch, startVertexLocation);
-		++drawCalls;
+		std::swap(_batches, _batchReorderer.GetBatches());
+		_batchCount = _batchReorderer.GetBatchCount();
+		std::swap(_vertices, _batchReorderer.GetVertices());
+		_vertexCount = _batchReorderer.GetVertexCount();
 	}
+}
+
+_Use_decl_annotations_
+void D2DXContext::DrawBatches(
+	uint32_t startVertexLocation)
+{
+	const uint32_t drawCalls = BatchMerger::DrawBatches(_renderContext.get(), _batches.items, _batchCount, startVertexLocation);
 
 	if (!(_frame & 255))
 	{
-		D2DX_DEBUG_LOG("Nr draw calls: %i", drawCalls);
+		D2DX_DEBUG_LOG("Nr draw calls: %u (%u before reordering)", drawCalls,
+			_options.GetFlag(OptionsFlag::NoBatchReordering) ? drawCalls : _batchReorderer.GetDrawCallsBefore());
 	}
 }
 
 
 void D2DXContext::OnBufferSwap()
 {
+	if (_glideTraceRecorder)
+	{
+		_glideTraceRecorder->RecordBufferSwap();
+	}
+
 	CheckMajorGameState();
 	InsertLogoOnTitleScreen();
 
+	Offset cameraOffset = { 0, 0 };
+
 	if (IsFeatureEnabled(Feature::UnitMotionPrediction) &&
 		_majorGameState == MajorGameState::InGame)
 	{
 		const Offset offset = _unitMotionPredictor.GetOffset(_gameHelper->GetPlayerUnit());
+		cameraOffset = { -offset.x, -offset.y };
+	}
 
-		for (uint32_t i = 0; i < _batchCount; ++i)
-		{
-			const auto& batch = _batches.items[i];
-			auto surfaceId = _vertices.items[batch.GetStartVertex()].GetSurfaceId();
+	/* Applied to the vertices flagged by SurfaceIdTracker when drawing, instead of rewriting them here. */
+	_renderContext->SetCameraOffset(cameraOffset);
 
-			if (surfaceId != D2DX_SURFACE_ID_USER_INTERFACE &&
-				batch.GetTextureCategory() != TextureCategory::Player)
-			{
-				const auto batchVertexCount = batch.GetVertexCount();
-				auto vertexIndex = batch.GetStartVertex();
-				for (uint32_t j = 0; j < batchVertexCount; ++j)
-				{
-					_vertices.items[vertexIndex++].AddOffset(
-						-offset.x,
-						-offset.y);
-				}
-			}
-		}
+	if (!_options.GetFlag(OptionsFlag::NoBatchReordering))
+	{
+		ReorderBatches(cameraOffset);
 	}
 
 	auto startVertexLocation = _renderContext->BulkWriteVertices(_vertices.items, _vertexCount);
@@ -447,7 +525,7 @@ void D2DXContext::OnBufferSwap()
 
 	if (!(_frame & 255))
 	{
-		_textureHasher.PrintStats();
+		_textureHasher.PrintStats(256);
 
 		D2DX_DEBUG_LOG("Sleeps/frame: %.2f", _sleeps / 256.0f);
 		_sleeps = 0;
@@ -475,6 +553,11 @@ void D2DXContext::OnColorCombine(
 	GrCombineOther_t other,
 	bool invert)
 {
+	if (_glideTraceRecorder)
+	{
+		_glideTraceRecorder->RecordColorCombine(function, factor, local, other, invert);
+	}
+
 	auto rgbCombine = RgbCombine::ColorMultipliedByTexture;
 
 	if (function == GR_COMBINE_FUNCTION_SCALE_OTHER && factor == GR_COMBINE_FACTOR_LOCAL &&
@@ -505,6 +588,11 @@ void D2DXContext::OnAlphaCombine(
 	GrCombineOther_t other,
 	bool invert)
 {
+	if (_glideTraceRecorder)
+	{
+		_glideTraceRecorder->RecordAlphaCombine(function, factor, local, other, invert);
+	}
+
 	auto alphaCombine = AlphaCombine::One;
 
 	if (function == GR_COMBINE_FUNCTION_LOCAL && factor == GR_COMBINE_FACTOR_ZERO &&
@@ -520,6 +608,11 @@ _Use_decl_annotations_
 void D2DXContext::OnConstantColorValue(
 	uint32_t color)
 {
+	if (_glideTraceRecorder)
+	{
+		_glideTraceRecorder->RecordConstantColorValue(color);
+	}
+
 	_glideState.constantColor = (color >> 8) | (color << 24);
 	_readVertexState.isDirty = true;
 }
@@ -531,6 +624,11 @@ void D2DXContext::OnAlphaBlendFunction(
 	GrAlphaBlendFnc_t alpha_sf,
 	GrAlphaBlendFnc_t alpha_df)
 {
+	if (_glideTraceRecorder)
+	{
+		_glideTraceRecorder->RecordAlphaBlendFunction(rgb_sf, rgb_df, alpha_sf, alpha_df);
+	}
+
 	auto alphaBlend = AlphaBlend::Opaque;
 
 	switch (D2DX_GLIDE_ALPHA_BLEND(rgb_sf, rgb_df, alpha_sf, alpha_df))
@@ -559,23 +657,21 @@ void D2DXContext::OnDrawPoint(
 	const void* pt,
 	uint32_t gameContext)
 {
+	if (_glideTraceRecorder)
+	{
+		_glideTraceRecorder->RecordDrawPoint(pt, gameContext);
+	}
+
 	Batch batch = _scratchBatch;
 	batch.SetGameAddress(GameAddress::Unknown);
 	batch.SetStartVertex(_vertexCount);
 
 	EnsureReadVertexStateUpdated(batch);
 
-	auto vertex0 = _readVertexState.templateVertex;
-
-	const uint32_t iteratedColorMask = _readVertexState.iteratedColorMask;
-	const uint32_t maskedConstantColor = _readVertexState.maskedConstantColor;
-	const int32_t stShift = _glideState.stShift;
-
 	const D2::Vertex* d2Vertex = (const D2::Vertex*)pt;
 
-	vertex0.SetPosition((int32_t)d2Vertex->x, (int32_t)d2Vertex->y);
-	vertex0.SetTexcoord((int32_t)d2Vertex->s >> stShift, (int32_t)d2Vertex->t >> stShift);
-	vertex0.SetColor(maskedConstantColor | (d2Vertex->color & iteratedColorMask));
+	Vertex vertex0;
+	ConvertVertices(&d2Vertex, 1, &vertex0);
 	vertex0.SetSurfaceId(_surfaceIdTracker.GetCurrentSurfaceId());
 
 	Vertex vertex1 = vertex0;
@@ -603,6 +699,11 @@ void D2DXContext::OnDrawLine(
 	const void* v2,
 	uint32_t gameContext)
 {
+	if (_glideTraceRecorder)
+	{
+		_glideTraceRecorder->RecordDrawLine(v1, v2, gameContext);
+	}
+
 	Batch batch = _scratchBatch;
 	batch.SetGameAddress(GameAddress::DrawLine);
 	batch.SetStartVertex(_vertexCount);
@@ -611,17 +712,13 @@ void D2DXContext::OnDrawLine(
 
 	EnsureReadVertexStateUpdated(batch);
 
-	auto vertex0 = _readVertexState.templateVertex;
-	vertex0.SetSurfaceId(D2DX_SURFACE_ID_USER_INTERFACE);
-
-	const uint32_t iteratedColorMask = _readVertexState.iteratedColorMask;
-	const uint32_t maskedConstantColor = _readVertexState.maskedConstantColor;
-
 	const D2::Vertex* d2Vertex0 = (const D2::Vertex*)v1;
 	const D2::Vertex* d2Vertex1 = (const D2::Vertex*)v2;
 
-	vertex0.SetTexcoord((int32_t)d2Vertex1->s >> _glideState.stShift, (int32_t)d2Vertex1->t >> _glideState.stShift);
-	vertex0.SetColor(maskedConstantColor | (d2Vertex1->color & iteratedColorMask));
+	/* The texcoord and color come from the second vertex; the positions are computed below. */
+	Vertex vertex0;
+	ConvertVertices(&d2Vertex1, 1, &vertex0);
+	vertex0.SetSurfaceId(D2DX_SURFACE_ID_USER_INTERFACE);
 
 	if (IsFeatureEnabled(Feature::WeatherMotionPrediction) &&
 		currentlyDrawingWeatherParticles)
@@ -760,6 +857,11 @@ const Batch D2DXContext::PrepareBatchForSubmit(
 {
 	auto gameAddress = _gameHelper->IdentifyGameAddress(gameContext);
 
+	if (_textureBindRecorder && batch.IsValid())
+	{
+		_textureBindRecorder->RecordBind((uint32_t)_frame, batch.GetHash(), batch.GetTextureWidth(), batch.GetTextureHeight());
+	}
+
 	auto tcl = _renderContext->UpdateTexture(batch, _glideState.tmuMemory.items, _glideState.tmuMemory.capacity);
 
 	if (tcl._textureAtlas < 0)
@@ -769,8 +871,10 @@ const Batch D2DXContext::PrepareBatchForSubmit(
 
 	batch.SetTextureAtlas(tcl._textureAtlas);
 	batch.SetTextureIndex(tcl._textureIndex);
+	batch.SetTextureTile(tcl._textureTile);
 
 	batch.SetGameAddress(gameAddress);
+	batch.SetPrimitiveType(primitiveType);
 	batch.SetStartVertex(_vertexCount);
 	batch.SetVertexCount(vertexCount);
 	batch.SetTextureCategory(_gameHelper->RefineTextureCategoryFromGameAddress(batch.GetTextureCategory(), gameAddress));
@@ -795,14 +899,50 @@ void D2DXContext::EnsureReadVertexStateUpdated(
 		batch.GetRgbCombine() == RgbCombine::ColorMultipliedByTexture ? batch.GetPaletteIndex() : D2DX_WHITE_PALETTE_INDEX,
 		0);
 
+	if (batch.IsValid() && _renderContext->IsMultiAtlasEnabled())
+	{
+		_readVertexState.templateVertex.SetTextureSelector(BatchMerger::GetTextureSelector(batch));
+	}
+
 	const bool isIteratedColor = batch.GetRgbCombine() == RgbCombine::ColorMultipliedByTexture;
 	const uint32_t constantColorMask = isIteratedColor ? 0xFF000000 : 0xFFFFFFFF;
 	_readVertexState.constantColorMask = constantColorMask;
 	_readVertexState.iteratedColorMask = isIteratedColor ? 0x00FFFFFF : 0x00000000;
 	_readVertexState.maskedConstantColor = constantColorMask & (_glideState.constantColor | (batch.GetAlphaBlend() != AlphaBlend::SrcAlphaInvSrcAlpha ? 0xFF000000 : 0));
+
+	/* Textures packed into a shared slot are sampled relative to, and within, their tile. */
+	const Offset tileOffset = batch.IsValid() ?
+		TextureAtlasPacker::GetTileOffset(batch.GetTextureWidth(), batch.GetTextureHeight(), batch.GetTextureTile()) :
+		Offset{ 0, 0 };
+
+	if (batch.IsValid())
+	{
+		_readVertexState.templateVertex.SetTexcoordClamp(batch.GetTextureWidth(), batch.GetTextureHeight(), tileOffset);
+	}
+
+	_readVertexState.texcoordOffsetS = tileOffset.x;
+	_readVertexState.texcoordOffsetT = tileOffset.y;
 	_readVertexState.isDirty = false;
 }
 
+_Use_decl_annotations_
+void D2DXContext::ConvertVertices(
+	const D2::Vertex* const* d2Vertices,
+	uint32_t count,
+	Vertex* vertices)
+{
+	_simd->ConvertVertices(
+		d2Vertices,
+		count,
+		_readVertexState.templateVertex,
+		_glideState.stShift,
+		_readVertexState.texcoordOffsetS,
+		_readVertexState.texcoordOffsetT,
+		_readVertexState.iteratedColorMask,
+		_readVertexState.maskedConstantColor,
+		vertices);
+}
+
 _Use_decl_annotations_
 void D2DXContext::OnDrawVertexArray(
 	uint32_t mode,
@@ -817,7 +957,18 @@ void D2DXContext::OnDrawVertexArray(
 		return;
 	}
 
-	Batch batch = PrepareBatchForSubmit(_scratchBatch, PrimitiveType::Triangles, 3 * (count - 2), gameContext);
+	if (_glideTraceRecorder)
+	{
+		_glideTraceRecorder->RecordDrawVertexArray(mode, count, pointers, gameContext);
+	}
+
+	/* Quads (nearly all sprites) keep their four vertices and are drawn with a static index buffer,
+	   or as sprite records of two vertices if they are axis-aligned rectangles. */
+	const bool isQuad = mode == GR_TRIANGLE_FAN && count == 4;
+
+	Batch batch = isQuad ?
+		PrepareBatchForSubmit(_scratchBatch, PrimitiveType::Quads, 4, gameContext) :
+		PrepareBatchForSubmit(_scratchBatch, PrimitiveType::Triangles, 3 * (count - 2), gameContext);
 
 	if (!batch.IsValid())
 	{
@@ -826,52 +977,49 @@ void D2DXContext::OnDrawVertexArray(
 
 	EnsureReadVertexStateUpdated(batch);
 
-	Vertex v = _readVertexState.templateVertex;
-
-	const uint32_t iteratedColorMask = _readVertexState.iteratedColorMask;
-	const uint32_t maskedConstantColor = _readVertexState.maskedConstantColor;
-
 	Vertex* pVertices = &_vertices.items[_vertexCount];
 
-	for (int32_t i = 0; i < 3; ++i)
+	/* The game vertices are converted into the end of the batch's range, and the triangles are then
+	   expanded from its start. Vertex i + 2 is read before triangle i is written, so the reads stay
+	   ahead of the writes. Quads are converted right where they will be drawn from. */
+	Vertex* pConverted = pVertices + batch.GetVertexCount() - count;
+	ConvertVertices((const D2::Vertex* const*)pointers, count, pConverted);
+
+	if (isQuad)
 	{
-		const D2::Vertex* d2Vertex = (const D2::Vertex*)pointers[i];
-		v.SetPosition((int32_t)d2Vertex->x, (int32_t)d2Vertex->y);
-		v.SetTexcoord((int32_t)d2Vertex->s >> _glideState.stShift, (int32_t)d2Vertex->t >> _glideState.stShift);
-		v.SetColor(maskedConstantColor | (d2Vertex->color & iteratedColorMask));
-		*pVertices++ = v;
+		if (SpriteEncoder::Encode(pVertices, pVertices))
+		{
+			batch.SetPrimitiveType(PrimitiveType::Sprites);
+			batch.SetVertexCount(2);
+		}
 	}
-
-	if (mode == GR_TRIANGLE_FAN)
+	else if (mode == GR_TRIANGLE_FAN)
 	{
-		auto vertex0 = pVertices[-3];
+		const Vertex vertex0 = pConverted[0];
 
-		for (uint32_t i = 0; i < (count - 3); ++i)
+		for (uint32_t i = 0; i < (count - 2); ++i)
 		{
+			const Vertex vertex1 = pConverted[i + 1];
+			const Vertex vertex2 = pConverted[i + 2];
 			*pVertices++ = vertex0;
-			*pVertices++ = pVertices[-2];
-			const D2::Vertex* d2Vertex = (const D2::Vertex*)pointers[i + 3];
-			v.SetPosition((int32_t)d2Vertex->x, (int32_t)d2Vertex->y);
-			v.SetTexcoord((int32_t)d2Vertex->s >> _glideState.stShift, (int32_t)d2Vertex->t >> _glideState.stShift);
-			v.SetColor(maskedConstantColor | (d2Vertex->color & iteratedColorMask));
-			*pVertices++ = v;
+			*pVertices++ = vertex1;
+			*pVertices++ = vertex2;
 		}
 	}
 	else
 	{
-		for (uint32_t i = 0; i < (count - 3); ++i)
+		for (uint32_t i = 0; i < (count - 2); ++i)
 		{
-			*pVertices++ = pVertices[-2];
-			*pVertices++ = pVertices[-2];
-			const D2::Vertex* d2Vertex = (const D2::Vertex*)pointers[i + 3];
-			v.SetPosition((int32_t)d2Vertex->x, (int32_t)d2Vertex->y);
-			v.SetTexcoord((int32_t)d2Vertex->s >> _glideState.stShift, (int32_t)d2Vertex->t >> _glideState.stShift);
-			v.SetColor(maskedConstantColor | (d2Vertex->color & iteratedColorMask));
-			*pVertices++ = v;
+			const Vertex vertex0 = pConverted[i];
+			const Vertex vertex1 = pConverted[i + 1];
+			const Vertex vertex2 = pConverted[i + 2];
+			*pVertices++ = vertex0;
+			*pVertices++ = vertex1;
+			*pVertices++ = vertex2;
 		}
 	}
 
-	_vertexCount += 3 * (count - 2);
+	_vertexCount += batch.GetVertexCount();
 
 	_surfaceIdTracker.UpdateBatchSurfaceId(batch, _majorGameState, _gameSize, &_vertices.items[batch.GetStartVertex()], batch.GetVertexCount());
 
@@ -896,7 +1044,12 @@ void D2DXContext::OnDrawVertexArrayContiguous(
 		return;
 	}
 
-	Batch batch = PrepareBatchForSubmit(_scratchBatch, PrimitiveType::Triangles, 6, gameContext);
+	if (_glideTraceRecorder)
+	{
+		_glideTraceRecorder->RecordDrawVertexArrayContiguous(mode, count, vertex, stride, gameContext);
+	}
+
+	Batch batch = PrepareBatchForSubmit(_scratchBatch, PrimitiveType::Quads, 4, gameContext);
 
 	if (!batch.IsValid())
 	{
@@ -905,27 +1058,19 @@ void D2DXContext::OnDrawVertexArrayContiguous(
 
 	EnsureReadVertexStateUpdated(batch);
 
-	const uint32_t iteratedColorMask = _readVertexState.iteratedColorMask;
-	const uint32_t maskedConstantColor = _readVertexState.maskedConstantColor;
-
 	const D2::Vertex* d2Vertices = (const D2::Vertex*)vertex;
-
-	Vertex v = _readVertexState.templateVertex;
+	const D2::Vertex* d2VertexPointers[4] = { &d2Vertices[0], &d2Vertices[1], &d2Vertices[2], &d2Vertices[3] };
 
 	Vertex* pVertices = &_vertices.items[_vertexCount];
+	ConvertVertices(d2VertexPointers, 4, pVertices);
 
-	for (int32_t i = 0; i < 4; ++i)
+	if (SpriteEncoder::Encode(pVertices, pVertices))
 	{
-		v.SetPosition((int32_t)d2Vertices[i].x, (int32_t)d2Vertices[i].y);
-		v.SetTexcoord((int32_t)d2Vertices[i].s >> _glideState.stShift, (int32_t)d2Vertices[i].t >> _glideState.stShift);
-		v.SetColor(maskedConstantColor | (d2Vertices[i].color & iteratedColorMask));
-		pVertices[i] = v;
+		batch.SetPrimitiveType(PrimitiveType::Sprites);
+		batch.SetVertexCount(2);
 	}
 
-	pVertices[4] = pVertices[0];
-	pVertices[5] = pVertices[2];
-
-	_vertexCount += 6;
+	_vertexCount += batch.GetVertexCount();
 
 	_surfaceIdTracker.UpdateBatchSurfaceId(batch, _majorGameState, _gameSize, &_vertices.items[batch.GetStartVertex()], batch.GetVertexCount());
 
@@ -944,9 +1089,14 @@ void D2DXContext::OnTexDownloadTable(
 		return;
 	}
 
+	if (_glideTraceRecorder)
+	{
+		_glideTraceRecorder->RecordTexDownloadTable((const uint32_t*)data);
+	}
+
 	_readVertexState.isDirty = true;
 
-	uint32_t hash = fnv_32a_buf(data, 1024, FNV1_32A_INIT);
+	uint32_t hash = _textureHasher.CalculateHash((const uint8_t*)data, 1024);
 	assert(hash != 0);
 
 	for (uint32_t i = 0; i < D2DX_MAX_GAME_PALETTES; ++i)
@@ -995,6 +1145,11 @@ _Use_decl_annotations_
 void D2DXContext::OnChromakeyMode(
 	GrChromakeyMode_t mode)
 {
+	if (_glideTraceRecorder)
+	{
+		_glideTraceRecorder->RecordChromakeyMode(mode);
+	}
+
 	_scratchBatch.SetIsChromaKeyEnabled(mode == GR_CHROMAKEY_ENABLE);
 
 	_readVertexState.isDirty = true;
@@ -1065,7 +1220,7 @@ void D2DXContext::PrepareLogoTextureBatch()
 
 	_renderContext->SetPalette(D2DX_LOGO_PALETTE_INDEX, palette.items);
 
-	uint32_t hash = fnv_32a_buf((void*)srcPixels, sizeof(uint8_t) * 81 * 40, FNV1_32A_INIT);
+	uint32_t hash = _textureHasher.CalculateHash(srcPixels, sizeof(uint8_t) * 81 * 40);
 
 	uint8_t* data = _glideState.sideTmuMemory.items;
 
@@ -1073,12 +1228,13 @@ void D2DXContext::PrepareLogoTextureBatch()
 	_logoTextureBatch.SetTextureHash(hash);
 	_logoTextureBatch.SetTextureSize(128, 128);
 	_logoTextureBatch.SetTextureCategory(TextureCategory::TitleScreen);
+	_logoTextureBatch.SetPrimitiveType(PrimitiveType::Quads);
 	_logoTextureBatch.SetAlphaBlend(AlphaBlend::SrcAlphaInvSrcAlpha);
 	_logoTextureBatch.SetIsChromaKeyEnabled(true);
 	_logoTextureBatch.SetRgbCombine(RgbCombine::ColorMultipliedByTexture);
 	_logoTextureBatch.SetAlphaCombine(AlphaCombine::One);
 	_logoTextureBatch.SetPaletteIndex(D2DX_LOGO_PALETTE_INDEX);
-	_logoTextureBatch.SetVertexCount(6);
+	_logoTextureBatch.SetVertexCount(4);
 
 	memset(data, 0, _logoTextureBatch.GetTextureWidth() * _logoTextureBatch.GetTextureHeight());
 
@@ -1102,6 +1258,7 @@ void D2DXContext::InsertLogoOnTitleScreen()
 
 	_logoTextureBatch.SetTextureAtlas(tcl._textureAtlas);
 	_logoTextureBatch.SetTextureIndex(tcl._textureIndex);
+	_logoTextureBatch.SetTextureTile(tcl._textureTile);
 	_logoTextureBatch.SetStartVertex(_vertexCount);
 
 	Size gameSize;
@@ -1116,12 +1273,19 @@ void D2DXContext::InsertLogoOnTitleScreen()
 	Vertex vertex2(x + 80, y + 41, 80, 41, color, true, _logoTextureBatch.GetTextureIndex(), D2DX_LOGO_PALETTE_INDEX, D2DX_SURFACE_ID_USER_INTERFACE);
 	Vertex vertex3(x, y + 41, 0, 41, color, true, _logoTextureBatch.GetTextureIndex(), D2DX_LOGO_PALETTE_INDEX, D2DX_SURFACE_ID_USER_INTERFACE);
 
-	assert((_vertexCount + 6) < _vertices.capacity);
+	if (_renderContext->IsMultiAtlasEnabled())
+	{
+		const int32_t textureSelector = BatchMerger::GetTextureSelector(_logoTextureBatch);
+		vertex0.SetTextureSelector(textureSelector);
+		vertex1.SetTextureSelector(textureSelector);
+		vertex2.SetTextureSelector(textureSelector);
+		vertex3.SetTextureSelector(textureSelector);
+	}
+
+	assert((_vertexCount + 4) < _vertices.capacity);
 	_vertices.items[_vertexCount++] = vertex0;
 	_vertices.items[_vertexCount++] = vertex1;
 	_vertices.items[_vertexCount++] = vertex2;
-	_vertices.items[_vertexCount++] = vertex0;
-	_vertices.items[_vertexCount++] = vertex2;
 	_vertices.items[_vertexCount++] = vertex3;
 
 	_batches.items[_batchCount++] = _logoTextureBatch;
@@ -1256,8 +1420,18 @@ const Options& D2DXContext::GetOptions() const
 	return _options;
 }
 
+IRenderContext* D2DXContext::GetRenderContext() const
+{
+	return _renderContext.get();
+}
+
 void D2DXContext::OnBufferClear()
 {
+	if (_glideTraceRecorder)
+	{
+		_glideTraceRecorder->RecordBufferClear();
+	}
+
 	if (_majorGameState == MajorGameState::InGame)
 	{
 		if (IsFeatureEnabled(Feature::UnitMotionPrediction))
@@ -1296,12 +1470,8 @@ Offset D2DXContext::BeginDrawText(
 
 	if (d2Function != D2Function::D2Win_DrawText && IsFeatureEnabled(Feature::TextMotionPrediction))
 	{
-		auto hash = fnv_32a_buf((void*)str, wcslen(str), FNV1_32A_INIT);
-
-		const uint64_t textId = 
-			(((uint64_t)(returnAddress & 0xFFFFFF) << 40ULL) |
-			((uint64_t)((uintptr_t)str & 0xFFFFFF) << 16ULL)) ^
-			(uint64_t)hash;
+		const uint32_t hash = _textureHasher.CalculateHash((const uint8_t*)str, (uint32_t)(wcslen(str) * sizeof(wchar_t)));
+		const uint64_t textId = TextMotionPredictor::GetTextId(str, hash, returnAddress);
 
 		offset = _textMotionPredictor.GetOffset(textId, pos);
 	}
@@ -1348,7 +1518,6 @@ Offset D2DXContext::BeginDrawImage(
 		{
 			// The player unit itself.
 			_scratchBatch.SetTextureCategory(TextureCategory::Player);
-			_playerScreenPos = pos;
 		}
 		else
 		{
@@ -1359,11 +1528,9 @@ Offset D2DXContext::BeginDrawImage(
 	{
 		if (d2Function == D2Function::D2Gfx_DrawShadow)
 		{
-			const bool isPlayerShadow =
-				_playerScreenPos.x > 0 &&
-				max(abs(pos.x - _playerScreenPos.x), abs(pos.y - _playerScreenPos.y)) < 8;
+			auto playerUnit = _gameHelper->GetPlayerUnit();
 
-			if (isPlayerShadow)
+			if (playerUnit && _unitMotionPredictor.IsShadowOfUnit(playerUnit, pos.x, pos.y))
 			{
 				_scratchBatch.SetTextureCategory(TextureCategory::Player);
 			}
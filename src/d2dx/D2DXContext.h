@@ -19,6 +19,7 @@
 #pragma once
 
 #include "Batch.h"
+#include "BatchReorderer.h"
 #include "Buffer.h"
 #include "IBuiltinResMod.h"
 #include "ID2DXContext.h"
@@ -27,6 +28,8 @@
 #include "IRenderContext.h"
 #include "IWin32InterceptionHandler.h"
 #include "CompatibilityModeDisabler.h"
+#include "GlideTraceRecorder.h"
+#include "TextureBindRecorder.h"
 #include "SurfaceIdTracker.h"
 #include "TextureHasher.h"
 #include "TextMotionPredictor.h"
@@ -46,6 +49,13 @@ namespace d2dx
 			_In_ const std::shared_ptr<IGameHelper>& gameHelper,
 			_In_ const std::shared_ptr<ISimd>& simd,
 			_In_ const std::shared_ptr<CompatibilityModeDisabler>& compatibilityModeDisabler);
+
+		/* Uses the given options instead of reading d2dx.cfg and the command line. */
+		D2DXContext(
+			_In_ const std::shared_ptr<IGameHelper>& gameHelper,
+			_In_ const std::shared_ptr<ISimd>& simd,
+			_In_ const std::shared_ptr<CompatibilityModeDisabler>& compatibilityModeDisabler,
+			_In_ const Options& options);
 		
 		virtual ~D2DXContext() noexcept;
 
@@ -167,6 +177,9 @@ namespace d2dx
 
 		virtual const Options& GetOptions() const override;
 
+		/* Null until the first OnSstWinOpen. */
+		IRenderContext* GetRenderContext() const;
+
 		virtual bool IsFeatureEnabled(
 			_In_ Feature feature) override;
 
@@ -212,6 +225,9 @@ namespace d2dx
 
 		void InsertLogoOnTitleScreen();
 
+		void ReorderBatches(
+			_In_ Offset cameraOffset);
+
 		void DrawBatches(
 			_In_ uint32_t startVertexLocation);
 
@@ -224,6 +240,12 @@ namespace d2dx
 		void EnsureReadVertexStateUpdated(
 			_In_ const Batch& batch);
 
+		/* Converts game vertices using the read vertex state, which must be up to date. */
+		void ConvertVertices(
+			_In_reads_(count) const D2::Vertex* const* d2Vertices,
+			_In_ uint32_t count,
+			_Out_writes_(count) Vertex* vertices);
+
 		struct GlideState
 		{
 			Buffer<uint8_t> tmuMemory{ D2DX_TMU_MEMORY_SIZE };
@@ -240,6 +262,8 @@ namespace d2dx
 			uint32_t constantColorMask{ 0 };
 			uint32_t iteratedColorMask{ 0 };
 			uint32_t maskedConstantColor{ 0 };
+			int32_t texcoordOffsetS{ 0 };
+			int32_t texcoordOffsetT{ 0 };
 			bool isDirty{ false };
 		};
 
@@ -254,6 +278,8 @@ namespace d2dx
 		std::shared_ptr<ISimd> _simd;
 		std::unique_ptr<IBuiltinResMod> _builtinResMod;
 		std::shared_ptr<CompatibilityModeDisabler> _compatibilityModeDisabler;
+		std::unique_ptr<GlideTraceRecorder> _glideTraceRecorder;
+		std::unique_ptr<TextureBindRecorder> _textureBindRecorder;
 		TextureHasher _textureHasher;
 		UnitMotionPredictor _unitMotionPredictor;
 		TextMotionPredictor _textMotionPredictor;
@@ -270,6 +296,9 @@ namespace d2dx
 		uint32_t _vertexCount;
 		Buffer<Vertex> _vertices;
 
+		Buffer<uint64_t> _batchMergeKeys;
+		BatchReorderer _batchReorderer;
+
 		Options _options;
 		Batch _logoTextureBatch;
 		
@@ -281,10 +310,11 @@ namespace d2dx
 		Size _gameSize;
 
 		bool _isDrawingText = false;
-		Offset _playerScreenPos = { 0,0 };
 
 		uint32_t _lastWeatherParticleIndex = 0xFFFFFFFF;
 
+		uint32_t _titleScreenTextureHash = 0;
+
 		OffsetF _avgDir = { 0.0f, 0.0f };
 
 		bool _areFeatureFlagsInitialized = false;
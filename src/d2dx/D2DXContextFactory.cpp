@@ -19,15 +19,35 @@
 #include "pch.h"
 #include "D2DXContextFactory.h"
 #include "GameHelper.h"
+#include "SimdAvx2.h"
+#include "SimdAvx512.h"
 #include "SimdSse2.h"
 #include "D2DXContext.h"
 #include "CompatibilityModeDisabler.h"
+#include "Utils.h"
 
 using namespace d2dx;
 
 static bool destroyed = false;
 static std::shared_ptr<ID2DXContext> instance;
 
+static std::shared_ptr<ISimd> CreateSimd()
+{
+	if (SimdAvx512::IsSupported())
+	{
+		D2DX_LOG("Using AVX-512 SIMD kernels.");
+		return std::make_shared<SimdAvx512>();
+	}
+	else if (SimdAvx2::IsSupported())
+	{
+		D2DX_LOG("Using AVX2 SIMD kernels.");
+		return std::make_shared<SimdAvx2>();
+	}
+
+	D2DX_LOG("Using SSE2 SIMD kernels.");
+	return std::make_shared<SimdSse2>();
+}
+
 ID2DXContext* D2DXContextFactory::GetInstance(
 	bool createIfNeeded)
 {
@@ -36,7 +56,7 @@ ID2DXContext* D2DXContextFactory::GetInstance(
 	if (!instance && !destroyed && createIfNeeded)
 	{
 		auto gameHelper = std::make_shared<GameHelper>();
-		auto simd = std::make_shared<SimdSse2>();
+		auto simd = CreateSimd();
 		auto compatibilityModeDisabler = std::make_shared<CompatibilityModeDisabler>();
 		instance = std::make_shared<D2DXContext>(gameHelper, simd, compatibilityModeDisabler);
 	}
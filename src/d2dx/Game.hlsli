@@ -25,14 +25,68 @@ struct GameVSInput
 	uint2 misc : TEXCOORD1;
 };
 
+/* A sprite record (see SpriteEncoder): a vertex and the opposite corner of the rectangle. */
+struct GameSpriteVSInput
+{
+	int2 pos : POSITION0;
+	int2 texCoord : TEXCOORD0;
+	float4 color : COLOR0;
+	uint2 misc : TEXCOORD1;
+	int2 pos2 : POSITION1;
+	int2 texCoord2 : TEXCOORD2;
+};
+
 struct GameVSOutput
 {
 	noperspective float4 pos : SV_POSITION;
 	noperspective float2 tc : TEXCOORD0;
 	noperspective float4 color : COLOR0;
 	nointerpolation uint4 atlasIndex_paletteIndex_surfaceId_flags : TEXCOORD1;
+	nointerpolation float4 tcClamp : TEXCOORD2;
 };
 
+/* The texel range to clamp tc to, as min.xy and max.zw (see Vertex::SetTexcoordClamp). */
+float4 GetTexcoordClamp(
+	in int2 texCoord)
+{
+	float4 tcClamp = float4(-1024, -1024, 1023, 1023);
+	const uint middle = (((uint)texCoord.y >> 9) & 63) * 4;
+
+	if (middle != 0)
+	{
+		const uint halfSize = 1U << firstbitlow(middle);
+		const float2 shortSide = float2(middle - halfSize, middle + halfSize - 1);
+
+		if (texCoord.x & 512)
+		{
+			tcClamp.yw = shortSide;
+		}
+		else
+		{
+			tcClamp.xz = shortSide;
+		}
+	}
+
+	return tcClamp;
+}
+
+/* Shared by GameVS and GameSpriteVS. */
+void TransformGameVertex(
+	in GameVSInput vs_in,
+	out GameVSOutput vs_out)
+{
+	float2 pos = float2(vs_in.pos) + ((vs_in.texCoord.y & 0x8000) ? c_cameraOffset : 0);
+	float2 unitPos = pos * c_invScreenSize - 0.5;
+	vs_out.pos = unitPos.xyxx * float4(2, -2, 0, 0) + float4(0, 0, 0, 1);
+	vs_out.tc = vs_in.texCoord & 511;
+	vs_out.color = vs_in.color;
+	vs_out.atlasIndex_paletteIndex_surfaceId_flags.x = vs_in.misc.x & 4095;
+	vs_out.atlasIndex_paletteIndex_surfaceId_flags.y = (vs_in.misc.x >> 12) | ((vs_in.misc.y & 0x8000) ? 0x10 : 0);
+	vs_out.atlasIndex_paletteIndex_surfaceId_flags.z = vs_in.misc.y & 16383;
+	vs_out.atlasIndex_paletteIndex_surfaceId_flags.w = ((vs_in.misc.y & 0x4000) ? 1 : 0) | (((uint)vs_in.texCoord.x >> 10) << 1);
+	vs_out.tcClamp = GetTexcoordClamp(vs_in.texCoord);
+}
+
 typedef GameVSOutput GamePSInput;
 
 struct GamePSOutput
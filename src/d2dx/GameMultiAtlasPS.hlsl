@@ -0,0 +1,68 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "Constants.hlsli"
+#include "Game.hlsli"
+
+/* Same as GamePS, but with the atlases of all texture caches bound at once. Each vertex selects
+   which one to sample from: texture cache index * 4 + atlas (see BatchMerger). */
+
+Texture1DArray palette : register(t1);
+Texture2DArray<uint> texs[28] : register(t2);
+
+uint LoadIndexedColor(uint textureSelector, int4 tc)
+{
+	/* Resource arrays can only be indexed with literals in SM 4.x. */
+#define CASE_LOAD(i) case i: return texs[i].Load(tc);
+
+	[forcecase] switch (textureSelector)
+	{
+		CASE_LOAD(0) CASE_LOAD(1) CASE_LOAD(2) CASE_LOAD(3)
+		CASE_LOAD(4) CASE_LOAD(5) CASE_LOAD(6) CASE_LOAD(7)
+		CASE_LOAD(8) CASE_LOAD(9) CASE_LOAD(10) CASE_LOAD(11)
+		CASE_LOAD(12) CASE_LOAD(13) CASE_LOAD(14) CASE_LOAD(15)
+		CASE_LOAD(16) CASE_LOAD(17) CASE_LOAD(18) CASE_LOAD(19)
+		CASE_LOAD(20) CASE_LOAD(21) CASE_LOAD(22) CASE_LOAD(23)
+		CASE_LOAD(24) CASE_LOAD(25) CASE_LOAD(26)
+		default: return texs[27].Load(tc);
+	}
+
+#undef CASE_LOAD
+}
+
+void main(
+	in GamePSInput ps_in,
+	out GamePSOutput ps_out)
+{
+	const uint atlasIndex = ps_in.atlasIndex_paletteIndex_surfaceId_flags.x;
+	const bool chromaKeyEnabled = ps_in.atlasIndex_paletteIndex_surfaceId_flags.w & 1;
+	const uint textureSelector = ps_in.atlasIndex_paletteIndex_surfaceId_flags.w >> 1;
+	const uint surfaceId = ps_in.atlasIndex_paletteIndex_surfaceId_flags.z;
+	const uint paletteIndex = ps_in.atlasIndex_paletteIndex_surfaceId_flags.y;
+	const float2 tc = clamp(ps_in.tc, ps_in.tcClamp.xy, ps_in.tcClamp.zw);
+
+	const uint indexedColor = LoadIndexedColor(textureSelector, int4(tc, atlasIndex, 0));
+
+	if (chromaKeyEnabled && indexedColor == 0)
+		discard;
+
+	const float4 textureColor = palette.Load(int3(indexedColor, paletteIndex, 0));
+
+	ps_out.color = ps_in.color * textureColor;
+	ps_out.surfaceId = ps_in.color.a > 0.5 ? surfaceId * 1.0 / 16383.0 : 0.0;
+}
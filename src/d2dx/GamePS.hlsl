@@ -30,8 +30,9 @@ void main(
 	const bool chromaKeyEnabled = ps_in.atlasIndex_paletteIndex_surfaceId_flags.w & 1;
 	const uint surfaceId = ps_in.atlasIndex_paletteIndex_surfaceId_flags.z;
 	const uint paletteIndex = ps_in.atlasIndex_paletteIndex_surfaceId_flags.y;
+	const float2 tc = clamp(ps_in.tc, ps_in.tcClamp.xy, ps_in.tcClamp.zw);
 
-	const uint indexedColor = tex.Load(int4(ps_in.tc, atlasIndex, 0));
+	const uint indexedColor = tex.Load(int4(tc, atlasIndex, 0));
 
 	if (chromaKeyEnabled && indexedColor == 0)
 		discard;
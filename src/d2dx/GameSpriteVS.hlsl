@@ -0,0 +1,39 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "Constants.hlsli"
+#include "Game.hlsli"
+
+/* Draws one instance per sprite record, with the quad index buffer. The vertex id picks the corner
+   (see SpriteEncoder::Decode): 0 and 2 are stored, 1 and 3 combine their coordinates. */
+void main(
+	in GameSpriteVSInput vs_in,
+	in uint vertexId : SV_VertexID,
+	out GameVSOutput vs_out)
+{
+	const bool isCorner2X = vertexId == 1 || vertexId == 2;
+	const bool isCorner2Y = vertexId >= 2;
+
+	GameVSInput corner;
+	corner.pos = int2(isCorner2X ? vs_in.pos2.x : vs_in.pos.x, isCorner2Y ? vs_in.pos2.y : vs_in.pos.y);
+	corner.texCoord = int2(isCorner2X ? vs_in.texCoord2.x : vs_in.texCoord.x, isCorner2Y ? vs_in.texCoord2.y : vs_in.texCoord.y);
+	corner.color = vs_in.color;
+	corner.misc = vs_in.misc;
+
+	TransformGameVertex(corner, vs_out);
+}
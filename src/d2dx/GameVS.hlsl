@@ -23,12 +23,5 @@ void main(
 	in GameVSInput vs_in,
 	out GameVSOutput vs_out)
 {
-	float2 unitPos = float2(vs_in.pos) * c_invScreenSize - 0.5;
-	vs_out.pos = unitPos.xyxx * float4(2, -2, 0, 0) + float4(0, 0, 0, 1);
-	vs_out.tc = vs_in.texCoord;
-	vs_out.color = vs_in.color;
-	vs_out.atlasIndex_paletteIndex_surfaceId_flags.x = vs_in.misc.x & 4095;
-	vs_out.atlasIndex_paletteIndex_surfaceId_flags.y = (vs_in.misc.x >> 12) | ((vs_in.misc.y & 0x8000) ? 0x10 : 0);
-	vs_out.atlasIndex_paletteIndex_surfaceId_flags.z = vs_in.misc.y & 16383;
-	vs_out.atlasIndex_paletteIndex_surfaceId_flags.w = (vs_in.misc.y & 0x4000) ? 1 : 0;
+	TransformGameVertex(vs_in, vs_out);
 }
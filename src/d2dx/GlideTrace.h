@@ -0,0 +1,65 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#define D2DX_GLIDE_TRACE_MAGIC 0x52543244 /* 'D2TR' */
+#define D2DX_GLIDE_TRACE_VERSION 1
+
+namespace d2dx
+{
+	/* A Glide trace is a file header followed by a stream of records. Each record is a
+	   GlideTraceRecordHeader followed by 'size' bytes of payload. All payload fields are
+	   32-bit, and the payload size is always a multiple of 4. */
+
+	enum class GlideTraceRecordType : uint16_t
+	{
+		SstWinOpen = 0,		/* width, height */
+		TexDownload = 1,	/* startAddress, width, height, pixels[width * height] (padded) */
+		TexSource = 2,		/* startAddress, width, height */
+		TexDownloadTable = 3,	/* palette[256] */
+		ConstantColorValue = 4,	/* color */
+		AlphaBlendFunction = 5,	/* rgb_sf, rgb_df, alpha_sf, alpha_df */
+		ColorCombine = 6,	/* function, factor, local, other, invert */
+		AlphaCombine = 7,	/* function, factor, local, other, invert */
+		ChromakeyMode = 8,	/* mode */
+		DrawPoint = 9,		/* gameContext, D2::Vertex */
+		DrawLine = 10,		/* gameContext, D2::Vertex[2] */
+		DrawVertexArray = 11,	/* mode, count, gameContext, D2::Vertex[count] */
+		DrawVertexArrayContiguous = 12, /* mode, count, gameContext, D2::Vertex[count] */
+		BufferClear = 13,	/* (none) */
+		BufferSwap = 14,	/* (none) */
+		Count = 15
+	};
+
+	struct GlideTraceFileHeader final
+	{
+		uint32_t magic;
+		uint32_t version;
+	};
+
+	struct GlideTraceRecordHeader final
+	{
+		GlideTraceRecordType type;
+		uint16_t reserved;
+		uint32_t size;
+	};
+
+	static_assert(sizeof(GlideTraceFileHeader) == 8, "sizeof(GlideTraceFileHeader)");
+	static_assert(sizeof(GlideTraceRecordHeader) == 8, "sizeof(GlideTraceRecordHeader)");
+}
@@ -0,0 +1,282 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "GlideTracePlayer.h"
+#include "D2Types.h"
+#include "Utils.h"
+
+using namespace d2dx;
+
+/* Returns true if the payload is exactly as large as the record type and its count fields say,
+   so that PlayRecord can trust those fields. */
+static bool IsPayloadSizeValid(
+	_In_ GlideTraceRecordType type,
+	_In_reads_(payloadSize / 4) const uint32_t* payload,
+	_In_ uint32_t payloadSize)
+{
+	uint64_t expectedSize = 0;
+
+	switch (type)
+	{
+	case GlideTraceRecordType::SstWinOpen:
+		expectedSize = 2 * sizeof(uint32_t);
+		break;
+	case GlideTraceRecordType::TexDownload:
+		/* Glide textures are at most 256x256. */
+		if (payloadSize < 3 * sizeof(uint32_t) || payload[1] > 256 || payload[2] > 256)
+		{
+			return false;
+		}
+		expectedSize = 3 * sizeof(uint32_t) + ((payload[1] * payload[2] + 3) & ~3U);
+		break;
+	case GlideTraceRecordType::TexSource:
+		expectedSize = 3 * sizeof(uint32_t);
+		break;
+	case GlideTraceRecordType::TexDownloadTable:
+		expectedSize = 256 * sizeof(uint32_t);
+		break;
+	case GlideTraceRecordType::ConstantColorValue:
+	case GlideTraceRecordType::ChromakeyMode:
+		expectedSize = sizeof(uint32_t);
+		break;
+	case GlideTraceRecordType::AlphaBlendFunction:
+		expectedSize = 4 * sizeof(uint32_t);
+		break;
+	case GlideTraceRecordType::ColorCombine:
+	case GlideTraceRecordType::AlphaCombine:
+		expectedSize = 5 * sizeof(uint32_t);
+		break;
+	case GlideTraceRecordType::DrawPoint:
+		expectedSize = sizeof(uint32_t) + sizeof(D2::Vertex);
+		break;
+	case GlideTraceRecordType::DrawLine:
+		expectedSize = sizeof(uint32_t) + 2 * sizeof(D2::Vertex);
+		break;
+	case GlideTraceRecordType::DrawVertexArray:
+	case GlideTraceRecordType::DrawVertexArrayContiguous:
+		if (payloadSize < 3 * sizeof(uint32_t))
+		{
+			return false;
+		}
+		expectedSize = 3 * sizeof(uint32_t) + (uint64_t)payload[1] * sizeof(D2::Vertex);
+		break;
+	case GlideTraceRecordType::BufferClear:
+	case GlideTraceRecordType::BufferSwap:
+		expectedSize = 0;
+		break;
+	default:
+		return false;
+	}
+
+	return payloadSize == expectedSize;
+}
+
+_Use_decl_annotations_
+GlideTracePlayer::GlideTracePlayer(
+	const char* filename)
+{
+	FILE* file = nullptr;
+
+	if (fopen_s(&file, filename, "rb") != 0 || !file)
+	{
+		D2DX_LOG("Failed to open Glide trace '%s'.", filename);
+		return;
+	}
+
+	fseek(file, 0, SEEK_END);
+	const long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	if (size < (long)sizeof(GlideTraceFileHeader))
+	{
+		fclose(file);
+		return;
+	}
+
+	_data = Buffer<uint8_t>((uint32_t)size);
+	_dataSize = (uint32_t)fread(_data.items, 1, (size_t)size, file);
+	fclose(file);
+
+	const GlideTraceFileHeader* fileHeader = (const GlideTraceFileHeader*)_data.items;
+
+	if (_dataSize < sizeof(GlideTraceFileHeader) ||
+		fileHeader->magic != D2DX_GLIDE_TRACE_MAGIC ||
+		fileHeader->version != D2DX_GLIDE_TRACE_VERSION)
+	{
+		D2DX_LOG("'%s' is not a supported Glide trace.", filename);
+		return;
+	}
+
+	/* Validate the record stream up front, so that playback doesn't need to. */
+	uint32_t offset = sizeof(GlideTraceFileHeader);
+
+	while ((offset + sizeof(GlideTraceRecordHeader)) <= _dataSize)
+	{
+		const GlideTraceRecordHeader* recordHeader = (const GlideTraceRecordHeader*)(_data.items + offset);
+		const uint32_t payloadOffset = offset + sizeof(GlideTraceRecordHeader);
+
+		/* Playback stops before the first bad record. */
+		if (recordHeader->type >= GlideTraceRecordType::Count ||
+			(recordHeader->size & 3) ||
+			recordHeader->size > (_dataSize - payloadOffset) ||
+			!IsPayloadSizeValid(recordHeader->type, (const uint32_t*)(_data.items + payloadOffset), recordHeader->size))
+		{
+			D2DX_LOG("Glide trace '%s' is truncated or corrupt at offset %u.", filename, offset);
+			break;
+		}
+
+		if (recordHeader->type == GlideTraceRecordType::BufferSwap)
+		{
+			++_frameCount;
+		}
+
+		offset = payloadOffset + recordHeader->size;
+	}
+
+	_dataSize = min(_dataSize, offset);
+	_isValid = true;
+
+	Rewind();
+
+	D2DX_LOG("Loaded Glide trace '%s' with %u frames.", filename, _frameCount);
+}
+
+bool GlideTracePlayer::IsValid() const
+{
+	return _isValid;
+}
+
+uint32_t GlideTracePlayer::GetFrameCount() const
+{
+	return _frameCount;
+}
+
+void GlideTracePlayer::Rewind()
+{
+	_readOffset = sizeof(GlideTraceFileHeader);
+}
+
+_Use_decl_annotations_
+bool GlideTracePlayer::PlayFrame(
+	IGlide3x* glide3x)
+{
+	if (!_isValid)
+	{
+		return false;
+	}
+
+	while ((_readOffset + sizeof(GlideTraceRecordHeader)) <= _dataSize)
+	{
+		const GlideTraceRecordHeader* recordHeader = (const GlideTraceRecordHeader*)(_data.items + _readOffset);
+		const uint32_t* payload = (const uint32_t*)(_data.items + _readOffset + sizeof(GlideTraceRecordHeader));
+
+		if ((_readOffset + sizeof(GlideTraceRecordHeader) + recordHeader->size) > _dataSize)
+		{
+			break;
+		}
+
+		_readOffset += sizeof(GlideTraceRecordHeader) + recordHeader->size;
+
+		PlayRecord(glide3x, recordHeader->type, payload, recordHeader->size);
+
+		if (recordHeader->type == GlideTraceRecordType::BufferSwap)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+_Use_decl_annotations_
+void GlideTracePlayer::PlayRecord(
+	IGlide3x* glide3x,
+	GlideTraceRecordType type,
+	const uint32_t* payload,
+	uint32_t payloadSize)
+{
+	switch (type)
+	{
+	case GlideTraceRecordType::SstWinOpen:
+		glide3x->OnSstWinOpen(0, (int32_t)payload[0], (int32_t)payload[1]);
+		break;
+	case GlideTraceRecordType::TexDownload:
+		glide3x->OnTexDownload(0, (const uint8_t*)&payload[3], payload[0], (int32_t)payload[1], (int32_t)payload[2]);
+		break;
+	case GlideTraceRecordType::TexSource:
+		glide3x->OnTexSource(0, payload[0], (int32_t)payload[1], (int32_t)payload[2]);
+		break;
+	case GlideTraceRecordType::TexDownloadTable:
+		/* The receiver may modify the palette in place, so give it a copy. */
+		memcpy(_palette.items, payload, 256 * sizeof(uint32_t));
+		glide3x->OnTexDownloadTable(GR_TEXTABLE_PALETTE, _palette.items);
+		break;
+	case GlideTraceRecordType::ConstantColorValue:
+		glide3x->OnConstantColorValue(payload[0]);
+		break;
+	case GlideTraceRecordType::AlphaBlendFunction:
+		glide3x->OnAlphaBlendFunction(payload[0], payload[1], payload[2], payload[3]);
+		break;
+	case GlideTraceRecordType::ColorCombine:
+		glide3x->OnColorCombine(payload[0], payload[1], payload[2], payload[3], payload[4] != 0);
+		break;
+	case GlideTraceRecordType::AlphaCombine:
+		glide3x->OnAlphaCombine(payload[0], payload[1], payload[2], payload[3], payload[4] != 0);
+		break;
+	case GlideTraceRecordType::ChromakeyMode:
+		glide3x->OnChromakeyMode(payload[0]);
+		break;
+	case GlideTraceRecordType::DrawPoint:
+		glide3x->OnDrawPoint(&payload[1], payload[0]);
+		break;
+	case GlideTraceRecordType::DrawLine:
+		glide3x->OnDrawLine(&payload[1], (const uint8_t*)&payload[1] + sizeof(D2::Vertex), payload[0]);
+		break;
+	case GlideTraceRecordType::DrawVertexArray:
+	{
+		const uint32_t count = payload[1];
+		uint8_t* vertices = (uint8_t*)&payload[3];
+
+		if (count > _pointers.capacity)
+		{
+			_pointers = Buffer<uint8_t*>(count);
+		}
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			_pointers.items[i] = vertices + i * sizeof(D2::Vertex);
+		}
+
+		glide3x->OnDrawVertexArray(payload[0], count, _pointers.items, payload[2]);
+		break;
+	}
+	case GlideTraceRecordType::DrawVertexArrayContiguous:
+		glide3x->OnDrawVertexArrayContiguous(payload[0], payload[1], (uint8_t*)&payload[3], sizeof(D2::Vertex), payload[2]);
+		break;
+	case GlideTraceRecordType::BufferClear:
+		glide3x->OnBufferClear();
+		break;
+	case GlideTraceRecordType::BufferSwap:
+		glide3x->OnBufferSwap();
+		break;
+	default:
+		assert(false && "Unhandled Glide trace record.");
+		break;
+	}
+}
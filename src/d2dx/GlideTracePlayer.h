@@ -0,0 +1,61 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Buffer.h"
+#include "GlideTrace.h"
+#include "IGlide3x.h"
+
+namespace d2dx
+{
+	class GlideTracePlayer final
+	{
+	public:
+		GlideTracePlayer(
+			_In_z_ const char* filename);
+
+		~GlideTracePlayer() noexcept {}
+
+		bool IsValid() const;
+
+		uint32_t GetFrameCount() const;
+
+		void Rewind();
+
+		/* Feeds the recorded calls into glide3x up to and including the next buffer swap.
+		   Returns false when the end of the trace has been reached. */
+		bool PlayFrame(
+			_In_ IGlide3x* glide3x);
+
+	private:
+		void PlayRecord(
+			_In_ IGlide3x* glide3x,
+			_In_ GlideTraceRecordType type,
+			_In_reads_(payloadSize / 4) const uint32_t* payload,
+			_In_ uint32_t payloadSize);
+
+		Buffer<uint8_t> _data;
+		uint32_t _dataSize = 0;
+		uint32_t _readOffset = 0;
+		uint32_t _frameCount = 0;
+		bool _isValid = false;
+		Buffer<uint8_t*> _pointers{ 256 };
+		Buffer<uint32_t> _palette{ 256 };
+	};
+}
@@ -0,0 +1,282 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "GlideTraceRecorder.h"
+#include "D2Types.h"
+#include "Utils.h"
+
+using namespace d2dx;
+
+_Use_decl_annotations_
+GlideTraceRecorder::GlideTraceRecorder(
+	const char* filename)
+{
+	if (fopen_s(&_file, filename, "wb") != 0 || !_file)
+	{
+		D2DX_LOG("Failed to open '%s' for recording the Glide trace.", filename);
+		_file = nullptr;
+		return;
+	}
+
+	/* The game issues thousands of small records per frame; let the CRT batch them up. */
+	setvbuf(_file, nullptr, _IOFBF, 4 * 1024 * 1024);
+
+	const GlideTraceFileHeader fileHeader{ D2DX_GLIDE_TRACE_MAGIC, D2DX_GLIDE_TRACE_VERSION };
+	Write(&fileHeader, sizeof(fileHeader));
+
+	D2DX_LOG("Recording Glide trace to '%s'.", filename);
+}
+
+GlideTraceRecorder::~GlideTraceRecorder() noexcept
+{
+	if (_file)
+	{
+		fclose(_file);
+		_file = nullptr;
+	}
+}
+
+bool GlideTraceRecorder::IsRecording() const
+{
+	return _file != nullptr;
+}
+
+uint32_t GlideTraceRecorder::GetFrameCount() const
+{
+	return _frameCount;
+}
+
+_Use_decl_annotations_
+void GlideTraceRecorder::RecordSstWinOpen(
+	int32_t width,
+	int32_t height)
+{
+	WriteRecordHeader(GlideTraceRecordType::SstWinOpen, 2 * sizeof(uint32_t));
+	WriteUInt32((uint32_t)width);
+	WriteUInt32((uint32_t)height);
+}
+
+_Use_decl_annotations_
+void GlideTraceRecorder::RecordTexDownload(
+	uint32_t startAddress,
+	int32_t width,
+	int32_t height,
+	const uint8_t* pixels)
+{
+	const uint32_t pixelsSize = (uint32_t)(width * height);
+	const uint32_t paddedPixelsSize = (pixelsSize + 3) & ~3U;
+
+	WriteRecordHeader(GlideTraceRecordType::TexDownload, 3 * sizeof(uint32_t) + paddedPixelsSize);
+	WriteUInt32(startAddress);
+	WriteUInt32((uint32_t)width);
+	WriteUInt32((uint32_t)height);
+	Write(pixels, pixelsSize);
+
+	const uint32_t zero = 0;
+	Write(&zero, paddedPixelsSize - pixelsSize);
+}
+
+_Use_decl_annotations_
+void GlideTraceRecorder::RecordTexSource(
+	uint32_t startAddress,
+	int32_t width,
+	int32_t height)
+{
+	WriteRecordHeader(GlideTraceRecordType::TexSource, 3 * sizeof(uint32_t));
+	WriteUInt32(startAddress);
+	WriteUInt32((uint32_t)width);
+	WriteUInt32((uint32_t)height);
+}
+
+_Use_decl_annotations_
+void GlideTraceRecorder::RecordTexDownloadTable(
+	const uint32_t* palette)
+{
+	WriteRecordHeader(GlideTraceRecordType::TexDownloadTable, 256 * sizeof(uint32_t));
+	Write(palette, 256 * sizeof(uint32_t));
+}
+
+_Use_decl_annotations_
+void GlideTraceRecorder::RecordConstantColorValue(
+	uint32_t color)
+{
+	WriteRecordHeader(GlideTraceRecordType::ConstantColorValue, sizeof(uint32_t));
+	WriteUInt32(color);
+}
+
+_Use_decl_annotations_
+void GlideTraceRecorder::RecordAlphaBlendFunction(
+	uint32_t rgb_sf,
+	uint32_t rgb_df,
+	uint32_t alpha_sf,
+	uint32_t alpha_df)
+{
+	WriteRecordHeader(GlideTraceRecordType::AlphaBlendFunction, 4 * sizeof(uint32_t));
+	WriteUInt32(rgb_sf);
+	WriteUInt32(rgb_df);
+	WriteUInt32(alpha_sf);
+	WriteUInt32(alpha_df);
+}
+
+_Use_decl_annotations_
+void GlideTraceRecorder::RecordColorCombine(
+	uint32_t function,
+	uint32_t factor,
+	uint32_t local,
+	uint32_t other,
+	bool invert)
+{
+	WriteRecordHeader(GlideTraceRecordType::ColorCombine, 5 * sizeof(uint32_t));
+	WriteUInt32(function);
+	WriteUInt32(factor);
+	WriteUInt32(local);
+	WriteUInt32(other);
+	WriteUInt32(invert ? 1 : 0);
+}
+
+_Use_decl_annotations_
+void GlideTraceRecorder::RecordAlphaCombine(
+	uint32_t function,
+	uint32_t factor,
+	uint32_t local,
+	uint32_t other,
+	bool invert)
+{
+	WriteRecordHeader(GlideTraceRecordType::AlphaCombine, 5 * sizeof(uint32_t));
+	WriteUInt32(function);
+	WriteUInt32(factor);
+	WriteUInt32(local);
+	WriteUInt32(other);
+	WriteUInt32(invert ? 1 : 0);
+}
+
+_Use_decl_annotations_
+void GlideTraceRecorder::RecordChromakeyMode(
+	uint32_t mode)
+{
+	WriteRecordHeader(GlideTraceRecordType::ChromakeyMode, sizeof(uint32_t));
+	WriteUInt32(mode);
+}
+
+_Use_decl_annotations_
+void GlideTraceRecorder::RecordDrawPoint(
+	const void* pt,
+	uint32_t gameContext)
+{
+	WriteRecordHeader(GlideTraceRecordType::DrawPoint, sizeof(uint32_t) + sizeof(D2::Vertex));
+	WriteUInt32(gameContext);
+	Write(pt, sizeof(D2::Vertex));
+}
+
+_Use_decl_annotations_
+void GlideTraceRecorder::RecordDrawLine(
+	const void* v1,
+	const void* v2,
+	uint32_t gameContext)
+{
+	WriteRecordHeader(GlideTraceRecordType::DrawLine, sizeof(uint32_t) + 2 * sizeof(D2::Vertex));
+	WriteUInt32(gameContext);
+	Write(v1, sizeof(D2::Vertex));
+	Write(v2, sizeof(D2::Vertex));
+}
+
+_Use_decl_annotations_
+void GlideTraceRecorder::RecordDrawVertexArray(
+	uint32_t mode,
+	uint32_t count,
+	uint8_t** pointers,
+	uint32_t gameContext)
+{
+	WriteRecordHeader(GlideTraceRecordType::DrawVertexArray, 3 * sizeof(uint32_t) + count * sizeof(D2::Vertex));
+	WriteUInt32(mode);
+	WriteUInt32(count);
+	WriteUInt32(gameContext);
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		Write(pointers[i], sizeof(D2::Vertex));
+	}
+}
+
+_Use_decl_annotations_
+void GlideTraceRecorder::RecordDrawVertexArrayContiguous(
+	uint32_t mode,
+	uint32_t count,
+	const uint8_t* vertex,
+	uint32_t stride,
+	uint32_t gameContext)
+{
+	WriteRecordHeader(GlideTraceRecordType::DrawVertexArrayContiguous, 3 * sizeof(uint32_t) + count * sizeof(D2::Vertex));
+	WriteUInt32(mode);
+	WriteUInt32(count);
+	WriteUInt32(gameContext);
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		Write(vertex + i * stride, sizeof(D2::Vertex));
+	}
+}
+
+void GlideTraceRecorder::RecordBufferClear()
+{
+	WriteRecordHeader(GlideTraceRecordType::BufferClear, 0);
+}
+
+void GlideTraceRecorder::RecordBufferSwap()
+{
+	WriteRecordHeader(GlideTraceRecordType::BufferSwap, 0);
+
+	++_frameCount;
+
+	if (_file && !(_frameCount & 255))
+	{
+		fflush(_file);
+		D2DX_DEBUG_LOG("Recorded %u frames of Glide trace.", _frameCount);
+	}
+}
+
+_Use_decl_annotations_
+void GlideTraceRecorder::WriteRecordHeader(
+	GlideTraceRecordType type,
+	uint32_t payloadSize)
+{
+	assert(!(payloadSize & 3));
+	const GlideTraceRecordHeader recordHeader{ type, 0, payloadSize };
+	Write(&recordHeader, sizeof(recordHeader));
+}
+
+_Use_decl_annotations_
+void GlideTraceRecorder::Write(
+	const void* data,
+	uint32_t size)
+{
+	if (!_file || size == 0)
+	{
+		return;
+	}
+
+	fwrite(data, size, 1, _file);
+}
+
+_Use_decl_annotations_
+void GlideTraceRecorder::WriteUInt32(
+	uint32_t value)
+{
+	Write(&value, sizeof(value));
+}
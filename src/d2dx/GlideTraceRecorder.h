@@ -0,0 +1,125 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "GlideTrace.h"
+
+namespace d2dx
+{
+	class GlideTraceRecorder final
+	{
+	public:
+		GlideTraceRecorder(
+			_In_z_ const char* filename);
+
+		~GlideTraceRecorder() noexcept;
+
+		GlideTraceRecorder(const GlideTraceRecorder&) = delete;
+		GlideTraceRecorder& operator=(const GlideTraceRecorder&) = delete;
+
+		bool IsRecording() const;
+
+		uint32_t GetFrameCount() const;
+
+		void RecordSstWinOpen(
+			_In_ int32_t width,
+			_In_ int32_t height);
+
+		void RecordTexDownload(
+			_In_ uint32_t startAddress,
+			_In_ int32_t width,
+			_In_ int32_t height,
+			_In_reads_(width * height) const uint8_t* pixels);
+
+		void RecordTexSource(
+			_In_ uint32_t startAddress,
+			_In_ int32_t width,
+			_In_ int32_t height);
+
+		void RecordTexDownloadTable(
+			_In_reads_(256) const uint32_t* palette);
+
+		void RecordConstantColorValue(
+			_In_ uint32_t color);
+
+		void RecordAlphaBlendFunction(
+			_In_ uint32_t rgb_sf,
+			_In_ uint32_t rgb_df,
+			_In_ uint32_t alpha_sf,
+			_In_ uint32_t alpha_df);
+
+		void RecordColorCombine(
+			_In_ uint32_t function,
+			_In_ uint32_t factor,
+			_In_ uint32_t local,
+			_In_ uint32_t other,
+			_In_ bool invert);
+
+		void RecordAlphaCombine(
+			_In_ uint32_t function,
+			_In_ uint32_t factor,
+			_In_ uint32_t local,
+			_In_ uint32_t other,
+			_In_ bool invert);
+
+		void RecordChromakeyMode(
+			_In_ uint32_t mode);
+
+		void RecordDrawPoint(
+			_In_ const void* pt,
+			_In_ uint32_t gameContext);
+
+		void RecordDrawLine(
+			_In_ const void* v1,
+			_In_ const void* v2,
+			_In_ uint32_t gameContext);
+
+		void RecordDrawVertexArray(
+			_In_ uint32_t mode,
+			_In_ uint32_t count,
+			_In_reads_(count) uint8_t** pointers,
+			_In_ uint32_t gameContext);
+
+		void RecordDrawVertexArrayContiguous(
+			_In_ uint32_t mode,
+			_In_ uint32_t count,
+			_In_reads_(count * stride) const uint8_t* vertex,
+			_In_ uint32_t stride,
+			_In_ uint32_t gameContext);
+
+		void RecordBufferClear();
+
+		void RecordBufferSwap();
+
+	private:
+		void WriteRecordHeader(
+			_In_ GlideTraceRecordType type,
+			_In_ uint32_t payloadSize);
+
+		void Write(
+			_In_reads_bytes_(size) const void* data,
+			_In_ uint32_t size);
+
+		void WriteUInt32(
+			_In_ uint32_t value);
+
+		FILE* _file = nullptr;
+		uint32_t _frameCount = 0;
+	};
+}
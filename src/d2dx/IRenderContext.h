@@ -41,6 +41,11 @@ namespace d2dx
 			_In_reads_(vertexCount) const Vertex* vertices,
 			_In_ uint32_t vertexCount) = 0;
 
+		/* Added to the positions of vertices with Vertex::IsCameraOffsetEnabled, from the next
+		   BulkWriteVertices and the draws that use those vertices. */
+		virtual void SetCameraOffset(
+			_In_ Offset offset) = 0;
+
 		virtual TextureCacheLocation UpdateTexture(
 			_In_ const Batch& batch,
 			_In_reads_(tmuDataSize) const uint8_t* tmuData,
@@ -66,6 +71,10 @@ namespace d2dx
 		virtual ITextureCache* GetTextureCache(
 			_In_ const Batch& batch) const = 0;
 
+		/* True if Draw binds all atlases of all texture caches, and samples the one selected by
+		   each vertex (see BatchMerger). */
+		virtual bool IsMultiAtlasEnabled() const = 0;
+
 		virtual void SetSizes(
 			_In_ Size gameSize,
 			_In_ Size windowSize) = 0;
@@ -18,17 +18,99 @@
 */
 #pragma once
 
+#include "D2Types.h"
+#include "Types.h"
 #include "Utils.h"
+#include "Vertex.h"
 
 namespace d2dx
 {
+	/* The motion state of the units tracked by UnitMotionPredictor, one array per field. Positions
+	   are 16.16 fixed point game coordinates, velocities are per second and times are 16.16 seconds. */
+	struct UnitMotions final
+	{
+		int32_t* __restrict posX;
+		int32_t* __restrict posY;
+		int32_t* __restrict lastPosX;
+		int32_t* __restrict lastPosY;
+		int32_t* __restrict velocityX;
+		int32_t* __restrict velocityY;
+		int32_t* __restrict predictedPosX;
+		int32_t* __restrict predictedPosY;
+		int32_t* __restrict correctedPosX;
+		int32_t* __restrict correctedPosY;
+		int32_t* __restrict dtLastPosChange;
+	};
+
 	struct ISimd abstract
 	{
 		virtual ~ISimd() noexcept {}
 
+		/* Returns the index of item, or -1. items must be 64-byte aligned, itemsCount a multiple of 64
+		   and the items unique. */
 		virtual int32_t IndexOfUInt32(
 			_In_reads_(itemsCount) const uint32_t* __restrict items,
 			_In_ uint32_t itemsCount,
 			_In_ uint32_t item) = 0;
+
+		/* Returns true if the two byte ranges are identical. No alignment requirements. */
+		virtual bool EqualUInt8(
+			_In_reads_(itemsCount) const uint8_t* __restrict itemsA,
+			_In_reads_(itemsCount) const uint8_t* __restrict itemsB,
+			_In_ uint32_t itemsCount) = 0;
+
+		/* Finds the smallest and largest byte. An empty range gives min 255, max 0. */
+		virtual void MinMaxUInt8(
+			_In_reads_(itemsCount) const uint8_t* __restrict items,
+			_In_ uint32_t itemsCount,
+			_Out_ uint8_t& minItem,
+			_Out_ uint8_t& maxItem) = 0;
+
+		/* Sets items[i] to value wherever mask[i] is non-zero. */
+		virtual void FillMaskedUInt32(
+			_Inout_updates_all_(itemsCount) uint32_t* __restrict items,
+			_In_reads_(itemsCount) const uint8_t* __restrict mask,
+			_In_ uint32_t itemsCount,
+			_In_ uint32_t value) = 0;
+
+		/* Converts game vertices to Vertex records, like Vertex::SetPosition, SetTexcoord and SetColor
+		   on a copy of templateVertex would: x, y, s and t are truncated to integers, s and t are then
+		   shifted right by stShift and offset, and the color is the game vertex color masked with
+		   iteratedColorMask, or:ed with maskedConstantColor. */
+		virtual void ConvertVertices(
+			_In_reads_(count) const D2::Vertex* const* __restrict d2Vertices,
+			_In_ uint32_t count,
+			_In_ const Vertex& templateVertex,
+			_In_ int32_t stShift,
+			_In_ int32_t texcoordOffsetS,
+			_In_ int32_t texcoordOffsetT,
+			_In_ uint32_t iteratedColorMask,
+			_In_ uint32_t maskedConstantColor,
+			_Out_writes_(count) Vertex* __restrict vertices) = 0;
+
+		/* Advances the motion of units by dt, given their current positions (posX, posY). A unit more
+		   than two whole tiles from its last or predicted position is snapped to it. When the position
+		   changes, or 1/25 s has passed, the velocity is re-estimated and the corrected position set
+		   halfway between the last two positions. While moving, the predicted position eases towards
+		   the corrected one and both advance by the velocity. 0 <= dt <= 65536. The arrays must be
+		   64-byte aligned and hold count rounded up to a multiple of 16; items past count are updated
+		   too. */
+		virtual void UpdateUnitMotions(
+			_In_ const UnitMotions& unitMotions,
+			_In_ uint32_t count,
+			_In_ int32_t dt) = 0;
+
+		/* Samples an 8-bit paletted texture at integer texcoords: indices[i] is the texel at (s[i], t[i]),
+		   or 0 if that is outside the texture, and colors[i] is palette[indices[i]]. The texture must
+		   be a whole number of 32-bit words, as the texels may be gathered four bytes at a time. */
+		virtual void SamplePalettedTexels(
+			_In_reads_(count) const int32_t* __restrict s,
+			_In_reads_(count) const int32_t* __restrict t,
+			_In_ uint32_t count,
+			_In_reads_(textureSize.width * textureSize.height) const uint8_t* __restrict texels,
+			_In_ Size textureSize,
+			_In_reads_(256) const uint32_t* __restrict palette,
+			_Out_writes_(count) uint32_t* __restrict indices,
+			_Out_writes_(count) uint32_t* __restrict colors) = 0;
 	};
 }
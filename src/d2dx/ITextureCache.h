@@ -29,9 +29,18 @@ namespace d2dx
 	{
 		int16_t _textureAtlas;
 		int16_t _textureIndex;
+		int16_t _textureTile;
 	};
 
-	static_assert(sizeof(TextureCacheLocation) == 4, "sizeof(TextureCacheLocation) == 4");
+	static_assert(sizeof(TextureCacheLocation) == 6, "sizeof(TextureCacheLocation) == 6");
+
+	/* Running totals since the cache was created. */
+	struct TextureCacheStats final
+	{
+		uint32_t hits = 0;
+		uint32_t misses = 0;
+		uint32_t evictions = 0;
+	};
 
 	struct ITextureCache abstract
 	{
@@ -55,5 +64,32 @@ namespace d2dx
 		virtual uint32_t GetMemoryFootprint() const = 0;
 
 		virtual uint32_t GetUsedCount() const = 0;
+
+		/* Number of textures found or inserted since the last OnNewFrame. */
+		virtual uint32_t GetUsedInFrameCount() const = 0;
+
+		/* Fraction of the texels in used slots that hold texture data. Below 1 when slots are shared
+		   by packed textures (see TextureAtlasPacker) and some tiles are still free. */
+		virtual float GetPackingEfficiency() const = 0;
+
+		virtual const TextureCacheStats& GetStats() const = 0;
+
+		virtual uint32_t GetWidth() const = 0;
+
+		virtual uint32_t GetHeight() const = 0;
+
+		virtual uint32_t GetCapacity() const = 0;
+
+		/* Capacity of one atlas, i.e. the step by which the cache grows or shrinks. */
+		virtual uint32_t GetTexturesPerAtlas() const = 0;
+
+		virtual uint32_t GetAtlasCount() const = 0;
+
+		virtual uint32_t GetMaxAtlasCount() const = 0;
+
+		/* Allocates or releases atlases. Textures in released atlases are evicted. Must only be called
+		   between frames, as locations handed out earlier in the frame may become invalid. */
+		virtual void SetAtlasCount(
+			_In_ uint32_t atlasCount) = 0;
 	};
 }
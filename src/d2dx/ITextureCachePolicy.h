@@ -0,0 +1,59 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+namespace d2dx
+{
+	/* Decides which slot of a texture cache a texture goes into, and which texture to evict. Slots
+	   found or inserted since the last OnNewFrame must not be evicted while there are other options,
+	   as batches earlier in the frame refer to them. */
+	struct ITextureCachePolicy abstract
+	{
+		virtual ~ITextureCachePolicy() noexcept {}
+
+		/* Returns the slot holding contentKey, or -1. lastIndex is a hint, or -1. */
+		virtual int32_t Find(
+			_In_ uint32_t contentKey,
+			_In_ int32_t lastIndex) = 0;
+
+		/* Returns the slot that contentKey was put into. A contentKey of 0 takes a slot that can't be
+		   found by key, and is kept alive with Touch instead (e.g. a page of TextureAtlasPacker). */
+		virtual int32_t Insert(
+			_In_ uint32_t contentKey,
+			_Out_ bool& evicted) = 0;
+
+		/* Marks the slot as used, like finding its key would. */
+		virtual void Touch(
+			_In_ int32_t index) = 0;
+
+		virtual void OnNewFrame() = 0;
+
+		virtual uint32_t GetUsedCount() const = 0;
+
+		/* Number of entries found or inserted since the last OnNewFrame. */
+		virtual uint32_t GetUsedInFrameCount() const = 0;
+
+		virtual uint32_t GetCapacity() const = 0;
+
+		/* Grows or shrinks the cache. Entries below the new capacity keep their slots; entries at or
+		   above it are dropped. */
+		virtual void SetCapacity(
+			_In_ uint32_t capacity) = 0;
+	};
+}
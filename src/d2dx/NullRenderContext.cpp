@@ -0,0 +1,346 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "Batch.h"
+#include "ID2DXContext.h"
+#include "NullRenderContext.h"
+#include "TextureCache.h"
+#include "Utils.h"
+
+using namespace d2dx;
+using namespace std;
+
+/* Matches the largest texture array size that RenderContextResources will use on real hardware. */
+#define D2DX_NULL_TEXTURES_PER_ATLAS 2048
+
+_Use_decl_annotations_
+NullRenderContext::NullRenderContext(
+	HWND hWnd,
+	Size gameSize,
+	Size windowSize,
+	ScreenMode initialScreenMode,
+	ID2DXContext* d2dxContext,
+	const std::shared_ptr<ISimd>& simd,
+	TextureCachePolicyOption textureCachePolicy,
+	bool isMultiAtlasEnabled) :
+	_hWnd{ hWnd },
+	_d2dxContext{ d2dxContext },
+	_screenMode{ initialScreenMode },
+	_vertices{ D2DX_MAX_VERTICES_PER_FRAME },
+	_palettes{ D2DX_MAX_PALETTES * 256, true },
+	_gammaTable{ 256, true },
+	_isMultiAtlasEnabled{ isMultiAtlasEnabled }
+{
+	uint32_t totalSize = 0;
+	for (int32_t i = 0; i < ARRAYSIZE(_textureCaches); ++i)
+	{
+		const Size size = TextureCache::GetCacheTextureSize(i);
+
+		_textureCaches[i] = std::make_unique<TextureCache>(size.width, size.height, TextureCache::GetInitialCapacity(i), D2DX_NULL_TEXTURES_PER_ATLAS, nullptr, simd, textureCachePolicy);
+		totalSize += _textureCaches[i]->GetMemoryFootprint();
+	}
+
+	/* Same budget as RenderContextResources, so that the caches resize the same way. */
+	_textureCacheManager = std::make_unique<TextureCacheManager>(totalSize * 2);
+
+	for (int32_t i = 0; i < ARRAYSIZE(_textureCaches); ++i)
+	{
+		_textureCacheManager->AddTextureCache(_textureCaches[i].get());
+	}
+
+	SetSizes(gameSize, windowSize);
+
+	_timeStart = TimeStart();
+
+	D2DX_LOG("Using the null render context; nothing will be displayed.");
+}
+
+HWND NullRenderContext::GetHWnd() const
+{
+	return _hWnd;
+}
+
+_Use_decl_annotations_
+void NullRenderContext::LoadGammaTable(
+	const uint32_t* values,
+	uint32_t valueCount)
+{
+	memcpy(_gammaTable.items, values, min(valueCount, _gammaTable.capacity) * sizeof(uint32_t));
+	++_frameStats.stateChanges;
+}
+
+_Use_decl_annotations_
+uint32_t NullRenderContext::BulkWriteVertices(
+	const Vertex* vertices,
+	uint32_t vertexCount)
+{
+	if ((_vbWriteIndex + vertexCount) > _vertices.capacity)
+	{
+		_vbWriteIndex = 0;
+		assert(vertexCount <= _vertices.capacity);
+		vertexCount = min(vertexCount, _vertices.capacity);
+	}
+
+	const uint32_t startVertexLocation = _vbWriteIndex;
+
+	/* Copy the vertices like the mapped vertex buffer would, so that the cost stays representative. */
+	memcpy(_vertices.items + _vbWriteIndex, vertices, sizeof(Vertex) * vertexCount);
+
+	/* No shaders here, so the camera offset is added when copying. */
+	if (_cameraOffset.x != 0 || _cameraOffset.y != 0)
+	{
+		Vertex* writtenVertices = _vertices.items + _vbWriteIndex;
+
+		for (uint32_t i = 0; i < vertexCount; ++i)
+		{
+			if (writtenVertices[i].IsCameraOffsetEnabled())
+			{
+				writtenVertices[i].AddOffset(_cameraOffset.x, _cameraOffset.y);
+			}
+		}
+	}
+
+	_vbWriteIndex += vertexCount;
+
+	_frameStats.verticesWritten += vertexCount;
+	_frameStats.vertexBytesUploaded += vertexCount * sizeof(Vertex);
+
+	return startVertexLocation;
+}
+
+_Use_decl_annotations_
+void NullRenderContext::SetCameraOffset(
+	Offset offset)
+{
+	_cameraOffset = offset;
+}
+
+_Use_decl_annotations_
+TextureCacheLocation NullRenderContext::UpdateTexture(
+	const Batch& batch,
+	const uint8_t* tmuData,
+	uint32_t tmuDataSize)
+{
+	if (!batch.IsValid())
+	{
+		return { -1, -1, -1 };
+	}
+
+	const uint32_t contentKey = batch.GetHash();
+
+	ITextureCache* atlas = GetTextureCache(batch);
+
+	auto tcl = atlas->FindTexture(contentKey, -1);
+
+	if (tcl._textureAtlas < 0)
+	{
+		tcl = atlas->InsertTexture(contentKey, batch, tmuData, tmuDataSize);
+
+		++_frameStats.textureUploads;
+		_frameStats.textureBytesUploaded += batch.GetTextureWidth() * batch.GetTextureHeight();
+	}
+
+	return tcl;
+}
+
+_Use_decl_annotations_
+void NullRenderContext::Draw(
+	const Batch& batch,
+	uint32_t startVertexLocation)
+{
+	/* In multi-atlas mode all atlases stay bound, like in RenderContext. */
+	if (_isMultiAtlasEnabled)
+	{
+		SetState(batch.GetAlphaBlend(), nullptr, 0);
+	}
+	else
+	{
+		SetState(batch.GetAlphaBlend(), GetTextureCache(batch), batch.GetTextureAtlas());
+	}
+
+	++_frameStats.drawCalls;
+}
+
+void NullRenderContext::Present()
+{
+	_textureCacheManager->OnNewFrame();
+
+	for (int32_t i = 0; i < ARRAYSIZE(_textureCaches); ++i)
+	{
+		_textureCaches[i]->OnNewFrame();
+	}
+
+	double curTime = TimeEndMs(_timeStart);
+	_frameTimeMs = curTime - _prevTime;
+	_prevTime = curTime;
+
+	_lastFrameStats = _frameStats;
+	_totalStats.drawCalls += _frameStats.drawCalls;
+	_totalStats.verticesWritten += _frameStats.verticesWritten;
+	_totalStats.vertexBytesUploaded += _frameStats.vertexBytesUploaded;
+	_totalStats.textureUploads += _frameStats.textureUploads;
+	_totalStats.textureBytesUploaded += _frameStats.textureBytesUploaded;
+	_totalStats.paletteUploads += _frameStats.paletteUploads;
+	_totalStats.stateChanges += _frameStats.stateChanges;
+	_frameStats = NullRenderContextStats();
+
+	/* The real context rebinds its state at the start of every frame. */
+	_alphaBlend = AlphaBlend::Count;
+	_textureCache = nullptr;
+	_textureAtlas = -1;
+
+	++_frameCount;
+}
+
+_Use_decl_annotations_
+void NullRenderContext::WriteToScreen(
+	const uint32_t* pixels,
+	int32_t width,
+	int32_t height)
+{
+	_frameStats.textureBytesUploaded += width * height * 4;
+	++_frameStats.textureUploads;
+	++_frameStats.drawCalls;
+
+	Present();
+}
+
+_Use_decl_annotations_
+void NullRenderContext::SetPalette(
+	int32_t paletteIndex,
+	const uint32_t* palette)
+{
+	assert(paletteIndex >= 0 && paletteIndex < D2DX_MAX_PALETTES);
+	memcpy(_palettes.items + paletteIndex * 256, palette, 256 * sizeof(uint32_t));
+	++_frameStats.paletteUploads;
+}
+
+const Options& NullRenderContext::GetOptions() const
+{
+	return _d2dxContext->GetOptions();
+}
+
+_Use_decl_annotations_
+ITextureCache* NullRenderContext::GetTextureCache(
+	const Batch& batch) const
+{
+	return GetTextureCache(batch.GetTextureWidth(), batch.GetTextureHeight());
+}
+
+bool NullRenderContext::IsMultiAtlasEnabled() const
+{
+	return _isMultiAtlasEnabled;
+}
+
+_Use_decl_annotations_
+ITextureCache* NullRenderContext::GetTextureCache(
+	int32_t textureWidth,
+	int32_t textureHeight) const
+{
+	const int32_t cacheIndex = TextureCache::GetCacheIndex(textureWidth, textureHeight);
+	assert(cacheIndex >= 0);
+	return _textureCaches[cacheIndex].get();
+}
+
+_Use_decl_annotations_
+void NullRenderContext::SetState(
+	AlphaBlend alphaBlend,
+	const ITextureCache* textureCache,
+	int32_t textureAtlas)
+{
+	if (alphaBlend != _alphaBlend)
+	{
+		_alphaBlend = alphaBlend;
+		++_frameStats.stateChanges;
+	}
+
+	if (textureCache != _textureCache || textureAtlas != _textureAtlas)
+	{
+		_textureCache = textureCache;
+		_textureAtlas = textureAtlas;
+		++_frameStats.stateChanges;
+	}
+}
+
+_Use_decl_annotations_
+void NullRenderContext::SetSizes(
+	Size gameSize,
+	Size windowSize)
+{
+	_gameSize = gameSize;
+	_windowSize = windowSize;
+}
+
+_Use_decl_annotations_
+void NullRenderContext::GetCurrentMetrics(
+	Size* gameSize,
+	Rect* renderRect,
+	Size* desktopSize) const
+{
+	if (gameSize)
+	{
+		*gameSize = _gameSize;
+	}
+
+	if (renderRect)
+	{
+		*renderRect = { 0, 0, _windowSize.width, _windowSize.height };
+	}
+
+	if (desktopSize)
+	{
+		*desktopSize = _windowSize;
+	}
+}
+
+void NullRenderContext::ToggleFullscreen()
+{
+	_screenMode = _screenMode == ScreenMode::Windowed ? ScreenMode::FullscreenDefault : ScreenMode::Windowed;
+}
+
+float NullRenderContext::GetFrameTime() const
+{
+	return (float)(_frameTimeMs / 1000.0);
+}
+
+int32_t NullRenderContext::GetFrameTimeFp() const
+{
+	auto frameTimeMs = (int64_t)(_frameTimeMs * (65536.0 / 1000.0));
+	return (int32_t)max(INT_MIN, min(INT_MAX, frameTimeMs));
+}
+
+ScreenMode NullRenderContext::GetScreenMode() const
+{
+	return _screenMode;
+}
+
+uint32_t NullRenderContext::GetFrameCount() const
+{
+	return _frameCount;
+}
+
+const NullRenderContextStats& NullRenderContext::GetLastFrameStats() const
+{
+	return _lastFrameStats;
+}
+
+const NullRenderContextStats& NullRenderContext::GetTotalStats() const
+{
+	return _totalStats;
+}
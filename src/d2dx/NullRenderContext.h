@@ -0,0 +1,165 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Buffer.h"
+#include "IRenderContext.h"
+#include "ISimd.h"
+#include "ITextureCache.h"
+#include "Options.h"
+#include "TextureCache.h"
+#include "TextureCacheManager.h"
+#include "Types.h"
+#include "Vertex.h"
+
+namespace d2dx
+{
+	struct ID2DXContext;
+	class Batch;
+
+	struct NullRenderContextStats final
+	{
+		uint32_t drawCalls = 0;
+		uint32_t verticesWritten = 0;
+		uint32_t vertexBytesUploaded = 0;
+		uint32_t textureUploads = 0;
+		uint32_t textureBytesUploaded = 0;
+		uint32_t paletteUploads = 0;
+		uint32_t stateChanges = 0;
+	};
+
+	/* An IRenderContext that does all the CPU-side bookkeeping of RenderContext (texture caches,
+	   vertex buffer writes, state tracking) but never touches a device. Used for measuring the
+	   CPU cost of a frame in isolation, e.g. when replaying a Glide trace. */
+	class NullRenderContext final : public IRenderContext
+	{
+	public:
+		NullRenderContext(
+			_In_ HWND hWnd,
+			_In_ Size gameSize,
+			_In_ Size windowSize,
+			_In_ ScreenMode initialScreenMode,
+			_In_ ID2DXContext* d2dxContext,
+			_In_ const std::shared_ptr<ISimd>& simd,
+			_In_ TextureCachePolicyOption textureCachePolicy = TextureCachePolicyOption::BitPmru,
+			_In_ bool isMultiAtlasEnabled = false);
+
+		virtual ~NullRenderContext() noexcept {}
+
+		virtual HWND GetHWnd() const override;
+
+		virtual void LoadGammaTable(
+			_In_reads_(valueCount) const uint32_t* values,
+			_In_ uint32_t valueCount) override;
+
+		virtual uint32_t BulkWriteVertices(
+			_In_reads_(vertexCount) const Vertex* vertices,
+			_In_ uint32_t vertexCount) override;
+
+		virtual void SetCameraOffset(
+			_In_ Offset offset) override;
+
+		virtual TextureCacheLocation UpdateTexture(
+			_In_ const Batch& batch,
+			_In_reads_(tmuDataSize) const uint8_t* tmuData,
+			_In_ uint32_t tmuDataSize) override;
+
+		virtual void Draw(
+			_In_ const Batch& batch,
+			_In_ uint32_t startVertexLocation) override;
+
+		virtual void Present() override;
+
+		virtual void WriteToScreen(
+			_In_reads_(width* height) const uint32_t* pixels,
+			_In_ int32_t width,
+			_In_ int32_t height) override;
+
+		virtual void SetPalette(
+			_In_ int32_t paletteIndex,
+			_In_reads_(256) const uint32_t* palette) override;
+
+		virtual const Options& GetOptions() const override;
+
+		virtual ITextureCache* GetTextureCache(
+			_In_ const Batch& batch) const override;
+
+		virtual bool IsMultiAtlasEnabled() const override;
+
+		virtual void SetSizes(
+			_In_ Size gameSize,
+			_In_ Size windowSize) override;
+
+		virtual void GetCurrentMetrics(
+			_Out_opt_ Size* gameSize,
+			_Out_opt_ Rect* renderRect,
+			_Out_opt_ Size* desktopSize) const override;
+
+		virtual void ToggleFullscreen() override;
+
+		virtual float GetFrameTime() const override;
+		virtual int32_t GetFrameTimeFp() const override;
+
+		virtual ScreenMode GetScreenMode() const override;
+
+		uint32_t GetFrameCount() const;
+
+		/* Counters for the most recently presented frame. */
+		const NullRenderContextStats& GetLastFrameStats() const;
+
+		/* Counters accumulated over all presented frames. */
+		const NullRenderContextStats& GetTotalStats() const;
+
+	private:
+		ITextureCache* GetTextureCache(
+			_In_ int32_t textureWidth,
+			_In_ int32_t textureHeight) const;
+
+		void SetState(
+			_In_ AlphaBlend alphaBlend,
+			_In_ const ITextureCache* textureCache,
+			_In_ int32_t textureAtlas);
+
+		HWND _hWnd = nullptr;
+		ID2DXContext* _d2dxContext = nullptr;
+		ScreenMode _screenMode = ScreenMode::Windowed;
+		Size _gameSize = { 0, 0 };
+		Size _windowSize = { 0, 0 };
+		std::unique_ptr<ITextureCache> _textureCaches[D2DX_TEXTURE_CACHE_COUNT];
+		std::unique_ptr<TextureCacheManager> _textureCacheManager;
+		Buffer<Vertex> _vertices;
+		uint32_t _vbWriteIndex = 0;
+		Offset _cameraOffset = { 0, 0 };
+		Buffer<uint32_t> _palettes;
+		Buffer<uint32_t> _gammaTable;
+
+		AlphaBlend _alphaBlend = AlphaBlend::Count;
+		const ITextureCache* _textureCache = nullptr;
+		int32_t _textureAtlas = -1;
+		bool _isMultiAtlasEnabled = false;
+
+		uint32_t _frameCount = 0;
+		NullRenderContextStats _frameStats;
+		NullRenderContextStats _lastFrameStats;
+		NullRenderContextStats _totalStats;
+		int64_t _timeStart = 0;
+		double _prevTime = 0;
+		double _frameTimeMs = 0;
+	};
+}
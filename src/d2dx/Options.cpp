@@ -79,6 +79,7 @@ void Options::ApplyCfg(
 		READ_OPTOUTS_FLAG(OptionsFlag::NoCompatModeFix, "nocompatmodefix");
 		READ_OPTOUTS_FLAG(OptionsFlag::NoTitleChange, "notitlechange");
 		READ_OPTOUTS_FLAG(OptionsFlag::NoMotionPrediction, "nomotionprediction");
+		READ_OPTOUTS_FLAG(OptionsFlag::NoBatchReordering, "nobatchreordering");
 
 #undef READ_OPTOUTS_FLAG
 	}
@@ -104,6 +105,20 @@ void Options::ApplyCfg(
 		{
 			_filtering = (FilteringOption)filtering.u.i;
 		}
+
+		auto textureCachePolicy = toml_int_in(game, "texturecachepolicy");
+		if (textureCachePolicy.ok &&
+			textureCachePolicy.u.i >= 0 &&
+			textureCachePolicy.u.i < (int64_t)TextureCachePolicyOption::Count)
+		{
+			_textureCachePolicy = (TextureCachePolicyOption)textureCachePolicy.u.i;
+		}
+
+		auto multiAtlas = toml_bool_in(game, "multiatlas");
+		if (multiAtlas.ok)
+		{
+			SetFlag(OptionsFlag::MultiAtlas, multiAtlas.u.b);
+		}
 	}
 
 	auto window = toml_table_in(root, "window");
@@ -144,6 +159,30 @@ void Options::ApplyCfg(
 		{
 			SetFlag(OptionsFlag::DbgDumpTextures, dumpTextures.u.b);
 		}
+
+		auto recordTrace = toml_bool_in(debug, "recordtrace");
+		if (recordTrace.ok)
+		{
+			SetFlag(OptionsFlag::DbgRecordTrace, recordTrace.u.b);
+		}
+
+		auto recordTextureBinds = toml_bool_in(debug, "recordtexturebinds");
+		if (recordTextureBinds.ok)
+		{
+			SetFlag(OptionsFlag::DbgRecordTextureBinds, recordTextureBinds.u.b);
+		}
+
+		auto nullRenderer = toml_bool_in(debug, "nullrenderer");
+		if (nullRenderer.ok)
+		{
+			SetFlag(OptionsFlag::DbgNullRenderer, nullRenderer.u.b);
+		}
+
+		auto softwareRenderer = toml_bool_in(debug, "softwarerenderer");
+		if (softwareRenderer.ok)
+		{
+			SetFlag(OptionsFlag::DbgSoftwareRenderer, softwareRenderer.u.b);
+		}
 	}
 
 	toml_free(root);
@@ -163,11 +202,17 @@ void Options::ApplyCommandLine(
 	if (strstr(cmdLine, "-dxnocompatmodefix")) SetFlag(OptionsFlag::NoCompatModeFix, true);
 	if (strstr(cmdLine, "-dxnotitlechange")) SetFlag(OptionsFlag::NoTitleChange, true);
 	if (strstr(cmdLine, "-dxnomop")) SetFlag(OptionsFlag::NoMotionPrediction, true);
+	if (strstr(cmdLine, "-dxnoreorder")) SetFlag(OptionsFlag::NoBatchReordering, true);
+	if (strstr(cmdLine, "-dxmultiatlas")) SetFlag(OptionsFlag::MultiAtlas, true);
 
 	if (strstr(cmdLine, "-dxscale3")) SetWindowScale(3.0);
 	else if (strstr(cmdLine, "-dxscale2")) SetWindowScale(2.0);
 
 	if (strstr(cmdLine, "-dxdbg_dump_textures")) SetFlag(OptionsFlag::DbgDumpTextures, true);
+	if (strstr(cmdLine, "-dxdbg_record_trace")) SetFlag(OptionsFlag::DbgRecordTrace, true);
+	if (strstr(cmdLine, "-dxdbg_record_texture_binds")) SetFlag(OptionsFlag::DbgRecordTextureBinds, true);
+	if (strstr(cmdLine, "-dxdbg_null_renderer")) SetFlag(OptionsFlag::DbgNullRenderer, true);
+	if (strstr(cmdLine, "-dxdbg_software_renderer")) SetFlag(OptionsFlag::DbgSoftwareRenderer, true);
 }
 
 _Use_decl_annotations_
@@ -227,3 +272,8 @@ FilteringOption Options::GetFiltering() const
 {
 	return _filtering;
 }
+
+TextureCachePolicyOption Options::GetTextureCachePolicy() const
+{
+	return _textureCachePolicy;
+}
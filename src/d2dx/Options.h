@@ -34,10 +34,16 @@ namespace d2dx
 		NoTitleChange,
 		NoVSync,
 		NoMotionPrediction,
+		NoBatchReordering,
 
 		DbgDumpTextures,
+		DbgRecordTrace,
+		DbgRecordTextureBinds,
+		DbgNullRenderer,
+		DbgSoftwareRenderer,
 
 		Frameless,
+		MultiAtlas,
 
 		Count
 	};
@@ -50,6 +56,13 @@ namespace d2dx
 		Count = 3
 	};
 
+	enum class TextureCachePolicyOption
+	{
+		BitPmru = 0,
+		TwoQueue = 1,
+		Count = 2
+	};
+
 	class Options final
 	{
 	public:
@@ -86,11 +99,14 @@ namespace d2dx
 
 		FilteringOption GetFiltering() const;
 
+		TextureCachePolicyOption GetTextureCachePolicy() const;
+
 	private:
 		uint32_t _flags = 0;
 		double _windowScale = 1.0;
 		Offset _windowPosition{ -1, -1 };
 		Size _userSpecifiedGameSize{ -1, -1 };
 		FilteringOption _filtering{ FilteringOption::HighQuality };
+		TextureCachePolicyOption _textureCachePolicy{ TextureCachePolicyOption::BitPmru };
 	};
 }
\ No newline at end of file
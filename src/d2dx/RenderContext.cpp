@@ -77,6 +77,8 @@ RenderContext::RenderContext(
 		_screenMode == ScreenMode::FullscreenDefault ? _desktopSize : _windowSize,
 		!_d2dxContext->GetOptions().GetFlag(OptionsFlag::NoWide));
 
+	_isMultiAtlasEnabled = _d2dxContext->GetOptions().GetFlag(OptionsFlag::MultiAtlas);
+
 #ifndef NDEBUG
 	ShowCursor_Real(TRUE);
 #endif
@@ -275,10 +277,12 @@ RenderContext::RenderContext(
 			16 * sizeof(Constants),
 			renderTargetSize,
 			_device.Get(),
-			simd);
+			simd,
+			_d2dxContext->GetOptions().GetTextureCachePolicy());
 
 	SetRasterizerState(_resources->GetRasterizerState(true));
 	_deviceContext->IASetInputLayout(_resources->GetInputLayout());
+	_shadowState.il = _resources->GetInputLayout();
 
 	ID3D11Buffer* cb = _resources->GetConstantBuffer();
 	_deviceContext->VSSetConstantBuffers(0, 1, &cb);
@@ -300,6 +304,7 @@ RenderContext::RenderContext(
 	uint32_t offset = 0;
 	ID3D11Buffer* vbs[1] = { _resources->GetVertexBuffer() };
 	_deviceContext->IASetVertexBuffers(0, 1, vbs, &stride, &offset);
+	_deviceContext->IASetIndexBuffer(_resources->GetQuadIndexBuffer(), DXGI_FORMAT_R16_UINT, 0);
 }
 
 HWND RenderContext::GetHWnd() const
@@ -312,17 +317,54 @@ void RenderContext::Draw(
 	const Batch& batch,
 	uint32_t startVertexLocation)
 {
+	/* Textures are uploaded when first drawn with, so this is once per frame unless the ring ran full. */
+	_resources->GetTextureUploadQueue()->Flush();
+
 	SetBlendState(batch.GetAlphaBlend());
 
-	ITextureCache* atlas = GetTextureCache(batch);
+	ID3D11VertexShader* vs = _resources->GetVertexShader(
+		batch.GetPrimitiveType() == PrimitiveType::Sprites ? RenderContextVertexShader::GameSprite : RenderContextVertexShader::Game);
 
-	SetShaderState(
-		_resources->GetVertexShader(RenderContextVertexShader::Game),
-		_resources->GetPixelShader(RenderContextPixelShader::Game),
-		atlas ? atlas->GetSrv(batch.GetTextureAtlas()) : nullptr,
-		_resources->GetTexture1DSrv(RenderContextTexture1D::Palette));
+	if (_isMultiAtlasEnabled)
+	{
+		SetShaderState(
+			vs,
+			_resources->GetPixelShader(RenderContextPixelShader::GameMultiAtlas),
+			nullptr,
+			_resources->GetTexture1DSrv(RenderContextTexture1D::Palette));
+
+		SetMultiAtlasSrvs();
+	}
+	else
+	{
+		ITextureCache* atlas = GetTextureCache(batch);
+
+		SetShaderState(
+			vs,
+			_resources->GetPixelShader(RenderContextPixelShader::Game),
+			atlas ? atlas->GetSrv(batch.GetTextureAtlas()) : nullptr,
+			_resources->GetTexture1DSrv(RenderContextTexture1D::Palette));
+	}
 
-	_deviceContext->Draw(batch.GetVertexCount(), startVertexLocation + batch.GetStartVertex());
+	if (batch.GetPrimitiveType() == PrimitiveType::Quads)
+	{
+		assert(!(batch.GetVertexCount() & 3) && batch.GetVertexCount() <= D2DX_MAX_QUADS_PER_DRAW_CALL * 4);
+		_deviceContext->DrawIndexed(batch.GetVertexCount() / 4 * 6, 0, startVertexLocation + batch.GetStartVertex());
+	}
+	else if (batch.GetPrimitiveType() == PrimitiveType::Sprites)
+	{
+		/* Each sprite record is an instance, read from where it was written in the vertex buffer. */
+		assert(!(batch.GetVertexCount() & 1));
+		ID3D11Buffer* vb = _resources->GetVertexBuffer();
+		const uint32_t stride = 2 * sizeof(Vertex);
+		const uint32_t offset = (startVertexLocation + batch.GetStartVertex()) * sizeof(Vertex);
+		_deviceContext->IASetVertexBuffers(1, 1, &vb, &stride, &offset);
+		_deviceContext->DrawIndexedInstanced(6, batch.GetVertexCount() / 2, 0, 0, 0);
+	}
+	else
+	{
+		_deviceContext->Draw(batch.GetVertexCount(), startVertexLocation + batch.GetStartVertex());
+	}
 }
 
 bool RenderContext::IsIntegerScale() const
@@ -448,9 +490,25 @@ void RenderContext::Present()
 			this->_resources->GetTextureCache(128, 128)->GetUsedCount(),
 			this->_resources->GetTextureCache(256, 256)->GetUsedCount(),
 			this->_resources->GetTextureCache(256, 128)->GetUsedCount());
+
+		D2DX_LOG("Texture cache packing efficiency: %.2f, %.2f, %.2f, %.2f, %.2f",
+			this->_resources->GetTextureCache(16, 16)->GetPackingEfficiency(),
+			this->_resources->GetTextureCache(32, 32)->GetPackingEfficiency(),
+			this->_resources->GetTextureCache(64, 64)->GetPackingEfficiency(),
+			this->_resources->GetTextureCache(128, 128)->GetPackingEfficiency(),
+			this->_resources->GetTextureCache(256, 256)->GetPackingEfficiency());
+
+		const TextureUploadQueueStats& uploadStats = this->_resources->GetTextureUploadQueue()->GetStats();
+		D2DX_LOG("Texture uploads: %u queued (%llu kB), %u coalesced, %u copies in %u flushes, %u ring stalls",
+			uploadStats.queuedUploads, uploadStats.queuedBytes / 1024, uploadStats.coalescedUploads,
+			uploadStats.copies, uploadStats.flushes, uploadStats.ringStalls);
+
+		D2DX_LOG("Vertex upload: %u bytes this frame", _frameVertexBytesUploaded);
 	}
 #endif
 
+	_frameVertexBytesUploaded = 0;
+
 	switch (_syncStrategy)
 	{
 	case RenderContextSyncStrategy::AllowTearing:
@@ -478,6 +536,8 @@ void RenderContext::Present()
 		_deviceContext1->DiscardView(_backbufferRtv.Get());
 	}
 
+	/* Resizing the texture caches may release atlases with queued uploads. */
+	_resources->GetTextureUploadQueue()->Flush();
 	_resources->OnNewFrame();
 
 	SetRenderTargets(
@@ -570,10 +630,21 @@ uint32_t RenderContext::BulkWriteVertices(
 	}
 
 	_vbWriteIndex += vertexCount;
+	_frameVertexBytesUploaded += vertexCount * sizeof(Vertex);
 
 	return startVertexLocation;
 }
 
+_Use_decl_annotations_
+void RenderContext::SetCameraOffset(
+	Offset offset)
+{
+	/* GameVS adds it, so the vertices don't have to be rewritten. */
+	_constants.cameraOffset[0] = (float)offset.x;
+	_constants.cameraOffset[1] = (float)offset.y;
+	UpdateConstants();
+}
+
 _Use_decl_annotations_
 uint32_t RenderContext::UpdateVerticesWithFullScreenTriangle(
 	Size srcSize,
@@ -613,7 +684,7 @@ TextureCacheLocation RenderContext::UpdateTexture(
 {
 	if (!batch.IsValid())
 	{
-		return { -1, -1 };
+		return { -1, -1, -1 };
 	}
 
 	const uint32_t contentKey = batch.GetHash();
@@ -646,6 +717,11 @@ void RenderContext::UpdateViewport(
 	_constants.invScreenSize[1] = 1.0f / _constants.screenSize[1];
 	_constants.flags[0] = _d2dxContext->GetOptions().GetFlag(OptionsFlag::NoAntiAliasing) ? 0 : 1;
 	_constants.flags[1] = 0;
+	UpdateConstants();
+}
+
+void RenderContext::UpdateConstants()
+{
 	if (memcmp(&_constants, &_shadowState.constants, sizeof(Constants)) != 0)
 	{
 		D3D11_MAPPED_SUBRESOURCE mappedSubResource = { 0 };
@@ -790,6 +866,16 @@ void RenderContext::SetShaderState(
 	{
 		_deviceContext->VSSetShader(vs, NULL, 0);
 		_shadowState.vs = vs;
+
+		/* Only GameSpriteVS reads its input per instance. */
+		ID3D11InputLayout* il = vs == _resources->GetVertexShader(RenderContextVertexShader::GameSprite) ?
+			_resources->GetSpriteInputLayout() : _resources->GetInputLayout();
+
+		if (il != _shadowState.il)
+		{
+			_deviceContext->IASetInputLayout(il);
+			_shadowState.il = il;
+		}
 	}
 
 	if (ps != _shadowState.ps)
@@ -808,6 +894,19 @@ void RenderContext::SetShaderState(
 	}
 }
 
+void RenderContext::SetMultiAtlasSrvs()
+{
+	/* The caches can gain or lose atlases at the start of a frame, so compare them all. */
+	ID3D11ShaderResourceView* srvs[D2DX_MAX_TEXTURE_SELECTORS];
+	_resources->GetMultiAtlasSrvs(srvs);
+
+	if (memcmp(srvs, _shadowState.psMultiAtlasSrvs, sizeof(srvs)))
+	{
+		_deviceContext->PSSetShaderResources(2, D2DX_MAX_TEXTURE_SELECTORS, srvs);
+		memcpy(_shadowState.psMultiAtlasSrvs, srvs, sizeof(srvs));
+	}
+}
+
 _Use_decl_annotations_
 ITextureCache* RenderContext::GetTextureCache(
 	const Batch& batch) const
@@ -815,6 +914,11 @@ ITextureCache* RenderContext::GetTextureCache(
 	return _resources->GetTextureCache(batch.GetTextureWidth(), batch.GetTextureHeight());
 }
 
+bool RenderContext::IsMultiAtlasEnabled() const
+{
+	return _isMultiAtlasEnabled;
+}
+
 void RenderContext::ResizeBackbuffer()
 {
 	if (_backbufferSizingStrategy == RenderContextBackbufferSizingStrategy::SetSourceSize)
@@ -72,6 +72,9 @@ namespace d2dx
 			_In_reads_(vertexCount) const Vertex* vertices,
 			_In_ uint32_t vertexCount) override;
 
+		virtual void SetCameraOffset(
+			_In_ Offset offset) override;
+
 		virtual TextureCacheLocation UpdateTexture(
 			_In_ const Batch& batch,
 			_In_reads_(tmuDataSize) const uint8_t* tmuData,
@@ -97,6 +100,8 @@ namespace d2dx
 		virtual ITextureCache* GetTextureCache(
 			_In_ const Batch& batch) const override;
 
+		virtual bool IsMultiAtlasEnabled() const override;
+
 		virtual void SetSizes(
 			_In_ Size gameSize,
 			_In_ Size windowSize) override;
@@ -122,6 +127,8 @@ namespace d2dx
 		void UpdateViewport(
 			_In_ Rect rect);
 
+		void UpdateConstants();
+
 		void SetRenderTargets(
 			_In_opt_ ID3D11RenderTargetView* rtv0,
 			_In_opt_ ID3D11RenderTargetView* rtv1);
@@ -152,6 +159,8 @@ namespace d2dx
 			_In_opt_ ID3D11ShaderResourceView* psSrv0,
 			_In_opt_ ID3D11ShaderResourceView* psSrv1);
 
+		void SetMultiAtlasSrvs();
+
 		void SetBlendState(
 			_In_ ID3D11BlendState* blendState);
 
@@ -160,19 +169,23 @@ namespace d2dx
 			float screenSize[2] = { 0.0f, 0.0f };
 			float invScreenSize[2] = { 0.0f, 0.0f };
 			uint32_t flags[4] = { 0, 0, 0, 0 };
+			float cameraOffset[2] = { 0.0f, 0.0f };
+			float padding[2] = { 0.0f, 0.0f };
 		};
 
-		static_assert(sizeof(Constants) == 8 * 4, "size of Constants");
+		static_assert(sizeof(Constants) == 12 * 4, "size of Constants");
 
 		struct DeviceContextState final
 		{
 			Constants constants;
 			ID3D11RasterizerState* rs = nullptr;
+			ID3D11InputLayout* il = nullptr;
 			ID3D11VertexShader* vs = nullptr;
 			ID3D11PixelShader* ps = nullptr;
 			ID3D11BlendState* bs = nullptr;
 			ID3D11ShaderResourceView* psSrv0 = nullptr;
 			ID3D11ShaderResourceView* psSrv1 = nullptr;
+			ID3D11ShaderResourceView* psMultiAtlasSrvs[D2DX_MAX_TEXTURE_SELECTORS] = {};
 			ID3D11RenderTargetView* rtv0 = nullptr;
 			ID3D11RenderTargetView* rtv1 = nullptr;
 		};
@@ -196,6 +209,7 @@ namespace d2dx
 		int32_t _desktopClientMaxHeight = 0;
 		uint32_t _vbWriteIndex = 0;
 		uint32_t _vbCapacity = 0;
+		uint32_t _frameVertexBytesUploaded = 0;
 		Constants _constants;
 		RenderContextSyncStrategy _syncStrategy = RenderContextSyncStrategy::AllowTearing;
 		RenderContextSwapStrategy _swapStrategy = RenderContextSwapStrategy::FlipDiscard;
@@ -210,6 +224,7 @@ namespace d2dx
 		EventHandle _frameLatencyWaitableObject;
 		int64_t _timeStart;
 		bool _hasAdjustedWindowPlacement = false;
+		bool _isMultiAtlasEnabled = false;
 
 		double _prevTime;
 		double _frameTimeMs;
@@ -27,6 +27,8 @@
 #include "DisplayBilinearScalePS_cso.h"
 #include "DisplayCatmullRomScalePS_cso.h"
 #include "GamePS_cso.h"
+#include "GameMultiAtlasPS_cso.h"
+#include "GameSpriteVS_cso.h"
 #include "GameVS_cso.h"
 #include "VideoPS_cso.h"
 #include "GammaPS_cso.h"
@@ -41,10 +43,11 @@ RenderContextResources::RenderContextResources(
 	uint32_t cbSizeBytes,
 	Size framebufferSize,
 	ID3D11Device* device,
-	const std::shared_ptr<ISimd>& simd)
+	const std::shared_ptr<ISimd>& simd,
+	TextureCachePolicyOption textureCachePolicy)
 {
 	CreateTexture1Ds(device);
-	CreateTextureCaches(device, simd);
+	CreateTextureCaches(device, simd, textureCachePolicy);
 	CreateVideoTextures(device);
 	CreateShadersAndInputLayout(device);
 	CreateRasterizerState(device);
@@ -52,11 +55,14 @@ RenderContextResources::RenderContextResources(
 	CreateBlendStates(device);
 	CreateFramebuffers(framebufferSize, device);
 	CreateVertexBuffer(vbSizeBytes, device);
+	CreateQuadIndexBuffer(device);
 	CreateConstantBuffer(cbSizeBytes, device);
 }
 
 void RenderContextResources::OnNewFrame()
 {
+	_textureCacheManager->OnNewFrame();
+
 	for (int32_t i = 0; i < ARRAYSIZE(_textureCaches); ++i)
 	{
 		_textureCaches[i]->OnNewFrame();
@@ -67,18 +73,24 @@ ITextureCache* RenderContextResources::GetTextureCache(
 	int32_t textureWidth,
 	int32_t textureHeight) const
 {
-	if (textureWidth == 256 && textureHeight == 128)
+	const int32_t cacheIndex = TextureCache::GetCacheIndex(textureWidth, textureHeight);
+	assert(cacheIndex >= 0);
+	return _textureCaches[cacheIndex].get();
+}
+
+_Use_decl_annotations_
+void RenderContextResources::GetMultiAtlasSrvs(
+	ID3D11ShaderResourceView** srvs) const
+{
+	for (int32_t i = 0; i < ARRAYSIZE(_textureCaches); ++i)
 	{
-		return _textureCaches[6].get();
-	}
+		const uint32_t atlasCount = _textureCaches[i]->GetAtlasCount();
 
-	const int32_t longest = max(textureWidth, textureHeight);
-	assert(longest >= 8);
-	uint32_t log2Longest = 0;
-	BitScanForward((DWORD*)&log2Longest, (DWORD)longest);
-	log2Longest -= 3;
-	assert(log2Longest <= 5);
-	return _textureCaches[log2Longest].get();
+		for (uint32_t j = 0; j < D2DX_MAX_ATLASES_PER_TEXTURE_CACHE; ++j)
+		{
+			srvs[i * D2DX_MAX_ATLASES_PER_TEXTURE_CACHE + j] = j < atlasCount ? _textureCaches[i]->GetSrv(j) : nullptr;
+		}
+	}
 }
 
 _Use_decl_annotations_
@@ -88,9 +100,15 @@ void RenderContextResources::CreateShadersAndInputLayout(
 	D2DX_CHECK_HR(
 		device->CreateVertexShader(GameVS_cso, ARRAYSIZE(GameVS_cso), NULL, &_vertexShaders[(int32_t)RenderContextVertexShader::Game]));
 
+	D2DX_CHECK_HR(
+		device->CreateVertexShader(GameSpriteVS_cso, ARRAYSIZE(GameSpriteVS_cso), NULL, &_vertexShaders[(int32_t)RenderContextVertexShader::GameSprite]));
+
 	D2DX_CHECK_HR(
 		device->CreatePixelShader(GamePS_cso, ARRAYSIZE(GamePS_cso), NULL, &_pixelShaders[(int32_t)RenderContextPixelShader::Game]));
 
+	D2DX_CHECK_HR(
+		device->CreatePixelShader(GameMultiAtlasPS_cso, ARRAYSIZE(GameMultiAtlasPS_cso), NULL, &_pixelShaders[(int32_t)RenderContextPixelShader::GameMultiAtlas]));
+
 	D2DX_CHECK_HR(
 		device->CreatePixelShader(VideoPS_cso, ARRAYSIZE(VideoPS_cso), NULL, &_pixelShaders[(int32_t)RenderContextPixelShader::Video]));
 
@@ -125,6 +143,20 @@ void RenderContextResources::CreateShadersAndInputLayout(
 
 	D2DX_CHECK_HR(
 		device->CreateInputLayout(inputElementDescs, ARRAYSIZE(inputElementDescs), GameVS_cso, ARRAYSIZE(GameVS_cso), &_inputLayout));
+
+	/* A sprite record is two vertices; the second only contributes its position and texcoord. */
+	D3D11_INPUT_ELEMENT_DESC spriteInputElementDescs[6] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R16G16_SINT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_SINT, 1, 4, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "COLOR", 0, DXGI_FORMAT_B8G8R8A8_UNORM, 1, 8, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "TEXCOORD", 1, DXGI_FORMAT_R16G16_UINT, 1, 12, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "POSITION", 1, DXGI_FORMAT_R16G16_SINT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "TEXCOORD", 2, DXGI_FORMAT_R16G16_SINT, 1, 20, D3D11_INPUT_PER_INSTANCE_DATA, 1 }
+	};
+
+	D2DX_CHECK_HR(
+		device->CreateInputLayout(spriteInputElementDescs, ARRAYSIZE(spriteInputElementDescs), GameSpriteVS_cso, ARRAYSIZE(GameSpriteVS_cso), &_spriteInputLayout));
 }
 
 _Use_decl_annotations_
@@ -180,33 +212,37 @@ void RenderContextResources::CreateTexture1Ds(
 _Use_decl_annotations_
 void RenderContextResources::CreateTextureCaches(
 	ID3D11Device* device,
-	const std::shared_ptr<ISimd>& simd)
+	const std::shared_ptr<ISimd>& simd,
+	TextureCachePolicyOption textureCachePolicy)
 {
-	static const uint32_t capacities[7] = { 512, 1024, 2048, 2048, 1024, 512, 1024 };
-
 	const uint32_t texturesPerAtlas = DetermineMaxTextureArraySize(device);
 	D2DX_LOG("The device supports %u textures per atlas.", texturesPerAtlas);
 
+	/* 512 kB per segment, enough for the misses of a typical area transition in one flush. */
+	_textureUploadQueue = std::make_unique<TextureUploadQueue>(2048, device);
+
 	uint32_t totalSize = 0;
 	for (int32_t i = 0; i < ARRAYSIZE(_textureCaches); ++i)
 	{
-		int32_t width = 1U << (i + 3);
-		int32_t height = 1U << (i + 3);
+		const Size size = TextureCache::GetCacheTextureSize(i);
+		const uint32_t capacity = TextureCache::GetInitialCapacity(i);
 
-		if (i == 6)
-		{
-			width = 256;
-			height = 128;
-		}
-
-		_textureCaches[i] = std::make_unique<TextureCache>(width, height, capacities[i], texturesPerAtlas, device, simd);
+		_textureCaches[i] = std::make_unique<TextureCache>(size.width, size.height, capacity, texturesPerAtlas, device, simd, textureCachePolicy, _textureUploadQueue.get());
 
-		D2DX_DEBUG_LOG("Creating texture cache for %i x %i with capacity %u (%u kB).", width, height, capacities[i], _textureCaches[i]->GetMemoryFootprint() / 1024);
+		D2DX_DEBUG_LOG("Creating texture cache for %i x %i with capacity %u (%u kB).", size.width, size.height, capacity, _textureCaches[i]->GetMemoryFootprint() / 1024);
 
 		totalSize += _textureCaches[i]->GetMemoryFootprint();
 	}
 
 	D2DX_LOG("Total size of texture caches is %u kB.", totalSize / 1024);
+
+	/* Leave room for the caches that turn out to be too small (e.g. with mods) to grow. */
+	_textureCacheManager = std::make_unique<TextureCacheManager>(totalSize * 2);
+
+	for (int32_t i = 0; i < ARRAYSIZE(_textureCaches); ++i)
+	{
+		_textureCacheManager->AddTextureCache(_textureCaches[i].get());
+	}
 }
 
 _Use_decl_annotations_
@@ -522,6 +558,38 @@ void RenderContextResources::CreateVertexBuffer(
 		device->CreateBuffer(&vbDesc, NULL, &_vb));
 }
 
+_Use_decl_annotations_
+void RenderContextResources::CreateQuadIndexBuffer(
+	ID3D11Device* device)
+{
+	Buffer<uint16_t> indices(D2DX_MAX_QUADS_PER_DRAW_CALL * 6);
+
+	for (uint32_t i = 0; i < D2DX_MAX_QUADS_PER_DRAW_CALL; ++i)
+	{
+		/* The same two triangles as a four-vertex triangle fan. */
+		const uint32_t vertex0 = i * 4;
+		indices.items[i * 6 + 0] = (uint16_t)vertex0;
+		indices.items[i * 6 + 1] = (uint16_t)(vertex0 + 1);
+		indices.items[i * 6 + 2] = (uint16_t)(vertex0 + 2);
+		indices.items[i * 6 + 3] = (uint16_t)vertex0;
+		indices.items[i * 6 + 4] = (uint16_t)(vertex0 + 2);
+		indices.items[i * 6 + 5] = (uint16_t)(vertex0 + 3);
+	}
+
+	const CD3D11_BUFFER_DESC ibDesc
+	{
+		indices.capacity * sizeof(uint16_t),
+		D3D11_BIND_INDEX_BUFFER,
+		D3D11_USAGE_IMMUTABLE
+	};
+
+	D3D11_SUBRESOURCE_DATA initialData = { 0 };
+	initialData.pSysMem = indices.items;
+
+	D2DX_CHECK_HR(
+		device->CreateBuffer(&ibDesc, &initialData, &_quadIb));
+}
+
 _Use_decl_annotations_
 void RenderContextResources::CreateConstantBuffer(
 	uint32_t cbSizeBytes,
@@ -18,9 +18,16 @@
 */
 #pragma once
 
+#include "BatchMerger.h"
 #include "ITextureCache.h"
+#include "Options.h"
+#include "TextureCacheManager.h"
+#include "TextureUploadQueue.h"
 #include "Types.h"
 
+/* Enough for a draw call of the maximum 65535 vertices. */
+#define D2DX_MAX_QUADS_PER_DRAW_CALL 16384
+
 namespace d2dx
 {
 	enum class RenderContextSamplerState
@@ -34,7 +41,8 @@ namespace d2dx
 	{
 		Game = 0,
 		Display = 1,
-		Count = 2
+		GameSprite = 2,
+		Count = 3
 	};
 
 	enum class RenderContextPixelShader
@@ -47,7 +55,8 @@ namespace d2dx
 		DisplayBilinearScale = 5,
 		DisplayCatmullRomScale = 6,
 		ResolveAA = 7,
-		Count = 8
+		GameMultiAtlas = 8,
+		Count = 9
 	};
 
 	enum class RenderContextTexture1D
@@ -73,7 +82,8 @@ namespace d2dx
 			_In_ uint32_t cbSizeBytes,
 			_In_ Size framebufferSize,
 			_In_ ID3D11Device* device,
-			_In_ const std::shared_ptr<ISimd>& simd);
+			_In_ const std::shared_ptr<ISimd>& simd,
+			_In_ TextureCachePolicyOption textureCachePolicy);
 		
 		virtual ~RenderContextResources() noexcept {}
 
@@ -81,6 +91,9 @@ namespace d2dx
 
 		ID3D11InputLayout* GetInputLayout() const { return _inputLayout.Get(); }
 
+		/* For GameSpriteVS, which reads sprite records as instances from input slot 1. */
+		ID3D11InputLayout* GetSpriteInputLayout() const { return _spriteInputLayout.Get(); }
+
 		ID3D11VertexShader* GetVertexShader(RenderContextVertexShader vertexShader) const
 		{
 			return _vertexShaders[(int32_t)vertexShader].Get();
@@ -95,6 +108,16 @@ namespace d2dx
 			int32_t textureWidth, 
 			int32_t textureHeight) const;
 
+		/* The SRVs of all atlases of all texture caches, indexed by texture selector (see
+		   BatchMerger). Atlases that the caches don't currently have are null. */
+		void GetMultiAtlasSrvs(
+			_Out_writes_(D2DX_MAX_TEXTURE_SELECTORS) ID3D11ShaderResourceView** srvs) const;
+
+		TextureUploadQueue* GetTextureUploadQueue() const
+		{
+			return _textureUploadQueue.get();
+		}
+
 		ID3D11Texture1D* GetTexture1D(RenderContextTexture1D texture1d) const
 		{ 
 			return _texture1Ds[(int32_t)texture1d].texture.Get();
@@ -160,6 +183,12 @@ namespace d2dx
 			return _vb.Get();
 		}
 
+		/* 16-bit indices that draw consecutive groups of four vertices as two triangles each. */
+		ID3D11Buffer* GetQuadIndexBuffer() const
+		{
+			return _quadIb.Get();
+		}
+
 		ID3D11Buffer* GetConstantBuffer() const
 		{
 			return _cb.Get();
@@ -180,7 +209,8 @@ namespace d2dx
 
 		void CreateTextureCaches(
 			_In_ ID3D11Device* device,
-			_In_ const std::shared_ptr<ISimd>& simd);
+			_In_ const std::shared_ptr<ISimd>& simd,
+			_In_ TextureCachePolicyOption textureCachePolicy);
 	
 		void CreateVideoTextures(
 			_In_ ID3D11Device* device);
@@ -199,11 +229,15 @@ namespace d2dx
 			_In_ uint32_t vbSizeBytes,
 			_In_ ID3D11Device* device);
 
+		void CreateQuadIndexBuffer(
+			_In_ ID3D11Device* device);
+
 		void CreateConstantBuffer(
 			_In_ uint32_t cbSizeBytes,
 			_In_ ID3D11Device* device);
 
 		ComPtr<ID3D11InputLayout> _inputLayout;
+		ComPtr<ID3D11InputLayout> _spriteInputLayout;
 		ComPtr<ID3D11VertexShader> _vertexShaders[(int32_t)RenderContextVertexShader::Count];
 		ComPtr<ID3D11PixelShader> _pixelShaders[(int32_t)RenderContextPixelShader::Count];
 		ComPtr<ID3D11PixelShader> _gammaPS;
@@ -220,7 +254,9 @@ namespace d2dx
 		ComPtr<ID3D11Texture2D> _videoTexture;
 		ComPtr<ID3D11ShaderResourceView> _videoTextureSrv;
 
-		std::unique_ptr<ITextureCache> _textureCaches[7];
+		std::unique_ptr<TextureUploadQueue> _textureUploadQueue;
+		std::unique_ptr<ITextureCache> _textureCaches[D2DX_TEXTURE_CACHE_COUNT];
+		std::unique_ptr<TextureCacheManager> _textureCacheManager;
 
 		ComPtr<ID3D11RasterizerState> _rasterizerStateNoScissor;
 		ComPtr<ID3D11RasterizerState> _rasterizerState;
@@ -239,6 +275,7 @@ namespace d2dx
 		Size _framebufferSize;
 
 		ComPtr<ID3D11Buffer> _vb;
+		ComPtr<ID3D11Buffer> _quadIb;
 		ComPtr<ID3D11Buffer> _cb;
 	};
 }
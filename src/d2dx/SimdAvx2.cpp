@@ -0,0 +1,413 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "SimdAvx2.h"
+
+using namespace d2dx;
+using namespace std;
+
+/* Note: this file is built with the same /arch as the rest of the project and only the intrinsics
+   use AVX2. Don't enable AVX2 code generation for it: inline functions from shared headers could
+   then be emitted with AVX2 instructions and picked by the linker for callers on any CPU. */
+
+bool SimdAvx2::IsSupported()
+{
+	int32_t cpuInfo[4];
+
+	__cpuid(cpuInfo, 0);
+	if (cpuInfo[0] < 7)
+	{
+		return false;
+	}
+
+	/* AVX and OSXSAVE, and the OS must save the YMM state (XCR0 bits 1 and 2). */
+	__cpuid(cpuInfo, 1);
+	const uint32_t avxAndOsxsave = (1U << 28) | (1U << 27);
+	if (((uint32_t)cpuInfo[2] & avxAndOsxsave) != avxAndOsxsave ||
+		(_xgetbv(0) & 0x6) != 0x6)
+	{
+		return false;
+	}
+
+	__cpuidex(cpuInfo, 7, 0);
+	return ((uint32_t)cpuInfo[1] & (1U << 5)) != 0;
+}
+
+_Use_decl_annotations_
+int32_t SimdAvx2::IndexOfUInt32(
+	const uint32_t* __restrict items,
+	uint32_t itemsCount,
+	uint32_t item)
+{
+	assert(items && ((uintptr_t)items & 63) == 0);
+	assert(!(itemsCount & 0x3F));
+
+	const __m256i key8 = _mm256_set1_epi32(item);
+	int32_t findIndex = -1;
+
+	for (uint32_t i = 0; i < itemsCount; i += 64)
+	{
+		const uint32_t res0 = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(key8, _mm256_load_si256((const __m256i*)&items[i + 0]))));
+		const uint32_t res1 = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(key8, _mm256_load_si256((const __m256i*)&items[i + 8]))));
+		const uint32_t res2 = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(key8, _mm256_load_si256((const __m256i*)&items[i + 16]))));
+		const uint32_t res3 = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(key8, _mm256_load_si256((const __m256i*)&items[i + 24]))));
+		const uint32_t res4 = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(key8, _mm256_load_si256((const __m256i*)&items[i + 32]))));
+		const uint32_t res5 = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(key8, _mm256_load_si256((const __m256i*)&items[i + 40]))));
+		const uint32_t res6 = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(key8, _mm256_load_si256((const __m256i*)&items[i + 48]))));
+		const uint32_t res7 = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(key8, _mm256_load_si256((const __m256i*)&items[i + 56]))));
+
+		const uint32_t resLo = res0 | (res1 << 8) | (res2 << 16) | (res3 << 24);
+		const uint32_t resHi = res4 | (res5 << 8) | (res6 << 16) | (res7 << 24);
+
+		DWORD bitIndex = 0;
+		if (BitScanForward(&bitIndex, resLo))
+		{
+			findIndex = (int32_t)(i + bitIndex);
+			break;
+		}
+		else if (BitScanForward(&bitIndex, resHi))
+		{
+			findIndex = (int32_t)(i + 32 + bitIndex);
+			break;
+		}
+	}
+
+	_mm256_zeroupper();
+
+	assert(findIndex < 0 || items[findIndex] == item);
+	return findIndex;
+}
+
+_Use_decl_annotations_
+bool SimdAvx2::EqualUInt8(
+	const uint8_t* __restrict itemsA,
+	const uint8_t* __restrict itemsB,
+	uint32_t itemsCount)
+{
+	uint32_t i = 0;
+	bool isEqual = true;
+
+	for (; (i + 32) <= itemsCount; i += 32)
+	{
+		const __m256i a = _mm256_loadu_si256((const __m256i*)&itemsA[i]);
+		const __m256i b = _mm256_loadu_si256((const __m256i*)&itemsB[i]);
+
+		if ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)) != 0xFFFFFFFF)
+		{
+			isEqual = false;
+			break;
+		}
+	}
+
+	_mm256_zeroupper();
+
+	for (; isEqual && i < itemsCount; ++i)
+	{
+		isEqual = itemsA[i] == itemsB[i];
+	}
+
+	return isEqual;
+}
+
+_Use_decl_annotations_
+void SimdAvx2::MinMaxUInt8(
+	const uint8_t* __restrict items,
+	uint32_t itemsCount,
+	uint8_t& minItem,
+	uint8_t& maxItem)
+{
+	__m256i min32 = _mm256_set1_epi8((char)0xFF);
+	__m256i max32 = _mm256_setzero_si256();
+	uint32_t i = 0;
+
+	for (; (i + 32) <= itemsCount; i += 32)
+	{
+		const __m256i v = _mm256_loadu_si256((const __m256i*)&items[i]);
+		min32 = _mm256_min_epu8(min32, v);
+		max32 = _mm256_max_epu8(max32, v);
+	}
+
+	/* Horizontal reduction; the result ends up in the lowest byte. */
+	__m128i min16 = _mm_min_epu8(_mm256_castsi256_si128(min32), _mm256_extracti128_si256(min32, 1));
+	__m128i max16 = _mm_max_epu8(_mm256_castsi256_si128(max32), _mm256_extracti128_si256(max32, 1));
+	_mm256_zeroupper();
+
+	min16 = _mm_min_epu8(min16, _mm_srli_si128(min16, 8));
+	max16 = _mm_max_epu8(max16, _mm_srli_si128(max16, 8));
+	min16 = _mm_min_epu8(min16, _mm_srli_si128(min16, 4));
+	max16 = _mm_max_epu8(max16, _mm_srli_si128(max16, 4));
+	min16 = _mm_min_epu8(min16, _mm_srli_si128(min16, 2));
+	max16 = _mm_max_epu8(max16, _mm_srli_si128(max16, 2));
+	min16 = _mm_min_epu8(min16, _mm_srli_si128(min16, 1));
+	max16 = _mm_max_epu8(max16, _mm_srli_si128(max16, 1));
+
+	uint8_t minValue = (uint8_t)_mm_cvtsi128_si32(min16);
+	uint8_t maxValue = (uint8_t)_mm_cvtsi128_si32(max16);
+
+	for (; i < itemsCount; ++i)
+	{
+		minValue = min(minValue, items[i]);
+		maxValue = max(maxValue, items[i]);
+	}
+
+	minItem = minValue;
+	maxItem = maxValue;
+}
+
+_Use_decl_annotations_
+void SimdAvx2::FillMaskedUInt32(
+	uint32_t* __restrict items,
+	const uint8_t* __restrict mask,
+	uint32_t itemsCount,
+	uint32_t value)
+{
+	const __m256i value8 = _mm256_set1_epi32(value);
+	const __m256i zero = _mm256_setzero_si256();
+	uint32_t i = 0;
+
+	for (; (i + 8) <= itemsCount; i += 8)
+	{
+		const __m256i maskItems = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&mask[i]));
+		const __m256i mask8 = _mm256_xor_si256(_mm256_cmpeq_epi32(maskItems, zero), _mm256_set1_epi32(-1));
+		_mm256_maskstore_epi32((int*)&items[i], mask8, value8);
+	}
+
+	_mm256_zeroupper();
+
+	for (; i < itemsCount; ++i)
+	{
+		if (mask[i])
+		{
+			items[i] = value;
+		}
+	}
+}
+
+_Use_decl_annotations_
+void SimdAvx2::ConvertVertices(
+	const D2::Vertex* const* __restrict d2Vertices,
+	uint32_t count,
+	const Vertex& templateVertex,
+	int32_t stShift,
+	int32_t texcoordOffsetS,
+	int32_t texcoordOffsetT,
+	uint32_t iteratedColorMask,
+	uint32_t maskedConstantColor,
+	Vertex* __restrict vertices)
+{
+	/* The same as SimdSse2::ConvertVertices, with one vertex in each 128-bit lane. */
+	const __m128i shift = _mm_cvtsi32_si128(stShift);
+	const __m256i texcoordOffset = _mm256_broadcastsi128_si256(_mm_set_epi32(texcoordOffsetT, texcoordOffsetS, 0, 0));
+	const __m256i colorMask = _mm256_broadcastsi128_si256(_mm_set_epi32(0, iteratedColorMask, 0, 0));
+	const __m256i constantColor = _mm256_broadcastsi128_si256(_mm_set_epi32(0, maskedConstantColor, 0, 0));
+	const __m256i templateBits = _mm256_broadcastsi128_si256(
+		_mm_and_si128(_mm_loadu_si128((const __m128i*)&templateVertex), _mm_set_epi32(-1, 0, 0x7E00FE00, 0)));
+
+	const auto convertPair = [&](const D2::Vertex* d2Vertex0, const D2::Vertex* d2Vertex1)
+	{
+		const __m256i xyColor = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)&d2Vertex0->x)), _mm_loadu_si128((const __m128i*)&d2Vertex1->x), 1);
+		const __m256i st = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadl_epi64((const __m128i*)&d2Vertex0->s)), _mm_loadl_epi64((const __m128i*)&d2Vertex1->s), 1);
+
+		const __m256i xyst = _mm256_cvttps_epi32(_mm256_castsi256_ps(_mm256_unpacklo_epi64(xyColor, st)));
+		const __m256i xystShifted = _mm256_add_epi32(_mm256_unpacklo_epi64(xyst, _mm256_srli_si256(_mm256_sra_epi32(xyst, shift), 8)), texcoordOffset);
+		const __m256i color = _mm256_srli_si256(_mm256_or_si256(_mm256_and_si256(xyColor, colorMask), constantColor), 8);
+
+		return _mm256_or_si256(_mm256_unpacklo_epi64(_mm256_packs_epi32(xystShifted, xystShifted), color), templateBits);
+	};
+
+	uint32_t i = 0;
+
+	for (; (i + 2) <= count; i += 2)
+	{
+		_mm256_storeu_si256((__m256i*)&vertices[i], convertPair(d2Vertices[i], d2Vertices[i + 1]));
+	}
+
+	if (i < count)
+	{
+		_mm_storeu_si128((__m128i*)&vertices[i], _mm256_castsi256_si128(convertPair(d2Vertices[i], d2Vertices[i])));
+	}
+
+	_mm256_zeroupper();
+}
+
+/* As in SimdSse2.cpp: (int32_t)(((int64_t)a * ka + (int64_t)b * kb) >> 16) per lane, for
+   0 <= ka, kb < 2^31. */
+static inline __m256i MulAddShr16(
+	__m256i a,
+	__m256i ka,
+	__m256i b,
+	__m256i kb)
+{
+	const __m256i productsEven = _mm256_add_epi64(_mm256_mul_epi32(a, ka), _mm256_mul_epi32(b, kb));
+	const __m256i productsOdd = _mm256_add_epi64(
+		_mm256_mul_epi32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(ka, 32)),
+		_mm256_mul_epi32(_mm256_srli_epi64(b, 32), _mm256_srli_epi64(kb, 32)));
+
+	/* The signed multiply leaves no correction to make; bits 16-47 are the result either way. */
+	return _mm256_blend_epi32(_mm256_srli_epi64(productsEven, 16), _mm256_slli_epi64(_mm256_srli_epi64(productsOdd, 16), 32), 0xAA);
+}
+
+_Use_decl_annotations_
+void SimdAvx2::UpdateUnitMotions(
+	const UnitMotions& unitMotions,
+	uint32_t count,
+	int32_t dt)
+{
+	/* The same as SimdSse2::UpdateUnitMotions, eight units at a time. */
+	assert(dt >= 0 && dt <= 65536);
+
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i dt8 = _mm256_set1_epi32(dt);
+	const __m256i maxTileDistance = _mm256_set1_epi32(2);
+	const __m256i minTileDistance = _mm256_set1_epi32(-2);
+	const __m256i velocityInterval = _mm256_set1_epi32(65536 / 25);
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i correctionAmount = _mm256_set1_epi32(7000);
+	const __m256i oneMinusCorrectionAmount = _mm256_set1_epi32(65536 - 7000);
+
+	for (uint32_t i = 0; i < count; i += 8)
+	{
+		const __m256i posX = _mm256_load_si256((const __m256i*)&unitMotions.posX[i]);
+		const __m256i posY = _mm256_load_si256((const __m256i*)&unitMotions.posY[i]);
+		__m256i lastPosX = _mm256_load_si256((const __m256i*)&unitMotions.lastPosX[i]);
+		__m256i lastPosY = _mm256_load_si256((const __m256i*)&unitMotions.lastPosY[i]);
+		__m256i velocityX = _mm256_load_si256((const __m256i*)&unitMotions.velocityX[i]);
+		__m256i velocityY = _mm256_load_si256((const __m256i*)&unitMotions.velocityY[i]);
+		__m256i predictedPosX = _mm256_load_si256((const __m256i*)&unitMotions.predictedPosX[i]);
+		__m256i predictedPosY = _mm256_load_si256((const __m256i*)&unitMotions.predictedPosY[i]);
+		__m256i correctedPosX = _mm256_load_si256((const __m256i*)&unitMotions.correctedPosX[i]);
+		__m256i correctedPosY = _mm256_load_si256((const __m256i*)&unitMotions.correctedPosY[i]);
+		__m256i dtLastPosChange = _mm256_load_si256((const __m256i*)&unitMotions.dtLastPosChange[i]);
+
+		const __m256i posWholeX = _mm256_srai_epi32(posX, 16);
+		const __m256i posWholeY = _mm256_srai_epi32(posY, 16);
+		const __m256i lastPosDX = _mm256_sub_epi32(posWholeX, _mm256_srai_epi32(lastPosX, 16));
+		const __m256i lastPosDY = _mm256_sub_epi32(posWholeY, _mm256_srai_epi32(lastPosY, 16));
+		const __m256i predictedPosDX = _mm256_sub_epi32(posWholeX, _mm256_srai_epi32(predictedPosX, 16));
+		const __m256i predictedPosDY = _mm256_sub_epi32(posWholeY, _mm256_srai_epi32(predictedPosY, 16));
+
+		const __m256i isFar = _mm256_or_si256(
+			_mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpgt_epi32(lastPosDX, maxTileDistance), _mm256_cmpgt_epi32(minTileDistance, lastPosDX)),
+				_mm256_or_si256(_mm256_cmpgt_epi32(lastPosDY, maxTileDistance), _mm256_cmpgt_epi32(minTileDistance, lastPosDY))),
+			_mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpgt_epi32(predictedPosDX, maxTileDistance), _mm256_cmpgt_epi32(minTileDistance, predictedPosDX)),
+				_mm256_or_si256(_mm256_cmpgt_epi32(predictedPosDY, maxTileDistance), _mm256_cmpgt_epi32(minTileDistance, predictedPosDY))));
+
+		lastPosX = _mm256_blendv_epi8(lastPosX, posX, isFar);
+		lastPosY = _mm256_blendv_epi8(lastPosY, posY, isFar);
+		predictedPosX = _mm256_blendv_epi8(predictedPosX, posX, isFar);
+		predictedPosY = _mm256_blendv_epi8(predictedPosY, posY, isFar);
+		correctedPosX = _mm256_blendv_epi8(correctedPosX, posX, isFar);
+		correctedPosY = _mm256_blendv_epi8(correctedPosY, posY, isFar);
+		velocityX = _mm256_andnot_si256(isFar, velocityX);
+		velocityY = _mm256_andnot_si256(isFar, velocityY);
+
+		const __m256i dx = _mm256_sub_epi32(posX, lastPosX);
+		const __m256i dy = _mm256_sub_epi32(posY, lastPosY);
+		dtLastPosChange = _mm256_add_epi32(dtLastPosChange, dt8);
+
+		const __m256i isPosChanged = _mm256_andnot_si256(
+			_mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi32(dx, zero), _mm256_cmpeq_epi32(dy, zero)), _mm256_cmpgt_epi32(velocityInterval, dtLastPosChange)),
+			_mm256_set1_epi32(-1));
+
+		const __m256i halfwayX = _mm256_add_epi32(_mm256_add_epi32(_mm256_srai_epi32(posX, 1), _mm256_srai_epi32(lastPosX, 1)), _mm256_and_si256(_mm256_and_si256(posX, lastPosX), one));
+		const __m256i halfwayY = _mm256_add_epi32(_mm256_add_epi32(_mm256_srai_epi32(posY, 1), _mm256_srai_epi32(lastPosY, 1)), _mm256_and_si256(_mm256_and_si256(posY, lastPosY), one));
+
+		correctedPosX = _mm256_blendv_epi8(correctedPosX, halfwayX, isPosChanged);
+		correctedPosY = _mm256_blendv_epi8(correctedPosY, halfwayY, isPosChanged);
+		velocityX = _mm256_blendv_epi8(velocityX, _mm256_mullo_epi32(dx, _mm256_set1_epi32(25)), isPosChanged);
+		velocityY = _mm256_blendv_epi8(velocityY, _mm256_mullo_epi32(dy, _mm256_set1_epi32(25)), isPosChanged);
+		lastPosX = _mm256_blendv_epi8(lastPosX, posX, isPosChanged);
+		lastPosY = _mm256_blendv_epi8(lastPosY, posY, isPosChanged);
+		dtLastPosChange = _mm256_andnot_si256(isPosChanged, dtLastPosChange);
+
+		const __m256i isMoving = _mm256_andnot_si256(
+			_mm256_cmpeq_epi32(_mm256_or_si256(velocityX, velocityY), zero),
+			_mm256_cmpgt_epi32(velocityInterval, dtLastPosChange));
+
+		const __m256i stepX = MulAddShr16(velocityX, dt8, zero, zero);
+		const __m256i stepY = MulAddShr16(velocityY, dt8, zero, zero);
+
+		predictedPosX = _mm256_blendv_epi8(predictedPosX, _mm256_add_epi32(MulAddShr16(predictedPosX, oneMinusCorrectionAmount, correctedPosX, correctionAmount), stepX), isMoving);
+		predictedPosY = _mm256_blendv_epi8(predictedPosY, _mm256_add_epi32(MulAddShr16(predictedPosY, oneMinusCorrectionAmount, correctedPosY, correctionAmount), stepY), isMoving);
+		correctedPosX = _mm256_blendv_epi8(correctedPosX, _mm256_add_epi32(correctedPosX, stepX), isMoving);
+		correctedPosY = _mm256_blendv_epi8(correctedPosY, _mm256_add_epi32(correctedPosY, stepY), isMoving);
+
+		_mm256_store_si256((__m256i*)&unitMotions.lastPosX[i], lastPosX);
+		_mm256_store_si256((__m256i*)&unitMotions.lastPosY[i], lastPosY);
+		_mm256_store_si256((__m256i*)&unitMotions.velocityX[i], velocityX);
+		_mm256_store_si256((__m256i*)&unitMotions.velocityY[i], velocityY);
+		_mm256_store_si256((__m256i*)&unitMotions.predictedPosX[i], predictedPosX);
+		_mm256_store_si256((__m256i*)&unitMotions.predictedPosY[i], predictedPosY);
+		_mm256_store_si256((__m256i*)&unitMotions.correctedPosX[i], correctedPosX);
+		_mm256_store_si256((__m256i*)&unitMotions.correctedPosY[i], correctedPosY);
+		_mm256_store_si256((__m256i*)&unitMotions.dtLastPosChange[i], dtLastPosChange);
+	}
+
+	_mm256_zeroupper();
+}
+
+_Use_decl_annotations_
+void SimdAvx2::SamplePalettedTexels(
+	const int32_t* __restrict s,
+	const int32_t* __restrict t,
+	uint32_t count,
+	const uint8_t* __restrict texels,
+	Size textureSize,
+	const uint32_t* __restrict palette,
+	uint32_t* __restrict indices,
+	uint32_t* __restrict colors)
+{
+	/* The same as SimdSse2::SamplePalettedTexels, eight texels at a time with gathers. A texel is
+	   gathered as the aligned 32-bit word that holds it, so no load goes past the end of the
+	   texture, and the tail is done with masked loads and stores. */
+	assert(((textureSize.width * textureSize.height) & 3) == 0);
+
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i minusOne = _mm256_set1_epi32(-1);
+	const __m256i width8 = _mm256_set1_epi32(textureSize.width);
+	const __m256i height8 = _mm256_set1_epi32(textureSize.height);
+	const __m256i laneIndices = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	for (uint32_t i = 0; i < count; i += 8)
+	{
+		const __m256i isLaneUsed = _mm256_cmpgt_epi32(_mm256_set1_epi32((int32_t)(count - i)), laneIndices);
+		const __m256i s8 = _mm256_maskload_epi32(&s[i], isLaneUsed);
+		const __m256i t8 = _mm256_maskload_epi32(&t[i], isLaneUsed);
+
+		const __m256i isInside = _mm256_and_si256(
+			_mm256_and_si256(isLaneUsed, _mm256_and_si256(_mm256_cmpgt_epi32(s8, minusOne), _mm256_cmpgt_epi32(width8, s8))),
+			_mm256_and_si256(_mm256_cmpgt_epi32(t8, minusOne), _mm256_cmpgt_epi32(height8, t8)));
+
+		const __m256i offsets = _mm256_add_epi32(_mm256_mullo_epi32(t8, width8), s8);
+		const __m256i words = _mm256_mask_i32gather_epi32(zero, (const int32_t*)texels, _mm256_srli_epi32(offsets, 2), isInside, 4);
+		const __m256i index8 = _mm256_and_si256(
+			_mm256_srlv_epi32(words, _mm256_slli_epi32(_mm256_and_si256(offsets, _mm256_set1_epi32(3)), 3)),
+			_mm256_set1_epi32(0xFF));
+		const __m256i color8 = _mm256_i32gather_epi32((const int32_t*)palette, index8, 4);
+
+		_mm256_maskstore_epi32((int32_t*)&indices[i], isLaneUsed, index8);
+		_mm256_maskstore_epi32((int32_t*)&colors[i], isLaneUsed, color8);
+	}
+
+	_mm256_zeroupper();
+}
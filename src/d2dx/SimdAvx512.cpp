@@ -0,0 +1,375 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "SimdAvx2.h"
+#include "SimdAvx512.h"
+
+using namespace d2dx;
+using namespace std;
+
+/* Note: as with SimdAvx2.cpp, only the intrinsics in this file use AVX-512. */
+
+bool SimdAvx512::IsSupported()
+{
+	if (!SimdAvx2::IsSupported())
+	{
+		return false;
+	}
+
+	/* AVX-512F and AVX-512BW, and the OS must also save the opmask and ZMM state (XCR0 bits 5-7). */
+	int32_t cpuInfo[4];
+	__cpuidex(cpuInfo, 7, 0);
+	const uint32_t avx512FAndBW = (1U << 16) | (1U << 30);
+
+	return ((uint32_t)cpuInfo[1] & avx512FAndBW) == avx512FAndBW &&
+		(_xgetbv(0) & 0xE6) == 0xE6;
+}
+
+_Use_decl_annotations_
+int32_t SimdAvx512::IndexOfUInt32(
+	const uint32_t* __restrict items,
+	uint32_t itemsCount,
+	uint32_t item)
+{
+	assert(items && ((uintptr_t)items & 63) == 0);
+	assert(!(itemsCount & 0x3F));
+
+	const __m512i key16 = _mm512_set1_epi32(item);
+	int32_t findIndex = -1;
+
+	for (uint32_t i = 0; i < itemsCount; i += 64)
+	{
+		const uint32_t res0 = _mm512_cmpeq_epi32_mask(key16, _mm512_load_si512(&items[i + 0]));
+		const uint32_t res1 = _mm512_cmpeq_epi32_mask(key16, _mm512_load_si512(&items[i + 16]));
+		const uint32_t res2 = _mm512_cmpeq_epi32_mask(key16, _mm512_load_si512(&items[i + 32]));
+		const uint32_t res3 = _mm512_cmpeq_epi32_mask(key16, _mm512_load_si512(&items[i + 48]));
+
+		const uint32_t resLo = res0 | (res1 << 16);
+		const uint32_t resHi = res2 | (res3 << 16);
+
+		DWORD bitIndex = 0;
+		if (BitScanForward(&bitIndex, resLo))
+		{
+			findIndex = (int32_t)(i + bitIndex);
+			break;
+		}
+		else if (BitScanForward(&bitIndex, resHi))
+		{
+			findIndex = (int32_t)(i + 32 + bitIndex);
+			break;
+		}
+	}
+
+	_mm256_zeroupper();
+
+	assert(findIndex < 0 || items[findIndex] == item);
+	return findIndex;
+}
+
+_Use_decl_annotations_
+bool SimdAvx512::EqualUInt8(
+	const uint8_t* __restrict itemsA,
+	const uint8_t* __restrict itemsB,
+	uint32_t itemsCount)
+{
+	bool isEqual = true;
+
+	for (uint32_t i = 0; i < itemsCount; i += 64)
+	{
+		/* Masked loads handle the tail without touching memory past the end. */
+		const uint32_t count = min(64U, itemsCount - i);
+		const __mmask64 loadMask = count == 64 ? ~0ULL : (1ULL << count) - 1;
+		const __m512i a = _mm512_maskz_loadu_epi8(loadMask, &itemsA[i]);
+		const __m512i b = _mm512_maskz_loadu_epi8(loadMask, &itemsB[i]);
+
+		if (_mm512_cmpneq_epu8_mask(a, b) != 0)
+		{
+			isEqual = false;
+			break;
+		}
+	}
+
+	_mm256_zeroupper();
+
+	return isEqual;
+}
+
+_Use_decl_annotations_
+void SimdAvx512::MinMaxUInt8(
+	const uint8_t* __restrict items,
+	uint32_t itemsCount,
+	uint8_t& minItem,
+	uint8_t& maxItem)
+{
+	__m512i min64 = _mm512_set1_epi8((char)0xFF);
+	__m512i max64 = _mm512_setzero_si512();
+
+	for (uint32_t i = 0; i < itemsCount; i += 64)
+	{
+		/* Masked-off lanes keep the neutral value of each reduction. */
+		const uint32_t count = min(64U, itemsCount - i);
+		const __mmask64 loadMask = count == 64 ? ~0ULL : (1ULL << count) - 1;
+		min64 = _mm512_min_epu8(min64, _mm512_mask_loadu_epi8(_mm512_set1_epi8((char)0xFF), loadMask, &items[i]));
+		max64 = _mm512_max_epu8(max64, _mm512_maskz_loadu_epi8(loadMask, &items[i]));
+	}
+
+	/* Horizontal reduction; the result ends up in the lowest byte. */
+	const __m256i min32 = _mm256_min_epu8(_mm512_castsi512_si256(min64), _mm512_extracti64x4_epi64(min64, 1));
+	const __m256i max32 = _mm256_max_epu8(_mm512_castsi512_si256(max64), _mm512_extracti64x4_epi64(max64, 1));
+	__m128i min16 = _mm_min_epu8(_mm256_castsi256_si128(min32), _mm256_extracti128_si256(min32, 1));
+	__m128i max16 = _mm_max_epu8(_mm256_castsi256_si128(max32), _mm256_extracti128_si256(max32, 1));
+	_mm256_zeroupper();
+
+	min16 = _mm_min_epu8(min16, _mm_srli_si128(min16, 8));
+	max16 = _mm_max_epu8(max16, _mm_srli_si128(max16, 8));
+	min16 = _mm_min_epu8(min16, _mm_srli_si128(min16, 4));
+	max16 = _mm_max_epu8(max16, _mm_srli_si128(max16, 4));
+	min16 = _mm_min_epu8(min16, _mm_srli_si128(min16, 2));
+	max16 = _mm_max_epu8(max16, _mm_srli_si128(max16, 2));
+	min16 = _mm_min_epu8(min16, _mm_srli_si128(min16, 1));
+	max16 = _mm_max_epu8(max16, _mm_srli_si128(max16, 1));
+
+	minItem = (uint8_t)_mm_cvtsi128_si32(min16);
+	maxItem = (uint8_t)_mm_cvtsi128_si32(max16);
+}
+
+_Use_decl_annotations_
+void SimdAvx512::FillMaskedUInt32(
+	uint32_t* __restrict items,
+	const uint8_t* __restrict mask,
+	uint32_t itemsCount,
+	uint32_t value)
+{
+	const __m512i value16 = _mm512_set1_epi32(value);
+
+	for (uint32_t i = 0; i < itemsCount; i += 16)
+	{
+		const uint32_t count = min(16U, itemsCount - i);
+		const __mmask64 loadMask = (1ULL << count) - 1;
+		const __m512i maskItems = _mm512_cvtepu8_epi32(_mm512_castsi512_si128(_mm512_maskz_loadu_epi8(loadMask, &mask[i])));
+		const __mmask16 storeMask = _mm512_test_epi32_mask(maskItems, maskItems);
+		_mm512_mask_storeu_epi32(&items[i], storeMask, value16);
+	}
+
+	_mm256_zeroupper();
+}
+
+_Use_decl_annotations_
+void SimdAvx512::ConvertVertices(
+	const D2::Vertex* const* __restrict d2Vertices,
+	uint32_t count,
+	const Vertex& templateVertex,
+	int32_t stShift,
+	int32_t texcoordOffsetS,
+	int32_t texcoordOffsetT,
+	uint32_t iteratedColorMask,
+	uint32_t maskedConstantColor,
+	Vertex* __restrict vertices)
+{
+	/* The same as SimdSse2::ConvertVertices, with one vertex in each 128-bit lane. */
+	const __m128i shift = _mm_cvtsi32_si128(stShift);
+	const __m512i texcoordOffset = _mm512_broadcast_i32x4(_mm_set_epi32(texcoordOffsetT, texcoordOffsetS, 0, 0));
+	const __m512i colorMask = _mm512_broadcast_i32x4(_mm_set_epi32(0, iteratedColorMask, 0, 0));
+	const __m512i constantColor = _mm512_broadcast_i32x4(_mm_set_epi32(0, maskedConstantColor, 0, 0));
+	const __m512i templateBits = _mm512_broadcast_i32x4(
+		_mm_and_si128(_mm_loadu_si128((const __m128i*)&templateVertex), _mm_set_epi32(-1, 0, 0x7E00FE00, 0)));
+
+	for (uint32_t i = 0; i < count; i += 4)
+	{
+		/* Lanes past the end repeat the last vertex and are masked off when storing. */
+		const uint32_t vertexCount = min(4U, count - i);
+		const D2::Vertex* d2Vertex0 = d2Vertices[i];
+		const D2::Vertex* d2Vertex1 = d2Vertices[i + min(1U, vertexCount - 1)];
+		const D2::Vertex* d2Vertex2 = d2Vertices[i + min(2U, vertexCount - 1)];
+		const D2::Vertex* d2Vertex3 = d2Vertices[i + vertexCount - 1];
+
+		__m512i xyColor = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i*)&d2Vertex0->x));
+		xyColor = _mm512_inserti32x4(xyColor, _mm_loadu_si128((const __m128i*)&d2Vertex1->x), 1);
+		xyColor = _mm512_inserti32x4(xyColor, _mm_loadu_si128((const __m128i*)&d2Vertex2->x), 2);
+		xyColor = _mm512_inserti32x4(xyColor, _mm_loadu_si128((const __m128i*)&d2Vertex3->x), 3);
+
+		__m512i st = _mm512_castsi128_si512(_mm_loadl_epi64((const __m128i*)&d2Vertex0->s));
+		st = _mm512_inserti32x4(st, _mm_loadl_epi64((const __m128i*)&d2Vertex1->s), 1);
+		st = _mm512_inserti32x4(st, _mm_loadl_epi64((const __m128i*)&d2Vertex2->s), 2);
+		st = _mm512_inserti32x4(st, _mm_loadl_epi64((const __m128i*)&d2Vertex3->s), 3);
+
+		const __m512i xyst = _mm512_cvttps_epi32(_mm512_castsi512_ps(_mm512_unpacklo_epi64(xyColor, st)));
+		const __m512i xystShifted = _mm512_add_epi32(_mm512_unpacklo_epi64(xyst, _mm512_bsrli_epi128(_mm512_sra_epi32(xyst, shift), 8)), texcoordOffset);
+		const __m512i color = _mm512_bsrli_epi128(_mm512_or_si512(_mm512_and_si512(xyColor, colorMask), constantColor), 8);
+
+		const __m512i vertex = _mm512_or_si512(_mm512_unpacklo_epi64(_mm512_packs_epi32(xystShifted, xystShifted), color), templateBits);
+		_mm512_mask_storeu_epi32(&vertices[i], (__mmask16)((1U << (vertexCount * 4)) - 1), vertex);
+	}
+
+	_mm256_zeroupper();
+}
+
+/* As in SimdSse2.cpp: (int32_t)(((int64_t)a * ka + (int64_t)b * kb) >> 16) per lane, for
+   0 <= ka, kb < 2^31. */
+static inline __m512i MulAddShr16(
+	__m512i a,
+	__m512i ka,
+	__m512i b,
+	__m512i kb)
+{
+	const __m512i productsEven = _mm512_add_epi64(_mm512_mul_epi32(a, ka), _mm512_mul_epi32(b, kb));
+	const __m512i productsOdd = _mm512_add_epi64(
+		_mm512_mul_epi32(_mm512_srli_epi64(a, 32), _mm512_srli_epi64(ka, 32)),
+		_mm512_mul_epi32(_mm512_srli_epi64(b, 32), _mm512_srli_epi64(kb, 32)));
+
+	return _mm512_mask_blend_epi32(0xAAAA, _mm512_srli_epi64(productsEven, 16), _mm512_slli_epi64(_mm512_srli_epi64(productsOdd, 16), 32));
+}
+
+_Use_decl_annotations_
+void SimdAvx512::UpdateUnitMotions(
+	const UnitMotions& unitMotions,
+	uint32_t count,
+	int32_t dt)
+{
+	/* The same as SimdSse2::UpdateUnitMotions, sixteen units at a time and with mask registers. */
+	assert(dt >= 0 && dt <= 65536);
+
+	const __m512i zero = _mm512_setzero_si512();
+	const __m512i dt16 = _mm512_set1_epi32(dt);
+	const __m512i maxTileDistance = _mm512_set1_epi32(2);
+	const __m512i velocityInterval = _mm512_set1_epi32(65536 / 25);
+	const __m512i one = _mm512_set1_epi32(1);
+	const __m512i correctionAmount = _mm512_set1_epi32(7000);
+	const __m512i oneMinusCorrectionAmount = _mm512_set1_epi32(65536 - 7000);
+
+	for (uint32_t i = 0; i < count; i += 16)
+	{
+		const __m512i posX = _mm512_load_si512(&unitMotions.posX[i]);
+		const __m512i posY = _mm512_load_si512(&unitMotions.posY[i]);
+		__m512i lastPosX = _mm512_load_si512(&unitMotions.lastPosX[i]);
+		__m512i lastPosY = _mm512_load_si512(&unitMotions.lastPosY[i]);
+		__m512i velocityX = _mm512_load_si512(&unitMotions.velocityX[i]);
+		__m512i velocityY = _mm512_load_si512(&unitMotions.velocityY[i]);
+		__m512i predictedPosX = _mm512_load_si512(&unitMotions.predictedPosX[i]);
+		__m512i predictedPosY = _mm512_load_si512(&unitMotions.predictedPosY[i]);
+		__m512i correctedPosX = _mm512_load_si512(&unitMotions.correctedPosX[i]);
+		__m512i correctedPosY = _mm512_load_si512(&unitMotions.correctedPosY[i]);
+		__m512i dtLastPosChange = _mm512_load_si512(&unitMotions.dtLastPosChange[i]);
+
+		const __m512i posWholeX = _mm512_srai_epi32(posX, 16);
+		const __m512i posWholeY = _mm512_srai_epi32(posY, 16);
+
+		const __mmask16 isFar =
+			_mm512_cmpgt_epi32_mask(_mm512_abs_epi32(_mm512_sub_epi32(posWholeX, _mm512_srai_epi32(lastPosX, 16))), maxTileDistance) |
+			_mm512_cmpgt_epi32_mask(_mm512_abs_epi32(_mm512_sub_epi32(posWholeY, _mm512_srai_epi32(lastPosY, 16))), maxTileDistance) |
+			_mm512_cmpgt_epi32_mask(_mm512_abs_epi32(_mm512_sub_epi32(posWholeX, _mm512_srai_epi32(predictedPosX, 16))), maxTileDistance) |
+			_mm512_cmpgt_epi32_mask(_mm512_abs_epi32(_mm512_sub_epi32(posWholeY, _mm512_srai_epi32(predictedPosY, 16))), maxTileDistance);
+
+		lastPosX = _mm512_mask_mov_epi32(lastPosX, isFar, posX);
+		lastPosY = _mm512_mask_mov_epi32(lastPosY, isFar, posY);
+		predictedPosX = _mm512_mask_mov_epi32(predictedPosX, isFar, posX);
+		predictedPosY = _mm512_mask_mov_epi32(predictedPosY, isFar, posY);
+		correctedPosX = _mm512_mask_mov_epi32(correctedPosX, isFar, posX);
+		correctedPosY = _mm512_mask_mov_epi32(correctedPosY, isFar, posY);
+		velocityX = _mm512_mask_mov_epi32(velocityX, isFar, zero);
+		velocityY = _mm512_mask_mov_epi32(velocityY, isFar, zero);
+
+		const __m512i dx = _mm512_sub_epi32(posX, lastPosX);
+		const __m512i dy = _mm512_sub_epi32(posY, lastPosY);
+		dtLastPosChange = _mm512_add_epi32(dtLastPosChange, dt16);
+
+		const __mmask16 isPosChanged =
+			_mm512_test_epi32_mask(dx, dx) |
+			_mm512_test_epi32_mask(dy, dy) |
+			_mm512_cmpge_epi32_mask(dtLastPosChange, velocityInterval);
+
+		const __m512i halfwayX = _mm512_add_epi32(_mm512_add_epi32(_mm512_srai_epi32(posX, 1), _mm512_srai_epi32(lastPosX, 1)), _mm512_and_si512(_mm512_and_si512(posX, lastPosX), one));
+		const __m512i halfwayY = _mm512_add_epi32(_mm512_add_epi32(_mm512_srai_epi32(posY, 1), _mm512_srai_epi32(lastPosY, 1)), _mm512_and_si512(_mm512_and_si512(posY, lastPosY), one));
+
+		correctedPosX = _mm512_mask_mov_epi32(correctedPosX, isPosChanged, halfwayX);
+		correctedPosY = _mm512_mask_mov_epi32(correctedPosY, isPosChanged, halfwayY);
+		velocityX = _mm512_mask_mullo_epi32(velocityX, isPosChanged, dx, _mm512_set1_epi32(25));
+		velocityY = _mm512_mask_mullo_epi32(velocityY, isPosChanged, dy, _mm512_set1_epi32(25));
+		lastPosX = _mm512_mask_mov_epi32(lastPosX, isPosChanged, posX);
+		lastPosY = _mm512_mask_mov_epi32(lastPosY, isPosChanged, posY);
+		dtLastPosChange = _mm512_mask_mov_epi32(dtLastPosChange, isPosChanged, zero);
+
+		const __mmask16 isMoving =
+			_mm512_test_epi32_mask(velocityX, velocityX) | _mm512_test_epi32_mask(velocityY, velocityY);
+		const __mmask16 isPredicting = isMoving & _mm512_cmplt_epi32_mask(dtLastPosChange, velocityInterval);
+
+		const __m512i stepX = MulAddShr16(velocityX, dt16, zero, zero);
+		const __m512i stepY = MulAddShr16(velocityY, dt16, zero, zero);
+
+		predictedPosX = _mm512_mask_add_epi32(predictedPosX, isPredicting, MulAddShr16(predictedPosX, oneMinusCorrectionAmount, correctedPosX, correctionAmount), stepX);
+		predictedPosY = _mm512_mask_add_epi32(predictedPosY, isPredicting, MulAddShr16(predictedPosY, oneMinusCorrectionAmount, correctedPosY, correctionAmount), stepY);
+		correctedPosX = _mm512_mask_add_epi32(correctedPosX, isPredicting, correctedPosX, stepX);
+		correctedPosY = _mm512_mask_add_epi32(correctedPosY, isPredicting, correctedPosY, stepY);
+
+		_mm512_store_si512(&unitMotions.lastPosX[i], lastPosX);
+		_mm512_store_si512(&unitMotions.lastPosY[i], lastPosY);
+		_mm512_store_si512(&unitMotions.velocityX[i], velocityX);
+		_mm512_store_si512(&unitMotions.velocityY[i], velocityY);
+		_mm512_store_si512(&unitMotions.predictedPosX[i], predictedPosX);
+		_mm512_store_si512(&unitMotions.predictedPosY[i], predictedPosY);
+		_mm512_store_si512(&unitMotions.correctedPosX[i], correctedPosX);
+		_mm512_store_si512(&unitMotions.correctedPosY[i], correctedPosY);
+		_mm512_store_si512(&unitMotions.dtLastPosChange[i], dtLastPosChange);
+	}
+
+	_mm256_zeroupper();
+}
+
+_Use_decl_annotations_
+void SimdAvx512::SamplePalettedTexels(
+	const int32_t* __restrict s,
+	const int32_t* __restrict t,
+	uint32_t count,
+	const uint8_t* __restrict texels,
+	Size textureSize,
+	const uint32_t* __restrict palette,
+	uint32_t* __restrict indices,
+	uint32_t* __restrict colors)
+{
+	/* The same as SimdAvx2::SamplePalettedTexels, sixteen texels at a time. */
+	assert(((textureSize.width * textureSize.height) & 3) == 0);
+
+	const __m512i zero = _mm512_setzero_si512();
+	const __m512i width16 = _mm512_set1_epi32(textureSize.width);
+	const __m512i height16 = _mm512_set1_epi32(textureSize.height);
+
+	for (uint32_t i = 0; i < count; i += 16)
+	{
+		const __mmask16 isLaneUsed = count - i >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1U << (count - i)) - 1);
+		const __m512i s16 = _mm512_maskz_loadu_epi32(isLaneUsed, &s[i]);
+		const __m512i t16 = _mm512_maskz_loadu_epi32(isLaneUsed, &t[i]);
+
+		/* Unsigned compares also reject negative texcoords. */
+		const __mmask16 isInside = isLaneUsed &
+			_mm512_cmplt_epu32_mask(s16, width16) &
+			_mm512_cmplt_epu32_mask(t16, height16);
+
+		const __m512i offsets = _mm512_add_epi32(_mm512_mullo_epi32(t16, width16), s16);
+		const __m512i words = _mm512_mask_i32gather_epi32(zero, isInside, _mm512_srli_epi32(offsets, 2), texels, 4);
+		const __m512i index16 = _mm512_and_si512(
+			_mm512_srlv_epi32(words, _mm512_slli_epi32(_mm512_and_si512(offsets, _mm512_set1_epi32(3)), 3)),
+			_mm512_set1_epi32(0xFF));
+		const __m512i color16 = _mm512_i32gather_epi32(index16, palette, 4);
+
+		_mm512_mask_storeu_epi32(&indices[i], isLaneUsed, index16);
+		_mm512_mask_storeu_epi32(&colors[i], isLaneUsed, color16);
+	}
+
+	_mm256_zeroupper();
+}
@@ -0,0 +1,81 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "ISimd.h"
+
+namespace d2dx
+{
+	class SimdAvx512 final : public ISimd
+	{
+	public:
+		virtual ~SimdAvx512() noexcept {}
+
+		/* True if both the CPU and the OS support AVX-512F and AVX-512BW. */
+		static bool IsSupported();
+
+		virtual int32_t IndexOfUInt32(
+			_In_reads_(itemsCount) const uint32_t* __restrict items,
+			_In_ uint32_t itemsCount,
+			_In_ uint32_t item) override;
+
+		virtual bool EqualUInt8(
+			_In_reads_(itemsCount) const uint8_t* __restrict itemsA,
+			_In_reads_(itemsCount) const uint8_t* __restrict itemsB,
+			_In_ uint32_t itemsCount) override;
+
+		virtual void MinMaxUInt8(
+			_In_reads_(itemsCount) const uint8_t* __restrict items,
+			_In_ uint32_t itemsCount,
+			_Out_ uint8_t& minItem,
+			_Out_ uint8_t& maxItem) override;
+
+		virtual void FillMaskedUInt32(
+			_Inout_updates_all_(itemsCount) uint32_t* __restrict items,
+			_In_reads_(itemsCount) const uint8_t* __restrict mask,
+			_In_ uint32_t itemsCount,
+			_In_ uint32_t value) override;
+
+		virtual void ConvertVertices(
+			_In_reads_(count) const D2::Vertex* const* __restrict d2Vertices,
+			_In_ uint32_t count,
+			_In_ const Vertex& templateVertex,
+			_In_ int32_t stShift,
+			_In_ int32_t texcoordOffsetS,
+			_In_ int32_t texcoordOffsetT,
+			_In_ uint32_t iteratedColorMask,
+			_In_ uint32_t maskedConstantColor,
+			_Out_writes_(count) Vertex* __restrict vertices) override;
+
+		virtual void UpdateUnitMotions(
+			_In_ const UnitMotions& unitMotions,
+			_In_ uint32_t count,
+			_In_ int32_t dt) override;
+
+		virtual void SamplePalettedTexels(
+			_In_reads_(count) const int32_t* __restrict s,
+			_In_reads_(count) const int32_t* __restrict t,
+			_In_ uint32_t count,
+			_In_reads_(textureSize.width * textureSize.height) const uint8_t* __restrict texels,
+			_In_ Size textureSize,
+			_In_reads_(256) const uint32_t* __restrict palette,
+			_Out_writes_(count) uint32_t* __restrict indices,
+			_Out_writes_(count) uint32_t* __restrict colors) override;
+	};
+}
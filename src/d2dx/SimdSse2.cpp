@@ -117,3 +117,336 @@ int32_t SimdSse2::IndexOfUInt32(
 
 	return -1;
 }
+
+_Use_decl_annotations_
+bool SimdSse2::EqualUInt8(
+	const uint8_t* __restrict itemsA,
+	const uint8_t* __restrict itemsB,
+	uint32_t itemsCount)
+{
+	uint32_t i = 0;
+
+	for (; (i + 16) <= itemsCount; i += 16)
+	{
+		const __m128i a = _mm_loadu_si128((const __m128i*)&itemsA[i]);
+		const __m128i b = _mm_loadu_si128((const __m128i*)&itemsB[i]);
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) != 0xFFFF)
+		{
+			return false;
+		}
+	}
+
+	for (; i < itemsCount; ++i)
+	{
+		if (itemsA[i] != itemsB[i])
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+_Use_decl_annotations_
+void SimdSse2::MinMaxUInt8(
+	const uint8_t* __restrict items,
+	uint32_t itemsCount,
+	uint8_t& minItem,
+	uint8_t& maxItem)
+{
+	__m128i min16 = _mm_set1_epi8((char)0xFF);
+	__m128i max16 = _mm_setzero_si128();
+	uint32_t i = 0;
+
+	for (; (i + 16) <= itemsCount; i += 16)
+	{
+		const __m128i v = _mm_loadu_si128((const __m128i*)&items[i]);
+		min16 = _mm_min_epu8(min16, v);
+		max16 = _mm_max_epu8(max16, v);
+	}
+
+	/* Horizontal reduction; the result ends up in the lowest byte. */
+	min16 = _mm_min_epu8(min16, _mm_srli_si128(min16, 8));
+	max16 = _mm_max_epu8(max16, _mm_srli_si128(max16, 8));
+	min16 = _mm_min_epu8(min16, _mm_srli_si128(min16, 4));
+	max16 = _mm_max_epu8(max16, _mm_srli_si128(max16, 4));
+	min16 = _mm_min_epu8(min16, _mm_srli_si128(min16, 2));
+	max16 = _mm_max_epu8(max16, _mm_srli_si128(max16, 2));
+	min16 = _mm_min_epu8(min16, _mm_srli_si128(min16, 1));
+	max16 = _mm_max_epu8(max16, _mm_srli_si128(max16, 1));
+
+	uint8_t minValue = (uint8_t)_mm_cvtsi128_si32(min16);
+	uint8_t maxValue = (uint8_t)_mm_cvtsi128_si32(max16);
+
+	for (; i < itemsCount; ++i)
+	{
+		minValue = min(minValue, items[i]);
+		maxValue = max(maxValue, items[i]);
+	}
+
+	minItem = minValue;
+	maxItem = maxValue;
+}
+
+_Use_decl_annotations_
+void SimdSse2::FillMaskedUInt32(
+	uint32_t* __restrict items,
+	const uint8_t* __restrict mask,
+	uint32_t itemsCount,
+	uint32_t value)
+{
+	const __m128i value4 = _mm_set1_epi32(value);
+	const __m128i zero = _mm_setzero_si128();
+	uint32_t i = 0;
+
+	for (; (i + 4) <= itemsCount; i += 4)
+	{
+		int32_t maskBytes;
+		memcpy(&maskBytes, &mask[i], sizeof(maskBytes));
+
+		/* Widen the four mask bytes to four 32-bit lanes that are all ones where the byte was set. */
+		__m128i mask4 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(maskBytes), zero), zero);
+		mask4 = _mm_andnot_si128(_mm_cmpeq_epi32(mask4, zero), _mm_set1_epi32(-1));
+
+		const __m128i old4 = _mm_loadu_si128((const __m128i*)&items[i]);
+		_mm_storeu_si128((__m128i*)&items[i], _mm_or_si128(_mm_and_si128(mask4, value4), _mm_andnot_si128(mask4, old4)));
+	}
+
+	for (; i < itemsCount; ++i)
+	{
+		if (mask[i])
+		{
+			items[i] = value;
+		}
+	}
+}
+
+_Use_decl_annotations_
+void SimdSse2::ConvertVertices(
+	const D2::Vertex* const* __restrict d2Vertices,
+	uint32_t count,
+	const Vertex& templateVertex,
+	int32_t stShift,
+	int32_t texcoordOffsetS,
+	int32_t texcoordOffsetT,
+	uint32_t iteratedColorMask,
+	uint32_t maskedConstantColor,
+	Vertex* __restrict vertices)
+{
+	/* A game vertex starts with x, y, color and padding, followed by s and t. A Vertex is x|y, s|t,
+	   color and the misc fields, which (with the texture selector and texcoord clamp in the top bits
+	   of s and t) come from the template. */
+	const __m128i shift = _mm_cvtsi32_si128(stShift);
+	const __m128i texcoordOffset = _mm_set_epi32(texcoordOffsetT, texcoordOffsetS, 0, 0);
+	const __m128i colorMask = _mm_set_epi32(0, iteratedColorMask, 0, 0);
+	const __m128i constantColor = _mm_set_epi32(0, maskedConstantColor, 0, 0);
+	const __m128i templateBits = _mm_and_si128(_mm_loadu_si128((const __m128i*)&templateVertex), _mm_set_epi32(-1, 0, 0x7E00FE00, 0));
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const __m128i xyColor = _mm_loadu_si128((const __m128i*)&d2Vertices[i]->x);
+		const __m128i st = _mm_loadl_epi64((const __m128i*)&d2Vertices[i]->s);
+
+		const __m128i xyst = _mm_cvttps_epi32(_mm_castsi128_ps(_mm_unpacklo_epi64(xyColor, st)));
+		const __m128i xystShifted = _mm_add_epi32(_mm_unpacklo_epi64(xyst, _mm_srli_si128(_mm_sra_epi32(xyst, shift), 8)), texcoordOffset);
+		const __m128i color = _mm_srli_si128(_mm_or_si128(_mm_and_si128(xyColor, colorMask), constantColor), 8);
+
+		const __m128i vertex = _mm_or_si128(_mm_unpacklo_epi64(_mm_packs_epi32(xystShifted, xystShifted), color), templateBits);
+		_mm_storeu_si128((__m128i*)&vertices[i], vertex);
+	}
+}
+
+/* (int32_t)(((int64_t)a * ka + (int64_t)b * kb) >> 16) per lane, for 0 <= ka, kb < 2^31. SSE2 only
+   has an unsigned 32x32->64 bit multiply; a negative a or b adds k * 2^32 too much to the product,
+   which is k * 2^16 after the shift. */
+static inline __m128i MulAddShr16(
+	__m128i a,
+	__m128i ka,
+	__m128i b,
+	__m128i kb)
+{
+	const __m128i productsEven = _mm_add_epi64(_mm_mul_epu32(a, ka), _mm_mul_epu32(b, kb));
+	const __m128i productsOdd = _mm_add_epi64(
+		_mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(ka, 32)),
+		_mm_mul_epu32(_mm_srli_epi64(b, 32), _mm_srli_epi64(kb, 32)));
+
+	const __m128i shifted = _mm_or_si128(
+		_mm_and_si128(_mm_srli_epi64(productsEven, 16), _mm_set_epi32(0, -1, 0, -1)),
+		_mm_slli_epi64(_mm_srli_epi64(productsOdd, 16), 32));
+
+	const __m128i correction = _mm_add_epi32(
+		_mm_and_si128(_mm_srai_epi32(a, 31), _mm_slli_epi32(ka, 16)),
+		_mm_and_si128(_mm_srai_epi32(b, 31), _mm_slli_epi32(kb, 16)));
+
+	return _mm_sub_epi32(shifted, correction);
+}
+
+static inline __m128i Select(
+	__m128i mask,
+	__m128i a,
+	__m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+_Use_decl_annotations_
+void SimdSse2::UpdateUnitMotions(
+	const UnitMotions& unitMotions,
+	uint32_t count,
+	int32_t dt)
+{
+	assert(dt >= 0 && dt <= 65536);
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i dt4 = _mm_set1_epi32(dt);
+	const __m128i maxTileDistance = _mm_set1_epi32(2);
+	const __m128i minTileDistance = _mm_set1_epi32(-2);
+	const __m128i velocityInterval = _mm_set1_epi32(65536 / 25);
+	const __m128i one = _mm_set1_epi32(1);
+
+	/* 7000/65536 of the way towards the corrected position per update. */
+	const __m128i correctionAmount = _mm_set1_epi32(7000);
+	const __m128i oneMinusCorrectionAmount = _mm_set1_epi32(65536 - 7000);
+
+	for (uint32_t i = 0; i < count; i += 4)
+	{
+		const __m128i posX = _mm_load_si128((const __m128i*)&unitMotions.posX[i]);
+		const __m128i posY = _mm_load_si128((const __m128i*)&unitMotions.posY[i]);
+		__m128i lastPosX = _mm_load_si128((const __m128i*)&unitMotions.lastPosX[i]);
+		__m128i lastPosY = _mm_load_si128((const __m128i*)&unitMotions.lastPosY[i]);
+		__m128i velocityX = _mm_load_si128((const __m128i*)&unitMotions.velocityX[i]);
+		__m128i velocityY = _mm_load_si128((const __m128i*)&unitMotions.velocityY[i]);
+		__m128i predictedPosX = _mm_load_si128((const __m128i*)&unitMotions.predictedPosX[i]);
+		__m128i predictedPosY = _mm_load_si128((const __m128i*)&unitMotions.predictedPosY[i]);
+		__m128i correctedPosX = _mm_load_si128((const __m128i*)&unitMotions.correctedPosX[i]);
+		__m128i correctedPosY = _mm_load_si128((const __m128i*)&unitMotions.correctedPosY[i]);
+		__m128i dtLastPosChange = _mm_load_si128((const __m128i*)&unitMotions.dtLastPosChange[i]);
+
+		/* Snap to the position if it is more than two whole tiles off. */
+		const __m128i posWholeX = _mm_srai_epi32(posX, 16);
+		const __m128i posWholeY = _mm_srai_epi32(posY, 16);
+		const __m128i lastPosDX = _mm_sub_epi32(posWholeX, _mm_srai_epi32(lastPosX, 16));
+		const __m128i lastPosDY = _mm_sub_epi32(posWholeY, _mm_srai_epi32(lastPosY, 16));
+		const __m128i predictedPosDX = _mm_sub_epi32(posWholeX, _mm_srai_epi32(predictedPosX, 16));
+		const __m128i predictedPosDY = _mm_sub_epi32(posWholeY, _mm_srai_epi32(predictedPosY, 16));
+
+		const __m128i isFar = _mm_or_si128(
+			_mm_or_si128(
+				_mm_or_si128(_mm_cmpgt_epi32(lastPosDX, maxTileDistance), _mm_cmplt_epi32(lastPosDX, minTileDistance)),
+				_mm_or_si128(_mm_cmpgt_epi32(lastPosDY, maxTileDistance), _mm_cmplt_epi32(lastPosDY, minTileDistance))),
+			_mm_or_si128(
+				_mm_or_si128(_mm_cmpgt_epi32(predictedPosDX, maxTileDistance), _mm_cmplt_epi32(predictedPosDX, minTileDistance)),
+				_mm_or_si128(_mm_cmpgt_epi32(predictedPosDY, maxTileDistance), _mm_cmplt_epi32(predictedPosDY, minTileDistance))));
+
+		lastPosX = Select(isFar, posX, lastPosX);
+		lastPosY = Select(isFar, posY, lastPosY);
+		predictedPosX = Select(isFar, posX, predictedPosX);
+		predictedPosY = Select(isFar, posY, predictedPosY);
+		correctedPosX = Select(isFar, posX, correctedPosX);
+		correctedPosY = Select(isFar, posY, correctedPosY);
+		velocityX = _mm_andnot_si128(isFar, velocityX);
+		velocityY = _mm_andnot_si128(isFar, velocityY);
+
+		/* Re-estimate the velocity when the position changes, or at the server's rate of 25 Hz. */
+		const __m128i dx = _mm_sub_epi32(posX, lastPosX);
+		const __m128i dy = _mm_sub_epi32(posY, lastPosY);
+		dtLastPosChange = _mm_add_epi32(dtLastPosChange, dt4);
+
+		const __m128i isPosChanged = _mm_andnot_si128(
+			_mm_and_si128(_mm_and_si128(_mm_cmpeq_epi32(dx, zero), _mm_cmpeq_epi32(dy, zero)), _mm_cmplt_epi32(dtLastPosChange, velocityInterval)),
+			_mm_set1_epi32(-1));
+
+		/* Halfway between the positions, rounding down as if added in 64 bits. */
+		const __m128i halfwayX = _mm_add_epi32(_mm_add_epi32(_mm_srai_epi32(posX, 1), _mm_srai_epi32(lastPosX, 1)), _mm_and_si128(_mm_and_si128(posX, lastPosX), one));
+		const __m128i halfwayY = _mm_add_epi32(_mm_add_epi32(_mm_srai_epi32(posY, 1), _mm_srai_epi32(lastPosY, 1)), _mm_and_si128(_mm_and_si128(posY, lastPosY), one));
+
+		correctedPosX = Select(isPosChanged, halfwayX, correctedPosX);
+		correctedPosY = Select(isPosChanged, halfwayY, correctedPosY);
+		velocityX = Select(isPosChanged, _mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(dx, 4), _mm_slli_epi32(dx, 3)), dx), velocityX);
+		velocityY = Select(isPosChanged, _mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(dy, 4), _mm_slli_epi32(dy, 3)), dy), velocityY);
+		lastPosX = Select(isPosChanged, posX, lastPosX);
+		lastPosY = Select(isPosChanged, posY, lastPosY);
+		dtLastPosChange = _mm_andnot_si128(isPosChanged, dtLastPosChange);
+
+		/* Ease towards the corrected position, and advance both by the velocity. */
+		const __m128i isMoving = _mm_andnot_si128(
+			_mm_cmpeq_epi32(_mm_or_si128(velocityX, velocityY), zero),
+			_mm_cmplt_epi32(dtLastPosChange, velocityInterval));
+
+		const __m128i stepX = MulAddShr16(velocityX, dt4, zero, zero);
+		const __m128i stepY = MulAddShr16(velocityY, dt4, zero, zero);
+
+		predictedPosX = Select(isMoving, _mm_add_epi32(MulAddShr16(predictedPosX, oneMinusCorrectionAmount, correctedPosX, correctionAmount), stepX), predictedPosX);
+		predictedPosY = Select(isMoving, _mm_add_epi32(MulAddShr16(predictedPosY, oneMinusCorrectionAmount, correctedPosY, correctionAmount), stepY), predictedPosY);
+		correctedPosX = Select(isMoving, _mm_add_epi32(correctedPosX, stepX), correctedPosX);
+		correctedPosY = Select(isMoving, _mm_add_epi32(correctedPosY, stepY), correctedPosY);
+
+		_mm_store_si128((__m128i*)&unitMotions.lastPosX[i], lastPosX);
+		_mm_store_si128((__m128i*)&unitMotions.lastPosY[i], lastPosY);
+		_mm_store_si128((__m128i*)&unitMotions.velocityX[i], velocityX);
+		_mm_store_si128((__m128i*)&unitMotions.velocityY[i], velocityY);
+		_mm_store_si128((__m128i*)&unitMotions.predictedPosX[i], predictedPosX);
+		_mm_store_si128((__m128i*)&unitMotions.predictedPosY[i], predictedPosY);
+		_mm_store_si128((__m128i*)&unitMotions.correctedPosX[i], correctedPosX);
+		_mm_store_si128((__m128i*)&unitMotions.correctedPosY[i], correctedPosY);
+		_mm_store_si128((__m128i*)&unitMotions.dtLastPosChange[i], dtLastPosChange);
+	}
+}
+
+/* _mm_mullo_epi32 is SSE4.1. */
+static inline __m128i MulLo(
+	__m128i a,
+	__m128i b)
+{
+	const __m128i productsEven = _mm_mul_epu32(a, b);
+	const __m128i productsOdd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(productsEven, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(productsOdd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+_Use_decl_annotations_
+void SimdSse2::SamplePalettedTexels(
+	const int32_t* __restrict s,
+	const int32_t* __restrict t,
+	uint32_t count,
+	const uint8_t* __restrict texels,
+	Size textureSize,
+	const uint32_t* __restrict palette,
+	uint32_t* __restrict indices,
+	uint32_t* __restrict colors)
+{
+	const __m128i minusOne = _mm_set1_epi32(-1);
+	const __m128i width4 = _mm_set1_epi32(textureSize.width);
+	const __m128i height4 = _mm_set1_epi32(textureSize.height);
+	alignas(16) int32_t offsets[4];
+	uint32_t i = 0;
+
+	/* SSE2 has no gather, so only the bounds checks and addressing are vectorized. Texcoords
+	   outside the texture get offset -1 and are not loaded. */
+	for (; (i + 4) <= count; i += 4)
+	{
+		const __m128i s4 = _mm_loadu_si128((const __m128i*)&s[i]);
+		const __m128i t4 = _mm_loadu_si128((const __m128i*)&t[i]);
+
+		const __m128i isInside = _mm_and_si128(
+			_mm_and_si128(_mm_cmpgt_epi32(s4, minusOne), _mm_cmplt_epi32(s4, width4)),
+			_mm_and_si128(_mm_cmpgt_epi32(t4, minusOne), _mm_cmplt_epi32(t4, height4)));
+
+		_mm_store_si128((__m128i*)offsets, Select(isInside, _mm_add_epi32(MulLo(t4, width4), s4), minusOne));
+
+		for (uint32_t j = 0; j < 4; ++j)
+		{
+			const uint32_t index = offsets[j] >= 0 ? texels[offsets[j]] : 0;
+			indices[i + j] = index;
+			colors[i + j] = palette[index];
+		}
+	}
+
+	for (; i < count; ++i)
+	{
+		const bool isInside = s[i] >= 0 && t[i] >= 0 && s[i] < textureSize.width && t[i] < textureSize.height;
+		const uint32_t index = isInside ? texels[t[i] * textureSize.width + s[i]] : 0;
+		indices[i] = index;
+		colors[i] = palette[index];
+	}
+}
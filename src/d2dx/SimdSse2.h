@@ -31,5 +31,48 @@ namespace d2dx
 			_In_reads_(itemsCount) const uint32_t* __restrict items,
 			_In_ uint32_t itemsCount,
 			_In_ uint32_t item) override;
+
+		virtual bool EqualUInt8(
+			_In_reads_(itemsCount) const uint8_t* __restrict itemsA,
+			_In_reads_(itemsCount) const uint8_t* __restrict itemsB,
+			_In_ uint32_t itemsCount) override;
+
+		virtual void MinMaxUInt8(
+			_In_reads_(itemsCount) const uint8_t* __restrict items,
+			_In_ uint32_t itemsCount,
+			_Out_ uint8_t& minItem,
+			_Out_ uint8_t& maxItem) override;
+
+		virtual void FillMaskedUInt32(
+			_Inout_updates_all_(itemsCount) uint32_t* __restrict items,
+			_In_reads_(itemsCount) const uint8_t* __restrict mask,
+			_In_ uint32_t itemsCount,
+			_In_ uint32_t value) override;
+
+		virtual void ConvertVertices(
+			_In_reads_(count) const D2::Vertex* const* __restrict d2Vertices,
+			_In_ uint32_t count,
+			_In_ const Vertex& templateVertex,
+			_In_ int32_t stShift,
+			_In_ int32_t texcoordOffsetS,
+			_In_ int32_t texcoordOffsetT,
+			_In_ uint32_t iteratedColorMask,
+			_In_ uint32_t maskedConstantColor,
+			_Out_writes_(count) Vertex* __restrict vertices) override;
+
+		virtual void UpdateUnitMotions(
+			_In_ const UnitMotions& unitMotions,
+			_In_ uint32_t count,
+			_In_ int32_t dt) override;
+
+		virtual void SamplePalettedTexels(
+			_In_reads_(count) const int32_t* __restrict s,
+			_In_reads_(count) const int32_t* __restrict t,
+			_In_ uint32_t count,
+			_In_reads_(textureSize.width * textureSize.height) const uint8_t* __restrict texels,
+			_In_ Size textureSize,
+			_In_reads_(256) const uint32_t* __restrict palette,
+			_Out_writes_(count) uint32_t* __restrict indices,
+			_Out_writes_(count) uint32_t* __restrict colors) override;
 	};
 }
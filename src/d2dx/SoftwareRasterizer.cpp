@@ -0,0 +1,589 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "SoftwareRasterizer.h"
+
+using namespace d2dx;
+using namespace std;
+
+namespace
+{
+	/* Twice the signed area of (a, b, p), with all coordinates in half-pixel units. */
+	inline int64_t EdgeFunction(
+		_In_ int64_t ax, _In_ int64_t ay,
+		_In_ int64_t bx, _In_ int64_t by,
+		_In_ int64_t px, _In_ int64_t py)
+	{
+		return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+	}
+
+	/* D3D11 top-left rule: pixels exactly on a top or left edge belong to the triangle. */
+	inline int64_t TopLeftBias(
+		_In_ int64_t ax, _In_ int64_t ay,
+		_In_ int64_t bx, _In_ int64_t by)
+	{
+		const int64_t dx = bx - ax;
+		const int64_t dy = by - ay;
+		const bool isTop = dy == 0 && dx > 0;
+		const bool isLeft = dy < 0;
+		return (isTop || isLeft) ? 0 : -1;
+	}
+
+	inline __m128 Interpolate(
+		_In_ __m128 l0,
+		_In_ __m128 l1,
+		_In_ __m128 l2,
+		_In_reads_(3) const float* values)
+	{
+		return _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(l0, _mm_set1_ps(values[0])), _mm_mul_ps(l1, _mm_set1_ps(values[1]))),
+			_mm_mul_ps(l2, _mm_set1_ps(values[2])));
+	}
+
+	inline void UnpackColors(
+		_In_ __m128i argb,
+		_Out_ __m128& r,
+		_Out_ __m128& g,
+		_Out_ __m128& b,
+		_Out_ __m128& a)
+	{
+		const __m128i mask = _mm_set1_epi32(0xFF);
+		const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+		r = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(argb, 16), mask)), scale);
+		g = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(argb, 8), mask)), scale);
+		b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(argb, mask)), scale);
+		a = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(argb, 24)), scale);
+	}
+
+	inline __m128i ToUnorm8(
+		_In_ __m128 value)
+	{
+		value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+	}
+
+	inline __m128i PackColors(
+		_In_ __m128 r,
+		_In_ __m128 g,
+		_In_ __m128 b,
+		_In_ __m128 a)
+	{
+		return _mm_or_si128(
+			_mm_or_si128(_mm_slli_epi32(ToUnorm8(a), 24), _mm_slli_epi32(ToUnorm8(r), 16)),
+			_mm_or_si128(_mm_slli_epi32(ToUnorm8(g), 8), ToUnorm8(b)));
+	}
+
+	/* Used for triangles without a palette, which sample black. */
+	const uint32_t blackPalette[256] = { };
+}
+
+_Use_decl_annotations_
+SoftwareRasterizer::SoftwareRasterizer(
+	const std::shared_ptr<ISimd>& simd,
+	uint32_t threadCount) :
+	_simd{ simd }
+{
+	if (threadCount == 0)
+	{
+		threadCount = max(1U, std::thread::hardware_concurrency());
+	}
+
+	for (uint32_t i = 1; i < threadCount; ++i)
+	{
+		_workers.emplace_back(&SoftwareRasterizer::WorkerMain, this);
+	}
+}
+
+SoftwareRasterizer::~SoftwareRasterizer() noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_isStopping = true;
+	}
+
+	_workAvailable.notify_all();
+
+	for (auto& worker : _workers)
+	{
+		worker.join();
+	}
+}
+
+_Use_decl_annotations_
+void SoftwareRasterizer::SetTargetSize(
+	Size targetSize)
+{
+	_targetSize = targetSize;
+	_tileCountX = (targetSize.width + D2DX_SOFTWARE_TILE_SIZE - 1) / D2DX_SOFTWARE_TILE_SIZE;
+	_tileCountY = (targetSize.height + D2DX_SOFTWARE_TILE_SIZE - 1) / D2DX_SOFTWARE_TILE_SIZE;
+	_triangles.clear();
+	_tileBins.clear();
+	_tileBins.resize(_tileCountX * _tileCountY);
+}
+
+_Use_decl_annotations_
+void SoftwareRasterizer::AddTriangle(
+	const Vertex& v0,
+	const Vertex& v1_,
+	const Vertex& v2_,
+	AlphaBlend alphaBlend,
+	const uint8_t* texels,
+	Size textureSize,
+	const uint32_t* palette)
+{
+	/* No culling: flip the winding of back-facing triangles. The first vertex is kept, since it
+	   provides the flat (nointerpolation) attributes. */
+	const Vertex* v1 = &v1_;
+	const Vertex* v2 = &v2_;
+
+	int64_t area = EdgeFunction(
+		2 * (int64_t)v0.GetX(), 2 * (int64_t)v0.GetY(),
+		2 * (int64_t)v1->GetX(), 2 * (int64_t)v1->GetY(),
+		2 * (int64_t)v2->GetX(), 2 * (int64_t)v2->GetY());
+
+	if (area == 0)
+	{
+		return;
+	}
+
+	if (area < 0)
+	{
+		swap(v1, v2);
+		area = -area;
+	}
+
+	Triangle triangle;
+	triangle.minX = max(0, min(v0.GetX(), min(v1->GetX(), v2->GetX())));
+	triangle.minY = max(0, min(v0.GetY(), min(v1->GetY(), v2->GetY())));
+	triangle.maxX = min(_targetSize.width, max(v0.GetX(), max(v1->GetX(), v2->GetX())));
+	triangle.maxY = min(_targetSize.height, max(v0.GetY(), max(v1->GetY(), v2->GetY())));
+
+	if (triangle.minX >= triangle.maxX || triangle.minY >= triangle.maxY)
+	{
+		return;
+	}
+
+	const Vertex* vertices[3] = { &v0, v1, v2 };
+
+	for (int32_t i = 0; i < 3; ++i)
+	{
+		const uint32_t color = vertices[i]->GetColor();
+		triangle.x[i] = 2 * (int64_t)vertices[i]->GetX();
+		triangle.y[i] = 2 * (int64_t)vertices[i]->GetY();
+		triangle.s[i] = (float)vertices[i]->GetS();
+		triangle.t[i] = (float)vertices[i]->GetT();
+		triangle.r[i] = (float)((color >> 16) & 0xFF) * (1.0f / 255.0f);
+		triangle.g[i] = (float)((color >> 8) & 0xFF) * (1.0f / 255.0f);
+		triangle.b[i] = (float)(color & 0xFF) * (1.0f / 255.0f);
+		triangle.a[i] = (float)(color >> 24) * (1.0f / 255.0f);
+	}
+
+	for (int32_t i = 0; i < 3; ++i)
+	{
+		const int32_t a = (i + 1) % 3;
+		const int32_t b = (i + 2) % 3;
+		triangle.bias[i] = TopLeftBias(triangle.x[a], triangle.y[a], triangle.x[b], triangle.y[b]);
+	}
+
+	/* Flat, like the texcoord clamp that GameVS passes on from the provoking vertex. */
+	Offset minTexcoord{ 0, 0 };
+	Offset maxTexcoord{ 0, 0 };
+	v0.GetTexcoordClamp(minTexcoord, maxTexcoord);
+	triangle.minS = (float)minTexcoord.x;
+	triangle.minT = (float)minTexcoord.y;
+	triangle.maxS = (float)maxTexcoord.x;
+	triangle.maxT = (float)maxTexcoord.y;
+
+	triangle.invArea = 1.0f / (float)area;
+	triangle.texels = texels;
+	triangle.palette = palette;
+	triangle.textureSize = textureSize;
+	triangle.alphaBlend = alphaBlend;
+	triangle.isChromaKeyEnabled = v0.IsChromaKeyEnabled();
+	triangle.surfaceId = (uint16_t)v0.GetSurfaceId();
+
+	const uint32_t triangleIndex = (uint32_t)_triangles.size();
+	_triangles.push_back(triangle);
+
+	const int32_t tileMinX = triangle.minX / D2DX_SOFTWARE_TILE_SIZE;
+	const int32_t tileMinY = triangle.minY / D2DX_SOFTWARE_TILE_SIZE;
+	const int32_t tileMaxX = (triangle.maxX - 1) / D2DX_SOFTWARE_TILE_SIZE;
+	const int32_t tileMaxY = (triangle.maxY - 1) / D2DX_SOFTWARE_TILE_SIZE;
+
+	for (int32_t tileY = tileMinY; tileY <= tileMaxY; ++tileY)
+	{
+		for (int32_t tileX = tileMinX; tileX <= tileMaxX; ++tileX)
+		{
+			_tileBins[tileY * _tileCountX + tileX].push_back(triangleIndex);
+		}
+	}
+}
+
+bool SoftwareRasterizer::HasPendingTriangles() const
+{
+	return !_triangles.empty();
+}
+
+_Use_decl_annotations_
+void SoftwareRasterizer::Flush(
+	uint32_t* gameFramebuffer,
+	uint16_t* surfaceIdFramebuffer)
+{
+	if (_triangles.empty())
+	{
+		return;
+	}
+
+	_gameFramebuffer = gameFramebuffer;
+	_surfaceIdFramebuffer = surfaceIdFramebuffer;
+
+	const uint32_t tileCount = (uint32_t)_tileBins.size();
+
+	if (_workers.empty())
+	{
+		for (uint32_t i = 0; i < tileCount; ++i)
+		{
+			RasterizeTile(i);
+		}
+	}
+	else
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_jobTileCount = tileCount;
+			_nextTile = 0;
+			_isJobOpen = true;
+			++_generation;
+		}
+
+		_workAvailable.notify_all();
+
+		RasterizeTiles();
+
+		/* Every tile has been claimed once the calling thread runs out of work; wait for the workers
+		   that are still finishing theirs, then close the job so that no late worker can join it. */
+		std::unique_lock<std::mutex> lock(_mutex);
+		_workDone.wait(lock, [&] { return _activeWorkerCount == 0; });
+		_isJobOpen = false;
+	}
+
+	_triangles.clear();
+
+	for (auto& tileBin : _tileBins)
+	{
+		tileBin.clear();
+	}
+}
+
+uint32_t SoftwareRasterizer::GetThreadCount() const
+{
+	return (uint32_t)_workers.size() + 1;
+}
+
+void SoftwareRasterizer::WorkerMain()
+{
+	uint32_t seenGeneration = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_workAvailable.wait(lock, [&] { return _isStopping || (_isJobOpen && _generation != seenGeneration); });
+
+			if (_isStopping)
+			{
+				return;
+			}
+
+			seenGeneration = _generation;
+			++_activeWorkerCount;
+		}
+
+		RasterizeTiles();
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			--_activeWorkerCount;
+		}
+
+		_workDone.notify_one();
+	}
+}
+
+void SoftwareRasterizer::RasterizeTiles()
+{
+	while (true)
+	{
+		const uint32_t tileIndex = _nextTile.fetch_add(1);
+
+		if (tileIndex >= _jobTileCount)
+		{
+			break;
+		}
+
+		RasterizeTile(tileIndex);
+	}
+}
+
+_Use_decl_annotations_
+void SoftwareRasterizer::RasterizeTile(
+	uint32_t tileIndex)
+{
+	const auto& tileBin = _tileBins[tileIndex];
+
+	if (tileBin.empty())
+	{
+		return;
+	}
+
+	const int32_t minX = (int32_t)(tileIndex % _tileCountX) * D2DX_SOFTWARE_TILE_SIZE;
+	const int32_t minY = (int32_t)(tileIndex / _tileCountX) * D2DX_SOFTWARE_TILE_SIZE;
+	const int32_t maxX = min(_targetSize.width, minX + D2DX_SOFTWARE_TILE_SIZE);
+	const int32_t maxY = min(_targetSize.height, minY + D2DX_SOFTWARE_TILE_SIZE);
+
+	for (const uint32_t triangleIndex : tileBin)
+	{
+		RasterizeTriangle(_triangles[triangleIndex], minX, minY, maxX, maxY);
+	}
+}
+
+_Use_decl_annotations_
+void SoftwareRasterizer::RasterizeTriangle(
+	const Triangle& triangle,
+	int32_t clipMinX,
+	int32_t clipMinY,
+	int32_t clipMaxX,
+	int32_t clipMaxY)
+{
+	const int32_t minX = max(triangle.minX, clipMinX);
+	const int32_t minY = max(triangle.minY, clipMinY);
+	const int32_t maxX = min(triangle.maxX, clipMaxX);
+	const int32_t maxY = min(triangle.maxY, clipMaxY);
+
+	const int64_t px = 2 * (int64_t)minX + 1;
+
+	for (int32_t y = minY; y < maxY; ++y)
+	{
+		const int64_t py = 2 * (int64_t)y + 1;
+
+		/* Each edge function is linear along the row, so the covered pixels form a single span that
+		   can be solved for exactly instead of testing every pixel. */
+		int64_t spanMinX = minX;
+		int64_t spanMaxX = maxX;
+		double w[3];
+		double wStepX[3];
+
+		for (int32_t i = 0; i < 3; ++i)
+		{
+			const int32_t a = (i + 1) % 3;
+			const int32_t b = (i + 2) % 3;
+			const int64_t edge = EdgeFunction(triangle.x[a], triangle.y[a], triangle.x[b], triangle.y[b], px, py);
+			const int64_t biasedEdge = edge + triangle.bias[i];
+			const int64_t stepX = -(triangle.y[b] - triangle.y[a]) * 2;
+
+			if (stepX > 0)
+			{
+				if (biasedEdge < 0)
+				{
+					spanMinX = max(spanMinX, minX + (-biasedEdge + stepX - 1) / stepX);
+				}
+			}
+			else if (stepX < 0)
+			{
+				spanMaxX = biasedEdge < 0 ? minX : min(spanMaxX, minX + biasedEdge / -stepX + 1);
+			}
+			else if (biasedEdge < 0)
+			{
+				spanMaxX = minX;
+			}
+
+			w[i] = (double)edge;
+			wStepX[i] = (double)stepX;
+		}
+
+		if (spanMinX >= spanMaxX)
+		{
+			continue;
+		}
+
+		/* Edge values stay far below 2^53, so these are exact. */
+		for (int32_t i = 0; i < 3; ++i)
+		{
+			w[i] += (double)(spanMinX - minX) * wStepX[i];
+		}
+
+		ShadeSpan(triangle, y, (int32_t)spanMinX, (int32_t)spanMaxX, w, wStepX);
+	}
+}
+
+_Use_decl_annotations_
+void SoftwareRasterizer::ShadeSpan(
+	const Triangle& triangle,
+	int32_t y,
+	int32_t x0,
+	int32_t x1,
+	const double* w,
+	const double* wStepX)
+{
+	/* Spans never cross a tile. */
+	assert(x1 - x0 <= D2DX_SOFTWARE_TILE_SIZE);
+
+	uint32_t* gameRow = _gameFramebuffer + y * _targetSize.width;
+	uint16_t* surfaceIdRow = _surfaceIdFramebuffer + y * _targetSize.width;
+
+	const __m128 invArea = _mm_set1_ps(triangle.invArea);
+	const bool writesSurfaceId = triangle.alphaBlend == AlphaBlend::Opaque || triangle.alphaBlend == AlphaBlend::SrcAlphaInvSrcAlpha;
+	const uint32_t* palette = triangle.palette ? triangle.palette : blackPalette;
+
+	__m128 barycentrics[D2DX_SOFTWARE_TILE_SIZE / 4][3];
+	alignas(16) int32_t s[D2DX_SOFTWARE_TILE_SIZE];
+	alignas(16) int32_t t[D2DX_SOFTWARE_TILE_SIZE];
+	alignas(16) uint32_t indexedColors[D2DX_SOFTWARE_TILE_SIZE];
+	alignas(16) uint32_t textureColors[D2DX_SOFTWARE_TILE_SIZE];
+	alignas(16) uint32_t tailGamePixels[4];
+	uint16_t tailSurfaceIds[4];
+
+	/* Texcoords for the whole span first, so that its texels are sampled with a single ISimd call. */
+	for (int32_t x = x0; x < x1; x += 4)
+	{
+		const int32_t first = x - x0;
+		__m128* l = barycentrics[first / 4];
+
+		/* Barycentrics, matching (float)w * invArea for each pixel. */
+		const double k = (double)first;
+
+		for (int32_t i = 0; i < 3; ++i)
+		{
+			const __m128d base = _mm_set1_pd(w[i] + k * wStepX[i]);
+			const __m128d w01 = _mm_add_pd(base, _mm_set_pd(wStepX[i], 0.0));
+			const __m128d w23 = _mm_add_pd(base, _mm_set_pd(3.0 * wStepX[i], 2.0 * wStepX[i]));
+			l[i] = _mm_mul_ps(_mm_movelh_ps(_mm_cvtpd_ps(w01), _mm_cvtpd_ps(w23)), invArea);
+		}
+
+		/* As in GamePS, texcoords are clamped first. tex.Load(int4(tc, ...)) truncates, and
+		   out-of-bounds loads return 0. */
+		const __m128 ss = _mm_min_ps(_mm_max_ps(Interpolate(l[0], l[1], l[2], triangle.s), _mm_set1_ps(triangle.minS)), _mm_set1_ps(triangle.maxS));
+		const __m128 ts = _mm_min_ps(_mm_max_ps(Interpolate(l[0], l[1], l[2], triangle.t), _mm_set1_ps(triangle.minT)), _mm_set1_ps(triangle.maxT));
+		_mm_store_si128((__m128i*)&s[first], _mm_cvttps_epi32(ss));
+		_mm_store_si128((__m128i*)&t[first], _mm_cvttps_epi32(ts));
+	}
+
+	if (triangle.texels)
+	{
+		_simd->SamplePalettedTexels(s, t, x1 - x0, triangle.texels, triangle.textureSize, palette, indexedColors, textureColors);
+	}
+	else
+	{
+		for (int32_t i = 0; i < x1 - x0; ++i)
+		{
+			indexedColors[i] = 0;
+			textureColors[i] = palette[0];
+		}
+	}
+
+	for (int32_t x = x0; x < x1; x += 4)
+	{
+		const int32_t first = x - x0;
+		const int32_t laneCount = min(4, x1 - x);
+		const __m128* l = barycentrics[first / 4];
+		uint32_t* gamePixels = gameRow + x;
+		uint16_t* surfaceIds = surfaceIdRow + x;
+
+		/* Don't touch memory past the end of the span (or the framebuffer). */
+		if (laneCount < 4)
+		{
+			memcpy(tailGamePixels, gamePixels, laneCount * sizeof(uint32_t));
+			memcpy(tailSurfaceIds, surfaceIds, laneCount * sizeof(uint16_t));
+			gamePixels = tailGamePixels;
+			surfaceIds = tailSurfaceIds;
+		}
+
+		/* Lanes past the end of the span are discarded, as are those that hit the chroma key. */
+		__m128i mask = _mm_cmpgt_epi32(_mm_set1_epi32(laneCount), _mm_setr_epi32(0, 1, 2, 3));
+
+		if (triangle.isChromaKeyEnabled)
+		{
+			mask = _mm_andnot_si128(_mm_cmpeq_epi32(_mm_load_si128((const __m128i*)&indexedColors[first]), _mm_setzero_si128()), mask);
+		}
+
+		__m128 tr, tg, tb, ta;
+		UnpackColors(_mm_load_si128((const __m128i*)&textureColors[first]), tr, tg, tb, ta);
+
+		const __m128 va = Interpolate(l[0], l[1], l[2], triangle.a);
+		const __m128 sr = _mm_mul_ps(Interpolate(l[0], l[1], l[2], triangle.r), tr);
+		const __m128 sg = _mm_mul_ps(Interpolate(l[0], l[1], l[2], triangle.g), tg);
+		const __m128 sb = _mm_mul_ps(Interpolate(l[0], l[1], l[2], triangle.b), tb);
+		const __m128 sa = _mm_mul_ps(va, ta);
+
+		const __m128i dstColors = _mm_loadu_si128((const __m128i*)gamePixels);
+		__m128 dr, dg, db, da;
+		UnpackColors(dstColors, dr, dg, db, da);
+
+		__m128i resultColors;
+
+		switch (triangle.alphaBlend)
+		{
+		default:
+		case AlphaBlend::Opaque:
+			resultColors = PackColors(sr, sg, sb, sa);
+			break;
+		case AlphaBlend::Additive:
+			resultColors = PackColors(_mm_add_ps(sr, dr), _mm_add_ps(sg, dg), _mm_add_ps(sb, db), da);
+			break;
+		case AlphaBlend::Multiplicative:
+			resultColors = PackColors(_mm_mul_ps(dr, sr), _mm_mul_ps(dg, sg), _mm_mul_ps(db, sb), _mm_setzero_ps());
+			break;
+		case AlphaBlend::SrcAlphaInvSrcAlpha:
+		{
+			const __m128 invSa = _mm_sub_ps(_mm_set1_ps(1.0f), sa);
+			resultColors = PackColors(
+				_mm_add_ps(_mm_mul_ps(sr, sa), _mm_mul_ps(dr, invSa)),
+				_mm_add_ps(_mm_mul_ps(sg, sa), _mm_mul_ps(dg, invSa)),
+				_mm_add_ps(_mm_mul_ps(sb, sa), _mm_mul_ps(db, invSa)),
+				_mm_setzero_ps());
+			break;
+		}
+		}
+
+		_mm_storeu_si128((__m128i*)gamePixels, _mm_or_si128(_mm_and_si128(mask, resultColors), _mm_andnot_si128(mask, dstColors)));
+
+		/* The surface id target uses MAX blending for Opaque/SrcAlphaInvSrcAlpha and is left
+		   untouched by the other modes. */
+		if (writesSurfaceId)
+		{
+			const int32_t isSurfaceIdWritten = _mm_movemask_ps(_mm_cmpgt_ps(va, _mm_set1_ps(0.5f)));
+			const int32_t isLaneWritten = _mm_movemask_ps(_mm_castsi128_ps(mask));
+
+			for (int32_t lane = 0; lane < laneCount; ++lane)
+			{
+				if (isLaneWritten & (1 << lane))
+				{
+					const uint16_t srcSurfaceId = (isSurfaceIdWritten & (1 << lane)) ? triangle.surfaceId : 0;
+					surfaceIds[lane] = max(surfaceIds[lane], srcSurfaceId);
+				}
+			}
+		}
+
+		if (laneCount < 4)
+		{
+			memcpy(gameRow + x, tailGamePixels, laneCount * sizeof(uint32_t));
+			memcpy(surfaceIdRow + x, tailSurfaceIds, laneCount * sizeof(uint16_t));
+		}
+	}
+}
@@ -0,0 +1,147 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "ISimd.h"
+#include "Types.h"
+#include "Vertex.h"
+
+#define D2DX_SOFTWARE_TILE_SIZE 64
+
+namespace d2dx
+{
+	/* Tile-based triangle rasterizer used by SoftwareRenderContext.
+
+	   Triangles are set up and binned into D2DX_SOFTWARE_TILE_SIZE square screen tiles as they
+	   are added. Flush() then rasterizes the tiles in parallel on a pool of worker threads (the
+	   calling thread takes part too). Each tile processes its triangles in submission order, so
+	   the result is the same for any number of threads. Spans are shaded four pixels at a time
+	   with SSE2, after sampling the texels of the whole span with ISimd::SamplePalettedTexels.
+
+	   Texels and palettes are referenced, not copied: the owner must Flush() before changing
+	   anything that a pending triangle may read. */
+	class SoftwareRasterizer final
+	{
+	public:
+		/* threadCount includes the calling thread; 0 means one per hardware thread. */
+		SoftwareRasterizer(
+			_In_ const std::shared_ptr<ISimd>& simd,
+			_In_ uint32_t threadCount);
+
+		~SoftwareRasterizer() noexcept;
+
+		SoftwareRasterizer(const SoftwareRasterizer&) = delete;
+		SoftwareRasterizer& operator=(const SoftwareRasterizer&) = delete;
+
+		/* Discards any pending triangles. */
+		void SetTargetSize(
+			_In_ Size targetSize);
+
+		void AddTriangle(
+			_In_ const Vertex& v0,
+			_In_ const Vertex& v1,
+			_In_ const Vertex& v2,
+			_In_ AlphaBlend alphaBlend,
+			_In_reads_opt_(textureSize.width * textureSize.height) const uint8_t* texels,
+			_In_ Size textureSize,
+			_In_reads_opt_(256) const uint32_t* palette);
+
+		bool HasPendingTriangles() const;
+
+		/* Rasterizes all pending triangles into the framebuffers, which must be of the target size. */
+		void Flush(
+			_Inout_ uint32_t* gameFramebuffer,
+			_Inout_ uint16_t* surfaceIdFramebuffer);
+
+		uint32_t GetThreadCount() const;
+
+	private:
+		struct Triangle final
+		{
+			/* Positions in half-pixel units, counter-clockwise. */
+			int64_t x[3];
+			int64_t y[3];
+			int64_t bias[3];
+			float invArea;
+			float s[3];
+			float t[3];
+			float r[3];
+			float g[3];
+			float b[3];
+			float a[3];
+			float minS;
+			float minT;
+			float maxS;
+			float maxT;
+			int32_t minX;
+			int32_t minY;
+			int32_t maxX;
+			int32_t maxY;
+			const uint8_t* texels;
+			const uint32_t* palette;
+			Size textureSize;
+			AlphaBlend alphaBlend;
+			bool isChromaKeyEnabled;
+			uint16_t surfaceId;
+		};
+
+		void WorkerMain();
+
+		void RasterizeTiles();
+
+		void RasterizeTile(
+			_In_ uint32_t tileIndex);
+
+		void RasterizeTriangle(
+			_In_ const Triangle& triangle,
+			_In_ int32_t clipMinX,
+			_In_ int32_t clipMinY,
+			_In_ int32_t clipMaxX,
+			_In_ int32_t clipMaxY);
+
+		void ShadeSpan(
+			_In_ const Triangle& triangle,
+			_In_ int32_t y,
+			_In_ int32_t x0,
+			_In_ int32_t x1,
+			_In_reads_(3) const double* w,
+			_In_reads_(3) const double* wStepX);
+
+		std::shared_ptr<ISimd> _simd;
+		Size _targetSize = { 0, 0 };
+		int32_t _tileCountX = 0;
+		int32_t _tileCountY = 0;
+		std::vector<Triangle> _triangles;
+		std::vector<std::vector<uint32_t>> _tileBins;
+
+		uint32_t* _gameFramebuffer = nullptr;
+		uint16_t* _surfaceIdFramebuffer = nullptr;
+
+		std::vector<std::thread> _workers;
+		std::mutex _mutex;
+		std::condition_variable _workAvailable;
+		std::condition_variable _workDone;
+		uint32_t _generation = 0;
+		uint32_t _activeWorkerCount = 0;
+		bool _isJobOpen = false;
+		bool _isStopping = false;
+		uint32_t _jobTileCount = 0;
+		std::atomic<uint32_t> _nextTile = 0;
+	};
+}
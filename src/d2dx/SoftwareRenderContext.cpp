@@ -0,0 +1,435 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "Batch.h"
+#include "ID2DXContext.h"
+#include "SoftwareRenderContext.h"
+#include "SpriteEncoder.h"
+#include "TextureCache.h"
+#include "Utils.h"
+
+using namespace d2dx;
+using namespace std;
+
+/* Matches the largest texture array size that RenderContextResources will use on real hardware. */
+#define D2DX_SOFTWARE_TEXTURES_PER_ATLAS 2048
+
+_Use_decl_annotations_
+SoftwareRenderContext::SoftwareRenderContext(
+	HWND hWnd,
+	Size gameSize,
+	Size windowSize,
+	ScreenMode initialScreenMode,
+	ID2DXContext* d2dxContext,
+	const std::shared_ptr<ISimd>& simd,
+	uint32_t threadCount,
+	TextureCachePolicyOption textureCachePolicy) :
+	_hWnd{ hWnd },
+	_d2dxContext{ d2dxContext },
+	_screenMode{ initialScreenMode },
+	_vertices{ D2DX_MAX_VERTICES_PER_FRAME },
+	_palettes{ D2DX_MAX_PALETTES * 256, true },
+	_gammaTable{ 256, true },
+	_rasterizer{ simd, threadCount }
+{
+	uint32_t totalSize = 0;
+
+	for (int32_t i = 0; i < ARRAYSIZE(_textureCaches); ++i)
+	{
+		const Size size = TextureCache::GetCacheTextureSize(i);
+		const uint32_t capacity = TextureCache::GetInitialCapacity(i);
+
+		_textureCaches[i] = std::make_unique<TextureCache>(size.width, size.height, capacity, D2DX_SOFTWARE_TEXTURES_PER_ATLAS, nullptr, simd, textureCachePolicy);
+		_texturePixels[i] = Buffer<uint8_t>(size.width * size.height * capacity, true);
+		totalSize += _texturePixels[i].capacity;
+	}
+
+	SetSizes(gameSize, windowSize);
+
+	_timeStart = TimeStart();
+
+	D2DX_LOG("Using the software render context (%u threads, %u kB of texture memory).", _rasterizer.GetThreadCount(), totalSize / 1024);
+}
+
+HWND SoftwareRenderContext::GetHWnd() const
+{
+	return _hWnd;
+}
+
+_Use_decl_annotations_
+void SoftwareRenderContext::LoadGammaTable(
+	const uint32_t* values,
+	uint32_t valueCount)
+{
+	/* Gamma is applied when presenting to the back buffer, which the golden frames don't include. */
+	memcpy(_gammaTable.items, values, min(valueCount, _gammaTable.capacity) * sizeof(uint32_t));
+}
+
+_Use_decl_annotations_
+uint32_t SoftwareRenderContext::BulkWriteVertices(
+	const Vertex* vertices,
+	uint32_t vertexCount)
+{
+	if ((_vbWriteIndex + vertexCount) > _vertices.capacity)
+	{
+		_vbWriteIndex = 0;
+		assert(vertexCount <= _vertices.capacity);
+		vertexCount = min(vertexCount, _vertices.capacity);
+	}
+
+	const uint32_t startVertexLocation = _vbWriteIndex;
+
+	memcpy(_vertices.items + _vbWriteIndex, vertices, sizeof(Vertex) * vertexCount);
+
+	/* No shaders here, so the camera offset is added when copying. */
+	if (_cameraOffset.x != 0 || _cameraOffset.y != 0)
+	{
+		Vertex* writtenVertices = _vertices.items + _vbWriteIndex;
+
+		for (uint32_t i = 0; i < vertexCount; ++i)
+		{
+			if (writtenVertices[i].IsCameraOffsetEnabled())
+			{
+				writtenVertices[i].AddOffset(_cameraOffset.x, _cameraOffset.y);
+			}
+		}
+	}
+
+	_vbWriteIndex += vertexCount;
+
+	return startVertexLocation;
+}
+
+_Use_decl_annotations_
+void SoftwareRenderContext::SetCameraOffset(
+	Offset offset)
+{
+	_cameraOffset = offset;
+}
+
+_Use_decl_annotations_
+TextureCacheLocation SoftwareRenderContext::UpdateTexture(
+	const Batch& batch,
+	const uint8_t* tmuData,
+	uint32_t tmuDataSize)
+{
+	if (!batch.IsValid())
+	{
+		return { -1, -1, -1 };
+	}
+
+	const uint32_t contentKey = batch.GetHash();
+	const int32_t cacheIndex = TextureCache::GetCacheIndex(batch.GetTextureWidth(), batch.GetTextureHeight());
+	ITextureCache* atlas = _textureCaches[cacheIndex].get();
+
+	auto tcl = atlas->FindTexture(contentKey, -1);
+
+	if (tcl._textureAtlas < 0)
+	{
+		/* The new texture may replace one that a pending triangle still samples from. */
+		FlushTriangles();
+
+		tcl = atlas->InsertTexture(contentKey, batch, tmuData, tmuDataSize);
+
+		/* Same as the UpdateSubresource in TextureCache: only the batch's box of the slice is written. */
+		const Size cacheSize = TextureCache::GetCacheTextureSize(cacheIndex);
+		const uint32_t slot = tcl._textureAtlas * atlas->GetTexturesPerAtlas() + tcl._textureIndex;
+		const int32_t width = batch.GetTextureWidth();
+		const int32_t height = batch.GetTextureHeight();
+		const Offset tileOffset = TextureAtlasPacker::GetTileOffset(width, height, tcl._textureTile);
+		const uint8_t* srcPixels = tmuData + batch.GetTextureStartAddress();
+		uint8_t* dstPixels = _texturePixels[cacheIndex].items + slot * cacheSize.width * cacheSize.height +
+			tileOffset.y * cacheSize.width + tileOffset.x;
+
+		assert((batch.GetTextureStartAddress() + width * height) <= (int32_t)tmuDataSize);
+
+		for (int32_t y = 0; y < height; ++y)
+		{
+			memcpy(dstPixels + y * cacheSize.width, srcPixels + y * width, width);
+		}
+	}
+
+	return tcl;
+}
+
+_Use_decl_annotations_
+void SoftwareRenderContext::Draw(
+	const Batch& batch,
+	uint32_t startVertexLocation)
+{
+	const int32_t cacheIndex = TextureCache::GetCacheIndex(batch.GetTextureWidth(), batch.GetTextureHeight());
+	const Size textureSize = TextureCache::GetCacheTextureSize(cacheIndex);
+	const uint32_t textureByteSize = textureSize.width * textureSize.height;
+	const uint32_t slotCount = _texturePixels[cacheIndex].capacity / textureByteSize;
+	const uint32_t texturesPerAtlas = _textureCaches[cacheIndex]->GetTexturesPerAtlas();
+	const Vertex* vertices = _vertices.items + startVertexLocation + batch.GetStartVertex();
+	const uint32_t vertexCount = batch.GetVertexCount();
+
+	/* Quads are two triangles of the same four vertices, like with the quad index buffer. Sprite
+	   records are expanded to such quads first, as GameSpriteVS does. */
+	const bool isSprites = batch.GetPrimitiveType() == PrimitiveType::Sprites;
+	const bool isQuads = isSprites || batch.GetPrimitiveType() == PrimitiveType::Quads;
+	const uint32_t primitiveVertexCount = isSprites ? 2 : isQuads ? 4 : 3;
+	Vertex spriteQuad[4];
+
+	assert((vertexCount % primitiveVertexCount) == 0);
+
+	for (uint32_t i = 0; (i + primitiveVertexCount) <= vertexCount; i += primitiveVertexCount)
+	{
+		const Vertex* primitive = vertices + i;
+
+		if (isSprites)
+		{
+			SpriteEncoder::Decode(primitive, spriteQuad);
+			primitive = spriteQuad;
+		}
+
+		/* Flat attributes come from the first vertex, as decoded by GameVS. */
+		const Vertex& v0 = primitive[0];
+		const int32_t slice = v0.GetAtlasIndex();
+		const int32_t paletteIndex = v0.GetPaletteIndex();
+		const uint32_t slot = batch.GetTextureAtlas() * texturesPerAtlas + slice;
+		const bool isSlotValid = (uint32_t)slice < texturesPerAtlas && slot < slotCount;
+		const uint8_t* texels = isSlotValid ? _texturePixels[cacheIndex].items + slot * textureByteSize : nullptr;
+		const uint32_t* palette = paletteIndex < D2DX_MAX_PALETTES ? _palettes.items + paletteIndex * 256 : nullptr;
+
+		_rasterizer.AddTriangle(v0, primitive[1], primitive[2], batch.GetAlphaBlend(), texels, textureSize, palette);
+
+		if (isQuads)
+		{
+			_rasterizer.AddTriangle(v0, primitive[2], primitive[3], batch.GetAlphaBlend(), texels, textureSize, palette);
+		}
+	}
+}
+
+void SoftwareRenderContext::FlushTriangles()
+{
+	_rasterizer.Flush(_gameFramebuffer.items, _surfaceIdFramebuffer.items);
+}
+
+void SoftwareRenderContext::Present()
+{
+	FlushTriangles();
+
+	for (int32_t i = 0; i < ARRAYSIZE(_textureCaches); ++i)
+	{
+		_textureCaches[i]->OnNewFrame();
+	}
+
+	std::swap(_gameFramebuffer, _presentedGameFramebuffer);
+	std::swap(_surfaceIdFramebuffer, _presentedSurfaceIdFramebuffer);
+	ClearFramebuffers();
+
+	if (_hWnd)
+	{
+		PresentToWindow();
+	}
+
+	double curTime = TimeEndMs(_timeStart);
+	_frameTimeMs = curTime - _prevTime;
+	_prevTime = curTime;
+
+	++_frameCount;
+}
+
+_Use_decl_annotations_
+void SoftwareRenderContext::WriteToScreen(
+	const uint32_t* pixels,
+	int32_t width,
+	int32_t height)
+{
+	FlushTriangles();
+
+	/* Point-sampled stretch of the video frame over the whole game framebuffer. */
+	for (int32_t y = 0; y < _gameSize.height; ++y)
+	{
+		const uint32_t* srcRow = pixels + ((y * height) / _gameSize.height) * width;
+		uint32_t* dstRow = _gameFramebuffer.items + y * _gameSize.width;
+
+		for (int32_t x = 0; x < _gameSize.width; ++x)
+		{
+			dstRow[x] = srcRow[(x * width) / _gameSize.width];
+		}
+	}
+
+	Present();
+}
+
+_Use_decl_annotations_
+void SoftwareRenderContext::SetPalette(
+	int32_t paletteIndex,
+	const uint32_t* palette)
+{
+	assert(paletteIndex >= 0 && paletteIndex < D2DX_MAX_PALETTES);
+	FlushTriangles();
+	memcpy(_palettes.items + paletteIndex * 256, palette, 256 * sizeof(uint32_t));
+}
+
+const Options& SoftwareRenderContext::GetOptions() const
+{
+	return _d2dxContext->GetOptions();
+}
+
+_Use_decl_annotations_
+ITextureCache* SoftwareRenderContext::GetTextureCache(
+	const Batch& batch) const
+{
+	return _textureCaches[TextureCache::GetCacheIndex(batch.GetTextureWidth(), batch.GetTextureHeight())].get();
+}
+
+bool SoftwareRenderContext::IsMultiAtlasEnabled() const
+{
+	/* The rasterizer reads the texels of one texture cache per draw call. */
+	return false;
+}
+
+_Use_decl_annotations_
+void SoftwareRenderContext::SetSizes(
+	Size gameSize,
+	Size windowSize)
+{
+	_windowSize = windowSize;
+
+	if (gameSize.width == _gameSize.width && gameSize.height == _gameSize.height)
+	{
+		return;
+	}
+
+	FlushTriangles();
+
+	_gameSize = gameSize;
+	_rasterizer.SetTargetSize(gameSize);
+
+	const uint32_t pixelCount = (uint32_t)(gameSize.width * gameSize.height);
+	_gameFramebuffer = Buffer<uint32_t>(pixelCount, true);
+	_surfaceIdFramebuffer = Buffer<uint16_t>(pixelCount, true);
+	_presentedGameFramebuffer = Buffer<uint32_t>(pixelCount, true);
+	_presentedSurfaceIdFramebuffer = Buffer<uint16_t>(pixelCount, true);
+}
+
+void SoftwareRenderContext::ClearFramebuffers()
+{
+	memset(_gameFramebuffer.items, 0, _gameFramebuffer.capacity * sizeof(uint32_t));
+	memset(_surfaceIdFramebuffer.items, 0, _surfaceIdFramebuffer.capacity * sizeof(uint16_t));
+}
+
+void SoftwareRenderContext::PresentToWindow()
+{
+	RECT clientRect;
+	if (!GetClientRect(_hWnd, &clientRect))
+	{
+		return;
+	}
+
+	HDC hDC = GetDC(_hWnd);
+	if (!hDC)
+	{
+		return;
+	}
+
+	/* 0xAARRGGBB in memory is the BGRA byte order of a 32-bit top-down DIB. */
+	BITMAPINFO bitmapInfo;
+	ZeroMemory(&bitmapInfo, sizeof(bitmapInfo));
+	bitmapInfo.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	bitmapInfo.bmiHeader.biWidth = _gameSize.width;
+	bitmapInfo.bmiHeader.biHeight = -_gameSize.height;
+	bitmapInfo.bmiHeader.biPlanes = 1;
+	bitmapInfo.bmiHeader.biBitCount = 32;
+	bitmapInfo.bmiHeader.biCompression = BI_RGB;
+
+	StretchDIBits(
+		hDC,
+		0, 0, clientRect.right - clientRect.left, clientRect.bottom - clientRect.top,
+		0, 0, _gameSize.width, _gameSize.height,
+		_presentedGameFramebuffer.items,
+		&bitmapInfo,
+		DIB_RGB_COLORS,
+		SRCCOPY);
+
+	ReleaseDC(_hWnd, hDC);
+}
+
+_Use_decl_annotations_
+void SoftwareRenderContext::GetCurrentMetrics(
+	Size* gameSize,
+	Rect* renderRect,
+	Size* desktopSize) const
+{
+	if (gameSize)
+	{
+		*gameSize = _gameSize;
+	}
+
+	if (renderRect)
+	{
+		*renderRect = { 0, 0, _windowSize.width, _windowSize.height };
+	}
+
+	if (desktopSize)
+	{
+		*desktopSize = _windowSize;
+	}
+}
+
+void SoftwareRenderContext::ToggleFullscreen()
+{
+	_screenMode = _screenMode == ScreenMode::Windowed ? ScreenMode::FullscreenDefault : ScreenMode::Windowed;
+}
+
+float SoftwareRenderContext::GetFrameTime() const
+{
+	return (float)(_frameTimeMs / 1000.0);
+}
+
+int32_t SoftwareRenderContext::GetFrameTimeFp() const
+{
+	auto frameTimeMs = (int64_t)(_frameTimeMs * (65536.0 / 1000.0));
+	return (int32_t)max(INT_MIN, min(INT_MAX, frameTimeMs));
+}
+
+ScreenMode SoftwareRenderContext::GetScreenMode() const
+{
+	return _screenMode;
+}
+
+uint32_t SoftwareRenderContext::GetFrameCount() const
+{
+	return _frameCount;
+}
+
+uint32_t SoftwareRenderContext::GetThreadCount() const
+{
+	return _rasterizer.GetThreadCount();
+}
+
+const uint32_t* SoftwareRenderContext::GetPresentedGameFramebuffer() const
+{
+	return _presentedGameFramebuffer.items;
+}
+
+const uint16_t* SoftwareRenderContext::GetPresentedSurfaceIdFramebuffer() const
+{
+	return _presentedSurfaceIdFramebuffer.items;
+}
+
+uint32_t SoftwareRenderContext::GetPresentedFrameHash() const
+{
+	uint32_t hash = fnv_32a_buf(_presentedGameFramebuffer.items, _presentedGameFramebuffer.capacity * sizeof(uint32_t), FNV1_32A_INIT);
+	return fnv_32a_buf(_presentedSurfaceIdFramebuffer.items, _presentedSurfaceIdFramebuffer.capacity * sizeof(uint16_t), hash);
+}
@@ -0,0 +1,163 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Buffer.h"
+#include "IRenderContext.h"
+#include "ISimd.h"
+#include "ITextureCache.h"
+#include "Options.h"
+#include "SoftwareRasterizer.h"
+#include "TextureCache.h"
+#include "Types.h"
+#include "Vertex.h"
+
+namespace d2dx
+{
+	struct ID2DXContext;
+	class Batch;
+
+	/* A CPU reference implementation of IRenderContext. Triangles are rasterized with the same
+	   rules as D3D11 (pixel centers, top-left fill rule, no culling) and shaded like GameVS/GamePS:
+	   palette lookup of the R8 texel, chroma-key discard, vertex color modulation, the four
+	   AlphaBlend modes on the game framebuffer and MAX blending of the surface id.
+
+	   The game framebuffer is stored as 0xAARRGGBB, the surface id framebuffer as the raw id.
+	   Present() makes the finished frame available through the getters and clears the next one.
+	   If there is a window, the frame is also copied to it with GDI (without gamma), which makes
+	   this usable as a fallback when no D3D11 device can be created. */
+	class SoftwareRenderContext final : public IRenderContext
+	{
+	public:
+		SoftwareRenderContext(
+			_In_ HWND hWnd,
+			_In_ Size gameSize,
+			_In_ Size windowSize,
+			_In_ ScreenMode initialScreenMode,
+			_In_ ID2DXContext* d2dxContext,
+			_In_ const std::shared_ptr<ISimd>& simd,
+			_In_ uint32_t threadCount = 0,
+			_In_ TextureCachePolicyOption textureCachePolicy = TextureCachePolicyOption::BitPmru);
+
+		virtual ~SoftwareRenderContext() noexcept {}
+
+		virtual HWND GetHWnd() const override;
+
+		virtual void LoadGammaTable(
+			_In_reads_(valueCount) const uint32_t* values,
+			_In_ uint32_t valueCount) override;
+
+		virtual uint32_t BulkWriteVertices(
+			_In_reads_(vertexCount) const Vertex* vertices,
+			_In_ uint32_t vertexCount) override;
+
+		virtual void SetCameraOffset(
+			_In_ Offset offset) override;
+
+		virtual TextureCacheLocation UpdateTexture(
+			_In_ const Batch& batch,
+			_In_reads_(tmuDataSize) const uint8_t* tmuData,
+			_In_ uint32_t tmuDataSize) override;
+
+		virtual void Draw(
+			_In_ const Batch& batch,
+			_In_ uint32_t startVertexLocation) override;
+
+		virtual void Present() override;
+
+		virtual void WriteToScreen(
+			_In_reads_(width* height) const uint32_t* pixels,
+			_In_ int32_t width,
+			_In_ int32_t height) override;
+
+		virtual void SetPalette(
+			_In_ int32_t paletteIndex,
+			_In_reads_(256) const uint32_t* palette) override;
+
+		virtual const Options& GetOptions() const override;
+
+		virtual ITextureCache* GetTextureCache(
+			_In_ const Batch& batch) const override;
+
+		virtual bool IsMultiAtlasEnabled() const override;
+
+		virtual void SetSizes(
+			_In_ Size gameSize,
+			_In_ Size windowSize) override;
+
+		virtual void GetCurrentMetrics(
+			_Out_opt_ Size* gameSize,
+			_Out_opt_ Rect* renderRect,
+			_Out_opt_ Size* desktopSize) const override;
+
+		virtual void ToggleFullscreen() override;
+
+		virtual float GetFrameTime() const override;
+		virtual int32_t GetFrameTimeFp() const override;
+
+		virtual ScreenMode GetScreenMode() const override;
+
+		uint32_t GetFrameCount() const;
+
+		uint32_t GetThreadCount() const;
+
+		/* The game framebuffer of the most recently presented frame, gameSize.width * gameSize.height pixels. */
+		const uint32_t* GetPresentedGameFramebuffer() const;
+
+		/* The surface id framebuffer of the most recently presented frame. */
+		const uint16_t* GetPresentedSurfaceIdFramebuffer() const;
+
+		/* FNV-1a over both presented framebuffers; for golden-frame comparisons. */
+		uint32_t GetPresentedFrameHash() const;
+
+	private:
+		void FlushTriangles();
+
+		void ClearFramebuffers();
+
+		void PresentToWindow();
+
+		HWND _hWnd = nullptr;
+		ID2DXContext* _d2dxContext = nullptr;
+		ScreenMode _screenMode = ScreenMode::Windowed;
+		Size _gameSize = { 0, 0 };
+		Size _windowSize = { 0, 0 };
+
+		std::unique_ptr<ITextureCache> _textureCaches[D2DX_TEXTURE_CACHE_COUNT];
+		Buffer<uint8_t> _texturePixels[D2DX_TEXTURE_CACHE_COUNT];
+
+		Buffer<Vertex> _vertices;
+		uint32_t _vbWriteIndex = 0;
+		Offset _cameraOffset = { 0, 0 };
+		Buffer<uint32_t> _palettes;
+		Buffer<uint32_t> _gammaTable;
+
+		Buffer<uint32_t> _gameFramebuffer;
+		Buffer<uint16_t> _surfaceIdFramebuffer;
+		Buffer<uint32_t> _presentedGameFramebuffer;
+		Buffer<uint16_t> _presentedSurfaceIdFramebuffer;
+
+		SoftwareRasterizer _rasterizer;
+
+		uint32_t _frameCount = 0;
+		int64_t _timeStart = 0;
+		double _prevTime = 0;
+		double _frameTimeMs = 0;
+	};
+}
@@ -0,0 +1,107 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "SpriteEncoder.h"
+
+using namespace d2dx;
+
+static bool HasSameFlatAttributes(
+	const Vertex& a,
+	const Vertex& b) noexcept
+{
+	return a.GetColor() == b.GetColor() &&
+		a.GetAtlasIndex() == b.GetAtlasIndex() &&
+		a.GetPaletteIndex() == b.GetPaletteIndex() &&
+		a.IsChromaKeyEnabled() == b.IsChromaKeyEnabled() &&
+		a.GetSurfaceId() == b.GetSurfaceId() &&
+		a.GetTextureSelector() == b.GetTextureSelector() &&
+		a.HasSameTexcoordClamp(b) &&
+		a.IsCameraOffsetEnabled() == b.IsCameraOffsetEnabled();
+}
+
+static bool IsCorner(
+	const Vertex& v,
+	int32_t x,
+	int32_t y,
+	int32_t s,
+	int32_t t) noexcept
+{
+	return v.GetX() == x && v.GetY() == y && v.GetS() == s && v.GetT() == t;
+}
+
+_Use_decl_annotations_
+bool SpriteEncoder::Encode(
+	const Vertex* quad,
+	Vertex* sprite) noexcept
+{
+	const Vertex& v0 = quad[0];
+	const Vertex& v1 = quad[1];
+	const Vertex& v2 = quad[2];
+	const Vertex& v3 = quad[3];
+
+	if (!HasSameFlatAttributes(v0, v1) ||
+		!HasSameFlatAttributes(v0, v2) ||
+		!HasSameFlatAttributes(v0, v3))
+	{
+		return false;
+	}
+
+	/* The remaining corners must take their x and s from one stored corner and their y and t from
+	   the other, in either order. Then s only varies with x and t only with y. */
+	const bool isRowFirst =
+		IsCorner(v1, v2.GetX(), v0.GetY(), v2.GetS(), v0.GetT()) &&
+		IsCorner(v3, v0.GetX(), v2.GetY(), v0.GetS(), v2.GetT());
+
+	const bool isColumnFirst =
+		IsCorner(v1, v0.GetX(), v2.GetY(), v0.GetS(), v2.GetT()) &&
+		IsCorner(v3, v2.GetX(), v0.GetY(), v2.GetS(), v0.GetT());
+
+	if (!isRowFirst && !isColumnFirst)
+	{
+		return false;
+	}
+
+	const Vertex corner2 = v2;
+	sprite[0] = v0;
+	sprite[1] = corner2;
+	return true;
+}
+
+_Use_decl_annotations_
+void SpriteEncoder::Decode(
+	const Vertex* sprite,
+	Vertex* quad) noexcept
+{
+	const Vertex& corner0 = sprite[0];
+	const Vertex& corner2 = sprite[1];
+
+	quad[0] = corner0;
+
+	quad[1] = corner0;
+	quad[1].SetPosition(corner2.GetX(), corner0.GetY());
+	quad[1].SetTexcoord(corner2.GetS(), corner0.GetT());
+
+	quad[2] = corner0;
+	quad[2].SetPosition(corner2.GetX(), corner2.GetY());
+	quad[2].SetTexcoord(corner2.GetS(), corner2.GetT());
+
+	quad[3] = corner0;
+	quad[3].SetPosition(corner0.GetX(), corner2.GetY());
+	quad[3].SetTexcoord(corner0.GetS(), corner2.GetT());
+}
@@ -0,0 +1,47 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Types.h"
+#include "Vertex.h"
+
+namespace d2dx
+{
+	/* Nearly all quads drawn by the game are axis-aligned sprites, and those are packed into sprite
+	   records of two vertices each: the first vertex of the quad and the opposite (third) corner. The
+	   other two corners are rebuilt from these by GameSpriteVS, which draws one instance per record,
+	   so a sprite takes 32 bytes of the vertex buffer instead of 64. Quads that are not rectangles
+	   with the texture aligned to the axes, or whose vertices differ in anything but position and
+	   texcoord, are left as quads. */
+	class SpriteEncoder final
+	{
+	public:
+		/* Packs a quad into a sprite record if possible. The quad and the record may overlap. */
+		static bool Encode(
+			_In_reads_(4) const Vertex* quad,
+			_Out_writes_(2) Vertex* sprite) noexcept;
+
+		/* Rebuilds the four corners of a sprite record, in the order GameSpriteVS uses: the stored
+		   corners are 0 and 2, corner 1 is on the same row as corner 0 and corner 3 on the same
+		   column. Drawn as (0, 1, 2) and (0, 2, 3), they cover the same pixels as the original quad. */
+		static void Decode(
+			_In_reads_(2) const Vertex* sprite,
+			_Out_writes_(4) Vertex* quad) noexcept;
+	};
+}
@@ -48,7 +48,7 @@ void SurfaceIdTracker::UpdateBatchSurfaceId(
 {
 	uint32_t surfaceId = 0;
 
-	uint64_t drawCallTexture = (uint64_t)batch.GetTextureIndex() | ((uint64_t)batch.GetTextureAtlas() << 32ULL);
+	uint64_t drawCallTexture = (uint64_t)batch.GetTextureIndex() | ((uint64_t)batch.GetTextureTile() << 16ULL) | ((uint64_t)batch.GetTextureAtlas() << 32ULL);
 
 	int32_t minx = INT_MAX;
 	int32_t miny = INT_MAX;
@@ -142,9 +142,15 @@ void SurfaceIdTracker::UpdateBatchSurfaceId(
 
 	_previousSurfaceId = surfaceId;
 
+	/* The UI and the player stay put; everything else moves with the predicted camera. */
+	const bool isCameraOffsetEnabled =
+		surfaceId != D2DX_SURFACE_ID_USER_INTERFACE &&
+		batch.GetTextureCategory() != TextureCategory::Player;
+
 	for (uint32_t i = 0; i < batch.GetVertexCount(); ++i)
 	{
 		batchVertices[i].SetSurfaceId(surfaceId);
+		batchVertices[i].SetIsCameraOffsetEnabled(isCameraOffsetEnabled);
 	}
 	_previousDrawCallTexture = drawCallTexture;
 	_previousDrawCallRect.offset.x = minx;
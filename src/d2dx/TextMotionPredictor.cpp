@@ -22,14 +22,34 @@
 using namespace d2dx;
 using namespace DirectX;
 
+static inline uint32_t GetTextIndexHomeSlot(
+	uint64_t textId,
+	uint32_t slotsCount)
+{
+	return ((uint32_t)(textId ^ (textId >> 32)) * 0x9E3779B1U) >> (32 - std::countr_zero(slotsCount));
+}
+
 _Use_decl_annotations_
 TextMotionPredictor::TextMotionPredictor(
 	const std::shared_ptr<IGameHelper>& gameHelper) :
 	_gameHelper{ gameHelper },
-	_textMotions{ 128, true },
+	_textMotions{ 256, true },
 	_textsCount{ 0 },
-	_frame{ 0 }
+	_frame{ 0 },
+	_textIndexSlots{ 512, true, -1 }
+{
+}
+
+_Use_decl_annotations_
+uint64_t TextMotionPredictor::GetTextId(
+	const wchar_t* str,
+	uint32_t textHash,
+	uint32_t returnAddress)
 {
+	return
+		(((uint64_t)(returnAddress & 0xFFFFFF) << 40ULL) |
+		((uint64_t)((uintptr_t)str & 0xFFFFFF) << 16ULL)) ^
+		(uint64_t)textHash;
 }
 
 _Use_decl_annotations_
@@ -53,6 +73,7 @@ void TextMotionPredictor::Update(
 
 		if (abs((int64_t)_frame - (int64_t)tm.lastUsedFrame) > 2)
 		{
+			RemoveTextIndex(i);
 			tm.id = 0;
 			expiredTextIndex = i;
 			continue;
@@ -82,6 +103,7 @@ void TextMotionPredictor::Update(
 		{
 			// Some entry is expired. Move the last entry to that place, and shrink the list.
 			_textMotions.items[expiredTextIndex] = _textMotions.items[_textsCount - 1];
+			_textIndexSlots.items[FindTextIndexSlot(_textMotions.items[expiredTextIndex].id)] = expiredTextIndex;
 			_textMotions.items[_textsCount - 1] = { };
 			--_textsCount;
 		}
@@ -96,56 +118,51 @@ Offset TextMotionPredictor::GetOffset(
 	Offset posFromGame)
 {
 	OffsetF posFromGameF{ (float)posFromGame.x, (float)posFromGame.y };
-	int32_t textIndex = -1;
+	uint32_t slot = FindTextIndexSlot(textId);
+	int32_t textIndex = _textIndexSlots.items[slot];
 
-	for (int32_t i = 0; i < _textsCount; ++i)
+	if (textIndex >= 0)
 	{
-		if (_textMotions.items[i].id == textId)
-		{
-			bool resetCurrentPos = false;
+		bool resetCurrentPos = false;
 
-			if ((_gameHelper->ScreenOpenMode() & 1) && posFromGameF.x >= _gameSize.width / 2)
-			{
-				resetCurrentPos = true;
-			}
-			else if ((_gameHelper->ScreenOpenMode() & 2) && posFromGameF.x <= _gameSize.width / 2)
+		if ((_gameHelper->ScreenOpenMode() & 1) && posFromGameF.x >= _gameSize.width / 2)
+		{
+			resetCurrentPos = true;
+		}
+		else if ((_gameHelper->ScreenOpenMode() & 2) && posFromGameF.x <= _gameSize.width / 2)
+		{
+			resetCurrentPos = true;
+		}
+		else
+		{
+			auto distance = (posFromGameF - _textMotions.items[textIndex].targetPos).Length();
+			if (distance > 32.0f)
 			{
 				resetCurrentPos = true;
 			}
-			else
-			{
-				auto distance = (posFromGameF - _textMotions.items[i].targetPos).Length();
-				if (distance > 32.0f)
-				{
-					resetCurrentPos = true;
-				}
-			}
-
-			_textMotions.items[i].targetPos = posFromGameF;
-			if (resetCurrentPos)
-			{
-				_textMotions.items[i].currentPos = posFromGameF;
-			}
-			_textMotions.items[i].lastUsedFrame = _frame;
-			textIndex = i;
-			break;
 		}
-	}
 
-	if (textIndex < 0)
-	{
-		if (_textsCount < (int32_t)_textMotions.capacity)
+		_textMotions.items[textIndex].targetPos = posFromGameF;
+		if (resetCurrentPos)
 		{
-			textIndex = _textsCount++;
-			_textMotions.items[textIndex].id = textId;
-			_textMotions.items[textIndex].targetPos = posFromGameF;
 			_textMotions.items[textIndex].currentPos = posFromGameF;
-			_textMotions.items[textIndex].lastUsedFrame = _frame;
 		}
-		else
+		_textMotions.items[textIndex].lastUsedFrame = _frame;
+	}
+	else if (textId)
+	{
+		if (_textsCount >= (int32_t)_textMotions.capacity)
 		{
-			D2DX_DEBUG_LOG("TMP: Too many texts.");
+			Grow();
+			slot = FindTextIndexSlot(textId);
 		}
+
+		textIndex = _textsCount++;
+		_textIndexSlots.items[slot] = textIndex;
+		_textMotions.items[textIndex].id = textId;
+		_textMotions.items[textIndex].targetPos = posFromGameF;
+		_textMotions.items[textIndex].currentPos = posFromGameF;
+		_textMotions.items[textIndex].lastUsedFrame = _frame;
 	}
 
 	if (textIndex < 0)
@@ -156,3 +173,68 @@ Offset TextMotionPredictor::GetOffset(
 	TextMotion& tm = _textMotions.items[textIndex];
 	return { (int32_t)(tm.currentPos.x - posFromGame.x), (int32_t)(tm.currentPos.y - posFromGame.y) };
 }
+
+_Use_decl_annotations_
+uint32_t TextMotionPredictor::FindTextIndexSlot(
+	uint64_t textId) const
+{
+	/* The slot holding the text, or else the empty slot where it would be inserted. */
+	const uint32_t slotMask = _textIndexSlots.capacity - 1;
+	uint32_t slot = GetTextIndexHomeSlot(textId, _textIndexSlots.capacity);
+
+	while (true)
+	{
+		const int32_t textIndex = _textIndexSlots.items[slot];
+
+		if (textIndex < 0 || _textMotions.items[textIndex].id == textId)
+		{
+			return slot;
+		}
+
+		slot = (slot + 1) & slotMask;
+	}
+}
+
+_Use_decl_annotations_
+void TextMotionPredictor::RemoveTextIndex(
+	int32_t textIndex)
+{
+	const uint32_t slotMask = _textIndexSlots.capacity - 1;
+	uint32_t emptySlot = FindTextIndexSlot(_textMotions.items[textIndex].id);
+	assert(_textIndexSlots.items[emptySlot] == textIndex);
+
+	/* Shift later entries of the probe sequence back, so that no lookup stops early at the hole. */
+	for (uint32_t slot = (emptySlot + 1) & slotMask;
+		_textIndexSlots.items[slot] >= 0;
+		slot = (slot + 1) & slotMask)
+	{
+		const uint32_t homeSlot = GetTextIndexHomeSlot(_textMotions.items[_textIndexSlots.items[slot]].id, _textIndexSlots.capacity);
+
+		if (((slot - homeSlot) & slotMask) >= ((slot - emptySlot) & slotMask))
+		{
+			_textIndexSlots.items[emptySlot] = _textIndexSlots.items[slot];
+			emptySlot = slot;
+		}
+	}
+
+	_textIndexSlots.items[emptySlot] = -1;
+}
+
+void TextMotionPredictor::Grow()
+{
+	Buffer<TextMotion> textMotions{ _textMotions.capacity * 2, true };
+	memcpy(textMotions.items, _textMotions.items, sizeof(TextMotion) * _textsCount);
+	_textMotions = std::move(textMotions);
+
+	_textIndexSlots = Buffer<int32_t>{ _textMotions.capacity * 2, true, -1 };
+
+	for (int32_t i = 0; i < _textsCount; ++i)
+	{
+		if (_textMotions.items[i].id)
+		{
+			_textIndexSlots.items[FindTextIndexSlot(_textMotions.items[i].id)] = i;
+		}
+	}
+
+	D2DX_DEBUG_LOG("TMP: Grew to %u texts.", _textMotions.capacity);
+}
@@ -36,6 +36,13 @@ namespace d2dx
 			_In_ uint64_t textId,
 			_In_ Offset posFromGame);
 
+		/* Identifies a text by where it is drawn from, its buffer and textHash, the hash of its
+		   characters. */
+		static uint64_t GetTextId(
+			_In_z_ const wchar_t* str,
+			_In_ uint32_t textHash,
+			_In_ uint32_t returnAddress);
+
 	private:
 		struct TextMotion final
 		{
@@ -46,10 +53,22 @@ namespace d2dx
 			int64_t dtLastPosChange = 0;
 		};
 
+		uint32_t FindTextIndexSlot(
+			_In_ uint64_t textId) const;
+
+		void RemoveTextIndex(
+			_In_ int32_t textIndex);
+
+		void Grow();
+
 		std::shared_ptr<IGameHelper> _gameHelper;
 		uint32_t _frame = 0;
 		Buffer<TextMotion> _textMotions;
 		int32_t _textsCount;
 		Size _gameSize;
+
+		/* Open-addressed index of the tracked texts, by id, with twice as many slots as there are
+		   entries in _textMotions. Each slot holds an index into _textMotions, or -1. */
+		Buffer<int32_t> _textIndexSlots;
 	};
 }
@@ -0,0 +1,258 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "TextureAtlasPacker.h"
+
+using namespace d2dx;
+using namespace std;
+
+_Use_decl_annotations_
+TextureAtlasPacker::TextureAtlasPacker(
+	int32_t slotWidth,
+	int32_t slotHeight,
+	uint32_t capacity) :
+	_slotWidth{ slotWidth },
+	_slotHeight{ slotHeight },
+	_capacity{ capacity },
+	/* Only square slots are packed: the smallest texture side is 8, so up to 32 tiles per slot. */
+	_tilesPerSlot{ slotWidth == slotHeight ? (uint32_t)slotWidth / 8 : 1U }
+{
+	assert(capacity > 0);
+	assert(_tilesPerSlot <= D2DX_MAX_TILES_PER_TEXTURE_SLOT);
+
+	for (int32_t i = 0; i < ARRAYSIZE(_openPages); ++i)
+	{
+		_openPages[i] = -1;
+	}
+
+	if (!IsEnabled())
+	{
+		return;
+	}
+
+	_tileMasks = Buffer<uint32_t>(capacity, true);
+	_shapes = Buffer<uint8_t>(capacity, true);
+	_tileKeys = Buffer<uint32_t>(capacity * _tilesPerSlot, true);
+	_tileKeyIndex = TextureCacheKeyIndex(capacity * _tilesPerSlot);
+}
+
+_Use_decl_annotations_
+bool TextureAtlasPacker::IsPacked(
+	int32_t width,
+	int32_t height) const
+{
+	return IsEnabled() && (width != _slotWidth || height != _slotHeight);
+}
+
+_Use_decl_annotations_
+int32_t TextureAtlasPacker::FindTile(
+	uint32_t contentKey,
+	int32_t& slot) const
+{
+	slot = -1;
+
+	if (!IsEnabled() || _pageCount == 0)
+	{
+		return -1;
+	}
+
+	const int32_t tileIndex = _tileKeyIndex.Find(contentKey, _tileKeys.items);
+
+	if (tileIndex < 0)
+	{
+		return -1;
+	}
+
+	slot = tileIndex / (int32_t)_tilesPerSlot;
+	return tileIndex % (int32_t)_tilesPerSlot;
+}
+
+_Use_decl_annotations_
+int32_t TextureAtlasPacker::GetOpenPage(
+	int32_t width,
+	int32_t height) const
+{
+	return _openPages[GetShape(width, height)];
+}
+
+_Use_decl_annotations_
+bool TextureAtlasPacker::IsPage(
+	int32_t slot) const
+{
+	assert(slot >= 0 && (uint32_t)slot < _capacity);
+	return IsEnabled() && _shapes.items[slot] != 0;
+}
+
+_Use_decl_annotations_
+void TextureAtlasPacker::AddPage(
+	int32_t slot,
+	int32_t width,
+	int32_t height)
+{
+	assert(IsPacked(width, height));
+	assert(slot >= 0 && (uint32_t)slot < _capacity);
+	assert(_shapes.items[slot] == 0);
+
+	const uint32_t shape = GetShape(width, height);
+
+	_tileMasks.items[slot] = 0;
+	_shapes.items[slot] = (uint8_t)shape;
+	_openPages[shape] = slot;
+	++_pageCount;
+}
+
+_Use_decl_annotations_
+int32_t TextureAtlasPacker::AddTile(
+	int32_t slot,
+	uint32_t contentKey)
+{
+	assert(slot >= 0 && (uint32_t)slot < _capacity);
+	assert(_shapes.items[slot] != 0);
+
+	const uint32_t shape = _shapes.items[slot];
+	const int32_t width = 1 << (shape >> 4);
+	const int32_t height = 1 << (shape & 15);
+	const uint32_t tileCount = (uint32_t)(_slotWidth / min(width, height));
+	const uint32_t fullMask = tileCount == 32 ? 0xFFFFFFFF : (1U << tileCount) - 1;
+
+	DWORD tile = 0;
+	BitScanForward(&tile, ~_tileMasks.items[slot]);
+	assert(tile < tileCount);
+
+	_tileMasks.items[slot] |= 1U << tile;
+
+	const int32_t tileIndex = slot * (int32_t)_tilesPerSlot + (int32_t)tile;
+	_tileKeys.items[tileIndex] = contentKey;
+	_tileKeyIndex.Add(contentKey, tileIndex);
+	_tileTexelCount += (uint32_t)(width * height);
+
+	if (_tileMasks.items[slot] == fullMask && _openPages[shape] == slot)
+	{
+		_openPages[shape] = -1;
+	}
+
+	return (int32_t)tile;
+}
+
+_Use_decl_annotations_
+uint32_t TextureAtlasPacker::RemoveSlot(
+	int32_t slot)
+{
+	if (!IsEnabled() || _shapes.items[slot] == 0)
+	{
+		return 0;
+	}
+
+	const uint32_t shape = _shapes.items[slot];
+	const int32_t width = 1 << (shape >> 4);
+	const int32_t height = 1 << (shape & 15);
+	uint32_t tileMask = _tileMasks.items[slot];
+	uint32_t tileCount = 0;
+
+	DWORD tile = 0;
+	while (BitScanForward(&tile, tileMask))
+	{
+		const int32_t tileIndex = slot * (int32_t)_tilesPerSlot + (int32_t)tile;
+		_tileKeyIndex.Remove(_tileKeys.items[tileIndex], tileIndex, _tileKeys.items);
+		_tileKeys.items[tileIndex] = 0;
+		tileMask &= tileMask - 1;
+		++tileCount;
+	}
+
+	_tileTexelCount -= (uint64_t)tileCount * (uint32_t)(width * height);
+	_tileMasks.items[slot] = 0;
+	_shapes.items[slot] = 0;
+	--_pageCount;
+
+	if (_openPages[shape] == slot)
+	{
+		_openPages[shape] = -1;
+	}
+
+	return tileCount;
+}
+
+_Use_decl_annotations_
+void TextureAtlasPacker::SetCapacity(
+	uint32_t capacity)
+{
+	if (capacity == _capacity || !IsEnabled())
+	{
+		_capacity = capacity;
+		return;
+	}
+
+	TextureAtlasPacker resized{ _slotWidth, _slotHeight, capacity };
+
+	for (uint32_t slot = 0; slot < min(capacity, _capacity); ++slot)
+	{
+		const uint32_t shape = _shapes.items[slot];
+
+		if (shape == 0)
+		{
+			continue;
+		}
+
+		resized.AddPage((int32_t)slot, 1 << (shape >> 4), 1 << (shape & 15));
+
+		uint32_t tileMask = _tileMasks.items[slot];
+		DWORD tile = 0;
+
+		while (BitScanForward(&tile, tileMask))
+		{
+			const int32_t tileIndex = (int32_t)(slot * _tilesPerSlot + tile);
+			const int32_t resizedTileIndex = (int32_t)(slot * resized._tilesPerSlot + tile);
+			resized._tileMasks.items[slot] |= 1U << tile;
+			resized._tileKeys.items[resizedTileIndex] = _tileKeys.items[tileIndex];
+			resized._tileKeyIndex.Add(_tileKeys.items[tileIndex], resizedTileIndex);
+			resized._tileTexelCount += (uint32_t)((1 << (shape >> 4)) * (1 << (shape & 15)));
+			tileMask &= tileMask - 1;
+		}
+	}
+
+	/* Keep packing into the same pages, if they survived. */
+	for (int32_t shape = 0; shape < ARRAYSIZE(_openPages); ++shape)
+	{
+		resized._openPages[shape] = _openPages[shape] >= 0 && (uint32_t)_openPages[shape] < capacity ? _openPages[shape] : -1;
+	}
+
+	*this = std::move(resized);
+}
+
+_Use_decl_annotations_
+Offset TextureAtlasPacker::GetTileOffset(
+	int32_t width,
+	int32_t height,
+	int32_t tile)
+{
+	/* Wide textures are stacked vertically and tall ones side by side. */
+	return width > height ? Offset{ 0, tile * height } : Offset{ tile * width, 0 };
+}
+
+_Use_decl_annotations_
+uint32_t TextureAtlasPacker::GetShape(
+	int32_t width,
+	int32_t height)
+{
+	DWORD log2Width = 0;
+	DWORD log2Height = 0;
+	BitScanReverse(&log2Width, (DWORD)width);
+	BitScanReverse(&log2Height, (DWORD)height);
+	return (log2Width << 4) | log2Height;
+}
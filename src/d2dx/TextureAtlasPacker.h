@@ -0,0 +1,119 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Buffer.h"
+#include "TextureCacheKeyIndex.h"
+#include "Types.h"
+
+#define D2DX_MAX_TILES_PER_TEXTURE_SLOT 32
+
+namespace d2dx
+{
+	/* Packs textures that are smaller than the slots of a texture cache, e.g. 256x8 or 16x128 strips in
+	   the 256x256 and 128x128 caches, into shared slots ("pages"). Each page holds tiles of one shape,
+	   stacked along the short side, so 32 256x8 textures share a slot instead of using one each.
+
+	   Pages are slots in the cache's replacement policy that have no key, so that no content key can
+	   find one; the packer keeps track of them. Finding a tile keeps its page alive, and when the
+	   policy evicts a page all of its tiles are evicted with it. */
+	class TextureAtlasPacker final
+	{
+	public:
+		TextureAtlasPacker() = default;
+		TextureAtlasPacker& operator=(TextureAtlasPacker&& rhs) = default;
+
+		TextureAtlasPacker(
+			_In_ int32_t slotWidth,
+			_In_ int32_t slotHeight,
+			_In_ uint32_t capacity);
+		~TextureAtlasPacker() noexcept {}
+
+		bool IsEnabled() const { return _tilesPerSlot > 1; }
+
+		bool IsPacked(
+			_In_ int32_t width,
+			_In_ int32_t height) const;
+
+		/* Returns the tile holding contentKey and its page in slot, or -1. */
+		int32_t FindTile(
+			_In_ uint32_t contentKey,
+			_Out_ int32_t& slot) const;
+
+		/* Returns the most recent page for the shape that still has a free tile, or -1. */
+		int32_t GetOpenPage(
+			_In_ int32_t width,
+			_In_ int32_t height) const;
+
+		bool IsPage(
+			_In_ int32_t slot) const;
+
+		void AddPage(
+			_In_ int32_t slot,
+			_In_ int32_t width,
+			_In_ int32_t height);
+
+		/* Returns the tile that contentKey was put into. The page must have a free tile. */
+		int32_t AddTile(
+			_In_ int32_t slot,
+			_In_ uint32_t contentKey);
+
+		/* Forgets whatever the slot held. Returns the number of tiles evicted with it. */
+		uint32_t RemoveSlot(
+			_In_ int32_t slot);
+
+		/* Slots at or above the new capacity are removed. */
+		void SetCapacity(
+			_In_ uint32_t capacity);
+
+		uint32_t GetPageCount() const { return _pageCount; }
+
+		/* Texels covered by the tiles in all pages. */
+		uint64_t GetTileTexelCount() const { return _tileTexelCount; }
+
+		/* Where in its slot a tile of the given texture size lies, in texels. */
+		static Offset GetTileOffset(
+			_In_ int32_t width,
+			_In_ int32_t height,
+			_In_ int32_t tile);
+
+	private:
+		static uint32_t GetShape(
+			_In_ int32_t width,
+			_In_ int32_t height);
+
+		int32_t _slotWidth = 0;
+		int32_t _slotHeight = 0;
+		uint32_t _capacity = 0;
+		uint32_t _tilesPerSlot = 0;
+		uint32_t _pageCount = 0;
+		uint64_t _tileTexelCount = 0;
+
+		/* Per slot; a shape of 0 means that the slot is not a page (textures are at least 8x8). */
+		Buffer<uint32_t> _tileMasks;
+		Buffer<uint8_t> _shapes;
+
+		/* Per tile, at slot * _tilesPerSlot + tile. */
+		Buffer<uint32_t> _tileKeys;
+		TextureCacheKeyIndex _tileKeyIndex;
+
+		/* Per shape (log2 width << 4 | log2 height). */
+		int32_t _openPages[256];
+	};
+}
@@ -0,0 +1,46 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#define D2DX_TEXTURE_BIND_LOG_MAGIC 0x42543244 /* 'D2TB' */
+#define D2DX_TEXTURE_BIND_LOG_VERSION 1
+
+namespace d2dx
+{
+	/* A texture bind log is a file header followed by one record for each texture that a batch
+	   looked up in the texture caches, in submission order. It contains just what is needed to
+	   replay the texture cache traffic offline (see TextureCacheSimulator). */
+
+	struct TextureBindLogFileHeader final
+	{
+		uint32_t magic;
+		uint32_t version;
+	};
+
+	struct TextureBindRecord final
+	{
+		uint32_t frame;
+		uint32_t contentKey;
+		uint16_t width;
+		uint16_t height;
+	};
+
+	static_assert(sizeof(TextureBindLogFileHeader) == 8, "sizeof(TextureBindLogFileHeader)");
+	static_assert(sizeof(TextureBindRecord) == 12, "sizeof(TextureBindRecord)");
+}
@@ -0,0 +1,73 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "TextureBindRecorder.h"
+#include "Utils.h"
+
+using namespace d2dx;
+
+_Use_decl_annotations_
+TextureBindRecorder::TextureBindRecorder(
+	const char* filename)
+{
+	if (fopen_s(&_file, filename, "wb") != 0 || !_file)
+	{
+		D2DX_LOG("Failed to open '%s' for recording texture binds.", filename);
+		_file = nullptr;
+		return;
+	}
+
+	/* Several thousand binds per frame; let the CRT batch them up. */
+	setvbuf(_file, nullptr, _IOFBF, 1024 * 1024);
+
+	const TextureBindLogFileHeader fileHeader{ D2DX_TEXTURE_BIND_LOG_MAGIC, D2DX_TEXTURE_BIND_LOG_VERSION };
+	fwrite(&fileHeader, sizeof(fileHeader), 1, _file);
+
+	D2DX_LOG("Recording texture binds to '%s'.", filename);
+}
+
+TextureBindRecorder::~TextureBindRecorder() noexcept
+{
+	if (_file)
+	{
+		fclose(_file);
+		_file = nullptr;
+	}
+}
+
+bool TextureBindRecorder::IsRecording() const
+{
+	return _file != nullptr;
+}
+
+_Use_decl_annotations_
+void TextureBindRecorder::RecordBind(
+	uint32_t frame,
+	uint32_t contentKey,
+	int32_t width,
+	int32_t height)
+{
+	if (!_file)
+	{
+		return;
+	}
+
+	const TextureBindRecord record{ frame, contentKey, (uint16_t)width, (uint16_t)height };
+	fwrite(&record, sizeof(record), 1, _file);
+}
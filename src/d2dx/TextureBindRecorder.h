@@ -0,0 +1,47 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "TextureBindLog.h"
+
+namespace d2dx
+{
+	class TextureBindRecorder final
+	{
+	public:
+		TextureBindRecorder(
+			_In_z_ const char* filename);
+
+		~TextureBindRecorder() noexcept;
+
+		TextureBindRecorder(const TextureBindRecorder&) = delete;
+		TextureBindRecorder& operator=(const TextureBindRecorder&) = delete;
+
+		bool IsRecording() const;
+
+		void RecordBind(
+			_In_ uint32_t frame,
+			_In_ uint32_t contentKey,
+			_In_ int32_t width,
+			_In_ int32_t height);
+
+	private:
+		FILE* _file = nullptr;
+	};
+}
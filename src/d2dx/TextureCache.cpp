@@ -20,6 +20,7 @@
 #include "D2DXContext.h"
 #include "Utils.h"
 #include "TextureCache.h"
+#include "TextureCachePolicy2Q.h"
 #include "TextureCachePolicyBitPmru.h"
 
 using namespace d2dx;
@@ -32,41 +33,123 @@ TextureCache::TextureCache(
 	uint32_t capacity,
 	uint32_t texturesPerAtlas,
 	ID3D11Device* device,
-	const std::shared_ptr<ISimd>& simd)
+	const std::shared_ptr<ISimd>& simd,
+	TextureCachePolicyOption policy,
+	TextureUploadQueue* uploadQueue)
 {
-	assert(_atlasCount <= 4);
+	assert(capacity > 0 && !(capacity & (capacity - 1)));
+	assert(texturesPerAtlas > 0 && !(texturesPerAtlas & (texturesPerAtlas - 1)));
 
+	/* Each atlas is a texture array. The cache starts out with the atlases needed for the requested
+	   capacity, and can then grow or shrink by whole atlases (see SetAtlasCount). */
 	_width = width;
 	_height = height;
-	_capacity = capacity;
-	_texturesPerAtlas = texturesPerAtlas;
-	_atlasCount = (int32_t)max(1, capacity / texturesPerAtlas);
-	_policy = TextureCachePolicyBitPmru(capacity, simd);
+	_texturesPerAtlas = min(texturesPerAtlas, capacity);
+	_atlasCount = (int32_t)(capacity / _texturesPerAtlas);
+	_capacity = _texturesPerAtlas * _atlasCount;
+
+	if (policy == TextureCachePolicyOption::TwoQueue)
+	{
+		_policy = std::make_unique<TextureCachePolicy2Q>(_capacity, simd);
+	}
+	else
+	{
+		_policy = std::make_unique<TextureCachePolicyBitPmru>(_capacity, simd);
+	}
+
+	_packer = TextureAtlasPacker{ _width, _height, _capacity };
+
+	assert(_atlasCount <= D2DX_MAX_ATLASES_PER_TEXTURE_CACHE);
 
 #ifndef D2DX_UNITTEST
+	if (!device)
+	{
+		/* Without a device (e.g. NullRenderContext) only the cache bookkeeping is done. */
+		return;
+	}
+
+	_device = device;
+	_uploadQueue = uploadQueue;
+	device->GetImmediateContext(&_deviceContext);
+	assert(_deviceContext);
 
+	for (int32_t atlas = 0; atlas < _atlasCount; ++atlas)
+	{
+		D2DX_CHECK_HR(CreateAtlas(atlas));
+	}
+#endif
+}
+
+_Use_decl_annotations_
+HRESULT TextureCache::CreateAtlas(
+	int32_t atlas)
+{
+#ifndef D2DX_UNITTEST
 	CD3D11_TEXTURE2D_DESC desc
 	{
 		DXGI_FORMAT_R8_UINT,
-		(UINT)width,
-		(UINT)height,
+		(UINT)_width,
+		(UINT)_height,
 		_texturesPerAtlas,
 		1U,
 		D3D11_BIND_SHADER_RESOURCE,
 		D3D11_USAGE_DEFAULT
 	};
 
-	uint32_t capacityPerPartition = _capacity;
+	HRESULT hr = _device->CreateTexture2D(&desc, nullptr, _textures[atlas].ReleaseAndGetAddressOf());
 
-	for (int32_t partition = 0; partition < 4; ++partition)
+	if (SUCCEEDED(hr))
 	{
-		D2DX_CHECK_HR(device->CreateTexture2D(&desc, nullptr, &_textures[partition]));
-		D2DX_CHECK_HR(device->CreateShaderResourceView(_textures[partition].Get(), NULL, _srvs[partition].GetAddressOf()));
+		hr = _device->CreateShaderResourceView(_textures[atlas].Get(), NULL, _srvs[atlas].ReleaseAndGetAddressOf());
 	}
 
-	device->GetImmediateContext(&_deviceContext);
-	assert(_deviceContext);
+	if (FAILED(hr))
+	{
+		_srvs[atlas].Reset();
+		_textures[atlas].Reset();
+	}
+
+	return hr;
+#else
+	return S_OK;
+#endif
+}
+
+_Use_decl_annotations_
+void TextureCache::SetAtlasCount(
+	uint32_t atlasCount)
+{
+	assert(atlasCount >= 1 && atlasCount <= D2DX_MAX_ATLASES_PER_TEXTURE_CACHE);
+	atlasCount = max(1U, min(atlasCount, (uint32_t)D2DX_MAX_ATLASES_PER_TEXTURE_CACHE));
+
+#ifndef D2DX_UNITTEST
+	if (_device)
+	{
+		for (uint32_t atlas = (uint32_t)_atlasCount; atlas < atlasCount; ++atlas)
+		{
+			const HRESULT hr = CreateAtlas((int32_t)atlas);
+
+			if (FAILED(hr))
+			{
+				/* Most likely out of video memory; stay at the size we could allocate. */
+				D2DX_LOG("Failed to allocate atlas for %ix%i textures (0x%08x).", _width, _height, (uint32_t)hr);
+				atlasCount = atlas;
+				break;
+			}
+		}
+
+		for (uint32_t atlas = atlasCount; atlas < (uint32_t)_atlasCount; ++atlas)
+		{
+			_srvs[atlas].Reset();
+			_textures[atlas].Reset();
+		}
+	}
 #endif
+
+	_atlasCount = (int32_t)atlasCount;
+	_capacity = _texturesPerAtlas * atlasCount;
+	_policy->SetCapacity(_capacity);
+	_packer.SetCapacity(_capacity);
 }
 
 uint32_t TextureCache::GetMemoryFootprint() const
@@ -79,14 +162,28 @@ TextureCacheLocation TextureCache::FindTexture(
 	uint32_t contentKey,
 	int32_t lastIndex)
 {
-	const int32_t index = _policy.Find(contentKey, lastIndex);
+	int32_t index = _policy->Find(contentKey, lastIndex);
+	int32_t tile = 0;
+
+	assert(index < 0 || !_packer.IsPage(index));
 
 	if (index < 0)
 	{
-		return { -1, -1 };
+		tile = _packer.FindTile(contentKey, index);
+
+		if (tile < 0)
+		{
+			++_stats.misses;
+			return { -1, -1, -1 };
+		}
+
+		/* Keep the page alive for as long as any of its tiles are in use. */
+		_policy->Touch(index);
 	}
 
-	return { (int16_t)(index / _texturesPerAtlas), (int16_t)(index & (_texturesPerAtlas - 1)) };
+	++_stats.hits;
+
+	return { (int16_t)(index / _texturesPerAtlas), (int16_t)(index & (_texturesPerAtlas - 1)), (int16_t)tile };
 }
 
 _Use_decl_annotations_
@@ -98,29 +195,65 @@ TextureCacheLocation TextureCache::InsertTexture(
 {
 	assert(batch.IsValid() && batch.GetTextureWidth() > 0 && batch.GetTextureHeight() > 0);
 
-	bool evicted = false;
-	int32_t replacementIndex = _policy.Insert(contentKey, evicted);
+	const int32_t width = batch.GetTextureWidth();
+	const int32_t height = batch.GetTextureHeight();
+	const bool isPacked = _packer.IsPacked(width, height);
+	int32_t replacementIndex = isPacked ? _packer.GetOpenPage(width, height) : -1;
 
-	if (evicted)
+	if (replacementIndex >= 0)
 	{
-		D2DX_DEBUG_LOG("Evicted %ix%i texture %i from cache.", batch.GetTextureWidth(), batch.GetTextureHeight(), replacementIndex);
+		_policy->Touch(replacementIndex);
+	}
+	else
+	{
+		/* Pages have no key, so that no content key can find one. */
+		bool evicted = false;
+		replacementIndex = _policy->Insert(isPacked ? 0 : contentKey, evicted);
+
+		if (evicted)
+		{
+			/* An evicted page takes all of its tiles with it. */
+			const uint32_t evictedCount = _packer.RemoveSlot(replacementIndex);
+			_stats.evictions += max(1U, evictedCount);
+			D2DX_DEBUG_LOG("Evicted %u textures from %ix%i slot %i in cache.", max(1U, evictedCount), _width, _height, replacementIndex);
+		}
+
+		if (isPacked)
+		{
+			_packer.AddPage(replacementIndex, width, height);
+		}
 	}
 
+	const int32_t tile = isPacked ? _packer.AddTile(replacementIndex, contentKey) : 0;
+
 #ifndef D2DX_UNITTEST
-	CD3D11_BOX box;
-	box.left = 0;
-	box.top = 0;
-	box.right = batch.GetTextureWidth();
-	box.bottom = batch.GetTextureHeight();
-	box.front = 0;
-	box.back = 1;
+	if (_deviceContext)
+	{
+		const Offset tileOffset = TextureAtlasPacker::GetTileOffset(width, height, tile);
+		const uint8_t* pData = tmuData + batch.GetTextureStartAddress();
+		ID3D11Texture2D* texture = _textures[replacementIndex / _texturesPerAtlas].Get();
+		const uint32_t slice = replacementIndex & (_texturesPerAtlas - 1);
 
-	const uint8_t* pData = tmuData + batch.GetTextureStartAddress();
+		if (_uploadQueue)
+		{
+			_uploadQueue->Enqueue(texture, slice, tileOffset, width, height, pData, width);
+		}
+		else
+		{
+			CD3D11_BOX box;
+			box.left = tileOffset.x;
+			box.top = tileOffset.y;
+			box.right = tileOffset.x + width;
+			box.bottom = tileOffset.y + height;
+			box.front = 0;
+			box.back = 1;
 
-	_deviceContext->UpdateSubresource(_textures[replacementIndex / _texturesPerAtlas].Get(), replacementIndex & (_texturesPerAtlas - 1), &box, pData, batch.GetTextureWidth(), 0);
+			_deviceContext->UpdateSubresource(texture, slice, &box, pData, width, 0);
+		}
+	}
 #endif
 
-	return { (int16_t)(replacementIndex / _texturesPerAtlas), (int16_t)(replacementIndex & (_texturesPerAtlas - 1)) };
+	return { (int16_t)(replacementIndex / _texturesPerAtlas), (int16_t)(replacementIndex & (_texturesPerAtlas - 1)), (int16_t)tile };
 }
 
 _Use_decl_annotations_
@@ -133,7 +266,7 @@ ID3D11ShaderResourceView* TextureCache::GetSrv(
 
 void TextureCache::OnNewFrame()
 {
-	_policy.OnNewFrame();
+	_policy->OnNewFrame();
 }
 
 _Use_decl_annotations_
@@ -164,5 +297,104 @@ void TextureCache::CopyPixels(
 
 uint32_t TextureCache::GetUsedCount() const
 {
-	return _policy.GetUsedCount();
+	return _policy->GetUsedCount();
+}
+
+uint32_t TextureCache::GetUsedInFrameCount() const
+{
+	return _policy->GetUsedInFrameCount();
+}
+
+float TextureCache::GetPackingEfficiency() const
+{
+	const uint32_t usedCount = _policy->GetUsedCount();
+
+	if (usedCount == 0)
+	{
+		return 1.0f;
+	}
+
+	/* Slots that aren't pages hold exactly one texture of the slot size. */
+	const uint64_t slotTexels = (uint64_t)_width * _height;
+	const uint64_t usedTexels = (usedCount - _packer.GetPageCount()) * slotTexels + _packer.GetTileTexelCount();
+	return (float)((double)usedTexels / (double)(usedCount * slotTexels));
+}
+
+const TextureCacheStats& TextureCache::GetStats() const
+{
+	return _stats;
+}
+
+uint32_t TextureCache::GetWidth() const
+{
+	return (uint32_t)_width;
+}
+
+uint32_t TextureCache::GetHeight() const
+{
+	return (uint32_t)_height;
+}
+
+uint32_t TextureCache::GetCapacity() const
+{
+	return _capacity;
+}
+
+uint32_t TextureCache::GetTexturesPerAtlas() const
+{
+	return _texturesPerAtlas;
+}
+
+uint32_t TextureCache::GetAtlasCount() const
+{
+	return (uint32_t)_atlasCount;
+}
+
+uint32_t TextureCache::GetMaxAtlasCount() const
+{
+	return D2DX_MAX_ATLASES_PER_TEXTURE_CACHE;
+}
+
+_Use_decl_annotations_
+int32_t TextureCache::GetCacheIndex(
+	int32_t textureWidth,
+	int32_t textureHeight)
+{
+	if (textureWidth < 8 || textureHeight < 8 || textureWidth > 256 || textureHeight > 256 ||
+		(textureWidth & (textureWidth - 1)) || (textureHeight & (textureHeight - 1)))
+	{
+		return -1;
+	}
+
+	if (textureWidth == 256 && textureHeight == 128)
+	{
+		return 6;
+	}
+
+	DWORD log2Longest = 0;
+	BitScanReverse(&log2Longest, (DWORD)max(textureWidth, textureHeight));
+	return (int32_t)log2Longest - 3;
+}
+
+_Use_decl_annotations_
+Size TextureCache::GetCacheTextureSize(
+	int32_t cacheIndex)
+{
+	assert(cacheIndex >= 0 && cacheIndex < D2DX_TEXTURE_CACHE_COUNT);
+
+	if (cacheIndex == 6)
+	{
+		return { 256, 128 };
+	}
+
+	return { 8 << cacheIndex, 8 << cacheIndex };
+}
+
+_Use_decl_annotations_
+uint32_t TextureCache::GetInitialCapacity(
+	int32_t cacheIndex)
+{
+	static const uint32_t capacities[D2DX_TEXTURE_CACHE_COUNT] = { 512, 1024, 2048, 2048, 1024, 512, 1024 };
+	assert(cacheIndex >= 0 && cacheIndex < D2DX_TEXTURE_CACHE_COUNT);
+	return capacities[cacheIndex];
 }
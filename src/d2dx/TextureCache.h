@@ -19,7 +19,16 @@
 #pragma once
 
 #include "ITextureCache.h"
-#include "TextureCachePolicyBitPmru.h"
+#include "ITextureCachePolicy.h"
+#include "Options.h"
+#include "TextureAtlasPacker.h"
+#include "TextureUploadQueue.h"
+
+#define D2DX_MAX_ATLASES_PER_TEXTURE_CACHE 4
+
+/* The render contexts have one texture cache per size of the longest texture side from 8 to 256,
+   and one of its own for 256x128 (see TextureCache::GetCacheIndex). */
+#define D2DX_TEXTURE_CACHE_COUNT 7
 
 namespace d2dx
 {
@@ -31,8 +40,10 @@ namespace d2dx
 			_In_ int32_t height,
 			_In_ uint32_t capacity,
 			_In_ uint32_t texturesPerAtlas,
-			_In_ ID3D11Device* device,
-			_In_ const std::shared_ptr<ISimd>& simd);
+			_In_opt_ ID3D11Device* device,
+			_In_ const std::shared_ptr<ISimd>& simd,
+			_In_ TextureCachePolicyOption policy = TextureCachePolicyOption::BitPmru,
+			_In_opt_ TextureUploadQueue* uploadQueue = nullptr);
 		
 		virtual ~TextureCache() noexcept {}
 
@@ -55,7 +66,45 @@ namespace d2dx
 		
 		virtual uint32_t GetUsedCount() const override;
 
+		virtual uint32_t GetUsedInFrameCount() const override;
+
+		virtual float GetPackingEfficiency() const override;
+
+		virtual const TextureCacheStats& GetStats() const override;
+
+		virtual uint32_t GetWidth() const override;
+
+		virtual uint32_t GetHeight() const override;
+
+		virtual uint32_t GetCapacity() const override;
+
+		virtual uint32_t GetTexturesPerAtlas() const override;
+
+		virtual uint32_t GetAtlasCount() const override;
+
+		virtual uint32_t GetMaxAtlasCount() const override;
+
+		virtual void SetAtlasCount(
+			_In_ uint32_t atlasCount) override;
+
+		/* Which of the D2DX_TEXTURE_CACHE_COUNT caches textures of the given size go in (the same
+		   as Batch::GetTextureCacheIndex), or -1 if the size isn't a power of two from 8 to 256. */
+		static int32_t GetCacheIndex(
+			_In_ int32_t textureWidth,
+			_In_ int32_t textureHeight);
+
+		/* The size of the slots in the given cache. */
+		static Size GetCacheTextureSize(
+			_In_ int32_t cacheIndex);
+
+		/* The capacity that the given cache is created with, before any resizing. */
+		static uint32_t GetInitialCapacity(
+			_In_ int32_t cacheIndex);
+
 	private:
+		HRESULT CreateAtlas(
+			_In_ int32_t atlas);
+
 		void CopyPixels(
 			_In_ int32_t srcWidth,
 			_In_ int32_t srcHeight,
@@ -69,9 +118,13 @@ namespace d2dx
 		uint32_t _capacity = 0;
 		uint32_t _texturesPerAtlas = 0;
 		int32_t _atlasCount = 0;
+		ComPtr<ID3D11Device> _device;
 		ComPtr<ID3D11DeviceContext> _deviceContext;
-		ComPtr<ID3D11Texture2D> _textures[4];
-		ComPtr<ID3D11ShaderResourceView> _srvs[4];
-		TextureCachePolicyBitPmru _policy;
+		ComPtr<ID3D11Texture2D> _textures[D2DX_MAX_ATLASES_PER_TEXTURE_CACHE];
+		ComPtr<ID3D11ShaderResourceView> _srvs[D2DX_MAX_ATLASES_PER_TEXTURE_CACHE];
+		std::unique_ptr<ITextureCachePolicy> _policy;
+		TextureAtlasPacker _packer;
+		TextureUploadQueue* _uploadQueue = nullptr;
+		TextureCacheStats _stats;
 	};
 }
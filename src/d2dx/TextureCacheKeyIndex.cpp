@@ -0,0 +1,115 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "TextureCacheKeyIndex.h"
+
+using namespace d2dx;
+
+_Use_decl_annotations_
+TextureCacheKeyIndex::TextureCacheKeyIndex(
+	uint32_t capacity)
+{
+	assert(capacity > 0 && capacity < 0x40000000);
+
+	uint32_t bits = 1;
+
+	while ((1U << bits) < 2 * capacity)
+	{
+		++bits;
+	}
+
+	_positions = Buffer<uint32_t>(1U << bits, true);
+	_shift = 32 - bits;
+}
+
+_Use_decl_annotations_
+uint32_t TextureCacheKeyIndex::GetPosition(
+	uint32_t contentKey) const
+{
+	/* Content keys are already hashes, but not necessarily well distributed in the low bits. */
+	return (contentKey * 0x9E3779B1U) >> _shift;
+}
+
+_Use_decl_annotations_
+int32_t TextureCacheKeyIndex::Find(
+	uint32_t contentKey,
+	const uint32_t* contentKeys) const
+{
+	const uint32_t mask = _positions.capacity - 1;
+
+	for (uint32_t position = GetPosition(contentKey); _positions.items[position] != 0; position = (position + 1) & mask)
+	{
+		const int32_t index = (int32_t)_positions.items[position] - 1;
+
+		if (contentKeys[index] == contentKey)
+		{
+			return index;
+		}
+	}
+
+	return -1;
+}
+
+_Use_decl_annotations_
+void TextureCacheKeyIndex::Add(
+	uint32_t contentKey,
+	int32_t index)
+{
+	const uint32_t mask = _positions.capacity - 1;
+	uint32_t position = GetPosition(contentKey);
+
+	while (_positions.items[position] != 0)
+	{
+		position = (position + 1) & mask;
+	}
+
+	_positions.items[position] = (uint32_t)(index + 1);
+}
+
+_Use_decl_annotations_
+void TextureCacheKeyIndex::Remove(
+	uint32_t contentKey,
+	int32_t index,
+	const uint32_t* contentKeys)
+{
+	const uint32_t mask = _positions.capacity - 1;
+	uint32_t hole = GetPosition(contentKey);
+
+	while (_positions.items[hole] != (uint32_t)(index + 1))
+	{
+		assert(_positions.items[hole] != 0);
+		hole = (hole + 1) & mask;
+	}
+
+	/* Backward-shift deletion: move later entries of the probe sequence into the hole, so that
+	   lookups never need tombstones. An entry may move if the hole lies between its home position
+	   and where it currently is. */
+	for (uint32_t position = (hole + 1) & mask; _positions.items[position] != 0; position = (position + 1) & mask)
+	{
+		const uint32_t home = GetPosition(contentKeys[_positions.items[position] - 1]);
+
+		if (((position - home) & mask) >= ((position - hole) & mask))
+		{
+			_positions.items[hole] = _positions.items[position];
+			hole = position;
+		}
+	}
+
+	_positions.items[hole] = 0;
+}
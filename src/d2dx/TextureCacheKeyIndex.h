@@ -0,0 +1,60 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Buffer.h"
+
+namespace d2dx
+{
+	/* Open-addressed hash index from content key to cache slot, for the texture cache policies. The
+	   keys themselves live in the policy's slot array, which is passed in where needed. */
+	class TextureCacheKeyIndex final
+	{
+	public:
+		TextureCacheKeyIndex() = default;
+		TextureCacheKeyIndex& operator=(TextureCacheKeyIndex&& rhs) = default;
+
+		TextureCacheKeyIndex(
+			_In_ uint32_t capacity);
+		~TextureCacheKeyIndex() noexcept {}
+
+		bool IsEnabled() const { return _positions.items != nullptr; }
+
+		int32_t Find(
+			_In_ uint32_t contentKey,
+			_In_ const uint32_t* contentKeys) const;
+
+		void Add(
+			_In_ uint32_t contentKey,
+			_In_ int32_t index);
+
+		void Remove(
+			_In_ uint32_t contentKey,
+			_In_ int32_t index,
+			_In_ const uint32_t* contentKeys);
+
+	private:
+		uint32_t GetPosition(
+			_In_ uint32_t contentKey) const;
+
+		/* Entries are slot index + 1, or 0 if empty. Linear probing, at most half full. */
+		Buffer<uint32_t> _positions;
+		uint32_t _shift = 0;
+	};
+}
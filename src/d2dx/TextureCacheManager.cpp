@@ -0,0 +1,192 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "TextureCacheManager.h"
+#include "Utils.h"
+
+using namespace d2dx;
+using namespace std;
+
+_Use_decl_annotations_
+TextureCacheManager::TextureCacheManager(
+	uint32_t memoryBudget,
+	uint32_t rebalanceInterval) :
+	_memoryBudget{ memoryBudget },
+	_rebalanceInterval{ rebalanceInterval }
+{
+	assert(rebalanceInterval > 0);
+}
+
+_Use_decl_annotations_
+void TextureCacheManager::AddTextureCache(
+	ITextureCache* textureCache)
+{
+	assert(textureCache);
+
+	TextureCacheState state;
+	state.textureCache = textureCache;
+	state.lastStats = textureCache->GetStats();
+	_states.push_back(state);
+}
+
+void TextureCacheManager::OnNewFrame()
+{
+	for (auto& state : _states)
+	{
+		const TextureCacheStats& stats = state.textureCache->GetStats();
+		state.evictions += stats.evictions - state.lastStats.evictions;
+		state.maxUsedInFrameCount = max(state.maxUsedInFrameCount, state.textureCache->GetUsedInFrameCount());
+		state.lastStats = stats;
+	}
+
+	++_frame;
+
+	if ((_frame % _rebalanceInterval) == 0)
+	{
+		Rebalance();
+
+		for (auto& state : _states)
+		{
+			state.evictions = 0;
+			state.maxUsedInFrameCount = 0;
+		}
+	}
+}
+
+void TextureCacheManager::Rebalance()
+{
+	/* At most one cache grows per interval: the one evicting the largest share of its capacity. */
+	TextureCacheState* hottest = nullptr;
+
+	for (auto& state : _states)
+	{
+		if (IsHot(state) &&
+			(!hottest || (uint64_t)state.evictions * hottest->textureCache->GetCapacity() >
+				(uint64_t)hottest->evictions * state.textureCache->GetCapacity()))
+		{
+			hottest = &state;
+		}
+	}
+
+	if (!hottest)
+	{
+		return;
+	}
+
+	const uint32_t footprint = GetMemoryFootprint();
+	const uint32_t growthFootprint = GetAtlasMemoryFootprint(hottest->textureCache);
+
+	if (footprint + growthFootprint > _memoryBudget)
+	{
+		/* Over budget: find cold caches to give up an atlas each. Nothing is shrunk unless enough
+		   memory can be freed for the growth. */
+		uint32_t freedFootprint = 0;
+		std::vector<TextureCacheState*> donors;
+
+		for (auto& state : _states)
+		{
+			if (&state != hottest && IsCold(state))
+			{
+				donors.push_back(&state);
+				freedFootprint += GetAtlasMemoryFootprint(state.textureCache);
+
+				if (footprint + growthFootprint - freedFootprint <= _memoryBudget)
+				{
+					break;
+				}
+			}
+		}
+
+		if (footprint + growthFootprint - freedFootprint > _memoryBudget)
+		{
+			return;
+		}
+
+		for (auto donor : donors)
+		{
+			SetAtlasCount(*donor, donor->textureCache->GetAtlasCount() - 1);
+		}
+	}
+
+	SetAtlasCount(*hottest, hottest->textureCache->GetAtlasCount() + 1);
+}
+
+_Use_decl_annotations_
+bool TextureCacheManager::IsHot(
+	const TextureCacheState& state) const
+{
+	/* Evicting more than 1/16th of the capacity per interval means the working set doesn't fit. */
+	return state.textureCache->GetAtlasCount() < state.textureCache->GetMaxAtlasCount() &&
+		state.evictions * 16 >= state.textureCache->GetCapacity();
+}
+
+_Use_decl_annotations_
+bool TextureCacheManager::IsCold(
+	const TextureCacheState& state) const
+{
+	/* No evictions, one atlas to spare even in the busiest frame of the interval, and not resized
+	   recently (so that two caches don't trade an atlas back and forth). */
+	const ITextureCache* textureCache = state.textureCache;
+
+	return textureCache->GetAtlasCount() > 1 &&
+		state.evictions == 0 &&
+		state.maxUsedInFrameCount + textureCache->GetTexturesPerAtlas() <= textureCache->GetCapacity() &&
+		(_frame - state.lastResizeFrame) >= 4 * _rebalanceInterval;
+}
+
+_Use_decl_annotations_
+void TextureCacheManager::SetAtlasCount(
+	TextureCacheState& state,
+	uint32_t atlasCount)
+{
+	ITextureCache* textureCache = state.textureCache;
+	textureCache->SetAtlasCount(atlasCount);
+	state.lastResizeFrame = _frame;
+
+	D2DX_LOG("Resized texture cache for %u x %u to %u atlases, capacity %u. Total size of texture caches is %u kB.",
+		textureCache->GetWidth(),
+		textureCache->GetHeight(),
+		textureCache->GetAtlasCount(),
+		textureCache->GetCapacity(),
+		GetMemoryFootprint() / 1024);
+}
+
+uint32_t TextureCacheManager::GetMemoryFootprint() const
+{
+	uint32_t footprint = 0;
+
+	for (const auto& state : _states)
+	{
+		footprint += state.textureCache->GetMemoryFootprint();
+	}
+
+	return footprint;
+}
+
+uint32_t TextureCacheManager::GetMemoryBudget() const
+{
+	return _memoryBudget;
+}
+
+_Use_decl_annotations_
+uint32_t TextureCacheManager::GetAtlasMemoryFootprint(
+	const ITextureCache* textureCache)
+{
+	return textureCache->GetWidth() * textureCache->GetHeight() * textureCache->GetTexturesPerAtlas();
+}
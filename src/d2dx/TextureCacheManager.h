@@ -0,0 +1,76 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "ITextureCache.h"
+
+namespace d2dx
+{
+	/* Moves atlases between the texture caches, so that caches that keep evicting textures can grow,
+	   while the total memory footprint stays within a budget. */
+	class TextureCacheManager final
+	{
+	public:
+		TextureCacheManager(
+			_In_ uint32_t memoryBudget,
+			_In_ uint32_t rebalanceInterval = 64);
+		~TextureCacheManager() noexcept {}
+
+		/* The manager does not own the cache. */
+		void AddTextureCache(
+			_In_ ITextureCache* textureCache);
+
+		/* Must be called between frames, before the caches' own OnNewFrame. */
+		void OnNewFrame();
+
+		uint32_t GetMemoryFootprint() const;
+
+		uint32_t GetMemoryBudget() const;
+
+	private:
+		struct TextureCacheState final
+		{
+			ITextureCache* textureCache = nullptr;
+			TextureCacheStats lastStats;
+			uint32_t evictions = 0;
+			uint32_t maxUsedInFrameCount = 0;
+			uint32_t lastResizeFrame = 0;
+		};
+
+		void Rebalance();
+
+		bool IsHot(
+			_In_ const TextureCacheState& state) const;
+
+		bool IsCold(
+			_In_ const TextureCacheState& state) const;
+
+		void SetAtlasCount(
+			_Inout_ TextureCacheState& state,
+			_In_ uint32_t atlasCount);
+
+		static uint32_t GetAtlasMemoryFootprint(
+			_In_ const ITextureCache* textureCache);
+
+		std::vector<TextureCacheState> _states;
+		uint32_t _memoryBudget = 0;
+		uint32_t _rebalanceInterval = 0;
+		uint32_t _frame = 0;
+	};
+}
@@ -0,0 +1,345 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "TextureCachePolicy2Q.h"
+#include "Utils.h"
+
+using namespace d2dx;
+using namespace std;
+
+_Use_decl_annotations_
+TextureCachePolicy2Q::TextureCachePolicy2Q(
+	uint32_t capacity,
+	const std::shared_ptr<ISimd>& simd) :
+	_capacity{ capacity },
+	_probationCapacity{ capacity / 4 },
+	_simd{ simd },
+	_contentKeys{ capacity, true },
+	_usedInFrameBits{ capacity >> 5, true },
+	_insertFrames{ capacity, true },
+	_queues{ capacity, true },
+	_prev{ capacity, true },
+	_next{ capacity, true },
+	_keyIndex{ capacity },
+	/* Remember as many evicted keys as half the capacity, as suggested in the paper. The SIMD scan
+	   wants a multiple of 64. */
+	_ghostKeys{ max(64U, (capacity / 2 + 63) & ~63U), true }
+{
+	assert(capacity > 0 && !(capacity & 63));
+	assert(capacity < 32768);
+	assert(simd);
+
+	/* Hand out free slots in order, like TextureCachePolicyBitPmru. */
+	for (int32_t i = (int32_t)capacity - 1; i >= 0; --i)
+	{
+		PushFront(Queue::Free, i);
+	}
+}
+
+_Use_decl_annotations_
+int32_t TextureCachePolicy2Q::Find(
+	uint32_t contentKey,
+	int32_t lastIndex)
+{
+	assert(contentKey != 0);
+
+	int32_t findIndex = -1;
+
+	if (lastIndex >= 0 && lastIndex < (int32_t)_capacity &&
+		contentKey == _contentKeys.items[lastIndex])
+	{
+		findIndex = lastIndex;
+	}
+	else
+	{
+		findIndex = _keyIndex.Find(contentKey, _contentKeys.items);
+	}
+
+	if (findIndex >= 0)
+	{
+		Touch(findIndex);
+	}
+
+	return findIndex;
+}
+
+_Use_decl_annotations_
+int32_t TextureCachePolicy2Q::Insert(
+	uint32_t contentKey,
+	bool& evicted)
+{
+	int32_t index = _heads[(int32_t)Queue::Free];
+	evicted = index < 0;
+
+	if (evicted)
+	{
+		index = FindVictim();
+
+		const uint32_t evictedKey = _contentKeys.items[index];
+
+		if (evictedKey)
+		{
+			_keyIndex.Remove(evictedKey, index, _contentKeys.items);
+
+			if (_queues.items[index] == Queue::Probation)
+			{
+				AddGhost(evictedKey);
+			}
+		}
+	}
+
+	Unlink(index);
+
+	/* A key that was recently evicted from probation has proven that it is reused. */
+	PushFront(contentKey && RemoveGhost(contentKey) ? Queue::Main : Queue::Probation, index);
+
+	_contentKeys.items[index] = contentKey;
+	_insertFrames.items[index] = _frame;
+
+	if (contentKey)
+	{
+		_keyIndex.Add(contentKey, index);
+	}
+
+	SetUsedInFrame(index);
+
+	return index;
+}
+
+void TextureCachePolicy2Q::OnNewFrame()
+{
+	memset(_usedInFrameBits.items, 0, sizeof(uint32_t) * _usedInFrameBits.capacity);
+	++_frame;
+}
+
+uint32_t TextureCachePolicy2Q::GetUsedCount() const
+{
+	return _capacity - _sizes[(int32_t)Queue::Free];
+}
+
+uint32_t TextureCachePolicy2Q::GetUsedInFrameCount() const
+{
+	uint32_t usedInFrameCount = 0;
+
+	for (uint32_t i = 0; i < _usedInFrameBits.capacity; ++i)
+	{
+		usedInFrameCount += (uint32_t)popcount(_usedInFrameBits.items[i]);
+	}
+
+	return usedInFrameCount;
+}
+
+_Use_decl_annotations_
+void TextureCachePolicy2Q::SetCapacity(
+	uint32_t capacity)
+{
+	if (capacity == _capacity)
+	{
+		return;
+	}
+
+	TextureCachePolicy2Q resized{ capacity, _simd };
+	resized._frame = _frame;
+
+	/* Re-add the kept entries oldest first, so that each queue keeps its order. */
+	for (int32_t queue = (int32_t)Queue::Probation; queue <= (int32_t)Queue::Main; ++queue)
+	{
+		for (int32_t index = _tails[queue]; index >= 0; index = _prev.items[index])
+		{
+			if (index < (int32_t)capacity)
+			{
+				resized.Unlink(index);
+				resized.PushFront((Queue)queue, index);
+				resized._contentKeys.items[index] = _contentKeys.items[index];
+				resized._insertFrames.items[index] = _insertFrames.items[index];
+
+				if (_contentKeys.items[index])
+				{
+					resized._keyIndex.Add(_contentKeys.items[index], index);
+				}
+
+				if (IsUsedInFrame(index))
+				{
+					resized.SetUsedInFrame(index);
+				}
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < _ghostKeys.capacity; ++i)
+	{
+		const uint32_t ghostKey = _ghostKeys.items[(_ghostNext + i) % _ghostKeys.capacity];
+
+		if (ghostKey)
+		{
+			resized.AddGhost(ghostKey);
+		}
+	}
+
+	*this = std::move(resized);
+}
+
+_Use_decl_annotations_
+bool TextureCachePolicy2Q::IsUsedInFrame(
+	int32_t index) const
+{
+	return (_usedInFrameBits.items[index >> 5] & (1U << (index & 31))) != 0;
+}
+
+_Use_decl_annotations_
+void TextureCachePolicy2Q::SetUsedInFrame(
+	int32_t index)
+{
+	_usedInFrameBits.items[index >> 5] |= 1U << (index & 31);
+}
+
+_Use_decl_annotations_
+void TextureCachePolicy2Q::Touch(
+	int32_t index)
+{
+	assert(index >= 0 && index < (int32_t)_capacity && _queues.items[index] != Queue::Free);
+
+	const Queue queue = _queues.items[index];
+
+	if (queue == Queue::Main)
+	{
+		Unlink(index);
+		PushFront(Queue::Main, index);
+	}
+	else if (queue == Queue::Probation)
+	{
+		/* Uses within the frame it was inserted are correlated (a sprite drawn many times), but a use
+		   in a later frame means the texture is worth keeping. */
+		Unlink(index);
+		PushFront(_insertFrames.items[index] != _frame ? Queue::Main : Queue::Probation, index);
+	}
+
+	SetUsedInFrame(index);
+}
+
+_Use_decl_annotations_
+void TextureCachePolicy2Q::Unlink(
+	int32_t index)
+{
+	const int32_t queue = (int32_t)_queues.items[index];
+	const int16_t prev = _prev.items[index];
+	const int16_t next = _next.items[index];
+
+	if (prev >= 0)
+	{
+		_next.items[prev] = next;
+	}
+	else
+	{
+		_heads[queue] = next;
+	}
+
+	if (next >= 0)
+	{
+		_prev.items[next] = prev;
+	}
+	else
+	{
+		_tails[queue] = prev;
+	}
+
+	--_sizes[queue];
+}
+
+_Use_decl_annotations_
+void TextureCachePolicy2Q::PushFront(
+	Queue queue,
+	int32_t index)
+{
+	const int16_t head = _heads[(int32_t)queue];
+
+	_queues.items[index] = queue;
+	_prev.items[index] = -1;
+	_next.items[index] = head;
+
+	if (head >= 0)
+	{
+		_prev.items[head] = (int16_t)index;
+	}
+	else
+	{
+		_tails[(int32_t)queue] = (int16_t)index;
+	}
+
+	_heads[(int32_t)queue] = (int16_t)index;
+	++_sizes[(int32_t)queue];
+}
+
+_Use_decl_annotations_
+int32_t TextureCachePolicy2Q::FindVictim(
+	Queue queue) const
+{
+	/* The oldest entry, unless a batch of the current frame refers to it. Entries move to the head
+	   of their queue whenever they are used, so if the oldest one was used in this frame, all were. */
+	const int32_t index = _tails[(int32_t)queue];
+	return index >= 0 && !IsUsedInFrame(index) ? index : -1;
+}
+
+int32_t TextureCachePolicy2Q::FindVictim()
+{
+	const bool isProbationFull = _sizes[(int32_t)Queue::Probation] > _probationCapacity;
+	const Queue firstChoice = isProbationFull ? Queue::Probation : Queue::Main;
+	const Queue secondChoice = isProbationFull ? Queue::Main : Queue::Probation;
+
+	int32_t index = FindVictim(firstChoice);
+
+	if (index < 0)
+	{
+		index = FindVictim(secondChoice);
+	}
+
+	if (index < 0)
+	{
+		D2DX_LOG("All texture atlas entries used in a single frame, starting over!");
+		memset(_usedInFrameBits.items, 0, sizeof(uint32_t) * _usedInFrameBits.capacity);
+
+		index = _tails[(int32_t)firstChoice] >= 0 ? _tails[(int32_t)firstChoice] : _tails[(int32_t)secondChoice];
+	}
+
+	assert(index >= 0);
+	return index;
+}
+
+_Use_decl_annotations_
+void TextureCachePolicy2Q::AddGhost(
+	uint32_t contentKey)
+{
+	_ghostKeys.items[_ghostNext] = contentKey;
+	_ghostNext = (_ghostNext + 1) % _ghostKeys.capacity;
+}
+
+_Use_decl_annotations_
+bool TextureCachePolicy2Q::RemoveGhost(
+	uint32_t contentKey)
+{
+	const int32_t index = _simd->IndexOfUInt32(_ghostKeys.items, _ghostKeys.capacity, contentKey);
+
+	if (index < 0)
+	{
+		return false;
+	}
+
+	_ghostKeys.items[index] = 0;
+	return true;
+}
@@ -0,0 +1,120 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Buffer.h"
+#include "ISimd.h"
+#include "ITextureCachePolicy.h"
+#include "TextureCacheKeyIndex.h"
+
+namespace d2dx
+{
+	/* Scan-resistant "2Q" replacement (Johnson & Shasha). New textures enter a FIFO probation queue and
+	   only move to the LRU main queue when they are used again in a later frame, or when they come back
+	   shortly after being evicted (tracked by a queue of evicted keys). While the probation queue is
+	   over its share of the capacity, evictions come from it, so a flood of one-off textures (e.g. the
+	   floor tiles after a waypoint jump) only replaces other one-off textures, not the UI and character
+	   sprites in the main queue. */
+	class TextureCachePolicy2Q final : public ITextureCachePolicy
+	{
+	public:
+		TextureCachePolicy2Q() = default;
+		TextureCachePolicy2Q& operator=(TextureCachePolicy2Q&& rhs) = default;
+
+		TextureCachePolicy2Q(
+			_In_ uint32_t capacity,
+			_In_ const std::shared_ptr<ISimd>& simd);
+		virtual ~TextureCachePolicy2Q() noexcept {}
+
+		virtual int32_t Find(
+			_In_ uint32_t contentKey,
+			_In_ int32_t lastIndex) override;
+
+		virtual int32_t Insert(
+			_In_ uint32_t contentKey,
+			_Out_ bool& evicted) override;
+
+		virtual void Touch(
+			_In_ int32_t index) override;
+
+		virtual void OnNewFrame() override;
+
+		virtual uint32_t GetUsedCount() const override;
+
+		virtual uint32_t GetUsedInFrameCount() const override;
+
+		virtual uint32_t GetCapacity() const override { return _capacity; }
+
+		virtual void SetCapacity(
+			_In_ uint32_t capacity) override;
+
+	private:
+		enum class Queue : uint8_t
+		{
+			Free = 0,
+			Probation = 1,
+			Main = 2,
+			Count = 3
+		};
+
+		bool IsUsedInFrame(
+			_In_ int32_t index) const;
+
+		void SetUsedInFrame(
+			_In_ int32_t index);
+
+		void Unlink(
+			_In_ int32_t index);
+
+		void PushFront(
+			_In_ Queue queue,
+			_In_ int32_t index);
+
+		int32_t FindVictim(
+			_In_ Queue queue) const;
+
+		int32_t FindVictim();
+
+		void AddGhost(
+			_In_ uint32_t contentKey);
+
+		bool RemoveGhost(
+			_In_ uint32_t contentKey);
+
+		uint32_t _capacity = 0;
+		uint32_t _probationCapacity = 0;
+		std::shared_ptr<ISimd> _simd;
+		Buffer<uint32_t> _contentKeys;
+		Buffer<uint32_t> _usedInFrameBits;
+		Buffer<uint32_t> _insertFrames;
+		Buffer<Queue> _queues;
+		Buffer<int16_t> _prev;
+		Buffer<int16_t> _next;
+		int16_t _heads[(int32_t)Queue::Count] = { -1, -1, -1 };
+		int16_t _tails[(int32_t)Queue::Count] = { -1, -1, -1 };
+		uint32_t _sizes[(int32_t)Queue::Count] = { 0, 0, 0 };
+		TextureCacheKeyIndex _keyIndex;
+
+		/* Keys recently evicted from the probation queue. A ring buffer; 0 is an empty entry. */
+		Buffer<uint32_t> _ghostKeys;
+		uint32_t _ghostNext = 0;
+
+		uint32_t _frame = 0;
+	};
+}
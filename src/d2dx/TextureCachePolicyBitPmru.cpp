@@ -22,19 +22,29 @@
 #include "ISimd.h"
 
 using namespace d2dx;
+using namespace std;
 
 _Use_decl_annotations_
 TextureCachePolicyBitPmru::TextureCachePolicyBitPmru(
 	uint32_t capacity,
-	const std::shared_ptr<ISimd>& simd) :
+	const std::shared_ptr<ISimd>& simd,
+	TextureCacheLookup lookup) :
 	_capacity{ capacity },
+	_lookup{ lookup },
 	_contentKeys{ capacity, true },
 	_usedInFrameBits{ capacity >> 5, true },
 	_mruBits{ capacity >> 5, true },
+	_occupiedBits{ capacity >> 5, true },
 	_simd{ simd }
 {
 	assert(!(capacity & 63));
+	assert(capacity < 32768);
 	assert(simd);
+
+	if (lookup == TextureCacheLookup::HashIndex && capacity > 0)
+	{
+		_keyIndex = TextureCacheKeyIndex(capacity);
+	}
 }
 
 _Use_decl_annotations_
@@ -52,23 +62,34 @@ int32_t TextureCachePolicyBitPmru::Find(
 	if (lastIndex >= 0 && lastIndex < (int32_t)_capacity &&
 		contentKey == _contentKeys.items[lastIndex])
 	{
-		_usedInFrameBits.items[lastIndex >> 5] |= 1 << (lastIndex & 31);
-		_mruBits.items[lastIndex >> 5] |= 1 << (lastIndex & 31);
+		Touch(lastIndex);
 		return lastIndex;
 	}
 
-	int32_t findIndex = _simd->IndexOfUInt32(_contentKeys.items, _capacity, contentKey);
+	int32_t findIndex = _keyIndex.IsEnabled() ?
+		_keyIndex.Find(contentKey, _contentKeys.items) :
+		_simd->IndexOfUInt32(_contentKeys.items, _capacity, contentKey);
 
 	if (findIndex >= 0)
 	{
-		_usedInFrameBits.items[findIndex >> 5] |= 1 << (findIndex & 31);
-		_mruBits.items[findIndex >> 5] |= 1 << (findIndex & 31);
+		Touch(findIndex);
 		return findIndex;
 	}
 
 	return -1;
 }
 
+_Use_decl_annotations_
+void TextureCachePolicyBitPmru::Touch(
+	int32_t index)
+{
+	assert(index >= 0 && index < (int32_t)_capacity);
+	assert(_occupiedBits.items[index >> 5] & (1 << (index & 31)));
+
+	_usedInFrameBits.items[index >> 5] |= 1 << (index & 31);
+	_mruBits.items[index >> 5] |= 1 << (index & 31);
+}
+
 _Use_decl_annotations_
 int32_t TextureCachePolicyBitPmru::Insert(
 	uint32_t contentKey,
@@ -127,15 +148,25 @@ int32_t TextureCachePolicyBitPmru::Insert(
 	_mruBits.items[replacementIndex >> 5] |= 1 << (replacementIndex & 31);
 	_usedInFrameBits.items[replacementIndex >> 5] |= 1 << (replacementIndex & 31);
 
-	evicted = _contentKeys.items[replacementIndex] != 0;
+	evicted = (_occupiedBits.items[replacementIndex >> 5] & (1 << (replacementIndex & 31))) != 0;
 
 	if (!evicted)
 	{
+		_occupiedBits.items[replacementIndex >> 5] |= 1 << (replacementIndex & 31);
 		++_usedCount;
 	}
+	else if (_keyIndex.IsEnabled() && _contentKeys.items[replacementIndex])
+	{
+		_keyIndex.Remove(_contentKeys.items[replacementIndex], replacementIndex, _contentKeys.items);
+	}
 
 	_contentKeys.items[replacementIndex] = contentKey;
 
+	if (_keyIndex.IsEnabled() && contentKey)
+	{
+		_keyIndex.Add(contentKey, replacementIndex);
+	}
+
 	return replacementIndex;
 }
 
@@ -148,3 +179,50 @@ uint32_t TextureCachePolicyBitPmru::GetUsedCount() const
 {
 	return _usedCount;
 }
+
+uint32_t TextureCachePolicyBitPmru::GetUsedInFrameCount() const
+{
+	uint32_t usedInFrameCount = 0;
+
+	for (uint32_t i = 0; i < _usedInFrameBits.capacity; ++i)
+	{
+		usedInFrameCount += (uint32_t)popcount(_usedInFrameBits.items[i]);
+	}
+
+	return usedInFrameCount;
+}
+
+_Use_decl_annotations_
+void TextureCachePolicyBitPmru::SetCapacity(
+	uint32_t capacity)
+{
+	if (capacity == _capacity)
+	{
+		return;
+	}
+
+	TextureCachePolicyBitPmru resized{ capacity, _simd, _lookup };
+
+	const uint32_t keptCapacity = min(capacity, _capacity);
+	memcpy(resized._usedInFrameBits.items, _usedInFrameBits.items, sizeof(uint32_t) * (keptCapacity >> 5));
+	memcpy(resized._mruBits.items, _mruBits.items, sizeof(uint32_t) * (keptCapacity >> 5));
+	memcpy(resized._occupiedBits.items, _occupiedBits.items, sizeof(uint32_t) * (keptCapacity >> 5));
+
+	for (uint32_t i = 0; i < keptCapacity; ++i)
+	{
+		const uint32_t contentKey = _contentKeys.items[i];
+
+		if (_occupiedBits.items[i >> 5] & (1 << (i & 31)))
+		{
+			resized._contentKeys.items[i] = contentKey;
+			++resized._usedCount;
+
+			if (resized._keyIndex.IsEnabled() && contentKey)
+			{
+				resized._keyIndex.Add(contentKey, (int32_t)i);
+			}
+		}
+	}
+
+	*this = std::move(resized);
+}
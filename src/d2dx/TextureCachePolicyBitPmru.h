@@ -20,10 +20,21 @@
 
 #include "Buffer.h"
 #include "ISimd.h"
+#include "ITextureCachePolicy.h"
+#include "TextureCacheKeyIndex.h"
 
 namespace d2dx
 {
-	class TextureCachePolicyBitPmru final
+	enum class TextureCacheLookup
+	{
+		/* Open-addressed hash index from content key to slot, kept up to date on insert/evict. */
+		HashIndex = 0,
+
+		/* Linear SIMD scan over all content keys. */
+		SimdScan = 1,
+	};
+
+	class TextureCachePolicyBitPmru final : public ITextureCachePolicy
 	{
 	public:
 		TextureCachePolicyBitPmru() = default;
@@ -31,27 +42,43 @@ namespace d2dx
 
 		TextureCachePolicyBitPmru(
 			_In_ uint32_t capacity,
-			_In_ const std::shared_ptr<ISimd>& simd);
-		~TextureCachePolicyBitPmru() noexcept {}
+			_In_ const std::shared_ptr<ISimd>& simd,
+			_In_ TextureCacheLookup lookup = TextureCacheLookup::HashIndex);
+		virtual ~TextureCachePolicyBitPmru() noexcept {}
 
-		int32_t Find(
+		virtual int32_t Find(
 			_In_ uint32_t contentKey,
-			_In_ int32_t lastIndex);
+			_In_ int32_t lastIndex) override;
 		
-		int32_t Insert(
+		virtual int32_t Insert(
 			_In_ uint32_t contentKey,
-			_Out_ bool& evicted);
+			_Out_ bool& evicted) override;
+
+		virtual void Touch(
+			_In_ int32_t index) override;
 		
-		void OnNewFrame();
+		virtual void OnNewFrame() override;
 
-		uint32_t GetUsedCount() const;
+		virtual uint32_t GetUsedCount() const override;
+
+		virtual uint32_t GetUsedInFrameCount() const override;
+
+		virtual uint32_t GetCapacity() const override { return _capacity; }
+
+		virtual void SetCapacity(
+			_In_ uint32_t capacity) override;
 
 	private:
 		uint32_t _capacity = 0;
+		TextureCacheLookup _lookup = TextureCacheLookup::HashIndex;
 		std::shared_ptr<ISimd> _simd;
 		Buffer<uint32_t> _contentKeys;
 		Buffer<uint32_t> _usedInFrameBits;
 		Buffer<uint32_t> _mruBits;
+
+		/* Slots that hold an entry; entries inserted with a key of 0 can't be told apart otherwise. */
+		Buffer<uint32_t> _occupiedBits;
 		uint32_t _usedCount = 0;
+		TextureCacheKeyIndex _keyIndex;
 	};
 }
@@ -0,0 +1,211 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "Batch.h"
+#include "TextureCache.h"
+#include "TextureCacheManager.h"
+#include "TextureCacheSimulator.h"
+#include "Utils.h"
+
+using namespace d2dx;
+using namespace std;
+
+_Use_decl_annotations_
+TextureCacheSimulator::TextureCacheSimulator(
+	const std::shared_ptr<ISimd>& simd) :
+	_simd{ simd }
+{
+	assert(simd);
+}
+
+_Use_decl_annotations_
+bool TextureCacheSimulator::LoadLog(
+	const char* filename,
+	std::vector<TextureBindRecord>& records)
+{
+	records.clear();
+
+	FILE* file = nullptr;
+
+	if (fopen_s(&file, filename, "rb") != 0 || !file)
+	{
+		D2DX_LOG("Failed to open texture bind log '%s'.", filename);
+		return false;
+	}
+
+	TextureBindLogFileHeader fileHeader{ 0, 0 };
+
+	if (fread(&fileHeader, sizeof(fileHeader), 1, file) != 1 ||
+		fileHeader.magic != D2DX_TEXTURE_BIND_LOG_MAGIC ||
+		fileHeader.version != D2DX_TEXTURE_BIND_LOG_VERSION)
+	{
+		D2DX_LOG("'%s' is not a supported texture bind log.", filename);
+		fclose(file);
+		return false;
+	}
+
+	TextureBindRecord chunk[4096];
+	size_t readCount = 0;
+
+	while ((readCount = fread(chunk, sizeof(TextureBindRecord), ARRAYSIZE(chunk), file)) > 0)
+	{
+		for (size_t i = 0; i < readCount; ++i)
+		{
+			/* Skip anything the texture caches couldn't have been asked for (e.g. a torn record
+			   at the end of a log from a crashed session). */
+			if (TextureCache::GetCacheIndex(chunk[i].width, chunk[i].height) >= 0 && chunk[i].contentKey != 0)
+			{
+				records.push_back(chunk[i]);
+			}
+		}
+	}
+
+	fclose(file);
+	return true;
+}
+
+_Use_decl_annotations_
+TextureCacheSimulatorResult TextureCacheSimulator::Run(
+	const TextureBindRecord* records,
+	uint32_t recordCount,
+	const TextureCacheSimulatorConfig& config) const
+{
+	TextureCacheSimulatorResult result;
+	std::unique_ptr<TextureCache> textureCaches[D2DX_TEXTURE_CACHE_COUNT];
+
+	for (int32_t i = 0; i < ARRAYSIZE(textureCaches); ++i)
+	{
+		const Size size = TextureCache::GetCacheTextureSize(i);
+
+		textureCaches[i] = std::make_unique<TextureCache>(
+			size.width, size.height, config.capacities[i], config.texturesPerAtlas, nullptr, _simd, config.policy);
+
+		result.initialMemoryFootprint += textureCaches[i]->GetMemoryFootprint();
+	}
+
+	/* Same budget as RenderContextResources. */
+	TextureCacheManager textureCacheManager{ result.initialMemoryFootprint * 2 };
+
+	for (int32_t i = 0; i < ARRAYSIZE(textureCaches); ++i)
+	{
+		textureCacheManager.AddTextureCache(textureCaches[i].get());
+	}
+
+	result.maxMemoryFootprint = result.initialMemoryFootprint;
+
+	/* The caches only look at the size and start address of the batch. */
+	Batch batch;
+	batch.SetTextureStartAddress(0);
+
+	const uint8_t tmuData[4] = { 0 };
+	uint32_t frameEvictions = 0;
+	uint32_t frameUploadBytes = 0;
+	uint32_t frame = records && recordCount > 0 ? records[0].frame : 0;
+
+	for (uint32_t i = 0; i <= recordCount; ++i)
+	{
+		if (i == recordCount || records[i].frame != frame)
+		{
+			++result.frameCount;
+
+			if (frameEvictions > result.maxEvictionsInFrame)
+			{
+				result.maxEvictionsInFrame = frameEvictions;
+			}
+
+			if (frameUploadBytes > result.maxUploadBytesInFrame)
+			{
+				result.maxUploadBytesInFrame = frameUploadBytes;
+				result.maxUploadBytesFrame = frame;
+			}
+
+			frameEvictions = 0;
+			frameUploadBytes = 0;
+
+			if (i == recordCount)
+			{
+				break;
+			}
+
+			frame = records[i].frame;
+
+			/* Same order as RenderContextResources::OnNewFrame. */
+			if (config.isResizeEnabled)
+			{
+				textureCacheManager.OnNewFrame();
+
+				uint32_t memoryFootprint = 0;
+
+				for (int32_t j = 0; j < ARRAYSIZE(textureCaches); ++j)
+				{
+					memoryFootprint += textureCaches[j]->GetMemoryFootprint();
+				}
+
+				result.maxMemoryFootprint = max(result.maxMemoryFootprint, memoryFootprint);
+			}
+
+			for (int32_t j = 0; j < ARRAYSIZE(textureCaches); ++j)
+			{
+				textureCaches[j]->OnNewFrame();
+			}
+		}
+
+		const TextureBindRecord& record = records[i];
+		const int32_t cacheIndex = TextureCache::GetCacheIndex(record.width, record.height);
+
+		if (cacheIndex < 0 || record.contentKey == 0)
+		{
+			continue;
+		}
+
+		TextureCache* textureCache = textureCaches[cacheIndex].get();
+		++result.bindCount;
+
+		if (textureCache->FindTexture(record.contentKey, -1)._textureAtlas >= 0)
+		{
+			++result.hits;
+			continue;
+		}
+
+		const uint32_t evictionsBefore = textureCache->GetStats().evictions;
+
+		batch.SetTextureSize(record.width, record.height);
+		textureCache->InsertTexture(record.contentKey, batch, tmuData, sizeof(tmuData));
+
+		const uint32_t evictions = textureCache->GetStats().evictions - evictionsBefore;
+
+		++result.misses;
+		++result.cacheMisses[cacheIndex];
+		result.evictions += evictions;
+		frameEvictions += evictions;
+
+		/* The whole texture is uploaded on a miss, one byte per texel. */
+		result.uploadBytes += (uint32_t)record.width * record.height;
+		frameUploadBytes += (uint32_t)record.width * record.height;
+	}
+
+	for (int32_t i = 0; i < ARRAYSIZE(textureCaches); ++i)
+	{
+		result.finalMemoryFootprint += textureCaches[i]->GetMemoryFootprint();
+		result.finalCapacities[i] = textureCaches[i]->GetCapacity();
+		result.finalPackingEfficiencies[i] = textureCaches[i]->GetPackingEfficiency();
+	}
+
+	return result;
+}
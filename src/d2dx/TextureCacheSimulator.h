@@ -0,0 +1,97 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "ISimd.h"
+#include "Options.h"
+#include "TextureBindLog.h"
+#include "TextureCache.h"
+
+namespace d2dx
+{
+	struct TextureCacheSimulatorConfig final
+	{
+		TextureCachePolicyOption policy = TextureCachePolicyOption::BitPmru;
+
+		/* In the order of TextureCache::GetCacheIndex: 8x8 to 256x256, then 256x128. Each must be a
+		   power of two. */
+		uint32_t capacities[D2DX_TEXTURE_CACHE_COUNT];
+
+		/* What the device supports (D3D11 guarantees 2048). */
+		uint32_t texturesPerAtlas = 2048;
+
+		/* Let a TextureCacheManager move atlases between the caches, as the game does. */
+		bool isResizeEnabled = true;
+
+		/* The capacities that the render contexts create the caches with. */
+		TextureCacheSimulatorConfig() noexcept
+		{
+			for (int32_t i = 0; i < D2DX_TEXTURE_CACHE_COUNT; ++i)
+			{
+				capacities[i] = TextureCache::GetInitialCapacity(i);
+			}
+		}
+	};
+
+	struct TextureCacheSimulatorResult final
+	{
+		uint32_t frameCount = 0;
+		uint64_t bindCount = 0;
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t evictions = 0;
+		uint32_t maxEvictionsInFrame = 0;
+		uint64_t uploadBytes = 0;
+		uint32_t maxUploadBytesInFrame = 0;
+		uint32_t maxUploadBytesFrame = 0;
+		uint32_t initialMemoryFootprint = 0;
+		uint32_t maxMemoryFootprint = 0;
+		uint32_t finalMemoryFootprint = 0;
+
+		/* Per cache, in the order of TextureCacheSimulatorConfig::capacities. */
+		uint64_t cacheMisses[D2DX_TEXTURE_CACHE_COUNT] = {};
+		uint32_t finalCapacities[D2DX_TEXTURE_CACHE_COUNT] = {};
+		float finalPackingEfficiencies[D2DX_TEXTURE_CACHE_COUNT] = {};
+	};
+
+	/* Replays a texture bind log through the same TextureCache, policy and TextureCacheManager code
+	   that the game uses, without a device. Used for tuning the cache capacities and policy for
+	   a mod from a recorded session (see d2dxcachesim). */
+	class TextureCacheSimulator final
+	{
+	public:
+		TextureCacheSimulator(
+			_In_ const std::shared_ptr<ISimd>& simd);
+
+		~TextureCacheSimulator() noexcept {}
+
+		/* Returns false if the file can't be read or is not a texture bind log. */
+		static bool LoadLog(
+			_In_z_ const char* filename,
+			_Out_ std::vector<TextureBindRecord>& records);
+
+		TextureCacheSimulatorResult Run(
+			_In_reads_(recordCount) const TextureBindRecord* records,
+			_In_ uint32_t recordCount,
+			_In_ const TextureCacheSimulatorConfig& config) const;
+
+	private:
+		std::shared_ptr<ISimd> _simd;
+	};
+}
@@ -22,19 +22,136 @@
 #include "Utils.h"
 
 using namespace d2dx;
+using namespace std;
 
-TextureHasher::TextureHasher() :
+#define D2DX_COMPATIBILITY_HASH_CAPACITY 16384
+#define D2DX_KNOWN_CONTENT_CAPACITY 4096
+#define D2DX_FINGERPRINT_SIZE 64
+
+_Use_decl_annotations_
+TextureHasher::TextureHasher(
+	const std::shared_ptr<ISimd>& simd,
+	TextureHashEngine engine) :
+	_simd{ simd },
+	_engine{ engine },
 	_cache{ D2DX_TMU_MEMORY_SIZE / 256, true },
+	_cacheSizes{ D2DX_TMU_MEMORY_SIZE / 256, true },
+	_compatibilityKeys{ D2DX_COMPATIBILITY_HASH_CAPACITY, true },
+	_compatibilityHashes{ D2DX_COMPATIBILITY_HASH_CAPACITY, true },
+	_knownContents{ D2DX_KNOWN_CONTENT_CAPACITY, true },
 	_cacheHits{ 0 },
-	_cacheMisses{ 0 }
+	_cacheMisses{ 0 },
+	_compatibilityHits{ 0 },
+	_compatibilityMisses{ 0 },
+	_downloads{ 0 },
+	_hashesAvoided{ 0 },
+	_copiesAvoided{ 0 }
+{
+}
+
+TextureHashEngine TextureHasher::GetFastestEngine()
+{
+	/* SSE4.2 is CPUID leaf 1, ECX bit 20. */
+	int32_t cpuInfo[4];
+	__cpuid(cpuInfo, 1);
+	return ((uint32_t)cpuInfo[2] & (1U << 20)) ? TextureHashEngine::Crc32c : TextureHashEngine::Fnv1a;
+}
+
+/* The crc32 instruction has a latency of three cycles but a throughput of one, so the input is
+   split into three interleaved streams of dwords that are folded together at the end. This is
+   not the standard CRC32C of the data, but it is just as good a content hash. With copy set, the
+   data is also written to dst in the same pass. With fnv1a set, the FNV-1a hash of the data is
+   calculated in the same pass too; it runs on other execution ports than the crc32s, so it costs
+   about as much as FNV-1a alone. */
+template<bool copy, bool fnv1a>
+static uint32_t Crc32c(
+	_Out_writes_opt_(size) uint8_t* __restrict dst,
+	_In_reads_(size) const uint8_t* __restrict src,
+	_In_ uint32_t size,
+	_Out_opt_ uint32_t* fnv1aHash)
+{
+	uint32_t fnv1aState = FNV1_32A_INIT;
+
+	uint32_t crc0 = size;
+	uint32_t crc1 = 0xFFFFFFFF;
+	uint32_t crc2 = 0x9E3779B9;
+	uint32_t i = 0;
+
+	for (; (i + 12) <= size; i += 12)
+	{
+		uint32_t dwords[3];
+		memcpy(dwords, src + i, sizeof(dwords));
+		crc0 = _mm_crc32_u32(crc0, dwords[0]);
+		crc1 = _mm_crc32_u32(crc1, dwords[1]);
+		crc2 = _mm_crc32_u32(crc2, dwords[2]);
+
+		if (copy)
+		{
+			memcpy(dst + i, dwords, sizeof(dwords));
+		}
+
+		if (fnv1a)
+		{
+			for (uint32_t j = 0; j < 12; ++j)
+			{
+				fnv1aState = (fnv1aState ^ src[i + j]) * 0x01000193;
+			}
+		}
+	}
+
+	for (; i < size; ++i)
+	{
+		crc0 = _mm_crc32_u8(crc0, src[i]);
+
+		if (copy)
+		{
+			dst[i] = src[i];
+		}
+
+		if (fnv1a)
+		{
+			fnv1aState = (fnv1aState ^ src[i]) * 0x01000193;
+		}
+	}
+
+	if (fnv1a)
+	{
+		*fnv1aHash = fnv1aState;
+	}
+
+	/* crc32 is linear, so folding the streams with more crc32s lets a change in one stream cancel
+	   out a matching change in another; e.g. two digits swapping places in a string. The streams
+	   are multiplied by different odd constants instead, and the high bits then mixed into the low
+	   ones. */
+	const uint32_t hash = (crc0 * 0x9E3779B1U) ^ (crc1 * 0x85EBCA77U) ^ (crc2 * 0xC2B2AE3DU);
+	return _mm_crc32_u32(hash >> 16, hash);
+}
+
+/* Same as fnv_32a_buf, but also writes the data to dst. */
+static uint32_t CopyAndFnv1a(
+	_Out_writes_(size) uint8_t* __restrict dst,
+	_In_reads_(size) const uint8_t* __restrict src,
+	_In_ uint32_t size)
 {
+	uint32_t hash = FNV1_32A_INIT;
+
+	for (uint32_t i = 0; i < size; ++i)
+	{
+		const uint8_t value = src[i];
+		dst[i] = value;
+		hash ^= value;
+		hash *= 0x01000193;
+	}
+
+	return hash;
 }
 
 _Use_decl_annotations_
-void TextureHasher::Invalidate(
-	uint32_t startAddress)
+uint32_t TextureHasher::GetCrc32cHash(
+	const uint8_t* data,
+	uint32_t size)
 {
-	_cache.items[startAddress >> 8] = 0;
+	return Crc32c<false, false>(nullptr, data, size, nullptr);
 }
 
 _Use_decl_annotations_
@@ -47,25 +164,164 @@ uint32_t TextureHasher::GetHash(
 
 	uint32_t hash = _cache.items[startAddress >> 8];
 
-	if (hash)
+	if (hash && _cacheSizes.items[startAddress >> 8] == pixelsSize)
 	{
 		++_cacheHits;
 	}
 	else
 	{
 		++_cacheMisses;
-		hash = fnv_32a_buf((void*)pixels, pixelsSize, FNV1_32A_INIT);
+		hash = CalculateHash(pixels, pixelsSize);
 		_cache.items[startAddress >> 8] = hash;
+		_cacheSizes.items[startAddress >> 8] = pixelsSize;
 	}
 
 	return hash;
 }
 
-void TextureHasher::PrintStats()
+_Use_decl_annotations_
+uint32_t TextureHasher::CopyAndHash(
+	uint32_t startAddress,
+	uint8_t* tmuMemory,
+	uint32_t tmuMemorySize,
+	const uint8_t* srcPixels,
+	uint32_t pixelsSize)
+{
+	assert((startAddress & 255) == 0);
+	assert(startAddress + pixelsSize <= tmuMemorySize);
+
+	++_downloads;
+
+	uint8_t* dstPixels = tmuMemory + startAddress;
+
+	/* The game keeps recycling TMU memory, so the same sprite is often downloaded again, to the same
+	   or to another address. A fingerprint of the first bytes finds the previous download, and a
+	   compare against it (which has to be done anyway, as the fingerprint is not unique) is cheaper
+	   than a hash. */
+	const uint32_t fingerprint = CalculateHash(srcPixels, min(pixelsSize, (uint32_t)D2DX_FINGERPRINT_SIZE)) ^ (pixelsSize * 0x9E3779B1);
+	KnownContent& knownContent = _knownContents.items[fingerprint & (D2DX_KNOWN_CONTENT_CAPACITY - 1)];
+
+	uint32_t hash = 0;
+
+	if (knownContent.fingerprint == fingerprint &&
+		knownContent.size == pixelsSize &&
+		knownContent.hash != 0 &&
+		(knownContent.startAddress + pixelsSize) <= tmuMemorySize &&
+		_simd->EqualUInt8(tmuMemory + knownContent.startAddress, srcPixels, pixelsSize))
+	{
+		++_hashesAvoided;
+		hash = knownContent.hash;
+
+		if (knownContent.startAddress == startAddress)
+		{
+			++_copiesAvoided;
+		}
+		else
+		{
+			memcpy(dstPixels, srcPixels, pixelsSize);
+		}
+	}
+	else
+	{
+		if (_engine == TextureHashEngine::Crc32c)
+		{
+			uint32_t compatibilityHash;
+			hash = Crc32c<true, true>(dstPixels, srcPixels, pixelsSize, &compatibilityHash);
+			SetCompatibilityHash(hash, compatibilityHash);
+		}
+		else
+		{
+			hash = CopyAndFnv1a(dstPixels, srcPixels, pixelsSize);
+		}
+
+		knownContent.fingerprint = fingerprint;
+		knownContent.size = pixelsSize;
+		knownContent.hash = hash;
+	}
+
+	/* The most recent copy is the least likely to have been overwritten next time. */
+	knownContent.startAddress = startAddress;
+
+	_cache.items[startAddress >> 8] = hash;
+	_cacheSizes.items[startAddress >> 8] = pixelsSize;
+	return hash;
+}
+
+_Use_decl_annotations_
+uint32_t TextureHasher::GetCompatibilityHash(
+	uint32_t hash,
+	const uint8_t* pixels,
+	uint32_t pixelsSize)
+{
+	if (_engine == TextureHashEngine::Fnv1a)
+	{
+		return hash;
+	}
+
+	/* Direct mapped; a collision just means FNV-1a is recalculated. */
+	const uint32_t index = hash & (D2DX_COMPATIBILITY_HASH_CAPACITY - 1);
+
+	if (hash && _compatibilityKeys.items[index] == hash)
+	{
+		++_compatibilityHits;
+		return _compatibilityHashes.items[index];
+	}
+
+	++_compatibilityMisses;
+	const uint32_t compatibilityHash = fnv_32a_buf((void*)pixels, pixelsSize, FNV1_32A_INIT);
+	SetCompatibilityHash(hash, compatibilityHash);
+	return compatibilityHash;
+}
+
+_Use_decl_annotations_
+void TextureHasher::SetCompatibilityHash(
+	uint32_t hash,
+	uint32_t compatibilityHash)
+{
+	const uint32_t index = hash & (D2DX_COMPATIBILITY_HASH_CAPACITY - 1);
+	_compatibilityKeys.items[index] = hash;
+	_compatibilityHashes.items[index] = compatibilityHash;
+}
+
+_Use_decl_annotations_
+uint32_t TextureHasher::CalculateHash(
+	const uint8_t* data,
+	uint32_t size) const
+{
+	switch (_engine)
+	{
+	case TextureHashEngine::Crc32c:
+		return GetCrc32cHash(data, size);
+	default:
+		return fnv_32a_buf((void*)data, size, FNV1_32A_INIT);
+	}
+}
+
+_Use_decl_annotations_
+void TextureHasher::PrintStats(
+	uint32_t frameCount)
 {
 	D2DX_DEBUG_LOG("Texture hash cache hits: %u (%i%%) misses %u",
 		_cacheHits,
 		(int32_t)(100.0f * (float)_cacheHits / (_cacheHits + _cacheMisses)),
 		_cacheMisses
 	);
+
+	if (_engine != TextureHashEngine::Fnv1a)
+	{
+		D2DX_DEBUG_LOG("Texture compatibility hash hits: %u misses %u",
+			_compatibilityHits,
+			_compatibilityMisses
+		);
+	}
+
+	D2DX_DEBUG_LOG("Texture downloads/frame: %.2f, hashes avoided/frame: %.2f, copies avoided/frame: %.2f",
+		(float)_downloads / frameCount,
+		(float)_hashesAvoided / frameCount,
+		(float)_copiesAvoided / frameCount
+	);
+
+	_downloads = 0;
+	_hashesAvoided = 0;
+	_copiesAvoided = 0;
 }
\ No newline at end of file
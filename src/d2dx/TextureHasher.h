@@ -19,28 +19,95 @@
 #pragma once
 
 #include "Buffer.h"
+#include "ISimd.h"
 
 namespace d2dx
 {
+	enum class TextureHashEngine
+	{
+		Fnv1a = 0,
+		Crc32c = 1,
+	};
+
 	class TextureHasher final
 	{
 	public:
-		TextureHasher();
+		TextureHasher(
+			_In_ const std::shared_ptr<ISimd>& simd,
+			_In_ TextureHashEngine engine = GetFastestEngine());
 		~TextureHasher() noexcept {}
 
-		void Invalidate(
-			_In_ uint32_t startAddress);
+		/* CRC32C (SSE4.2) when the CPU has it, otherwise FNV-1a. */
+		static TextureHashEngine GetFastestEngine();
+
+		static uint32_t GetCrc32cHash(
+			_In_reads_(size) const uint8_t* data,
+			_In_ uint32_t size);
+
+		TextureHashEngine GetEngine() const { return _engine; }
+
+		/* Hashes data that isn't in TMU memory, such as palettes, with the selected engine. */
+		uint32_t CalculateHash(
+			_In_reads_(size) const uint8_t* data,
+			_In_ uint32_t size) const;
 
 		uint32_t GetHash(
 			_In_ uint32_t startAddress,
 			_In_reads_(pixelsSize) const uint8_t* pixels,
 			_In_ uint32_t pixelsSize);
 
-		void PrintStats();
+		/* Copies the pixels to startAddress in tmuMemory and hashes them in a single pass, so that the
+		   following GetHash for startAddress is a cache hit. Returns the same hash as GetHash would.
+		   If the same content was recently downloaded elsewhere in tmuMemory, it is recognized by a
+		   prefix fingerprint and compared instead of hashed. With CRC32C, the same pass also
+		   calculates the compatibility hash. */
+		uint32_t CopyAndHash(
+			_In_ uint32_t startAddress,
+			_Inout_updates_(tmuMemorySize) uint8_t* __restrict tmuMemory,
+			_In_ uint32_t tmuMemorySize,
+			_In_reads_(pixelsSize) const uint8_t* __restrict srcPixels,
+			_In_ uint32_t pixelsSize);
+
+		/* Maps a hash from GetHash to the FNV-1a hash of the same pixels, which is what the hardcoded
+		   hashes in GameHelper use. Those are hashes of game content that D2DX doesn't have, so they
+		   can't be converted to another engine up front. Content that came through CopyAndHash is
+		   usually known already; otherwise FNV-1a is calculated here. */
+		uint32_t GetCompatibilityHash(
+			_In_ uint32_t hash,
+			_In_reads_(pixelsSize) const uint8_t* pixels,
+			_In_ uint32_t pixelsSize);
+
+		/* Logs the hit rates and the download counters averaged over frameCount frames, and resets
+		   the download counters. */
+		void PrintStats(
+			_In_ uint32_t frameCount);
 
 	private:
+		struct KnownContent final
+		{
+			uint32_t fingerprint;
+			uint32_t size;
+			uint32_t startAddress;
+			uint32_t hash;
+		};
+
+		void SetCompatibilityHash(
+			_In_ uint32_t hash,
+			_In_ uint32_t compatibilityHash);
+
+		std::shared_ptr<ISimd> _simd;
+		TextureHashEngine _engine;
 		Buffer<uint32_t> _cache;
+		Buffer<uint32_t> _cacheSizes;
+		Buffer<uint32_t> _compatibilityKeys;
+		Buffer<uint32_t> _compatibilityHashes;
+		Buffer<KnownContent> _knownContents;
 		uint32_t _cacheHits;
 		uint32_t _cacheMisses;
+		uint32_t _compatibilityHits;
+		uint32_t _compatibilityMisses;
+		uint32_t _downloads;
+		uint32_t _hashesAvoided;
+		uint32_t _copiesAvoided;
 	};
 }
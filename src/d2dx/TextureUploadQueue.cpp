@@ -0,0 +1,288 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "TextureUploadQueue.h"
+#include "Utils.h"
+
+using namespace d2dx;
+using namespace std;
+
+_Use_decl_annotations_
+TextureUploadQueue::TextureUploadQueue(
+	uint32_t segmentHeight,
+	ID3D11Device* device) :
+	_segmentHeight{ segmentHeight }
+{
+	/* Room for at least one texture of the largest size. */
+	assert(segmentHeight >= 256);
+
+	_pending.reserve(1024);
+
+#ifndef D2DX_UNITTEST
+	if (device)
+	{
+		device->GetImmediateContext(&_deviceContext);
+		assert(_deviceContext);
+
+		CD3D11_TEXTURE2D_DESC desc
+		{
+			DXGI_FORMAT_R8_UINT,
+			(UINT)D2DX_TEXTURE_UPLOAD_RING_WIDTH,
+			(UINT)segmentHeight,
+			1U,
+			1U,
+			0,
+			D3D11_USAGE_STAGING,
+			D3D11_CPU_ACCESS_WRITE
+		};
+
+		for (int32_t segment = 0; segment < D2DX_TEXTURE_UPLOAD_RING_SEGMENTS; ++segment)
+		{
+			D2DX_CHECK_HR(device->CreateTexture2D(&desc, nullptr, &_stagingTextures[segment]));
+		}
+
+		return;
+	}
+#endif
+
+	for (int32_t segment = 0; segment < D2DX_TEXTURE_UPLOAD_RING_SEGMENTS; ++segment)
+	{
+		_stagingMemory[segment] = Buffer<uint8_t>(D2DX_TEXTURE_UPLOAD_RING_WIDTH * segmentHeight, true);
+	}
+}
+
+TextureUploadQueue::~TextureUploadQueue() noexcept
+{
+	UnmapSegment();
+}
+
+_Use_decl_annotations_
+void TextureUploadQueue::Enqueue(
+	ID3D11Texture2D* dstTexture,
+	uint32_t dstSlice,
+	Offset dstOffset,
+	int32_t width,
+	int32_t height,
+	const uint8_t* srcPixels,
+	uint32_t srcPitch)
+{
+	assert(width > 0 && width <= D2DX_TEXTURE_UPLOAD_RING_WIDTH);
+	assert(height > 0 && (uint32_t)height <= _segmentHeight);
+
+	Offset srcOffset{ 0, 0 };
+
+	if (!Allocate(width, height, srcOffset))
+	{
+		/* The segment is full; copy what we have and continue in the next one. */
+		++_stats.ringStalls;
+		Flush();
+		Allocate(width, height, srcOffset);
+	}
+
+	if (!_mappedPixels)
+	{
+		MapSegment();
+	}
+
+	uint8_t* dstPixels = _mappedPixels + srcOffset.y * _mappedPitch + srcOffset.x;
+
+	for (int32_t y = 0; y < height; ++y)
+	{
+		memcpy(dstPixels, srcPixels, width);
+		dstPixels += _mappedPitch;
+		srcPixels += srcPitch;
+	}
+
+	_stats.queuedBytes += (uint32_t)(width * height);
+	++_stats.queuedUploads;
+
+	Coalesce({
+		dstTexture,
+		dstSlice,
+		(int16_t)dstOffset.x,
+		(int16_t)dstOffset.y,
+		(int16_t)srcOffset.x,
+		(int16_t)srcOffset.y,
+		(int16_t)width,
+		(int16_t)height });
+}
+
+_Use_decl_annotations_
+void TextureUploadQueue::Coalesce(
+	const TextureUpload& upload)
+{
+	/* Drop earlier uploads that this one overwrites completely, e.g. when a slot was reused. */
+	for (auto it = _pending.begin(); it != _pending.end();)
+	{
+		if (it->dstTexture == upload.dstTexture &&
+			it->dstSlice == upload.dstSlice &&
+			it->dstX >= upload.dstX && (it->dstX + it->width) <= (upload.dstX + upload.width) &&
+			it->dstY >= upload.dstY && (it->dstY + it->height) <= (upload.dstY + upload.height))
+		{
+			it = _pending.erase(it);
+			++_stats.coalescedUploads;
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	/* Extend the previous upload if the new one continues it both in the segment and in the slice,
+	   as consecutive tiles of a packed page do. */
+	if (!_pending.empty())
+	{
+		TextureUpload& last = _pending.back();
+
+		if (last.dstTexture == upload.dstTexture && last.dstSlice == upload.dstSlice)
+		{
+			if (last.width == upload.width &&
+				last.dstX == upload.dstX && last.srcX == upload.srcX &&
+				(last.dstY + last.height) == upload.dstY && (last.srcY + last.height) == upload.srcY)
+			{
+				last.height += upload.height;
+				++_stats.coalescedUploads;
+				return;
+			}
+
+			if (last.height == upload.height &&
+				last.dstY == upload.dstY && last.srcY == upload.srcY &&
+				(last.dstX + last.width) == upload.dstX && (last.srcX + last.width) == upload.srcX)
+			{
+				last.width += upload.width;
+				++_stats.coalescedUploads;
+				return;
+			}
+		}
+	}
+
+	_pending.push_back(upload);
+}
+
+void TextureUploadQueue::Flush()
+{
+	if (_pending.empty())
+	{
+		return;
+	}
+
+	UnmapSegment();
+
+#ifndef D2DX_UNITTEST
+	if (_deviceContext)
+	{
+		ID3D11Texture2D* stagingTexture = _stagingTextures[_segment].Get();
+
+		for (const TextureUpload& upload : _pending)
+		{
+			CD3D11_BOX box;
+			box.left = upload.srcX;
+			box.top = upload.srcY;
+			box.right = upload.srcX + upload.width;
+			box.bottom = upload.srcY + upload.height;
+			box.front = 0;
+			box.back = 1;
+
+			_deviceContext->CopySubresourceRegion(
+				upload.dstTexture, upload.dstSlice, upload.dstX, upload.dstY, 0, stagingTexture, 0, &box);
+		}
+	}
+#endif
+
+	_stats.copies += (uint32_t)_pending.size();
+	++_stats.flushes;
+	_pending.clear();
+
+	_segment = (_segment + 1) % D2DX_TEXTURE_UPLOAD_RING_SEGMENTS;
+	_shelfX = 0;
+	_shelfY = 0;
+	_shelfHeight = 0;
+}
+
+_Use_decl_annotations_
+bool TextureUploadQueue::Allocate(
+	int32_t width,
+	int32_t height,
+	Offset& srcOffset)
+{
+	if ((_shelfX + width) > D2DX_TEXTURE_UPLOAD_RING_WIDTH)
+	{
+		_shelfY += _shelfHeight;
+		_shelfX = 0;
+		_shelfHeight = 0;
+	}
+
+	if ((uint32_t)(_shelfY + height) > _segmentHeight)
+	{
+		srcOffset = { 0, 0 };
+		return false;
+	}
+
+	srcOffset = { _shelfX, _shelfY };
+	_shelfX += width;
+	_shelfHeight = max(_shelfHeight, height);
+	return true;
+}
+
+void TextureUploadQueue::MapSegment()
+{
+	assert(!_mappedPixels);
+
+#ifndef D2DX_UNITTEST
+	if (_deviceContext)
+	{
+		ID3D11Texture2D* stagingTexture = _stagingTextures[_segment].Get();
+		D3D11_MAPPED_SUBRESOURCE ms = { 0 };
+		HRESULT result = _deviceContext->Map(stagingTexture, 0, D3D11_MAP_WRITE, D3D11_MAP_FLAG_DO_NOT_WAIT, &ms);
+
+		if (result == DXGI_ERROR_WAS_STILL_DRAWING)
+		{
+			/* The GPU hasn't finished copying out of this segment yet. */
+			++_stats.ringStalls;
+			result = _deviceContext->Map(stagingTexture, 0, D3D11_MAP_WRITE, 0, &ms);
+		}
+
+		D2DX_CHECK_HR(result);
+		_mappedPixels = (uint8_t*)ms.pData;
+		_mappedPitch = ms.RowPitch;
+		return;
+	}
+#endif
+
+	_mappedPixels = _stagingMemory[_segment].items;
+	_mappedPitch = D2DX_TEXTURE_UPLOAD_RING_WIDTH;
+}
+
+void TextureUploadQueue::UnmapSegment()
+{
+	if (!_mappedPixels)
+	{
+		return;
+	}
+
+#ifndef D2DX_UNITTEST
+	if (_deviceContext)
+	{
+		_deviceContext->Unmap(_stagingTextures[_segment].Get(), 0);
+	}
+#endif
+
+	_mappedPixels = nullptr;
+	_mappedPitch = 0;
+}
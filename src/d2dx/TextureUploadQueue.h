@@ -0,0 +1,121 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Buffer.h"
+#include "Types.h"
+
+#define D2DX_TEXTURE_UPLOAD_RING_WIDTH 256
+#define D2DX_TEXTURE_UPLOAD_RING_SEGMENTS 3
+
+namespace d2dx
+{
+	/* Running totals since the queue was created. */
+	struct TextureUploadQueueStats final
+	{
+		uint64_t queuedBytes = 0;
+		uint32_t queuedUploads = 0;
+		uint32_t coalescedUploads = 0;
+		uint32_t copies = 0;
+		uint32_t flushes = 0;
+		uint32_t ringStalls = 0;
+	};
+
+	/* One copy from the staging ring into a slice of a texture cache atlas. */
+	struct TextureUpload final
+	{
+		ID3D11Texture2D* dstTexture;
+		uint32_t dstSlice;
+		int16_t dstX;
+		int16_t dstY;
+		int16_t srcX;
+		int16_t srcY;
+		int16_t width;
+		int16_t height;
+	};
+
+	/* Collects texture uploads during a frame and copies them into the atlases in one go, instead of
+	   one UpdateSubresource per cache miss in the middle of draw submission.
+
+	   Texels are written straight into a staging texture, 256 texels wide, which is split into
+	   segments that are used round-robin, one per flush. A segment stays mapped from the first upload
+	   after a flush until the next flush (D3D11 can't copy from a mapped resource). Uploads are placed
+	   on shelves within the segment, so that textures of one shape that land next to each other in an
+	   atlas slice also lie next to each other in the segment, and are merged into a single copy.
+
+	   Flush must be called before the queued uploads are sampled and before any destination texture
+	   is released. Without a device (D2DX_UNITTEST), the segments are plain memory and Flush only does
+	   the bookkeeping. */
+	class TextureUploadQueue final
+	{
+	public:
+		TextureUploadQueue(
+			_In_ uint32_t segmentHeight,
+			_In_opt_ ID3D11Device* device);
+		~TextureUploadQueue() noexcept;
+
+		void Enqueue(
+			_In_ ID3D11Texture2D* dstTexture,
+			_In_ uint32_t dstSlice,
+			_In_ Offset dstOffset,
+			_In_ int32_t width,
+			_In_ int32_t height,
+			_In_reads_(srcPitch* height) const uint8_t* srcPixels,
+			_In_ uint32_t srcPitch);
+
+		void Flush();
+
+		uint32_t GetPendingCount() const { return (uint32_t)_pending.size(); }
+
+		const TextureUpload* GetPendingUploads() const { return _pending.data(); }
+
+		/* The segment that pending uploads are written to. Only valid while it is mapped. */
+		const uint8_t* GetStagingPixels() const { return _mappedPixels; }
+
+		uint32_t GetStagingPitch() const { return _mappedPitch; }
+
+		const TextureUploadQueueStats& GetStats() const { return _stats; }
+
+	private:
+		bool Allocate(
+			_In_ int32_t width,
+			_In_ int32_t height,
+			_Out_ Offset& srcOffset);
+
+		void MapSegment();
+
+		void UnmapSegment();
+
+		void Coalesce(
+			_In_ const TextureUpload& upload);
+
+		uint32_t _segmentHeight = 0;
+		int32_t _segment = 0;
+		int32_t _shelfY = 0;
+		int32_t _shelfHeight = 0;
+		int32_t _shelfX = 0;
+		uint8_t* _mappedPixels = nullptr;
+		uint32_t _mappedPitch = 0;
+		std::vector<TextureUpload> _pending;
+		TextureUploadQueueStats _stats;
+		ComPtr<ID3D11DeviceContext> _deviceContext;
+		ComPtr<ID3D11Texture2D> _stagingTextures[D2DX_TEXTURE_UPLOAD_RING_SEGMENTS];
+		Buffer<uint8_t> _stagingMemory[D2DX_TEXTURE_UPLOAD_RING_SEGMENTS];
+	};
+}
@@ -55,7 +55,9 @@ namespace d2dx
 		Points = 0,
 		Lines = 1,
 		Triangles = 2,
-		Count = 3
+		Quads = 3,
+		Sprites = 4,
+		Count = 5
 	};
 
 	enum class AlphaBlend
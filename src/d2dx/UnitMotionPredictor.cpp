@@ -22,23 +22,69 @@
 using namespace d2dx;
 using namespace DirectX;
 
+/* Twice the unit capacity, so that probe sequences stay short and there is always an empty slot. */
+#define D2DX_UNIT_INDEX_SLOT_BITS 11
+#define D2DX_UNIT_INDEX_SLOTS (1 << D2DX_UNIT_INDEX_SLOT_BITS)
+
+#define D2DX_UNIT_MOTION_FIELDS 11
+
+#define D2DX_SHADOW_CELL_SHIFT 4
+#define D2DX_SHADOW_GRID_SIZE 64
+
+static inline int32_t GetShadowCell(
+	int32_t cellX,
+	int32_t cellY)
+{
+	return (cellY & (D2DX_SHADOW_GRID_SIZE - 1)) * D2DX_SHADOW_GRID_SIZE + (cellX & (D2DX_SHADOW_GRID_SIZE - 1));
+}
+
+static inline uint32_t GetUnitIndexHomeSlot(
+	uint16_t unitId,
+	uint16_t unitType)
+{
+	return (((uint32_t)unitType << 16 | unitId) * 0x9E3779B1U) >> (32 - D2DX_UNIT_INDEX_SLOT_BITS);
+}
+
 _Use_decl_annotations_
 UnitMotionPredictor::UnitMotionPredictor(
-	const std::shared_ptr<IGameHelper>& gameHelper) :
+	const std::shared_ptr<IGameHelper>& gameHelper,
+	const std::shared_ptr<ISimd>& simd) :
 	_gameHelper{ gameHelper },
+	_simd{ simd },
 	_unitIdAndTypes{ 1024, true },
-	_unitMotions{ 1024, true },
-	_unitScreenPositions{ 1024, true }
+	_unitMotionFields{ D2DX_UNIT_MOTION_FIELDS * 1024, true },
+	_unitScreenPositions{ 1024, true },
+	_unitPointers{ 1024, true },
+	_unitPointerFrames{ 1024, true },
+	_unitIndexSlots{ D2DX_UNIT_INDEX_SLOTS, true, -1 },
+	_cellFirstUnits{ D2DX_SHADOW_GRID_SIZE * D2DX_SHADOW_GRID_SIZE, true, -1 },
+	_unitCells{ 1024, true, -1 },
+	_unitCellNexts{ 1024, true, -1 }
 {
+	int32_t* fields = _unitMotionFields.items;
+	_unitMotions.posX = fields + 0 * 1024;
+	_unitMotions.posY = fields + 1 * 1024;
+	_unitMotions.lastPosX = fields + 2 * 1024;
+	_unitMotions.lastPosY = fields + 3 * 1024;
+	_unitMotions.velocityX = fields + 4 * 1024;
+	_unitMotions.velocityY = fields + 5 * 1024;
+	_unitMotions.predictedPosX = fields + 6 * 1024;
+	_unitMotions.predictedPosY = fields + 7 * 1024;
+	_unitMotions.correctedPosX = fields + 8 * 1024;
+	_unitMotions.correctedPosY = fields + 9 * 1024;
+	_unitMotions.dtLastPosChange = fields + 10 * 1024;
 }
 
 _Use_decl_annotations_
 void UnitMotionPredictor::Update(
 	IRenderContext* renderContext)
 {
-	const int32_t dt = renderContext->GetFrameTimeFp();
+	/* Prediction stops 1/25 s after the last position change anyway, so longer frames can be
+	   clamped. This keeps the motion state within 32 bits. */
+	const int32_t dt = max(0, min(65536, renderContext->GetFrameTimeFp()));
 	int32_t expiredUnitIndex = -1;
 
+	/* First get the positions from the game, which is where the function calls are. */
 	for (int32_t i = 0; i < _unitsCount; ++i)
 	{
 		UnitIdAndType& uiat = _unitIdAndTypes.items[i];
@@ -49,107 +95,72 @@ void UnitMotionPredictor::Update(
 			continue;
 		}
 
-		auto unit = _gameHelper->FindUnit(uiat.unitId, (D2::UnitType)uiat.unitType);
+		/* Units drawn last frame can be used as they were, as long as the memory still holds the
+		   same unit. Only the others have to be looked up in the game's unit tables. */
+		const D2::UnitAny* unit = _unitPointers.items[i];
 
-		if (!unit)
+		if (unit &&
+			_unitPointerFrames.items[i] == _frame &&
+			_gameHelper->GetUnitId(unit) == uiat.unitId &&
+			(uint32_t)_gameHelper->GetUnitType(unit) == uiat.unitType)
 		{
-			uiat.unitId = 0;
-			expiredUnitIndex = i;
-			continue;
+			++_unitPointerCacheHits;
 		}
-
-		UnitMotion& um = _unitMotions.items[i];
-		const Offset pos = _gameHelper->GetUnitPos(unit);
-
-		Offset posWhole{ pos.x >> 16, pos.y >> 16 };
-		Offset lastPosWhole{ um.lastPos.x >> 16, um.lastPos.y >> 16 };
-		Offset predictedPosWhole{ um.predictedPos.x >> 16, um.predictedPos.y >> 16 };
-
-		int32_t lastPosMd = max(abs(posWhole.x - lastPosWhole.x), abs(posWhole.y - lastPosWhole.y));
-		int32_t predictedPosMd = max(abs(posWhole.x - predictedPosWhole.x), abs(posWhole.y - predictedPosWhole.y));
-
-		if (lastPosMd > 2 || predictedPosMd > 2)
-		{
-			um.predictedPos = pos;
-			um.correctedPos = pos;
-			um.lastPos = pos;
-			um.velocity = { 0,0 };
-		}
-
-		const int32_t dx = pos.x - um.lastPos.x;
-		const int32_t dy = pos.y - um.lastPos.y;
-
-		um.dtLastPosChange += dt;
-
-		if (dx != 0 || dy != 0 || um.dtLastPosChange >= (65536 / 25))
+		else
 		{
-			um.correctedPos.x = ((int64_t)pos.x + um.lastPos.x) >> 1;
-			um.correctedPos.y = ((int64_t)pos.y + um.lastPos.y) >> 1;
-			//D2DX_DEBUG_LOG("Server %f %f", pos.x / 65536.0f, pos.y / 65536.0f);
-
-			um.velocity.x = 25 * dx;
-			um.velocity.y = 25 * dy;
-
-			um.lastPos = pos;
-			um.dtLastPosChange = 0;
-		}
+			++_unitPointerCacheMisses;
+			unit = _gameHelper->FindUnit(uiat.unitId, (D2::UnitType)uiat.unitType);
 
-		if (um.velocity.x != 0 || um.velocity.y != 0)
-		{
-			if (um.dtLastPosChange < (65536 / 25))
+			if (!unit)
 			{
-				Offset vStep{
-					(int32_t)(((int64_t)dt * um.velocity.x) >> 16),
-					(int32_t)(((int64_t)dt * um.velocity.y) >> 16) };
-
-				const int32_t correctionAmount = 7000;
-				const int32_t oneMinusCorrectionAmount = 65536 - correctionAmount;
-
-				um.predictedPos.x = (int32_t)(((int64_t)um.predictedPos.x * oneMinusCorrectionAmount + (int64_t)um.correctedPos.x * correctionAmount) >> 16);
-				um.predictedPos.y = (int32_t)(((int64_t)um.predictedPos.y * oneMinusCorrectionAmount + (int64_t)um.correctedPos.y * correctionAmount) >> 16);
-				//D2DX_DEBUG_LOG("Predicted %f %f", um.predictedPos.x / 65536.0f, um.predictedPos.y / 65536.0f);
-
-			/*	int32_t ex = um.correctedPos.x - um.predictedPos.x;
-				int32_t ey = um.correctedPos.y - um.predictedPos.y;
-
-				if (unit->dwType == D2::UnitType::Player && (ex != 0 || ey != 0))
-				{
-					D2DX_DEBUG_LOG("%f, %f, %f, %f, %f, %f, %f, %f",
-						pos.x / 65536.0f,
-						pos.y / 65536.0f,
-						um.correctedPos.x / 65536.0f,
-						um.correctedPos.y / 65536.0f,
-						um.predictedPos.x / 65536.0f,
-						um.predictedPos.y / 65536.0f,
-						ex / 65536.0f,
-						ey / 65536.0f);
-				}*/
-
-				um.predictedPos.x += vStep.x;
-				um.predictedPos.y += vStep.y;
-
-				um.correctedPos.x += vStep.x;
-				um.correctedPos.y += vStep.y;
+				RemoveUnitIndex(i);
+				UnlinkUnitCell(i);
+				uiat.unitId = 0;
+				_unitPointers.items[i] = nullptr;
+				expiredUnitIndex = i;
+				continue;
 			}
 		}
+
+		const Offset pos = _gameHelper->GetUnitPos(unit);
+		_unitMotions.posX[i] = pos.x;
+		_unitMotions.posY[i] = pos.y;
 	}
 
+	/* Then predict all units in one go. Expired entries are updated along with the rest, but are
+	   reset before they are used again. */
+	_simd->UpdateUnitMotions(_unitMotions, (uint32_t)_unitsCount, dt);
+
 	// Gradually (one change per frame) compact the unit list.
 	if (_unitsCount > 1)
 	{
 		if (!_unitIdAndTypes.items[_unitsCount - 1].unitId)
 		{
 			// The last entry is expired. Shrink the list.
-			_unitMotions.items[_unitsCount - 1] = { };
+			ResetUnitMotion(_unitsCount - 1);
 			--_unitsCount;
 		}
 		else if (expiredUnitIndex >= 0 && expiredUnitIndex < (_unitsCount - 1))
 		{
 			// Some entry is expired. Move the last entry to that place, and shrink the list.
 			_unitIdAndTypes.items[expiredUnitIndex] = _unitIdAndTypes.items[_unitsCount - 1];
-			_unitMotions.items[expiredUnitIndex] = _unitMotions.items[_unitsCount - 1];
+			MoveUnitMotion(expiredUnitIndex, _unitsCount - 1);
+			_unitPointers.items[expiredUnitIndex] = _unitPointers.items[_unitsCount - 1];
+			_unitPointerFrames.items[expiredUnitIndex] = _unitPointerFrames.items[_unitsCount - 1];
+			_unitIndexSlots.items[FindUnitIndexSlot(
+				_unitIdAndTypes.items[expiredUnitIndex].unitId,
+				_unitIdAndTypes.items[expiredUnitIndex].unitType)] = (int16_t)expiredUnitIndex;
+
+			if (_unitCells.items[_unitsCount - 1] >= 0)
+			{
+				UnlinkUnitCell(_unitsCount - 1);
+				_unitScreenPositions.items[expiredUnitIndex] = _unitScreenPositions.items[_unitsCount - 1];
+				LinkUnitCell(expiredUnitIndex);
+			}
+
 			_unitIdAndTypes.items[_unitsCount - 1] = { 0,0 };
-			_unitMotions.items[_unitsCount - 1] = { };
+			_unitPointers.items[_unitsCount - 1] = nullptr;
+			ResetUnitMotion(_unitsCount - 1);
 			--_unitsCount;
 		}
 	}
@@ -161,93 +172,263 @@ _Use_decl_annotations_
 Offset UnitMotionPredictor::GetOffset(
 	const D2::UnitAny* unit)
 {
-	int32_t unitIndex = -1;
-
 	auto unitId = _gameHelper->GetUnitId(unit);
 	auto unitType = _gameHelper->GetUnitType(unit);
 
-	for (int32_t i = 0; i < _unitsCount; ++i)
+	const int32_t unitIndex = FindOrAddUnitIndex(unitId, (uint32_t)unitType);
+
+	if (unitIndex < 0)
 	{
-		if (_unitIdAndTypes.items[i].unitId == (uint16_t)unitId &&
-			_unitIdAndTypes.items[i].unitType == (uint16_t)unitType)
-		{
-			_unitMotions.items[i].lastUsedFrame = _frame;
-			unitIndex = i;
-			break;
-		}
+		return { 0, 0 };
 	}
 
+	CacheUnitPointer(unitIndex, unit);
+
+	return GetUnitOffset(unitIndex);
+}
+
+_Use_decl_annotations_
+void UnitMotionPredictor::SetUnitScreenPos(
+	const D2::UnitAny* unit,
+	int32_t x,
+	int32_t y)
+{
+	auto unitId = _gameHelper->GetUnitId(unit);
+	auto unitType = _gameHelper->GetUnitType(unit);
+
+	/* Track the unit from its first draw, so that its shadow can be found even before GetOffset. */
+	const int32_t unitIndex = FindOrAddUnitIndex(unitId, (uint32_t)unitType);
+
 	if (unitIndex < 0)
 	{
-		if (_unitsCount < (int32_t)_unitIdAndTypes.capacity)
-		{
-			unitIndex = _unitsCount++;
-			_unitIdAndTypes.items[unitIndex].unitId = (uint16_t)unitId;
-			_unitIdAndTypes.items[unitIndex].unitType = (uint16_t)unitType;
-			_unitMotions.items[unitIndex] = { };
-			_unitMotions.items[unitIndex].lastUsedFrame = _frame;
-		}
-		else
+		return;
+	}
+
+	CacheUnitPointer(unitIndex, unit);
+
+	const int32_t cell = GetShadowCell(x >> D2DX_SHADOW_CELL_SHIFT, y >> D2DX_SHADOW_CELL_SHIFT);
+
+	if (cell != _unitCells.items[unitIndex])
+	{
+		UnlinkUnitCell(unitIndex);
+		_unitScreenPositions.items[unitIndex] = { x, y };
+		LinkUnitCell(unitIndex);
+	}
+	else
+	{
+		_unitScreenPositions.items[unitIndex] = { x, y };
+	}
+}
+
+_Use_decl_annotations_
+Offset UnitMotionPredictor::GetOffsetForShadow(
+	_In_ int32_t x,
+	_In_ int32_t y)
+{
+	/* Only the cells within 7 pixels can hold a match. If several units match, the one that comes
+	   first in the unit list wins, as it did when the whole list was searched. */
+	int32_t shadowUnitIndex = INT_MAX;
+
+	for (int32_t cellY = (y - 7) >> D2DX_SHADOW_CELL_SHIFT; cellY <= ((y + 7) >> D2DX_SHADOW_CELL_SHIFT); ++cellY)
+	{
+		for (int32_t cellX = (x - 7) >> D2DX_SHADOW_CELL_SHIFT; cellX <= ((x + 7) >> D2DX_SHADOW_CELL_SHIFT); ++cellX)
 		{
-			D2DX_DEBUG_LOG("UMP: Too many units.");
+			for (int32_t i = _cellFirstUnits.items[GetShadowCell(cellX, cellY)]; i >= 0; i = _unitCellNexts.items[i])
+			{
+				const int32_t dist = max(abs(_unitScreenPositions.items[i].x - x), abs(_unitScreenPositions.items[i].y - y));
+
+				if (dist < 8)
+				{
+					shadowUnitIndex = min(shadowUnitIndex, i);
+				}
+			}
 		}
 	}
 
-	if (unitIndex < 0)
+	if (shadowUnitIndex == INT_MAX)
 	{
 		return { 0, 0 };
 	}
 
-	return _unitMotions.items[unitIndex].GetOffset();
+	return GetUnitOffset(shadowUnitIndex);
 }
 
 _Use_decl_annotations_
-void UnitMotionPredictor::SetUnitScreenPos(
+bool UnitMotionPredictor::IsShadowOfUnit(
 	const D2::UnitAny* unit,
 	int32_t x,
 	int32_t y)
 {
-	auto unitId = _gameHelper->GetUnitId(unit);
-	auto unitType = _gameHelper->GetUnitType(unit);
+	const int32_t unitIndex = FindUnitIndex(_gameHelper->GetUnitId(unit), (uint32_t)_gameHelper->GetUnitType(unit));
 
-	for (int32_t unitIndex = 0; unitIndex < _unitsCount; ++unitIndex)
+	return unitIndex >= 0 &&
+		_unitCells.items[unitIndex] >= 0 &&
+		max(abs(_unitScreenPositions.items[unitIndex].x - x), abs(_unitScreenPositions.items[unitIndex].y - y)) < 8;
+}
+
+_Use_decl_annotations_
+int32_t UnitMotionPredictor::FindUnitIndex(
+	uint32_t unitId,
+	uint32_t unitType) const
+{
+	return _unitIndexSlots.items[FindUnitIndexSlot(unitId, unitType)];
+}
+
+_Use_decl_annotations_
+int32_t UnitMotionPredictor::FindOrAddUnitIndex(
+	uint32_t unitId,
+	uint32_t unitType)
+{
+	/* An id of 0 marks an expired entry, so such a unit would never get any motion anyway. */
+	if (!(uint16_t)unitId)
 	{
-		if (_unitIdAndTypes.items[unitIndex].unitId == (uint16_t)unitId &&
-			_unitIdAndTypes.items[unitIndex].unitType == (uint16_t)unitType)
-		{
-			_unitScreenPositions.items[unitIndex] = { x, y };
-			break;
-		}
+		return -1;
 	}
+
+	const uint32_t slot = FindUnitIndexSlot(unitId, unitType);
+
+	if (_unitIndexSlots.items[slot] >= 0)
+	{
+		return _unitIndexSlots.items[slot];
+	}
+
+	if (_unitsCount >= (int32_t)_unitIdAndTypes.capacity)
+	{
+		D2DX_DEBUG_LOG("UMP: Too many units.");
+		return -1;
+	}
+
+	const int32_t unitIndex = _unitsCount++;
+	_unitIndexSlots.items[slot] = (int16_t)unitIndex;
+	_unitIdAndTypes.items[unitIndex].unitId = (uint16_t)unitId;
+	_unitIdAndTypes.items[unitIndex].unitType = (uint16_t)unitType;
+	ResetUnitMotion(unitIndex);
+	assert(_unitCells.items[unitIndex] < 0);
+	return unitIndex;
 }
 
 _Use_decl_annotations_
-Offset UnitMotionPredictor::GetOffsetForShadow(
-	_In_ int32_t x,
-	_In_ int32_t y)
+uint32_t UnitMotionPredictor::FindUnitIndexSlot(
+	uint32_t unitId,
+	uint32_t unitType) const
 {
-	for (int32_t i = 0; i < _unitsCount; ++i)
+	/* The slot holding the unit, or else the empty slot where it would be inserted. */
+	uint32_t slot = GetUnitIndexHomeSlot((uint16_t)unitId, (uint16_t)unitType);
+
+	while (true)
 	{
-		if (!_unitIdAndTypes.items[i].unitId)
+		const int32_t unitIndex = _unitIndexSlots.items[slot];
+
+		if (unitIndex < 0 ||
+			(_unitIdAndTypes.items[unitIndex].unitId == (uint16_t)unitId &&
+			 _unitIdAndTypes.items[unitIndex].unitType == (uint16_t)unitType))
 		{
-			continue;
+			return slot;
 		}
 
-		const int32_t dist = max(abs(_unitScreenPositions.items[i].x - x), abs(_unitScreenPositions.items[i].y - y));
+		slot = (slot + 1) & (D2DX_UNIT_INDEX_SLOTS - 1);
+	}
+}
 
-		if (dist < 8)
+_Use_decl_annotations_
+void UnitMotionPredictor::RemoveUnitIndex(
+	int32_t unitIndex)
+{
+	const UnitIdAndType& uiat = _unitIdAndTypes.items[unitIndex];
+	uint32_t emptySlot = FindUnitIndexSlot(uiat.unitId, uiat.unitType);
+	assert(_unitIndexSlots.items[emptySlot] == unitIndex);
+
+	/* Shift later entries of the probe sequence back, so that no lookup stops early at the hole. */
+	for (uint32_t slot = (emptySlot + 1) & (D2DX_UNIT_INDEX_SLOTS - 1);
+		_unitIndexSlots.items[slot] >= 0;
+		slot = (slot + 1) & (D2DX_UNIT_INDEX_SLOTS - 1))
+	{
+		const UnitIdAndType& other = _unitIdAndTypes.items[_unitIndexSlots.items[slot]];
+		const uint32_t homeSlot = GetUnitIndexHomeSlot(other.unitId, other.unitType);
+
+		if (((slot - homeSlot) & (D2DX_UNIT_INDEX_SLOTS - 1)) >= ((slot - emptySlot) & (D2DX_UNIT_INDEX_SLOTS - 1)))
 		{
-			return _unitMotions.items[i].GetOffset();
+			_unitIndexSlots.items[emptySlot] = _unitIndexSlots.items[slot];
+			emptySlot = slot;
 		}
 	}
 
-	return { 0, 0 };
+	_unitIndexSlots.items[emptySlot] = -1;
+}
+
+_Use_decl_annotations_
+void UnitMotionPredictor::CacheUnitPointer(
+	int32_t unitIndex,
+	const D2::UnitAny* unit)
+{
+	_unitPointers.items[unitIndex] = unit;
+	_unitPointerFrames.items[unitIndex] = _frame;
 }
 
-Offset UnitMotionPredictor::UnitMotion::GetOffset() const
+_Use_decl_annotations_
+void UnitMotionPredictor::LinkUnitCell(
+	int32_t unitIndex)
 {
-	const OffsetF offset{ (predictedPos.x - lastPos.x) / 65536.0f, (predictedPos.y - lastPos.y) / 65536.0f };
+	const Offset& screenPos = _unitScreenPositions.items[unitIndex];
+	const int32_t cell = GetShadowCell(screenPos.x >> D2DX_SHADOW_CELL_SHIFT, screenPos.y >> D2DX_SHADOW_CELL_SHIFT);
+
+	_unitCells.items[unitIndex] = (int16_t)cell;
+	_unitCellNexts.items[unitIndex] = _cellFirstUnits.items[cell];
+	_cellFirstUnits.items[cell] = (int16_t)unitIndex;
+}
+
+_Use_decl_annotations_
+void UnitMotionPredictor::UnlinkUnitCell(
+	int32_t unitIndex)
+{
+	const int32_t cell = _unitCells.items[unitIndex];
+
+	if (cell < 0)
+	{
+		return;
+	}
+
+	int16_t* link = &_cellFirstUnits.items[cell];
+
+	while (*link != unitIndex)
+	{
+		assert(*link >= 0);
+		link = &_unitCellNexts.items[*link];
+	}
+
+	*link = _unitCellNexts.items[unitIndex];
+	_unitCells.items[unitIndex] = -1;
+}
+
+_Use_decl_annotations_
+Offset UnitMotionPredictor::GetUnitOffset(
+	int32_t unitIndex) const
+{
+	const OffsetF offset{
+		(_unitMotions.predictedPosX[unitIndex] - _unitMotions.lastPosX[unitIndex]) / 65536.0f,
+		(_unitMotions.predictedPosY[unitIndex] - _unitMotions.lastPosY[unitIndex]) / 65536.0f };
 	const OffsetF scaleFactors{ 32.0f / sqrtf(2.0f), 16.0f / sqrtf(2.0f) };
 	const OffsetF screenOffset = scaleFactors * OffsetF{ offset.x - offset.y, offset.x + offset.y } + 0.5f;
 	return { (int32_t)screenOffset.x, (int32_t)screenOffset.y };
 }
+
+_Use_decl_annotations_
+void UnitMotionPredictor::MoveUnitMotion(
+	int32_t toUnitIndex,
+	int32_t fromUnitIndex)
+{
+	for (int32_t field = 0; field < D2DX_UNIT_MOTION_FIELDS; ++field)
+	{
+		_unitMotionFields.items[field * 1024 + toUnitIndex] = _unitMotionFields.items[field * 1024 + fromUnitIndex];
+	}
+}
+
+_Use_decl_annotations_
+void UnitMotionPredictor::ResetUnitMotion(
+	int32_t unitIndex)
+{
+	for (int32_t field = 0; field < D2DX_UNIT_MOTION_FIELDS; ++field)
+	{
+		_unitMotionFields.items[field * 1024 + unitIndex] = 0;
+	}
+}
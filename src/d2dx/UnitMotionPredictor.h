@@ -20,6 +20,7 @@
 
 #include "IGameHelper.h"
 #include "IRenderContext.h"
+#include "ISimd.h"
 
 namespace d2dx
 {
@@ -27,7 +28,8 @@ namespace d2dx
 	{
 	public:
 		UnitMotionPredictor(
-			_In_ const std::shared_ptr<IGameHelper>& gameHelper);
+			_In_ const std::shared_ptr<IGameHelper>& gameHelper,
+			_In_ const std::shared_ptr<ISimd>& simd);
 
 		void Update(
 			_In_ IRenderContext* renderContext);
@@ -40,10 +42,20 @@ namespace d2dx
 			_In_ int32_t x,
 			_In_ int32_t y);
 
+		/* The offset of the unit a shadow drawn at (x, y) belongs to, if any. */
 		Offset GetOffsetForShadow(
 			_In_ int32_t x,
 			_In_ int32_t y);
 
+		bool IsShadowOfUnit(
+			_In_ const D2::UnitAny* unit,
+			_In_ int32_t x,
+			_In_ int32_t y);
+
+		/* How often Update got a unit from the pointers seen while drawing, rather than from the game. */
+		uint32_t GetUnitPointerCacheHits() const { return _unitPointerCacheHits; }
+		uint32_t GetUnitPointerCacheMisses() const { return _unitPointerCacheMisses; }
+
 	private:
 		struct UnitIdAndType final
 		{
@@ -51,23 +63,67 @@ namespace d2dx
 			uint16_t unitId = 0;
 		};
 
-		struct UnitMotion final
-		{
-			Offset GetOffset() const;
-
-			uint32_t lastUsedFrame = 0;
-			Offset lastPos = { 0, 0 };
-			Offset velocity = { 0, 0 };
-			Offset predictedPos = { 0, 0 };
-			Offset correctedPos = { 0, 0 };
-			int64_t dtLastPosChange = 0;
-		};
+		Offset GetUnitOffset(
+			_In_ int32_t unitIndex) const;
+
+		void MoveUnitMotion(
+			_In_ int32_t toUnitIndex,
+			_In_ int32_t fromUnitIndex);
+
+		void ResetUnitMotion(
+			_In_ int32_t unitIndex);
+
+		int32_t FindUnitIndex(
+			_In_ uint32_t unitId,
+			_In_ uint32_t unitType) const;
+
+		int32_t FindOrAddUnitIndex(
+			_In_ uint32_t unitId,
+			_In_ uint32_t unitType);
+
+		uint32_t FindUnitIndexSlot(
+			_In_ uint32_t unitId,
+			_In_ uint32_t unitType) const;
+
+		void RemoveUnitIndex(
+			_In_ int32_t unitIndex);
+
+		void CacheUnitPointer(
+			_In_ int32_t unitIndex,
+			_In_ const D2::UnitAny* unit);
+
+		void LinkUnitCell(
+			_In_ int32_t unitIndex);
+
+		void UnlinkUnitCell(
+			_In_ int32_t unitIndex);
 
 		std::shared_ptr<IGameHelper> _gameHelper;
+		std::shared_ptr<ISimd> _simd;
 		uint32_t _frame = 0;
 		Buffer<UnitIdAndType> _unitIdAndTypes;
-		Buffer<UnitMotion> _unitMotions;
+
+		/* The fields of UnitMotions, one after the other, each with room for all units. */
+		Buffer<int32_t> _unitMotionFields;
+		UnitMotions _unitMotions;
 		Buffer<Offset> _unitScreenPositions;
 		int32_t _unitsCount = 0;
+
+		/* The pointer each unit was last drawn with, and the frame it was drawn in. */
+		Buffer<const D2::UnitAny*> _unitPointers;
+		Buffer<uint32_t> _unitPointerFrames;
+		uint32_t _unitPointerCacheHits = 0;
+		uint32_t _unitPointerCacheMisses = 0;
+
+		/* Open-addressed index of the tracked units, by id and type. Each slot holds an index into
+		   the unit arrays, or -1. Expired units are removed from it right away. */
+		Buffer<int16_t> _unitIndexSlots;
+
+		/* Units by screen position, in a grid of 16x16 pixel cells that wraps around. Each cell
+		   holds a list of the units in it, linked through _unitCellNexts. Units that haven't been
+		   drawn yet have no cell (-1). */
+		Buffer<int16_t> _cellFirstUnits;
+		Buffer<int16_t> _unitCells;
+		Buffer<int16_t> _unitCellNexts;
 	};
 }
@@ -18,6 +18,8 @@
 */
 #pragma once
 
+#include "Types.h"
+
 namespace d2dx
 {
 	class Vertex final
@@ -99,20 +101,97 @@ namespace d2dx
 
 		inline int32_t GetS() const noexcept
 		{
-			return _s;
+			return _s & 511;
 		}
 
 		inline int32_t GetT() const noexcept
 		{
-			return _t;
+			return _t & 511;
 		}
 
 		inline void SetTexcoord(int32_t s, int32_t t) noexcept
 		{
 			assert(s >= 0 && s <= 511);
 			assert(t >= 0 && t <= 511);
-			_s = s;
-			_t = t;
+			_s = (int16_t)((_s & ~511) | s);
+			_t = (int16_t)((_t & ~511) | t);
+		}
+
+		/* Clamps sampling of a non-square texture to its own texels along its short side, which is
+		   the side that TextureAtlasPacker stacks tiles along. Texcoords that reach past the texture
+		   then sample its edge rather than the neighbouring tile. Kept in bit 9 of s (set when the
+		   short side is t) and in bits 9-14 of t, as the middle of the texels / 4: tiles lie at
+		   multiples of their size, so the lowest set bit of the middle is half the size. */
+		inline void SetTexcoordClamp(
+			_In_ int32_t textureWidth,
+			_In_ int32_t textureHeight,
+			_In_ Offset tileOffset) noexcept
+		{
+			int32_t middle = 0;
+
+			if (textureWidth != textureHeight)
+			{
+				const bool isShortSideT = textureWidth > textureHeight;
+				const int32_t size = isShortSideT ? textureHeight : textureWidth;
+				const int32_t first = isShortSideT ? tileOffset.y : tileOffset.x;
+				assert(size >= 8 && (first % size) == 0 && (first + size) <= 256);
+				middle = first + size / 2;
+				_s = (int16_t)((_s & ~512) | (isShortSideT ? 512 : 0));
+			}
+
+			_t = (int16_t)((_t & ~(63 << 9)) | ((middle / 4) << 9));
+		}
+
+		/* The texel range that sampling is clamped to (see SetTexcoordClamp). Unclamped sides get
+		   a range that covers any texcoord. */
+		inline void GetTexcoordClamp(
+			_Out_ Offset& minTexcoord,
+			_Out_ Offset& maxTexcoord) const noexcept
+		{
+			minTexcoord = { -1024, -1024 };
+			maxTexcoord = { 1023, 1023 };
+
+			const int32_t middle = ((_t >> 9) & 63) * 4;
+
+			if (middle != 0)
+			{
+				const int32_t halfSize = middle & -middle;
+				int32_t& minShortSide = (_s & 512) ? minTexcoord.y : minTexcoord.x;
+				int32_t& maxShortSide = (_s & 512) ? maxTexcoord.y : maxTexcoord.x;
+				minShortSide = middle - halfSize;
+				maxShortSide = middle + halfSize - 1;
+			}
+		}
+
+		inline bool HasSameTexcoordClamp(
+			_In_ const Vertex& other) const noexcept
+		{
+			return ((_s ^ other._s) & 512) == 0 && ((_t ^ other._t) & (63 << 9)) == 0;
+		}
+
+		/* Whether the render context adds the camera offset (see IRenderContext::SetCameraOffset) to
+		   the position. Kept in the top bit of t. */
+		inline void SetIsCameraOffsetEnabled(bool isCameraOffsetEnabled) noexcept
+		{
+			_t = (int16_t)((_t & 0x7FFF) | (isCameraOffsetEnabled ? 0x8000 : 0));
+		}
+
+		inline bool IsCameraOffsetEnabled() const noexcept
+		{
+			return (_t & 0x8000) != 0;
+		}
+
+		/* Which texture cache and atlas to sample from when all of them are bound at once (see
+		   BatchMerger). Kept in the bits of s above the texcoord, so it is zero otherwise. */
+		inline void SetTextureSelector(int32_t textureSelector) noexcept
+		{
+			assert(textureSelector >= 0 && textureSelector <= 31);
+			_s = (int16_t)((_s & 1023) | (textureSelector << 10));
+		}
+
+		inline int32_t GetTextureSelector() const noexcept
+		{
+			return (_s >> 10) & 31;
 		}
 
 		inline uint32_t GetColor() const noexcept
@@ -130,6 +209,16 @@ namespace d2dx
 			return (_isChromaKeyEnabled_surfaceId & 0x4000) != 0;
 		}
 
+		inline int32_t GetAtlasIndex() const noexcept
+		{
+			return _paletteIndex_atlasIndex & 4095;
+		}
+
+		inline int32_t GetPaletteIndex() const noexcept
+		{
+			return (_paletteIndex_atlasIndex >> 12) | ((_isChromaKeyEnabled_surfaceId & 0x8000) ? 0x10 : 0);
+		}
+
 	private:
 		int16_t _x;
 		int16_t _y;
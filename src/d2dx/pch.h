@@ -23,6 +23,7 @@
 #define __MSC__
 
 #include <array>
+#include <bit>
 #include <stdexcept>
 #include <cstdio>
 #include <cstdint>
@@ -37,9 +38,16 @@
 #include <wrl/implements.h>
 #include <wrl.h>
 #include <memory>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <comdef.h>
 #include <system_error>
 #include <emmintrin.h>
+#include <immintrin.h>
+#include <intrin.h>
 #include <string.h>
 
 #include "../../thirdparty/fnv/fnv.h"
@@ -0,0 +1,194 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include <algorithm>
+#include "SimdAvx2.h"
+#include "SimdAvx512.h"
+#include "SimdSse2.h"
+#include "TextureCache.h"
+#include "TextureCacheSimulator.h"
+
+using namespace d2dx;
+using namespace std;
+
+/* Replays a texture bind log (recorded with -dxdbg_record_texture_binds, or recordtexturebinds=true
+   in the [debug] section of d2dx.cfg) through the texture caches, for each combination of the
+   given policies and capacities, and prints how each one fared. */
+
+static const char* policyNames[] = { "bitpmru", "2q" };
+
+static void PrintUsage()
+{
+	printf(
+		"Usage: d2dxcachesim <d2dx_texturebinds.bin> [options]\n"
+		"\n"
+		"  -policy=N                 0 (bitpmru) or 1 (2q). May be repeated. Default: all policies.\n"
+		"  -capacities=a,b,c,d,e,f,g capacities of the 8x8, 16x16, 32x32, 64x64, 128x128, 256x256 and\n"
+		"                            256x128 caches (powers of two). May be repeated.\n"
+		"                            Default: the capacities d2dx uses.\n"
+		"  -texturesperatlas=N       textures per atlas (power of two). Default: 2048.\n"
+		"  -noresize                 don't move atlases between the caches.\n");
+}
+
+static std::shared_ptr<ISimd> CreateSimd()
+{
+	if (SimdAvx512::IsSupported())
+	{
+		return std::make_shared<SimdAvx512>();
+	}
+	else if (SimdAvx2::IsSupported())
+	{
+		return std::make_shared<SimdAvx2>();
+	}
+
+	return std::make_shared<SimdSse2>();
+}
+
+static bool IsPowerOfTwo(uint32_t value)
+{
+	return value > 0 && !(value & (value - 1));
+}
+
+static void PrintResult(
+	const TextureCacheSimulatorConfig& config,
+	const TextureCacheSimulatorResult& result)
+{
+	const double hitRate = result.bindCount > 0 ? 100.0 * result.hits / result.bindCount : 0.0;
+	const double evictionsPerFrame = result.frameCount > 0 ? (double)result.evictions / result.frameCount : 0.0;
+
+	printf("policy %s, capacities %u,%u,%u,%u,%u,%u,%u%s\n",
+		policyNames[(int32_t)config.policy],
+		config.capacities[0], config.capacities[1], config.capacities[2], config.capacities[3],
+		config.capacities[4], config.capacities[5], config.capacities[6],
+		config.isResizeEnabled ? "" : " (no resizing)");
+
+	printf("  hit rate         %.3f %% (%llu hits, %llu misses)\n", hitRate, result.hits, result.misses);
+	printf("  evictions/frame  %.2f average, %u worst\n", evictionsPerFrame, result.maxEvictionsInFrame);
+	printf("  uploads          %llu kB total, worst frame %u kB (frame %u)\n",
+		result.uploadBytes / 1024, result.maxUploadBytesInFrame / 1024, result.maxUploadBytesFrame);
+	printf("  memory           %u kB initial, %u kB peak, %u kB final\n",
+		result.initialMemoryFootprint / 1024, result.maxMemoryFootprint / 1024, result.finalMemoryFootprint / 1024);
+	printf("  misses per cache %llu,%llu,%llu,%llu,%llu,%llu,%llu\n",
+		result.cacheMisses[0], result.cacheMisses[1], result.cacheMisses[2], result.cacheMisses[3],
+		result.cacheMisses[4], result.cacheMisses[5], result.cacheMisses[6]);
+	printf("  final capacities %u,%u,%u,%u,%u,%u,%u\n",
+		result.finalCapacities[0], result.finalCapacities[1], result.finalCapacities[2], result.finalCapacities[3],
+		result.finalCapacities[4], result.finalCapacities[5], result.finalCapacities[6]);
+	printf("  final packing    %.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n\n",
+		result.finalPackingEfficiencies[0], result.finalPackingEfficiencies[1], result.finalPackingEfficiencies[2], result.finalPackingEfficiencies[3],
+		result.finalPackingEfficiencies[4], result.finalPackingEfficiencies[5], result.finalPackingEfficiencies[6]);
+}
+
+int main(int argc, const char* argv[])
+{
+	if (argc < 2)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	std::vector<TextureCachePolicyOption> policies;
+	std::vector<TextureCacheSimulatorConfig> capacityConfigs;
+	uint32_t texturesPerAtlas = 2048;
+	bool isResizeEnabled = true;
+
+	for (int32_t i = 2; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		uint32_t policy = 0;
+		uint32_t count = 0;
+		TextureCacheSimulatorConfig config;
+		uint32_t* c = config.capacities;
+
+		if (sscanf_s(arg, "-policy=%u", &policy) == 1 && policy < (uint32_t)TextureCachePolicyOption::Count)
+		{
+			policies.push_back((TextureCachePolicyOption)policy);
+		}
+		else if (sscanf_s(arg, "-capacities=%u,%u,%u,%u,%u,%u,%u", &c[0], &c[1], &c[2], &c[3], &c[4], &c[5], &c[6]) == 7 &&
+			all_of(c, c + 7, IsPowerOfTwo))
+		{
+			capacityConfigs.push_back(config);
+		}
+		else if (sscanf_s(arg, "-texturesperatlas=%u", &count) == 1 && IsPowerOfTwo(count))
+		{
+			texturesPerAtlas = count;
+		}
+		else if (!strcmp(arg, "-noresize"))
+		{
+			isResizeEnabled = false;
+		}
+		else
+		{
+			printf("Invalid option '%s'.\n\n", arg);
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (policies.empty())
+	{
+		for (int32_t i = 0; i < (int32_t)TextureCachePolicyOption::Count; ++i)
+		{
+			policies.push_back((TextureCachePolicyOption)i);
+		}
+	}
+
+	if (capacityConfigs.empty())
+	{
+		capacityConfigs.push_back({});
+	}
+
+	for (const auto& capacityConfig : capacityConfigs)
+	{
+		if (any_of(capacityConfig.capacities, capacityConfig.capacities + D2DX_TEXTURE_CACHE_COUNT,
+			[=](uint32_t capacity) { return capacity > texturesPerAtlas * D2DX_MAX_ATLASES_PER_TEXTURE_CACHE; }))
+		{
+			printf("Capacities can be at most %u textures per atlas x %u atlases.\n", texturesPerAtlas, D2DX_MAX_ATLASES_PER_TEXTURE_CACHE);
+			return 1;
+		}
+	}
+
+	std::vector<TextureBindRecord> records;
+
+	if (!TextureCacheSimulator::LoadLog(argv[1], records))
+	{
+		printf("Failed to load texture bind log '%s'.\n", argv[1]);
+		return 1;
+	}
+
+	TextureCacheSimulator simulator{ CreateSimd() };
+
+	printf("%s: %zu binds, %u frames\n\n", argv[1], records.size(),
+		records.empty() ? 0 : records.back().frame - records.front().frame + 1);
+
+	for (const auto& capacityConfig : capacityConfigs)
+	{
+		for (const auto policy : policies)
+		{
+			TextureCacheSimulatorConfig config = capacityConfig;
+			config.policy = policy;
+			config.texturesPerAtlas = texturesPerAtlas;
+			config.isResizeEnabled = isResizeEnabled;
+
+			PrintResult(config, simulator.Run(records.data(), (uint32_t)records.size(), config));
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,210 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include <algorithm>
+#include <vector>
+#include "CompatibilityModeDisabler.h"
+#include "D2DXContext.h"
+#include "GlideTracePlayer.h"
+#include "NullRenderContext.h"
+#include "SimdAvx2.h"
+#include "SimdAvx512.h"
+#include "SimdSse2.h"
+#include "Utils.h"
+
+using namespace d2dx;
+using namespace std;
+
+/* Replays a Glide trace (recorded with -dxdbg_record_trace, or recordtrace=true in the [debug]
+   section of d2dx.cfg) through D2DXContext and the null render context, and prints the CPU time
+   per frame. The game isn't running, so a stand-in game helper answers for it. */
+
+class ReplayGameHelper final : public IGameHelper
+{
+public:
+	ReplayGameHelper(
+		_In_ bool isInGame) :
+		_isInGame{ isInGame }
+	{
+	}
+
+	virtual GameVersion GetVersion() const override { return GameVersion::Unsupported; }
+	virtual const char* GetVersionString() const override { return "replay"; }
+	virtual uint32_t ScreenOpenMode() const override { return 0; }
+	virtual Size GetConfiguredGameSize() const override { return { 800, 600 }; }
+	virtual GameAddress IdentifyGameAddress(uint32_t returnAddress) const override { return GameAddress::Unknown; }
+	virtual TextureCategory GetTextureCategoryFromHash(uint32_t textureHash) const override { return TextureCategory::Unknown; }
+	virtual TextureCategory RefineTextureCategoryFromGameAddress(TextureCategory previousCategory, GameAddress gameAddress) const override { return previousCategory; }
+	virtual bool TryApplyInGameFpsFix() override { return false; }
+	virtual bool TryApplyMenuFpsFix() override { return false; }
+	virtual bool TryApplyInGameSleepFixes() override { return false; }
+	/* Returning no functions also keeps D2DXContext from detouring anything. */
+	virtual void* GetFunction(D2Function function) const override { return nullptr; }
+	virtual DrawParameters GetDrawParameters(const D2::CellContext* cellContext) const override { return { 0, 0, 0 }; }
+	virtual D2::UnitAny* GetPlayerUnit() const override { return nullptr; }
+	virtual Offset GetUnitPos(const D2::UnitAny* unit) const override { return { 0, 0 }; }
+	virtual D2::UnitType GetUnitType(const D2::UnitAny* unit) const override { return D2::UnitType::Monster; }
+	virtual uint32_t GetUnitId(const D2::UnitAny* unit) const override { return 0; }
+	virtual int32_t GetCurrentAct() const override { return 0; }
+	virtual bool IsGameMenuOpen() const override { return false; }
+	virtual bool IsInGame() const override { return _isInGame; }
+	virtual bool IsProjectDiablo2() const override { return false; }
+	virtual D2::UnitAny* FindUnit(uint32_t unitId, D2::UnitType unitType) const override { return nullptr; }
+
+private:
+	bool _isInGame;
+};
+
+static void PrintUsage()
+{
+	printf(
+		"Usage: d2dxreplay <d2dx_trace.bin> [options] [d2dx options]\n"
+		"\n"
+		"  -loops=N   play the trace N times. Default: 1.\n"
+		"  -menus     replay as if the game were in the menus. Default: in game.\n"
+		"\n"
+		"d2dx options such as -dxmultiatlas are applied too. The null renderer is always used.\n");
+}
+
+static std::shared_ptr<ISimd> CreateSimd()
+{
+	if (SimdAvx512::IsSupported())
+	{
+		return std::make_shared<SimdAvx512>();
+	}
+	else if (SimdAvx2::IsSupported())
+	{
+		return std::make_shared<SimdAvx2>();
+	}
+
+	return std::make_shared<SimdSse2>();
+}
+
+int main(int argc, const char* argv[])
+{
+	if (argc < 2)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	uint32_t loopCount = 1;
+	bool isInGame = true;
+
+	for (int32_t i = 2; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		uint32_t count = 0;
+
+		if (sscanf_s(arg, "-loops=%u", &count) == 1 && count > 0)
+		{
+			loopCount = count;
+		}
+		else if (!strcmp(arg, "-menus"))
+		{
+			isInGame = false;
+		}
+		else if (strncmp(arg, "-dx", 3))
+		{
+			printf("Invalid option '%s'.\n\n", arg);
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	GlideTracePlayer player{ argv[1] };
+
+	if (!player.IsValid())
+	{
+		printf("Failed to load Glide trace '%s'.\n", argv[1]);
+		return 1;
+	}
+
+	/* Only what affects the CPU-side work is taken from the command line; nothing may touch the
+	   real game or display. */
+	Options options;
+	options.ApplyCommandLine(GetCommandLineA());
+	options.SetFlag(OptionsFlag::DbgNullRenderer, true);
+	options.SetFlag(OptionsFlag::DbgSoftwareRenderer, false);
+	options.SetFlag(OptionsFlag::DbgRecordTrace, false);
+	options.SetFlag(OptionsFlag::NoResMod, true);
+	options.SetFlag(OptionsFlag::NoFpsFix, true);
+	options.SetFlag(OptionsFlag::NoCompatModeFix, true);
+
+	D2DXContext d2dxContext{
+		std::make_shared<ReplayGameHelper>(isInGame),
+		CreateSimd(),
+		std::make_shared<CompatibilityModeDisabler>(),
+		options };
+
+	std::vector<float> frameTimesMs;
+
+	for (uint32_t loop = 0; loop < loopCount; ++loop)
+	{
+		player.Rewind();
+
+		while (true)
+		{
+			const int64_t startTime = TimeStart();
+			const bool isFrameComplete = player.PlayFrame(&d2dxContext);
+			const float timeMs = TimeEndMs(startTime);
+
+			if (!isFrameComplete)
+			{
+				break;
+			}
+
+			frameTimesMs.push_back(timeMs);
+		}
+	}
+
+	const NullRenderContext* renderContext = dynamic_cast<const NullRenderContext*>(d2dxContext.GetRenderContext());
+
+	if (frameTimesMs.empty() || !renderContext)
+	{
+		printf("'%s' has no complete frames.\n", argv[1]);
+		return 1;
+	}
+
+	const uint32_t frameCount = (uint32_t)frameTimesMs.size();
+	double totalTimeMs = 0.0;
+
+	for (const float timeMs : frameTimesMs)
+	{
+		totalTimeMs += timeMs;
+	}
+
+	sort(frameTimesMs.begin(), frameTimesMs.end());
+
+	const NullRenderContextStats& totalStats = renderContext->GetTotalStats();
+
+	printf("%s: %u frames (%u per loop)\n\n", argv[1], frameCount, player.GetFrameCount());
+	printf("  time/frame       %.3f ms average, %.3f ms median, %.3f ms 99th percentile, %.3f ms worst\n",
+		totalTimeMs / frameCount,
+		frameTimesMs[frameCount / 2],
+		frameTimesMs[min(frameCount - 1, frameCount * 99 / 100)],
+		frameTimesMs.back());
+	printf("  draw calls/frame %.1f\n", (double)totalStats.drawCalls / frameCount);
+	printf("  vertices/frame   %.1f\n", (double)totalStats.verticesWritten / frameCount);
+	printf("  state changes    %.1f per frame\n", (double)totalStats.stateChanges / frameCount);
+	printf("  uploads          %u textures (%u kB), %u palettes\n",
+		totalStats.textureUploads, totalStats.textureBytesUploaded / 1024, totalStats.paletteUploads);
+
+	return 0;
+}
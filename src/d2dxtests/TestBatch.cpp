@@ -113,6 +113,22 @@ namespace d2dxtests
 			}
 		}
 
+		TEST_METHOD(SetPrimitiveType)
+		{
+			Batch batch;
+			for (int32_t i = 0; i < (int32_t)PrimitiveType::Count; ++i)
+			{
+				batch.SetPrimitiveType((d2dx::PrimitiveType)i);
+				Assert::IsFalse(batch.IsValid());
+				Assert::AreEqual((d2dx::PrimitiveType)i, batch.GetPrimitiveType());
+				Assert::AreEqual(AlphaBlend::Opaque, batch.GetAlphaBlend());
+				Assert::AreEqual(AlphaCombine::One, batch.GetAlphaCombine());
+				Assert::AreEqual(RgbCombine::ColorMultipliedByTexture, batch.GetRgbCombine());
+				Assert::AreEqual(TextureCategory::Unknown, batch.GetTextureCategory());
+				Assert::AreEqual(0U, batch.GetVertexCount());
+			}
+		}
+
 		TEST_METHOD(SetAtlasIndex)
 		{
 			Batch batch;
@@ -209,6 +225,7 @@ namespace d2dxtests
 					Assert::AreEqual(-D2DX_TMU_ADDRESS_ALIGNMENT, batch.GetTextureStartAddress());
 					Assert::AreEqual(0U, batch.GetVertexCount());
 					Assert::AreEqual(1 << w, batch.GetTextureWidth());
+					Assert::AreEqual((w == 8 && h == 7) ? 6 : max(w, h) - 3, batch.GetTextureCacheIndex());
 				}
 			}
 		}
@@ -0,0 +1,156 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include <array>
+#include "CppUnitTest.h"
+
+#include "../d2dx/BatchMerger.h"
+#include "../d2dx/NullRenderContext.h"
+#include "../d2dx/SimdSse2.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestBatchMerger)
+	{
+	public:
+		struct Frame
+		{
+			std::array<Batch, 64> batches;
+			uint32_t batchCount = 0;
+			uint32_t vertexCount = 0;
+
+			void Add(int32_t width, int32_t height, uint32_t atlas, AlphaBlend alphaBlend, uint32_t vertexCount_ = 4,
+				PrimitiveType primitiveType = PrimitiveType::Quads)
+			{
+				Batch batch;
+				batch.SetTextureStartAddress(0);
+				batch.SetTextureSize(width, height);
+				batch.SetTextureAtlas(atlas);
+				batch.SetAlphaBlend(alphaBlend);
+				batch.SetPrimitiveType(primitiveType);
+				batch.SetStartVertex(vertexCount);
+				batch.SetVertexCount(vertexCount_);
+				vertexCount += vertexCount_;
+				batches[batchCount++] = batch;
+			}
+		};
+
+		/* A frame shaped like one recorded in town: floor tiles, walls, units and shadows, then the UI. */
+		static void AddTownFrame(Frame& frame)
+		{
+			for (int32_t i = 0; i < 8; ++i)
+			{
+				frame.Add(256, 128, i & 1, AlphaBlend::Opaque);
+			}
+
+			frame.Add(64, 64, 0, AlphaBlend::Opaque);
+			frame.Add(128, 128, 0, AlphaBlend::Opaque);
+			frame.Add(64, 64, 1, AlphaBlend::Opaque);
+			frame.Add(32, 32, 0, AlphaBlend::SrcAlphaInvSrcAlpha);
+			frame.Add(64, 32, 0, AlphaBlend::SrcAlphaInvSrcAlpha);
+			frame.Add(128, 64, 2, AlphaBlend::Opaque);
+			frame.Add(256, 256, 0, AlphaBlend::Opaque);
+			frame.Add(16, 16, 0, AlphaBlend::Opaque);
+			frame.Add(8, 8, 0, AlphaBlend::Opaque);
+			frame.Add(256, 32, 3, AlphaBlend::Opaque);
+		}
+
+		static uint32_t CountDrawCalls(const Frame& frame, bool isMultiAtlasEnabled)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			NullRenderContext renderContext{ nullptr, { 640, 480 }, { 800, 600 }, ScreenMode::Windowed, nullptr, simd,
+				TextureCachePolicyOption::BitPmru, isMultiAtlasEnabled };
+
+			const uint32_t drawCalls = BatchMerger::DrawBatches(&renderContext, frame.batches.data(), frame.batchCount, 0);
+			renderContext.Present();
+
+			Assert::AreEqual(drawCalls, renderContext.GetLastFrameStats().drawCalls);
+			return drawCalls;
+		}
+
+		TEST_METHOD(MultiAtlasSplitsOnlyOnBlendMode)
+		{
+			Frame frame;
+			AddTownFrame(frame);
+
+			Assert::AreEqual(18U, CountDrawCalls(frame, false));
+			Assert::AreEqual(3U, CountDrawCalls(frame, true));
+		}
+
+		TEST_METHOD(SplitsAtVertexLimit)
+		{
+			Frame frame;
+			frame.Add(32, 32, 0, AlphaBlend::Opaque, 30000);
+			frame.Add(64, 64, 0, AlphaBlend::Opaque, 30000);
+			frame.Add(64, 64, 1, AlphaBlend::Opaque, 30000);
+
+			Assert::AreEqual(3U, CountDrawCalls(frame, false));
+			Assert::AreEqual(2U, CountDrawCalls(frame, true));
+		}
+
+		TEST_METHOD(KeepsQuadsApartFromTriangles)
+		{
+			Frame frame;
+			frame.Add(32, 32, 0, AlphaBlend::Opaque);
+			frame.Add(32, 32, 0, AlphaBlend::Opaque);
+			frame.Add(32, 32, 0, AlphaBlend::Opaque, 6, PrimitiveType::Triangles);
+			frame.Add(32, 32, 0, AlphaBlend::Opaque, 9, PrimitiveType::Triangles);
+			frame.Add(32, 32, 0, AlphaBlend::Opaque);
+
+			Assert::AreEqual(3U, CountDrawCalls(frame, false));
+			Assert::AreEqual(3U, CountDrawCalls(frame, true));
+		}
+
+		TEST_METHOD(KeepsSpritesApartFromQuads)
+		{
+			Frame frame;
+			frame.Add(32, 32, 0, AlphaBlend::Opaque, 2, PrimitiveType::Sprites);
+			frame.Add(32, 32, 0, AlphaBlend::Opaque, 2, PrimitiveType::Sprites);
+			frame.Add(32, 32, 0, AlphaBlend::Opaque);
+			frame.Add(32, 32, 0, AlphaBlend::Opaque, 2, PrimitiveType::Sprites);
+
+			Assert::AreEqual(3U, CountDrawCalls(frame, false));
+			Assert::AreEqual(3U, CountDrawCalls(frame, true));
+		}
+
+		TEST_METHOD(TextureSelectors)
+		{
+			Batch batch;
+			batch.SetTextureSize(8, 8);
+			Assert::AreEqual(0, BatchMerger::GetTextureSelector(batch));
+			batch.SetTextureSize(32, 64);
+			batch.SetTextureAtlas(2);
+			Assert::AreEqual(3 * D2DX_MAX_ATLASES_PER_TEXTURE_CACHE + 2, BatchMerger::GetTextureSelector(batch));
+			batch.SetTextureSize(256, 128);
+			batch.SetTextureAtlas(3);
+			Assert::AreEqual(D2DX_MAX_TEXTURE_SELECTORS - 1, BatchMerger::GetTextureSelector(batch));
+
+			/* The selector shares the bits of s with the texcoord. */
+			Vertex vertex{ 0, 0, 0, 0, 0xFFFFFFFF, false, 0, 0, 0 };
+			vertex.SetTextureSelector(27);
+			vertex.SetTexcoord(511, 7);
+			Assert::AreEqual(27, vertex.GetTextureSelector());
+			Assert::AreEqual(511, vertex.GetS());
+			Assert::AreEqual(7, vertex.GetT());
+		}
+	};
+}
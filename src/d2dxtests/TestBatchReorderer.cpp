@@ -0,0 +1,175 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include <array>
+#include "CppUnitTest.h"
+
+#include "../d2dx/BatchReorderer.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestBatchReorderer)
+	{
+	public:
+		struct Frame
+		{
+			std::array<Batch, 64> batches;
+			std::array<uint64_t, 64> mergeKeys;
+			std::array<Vertex, 64 * 6> vertices;
+			uint32_t batchCount = 0;
+			uint32_t vertexCount = 0;
+
+			/* A quad batch; the id ends up in the texture hash, to tell the batches apart. */
+			void AddQuad(uint32_t id, uint64_t mergeKey, int32_t x, int32_t y, int32_t width, int32_t height, bool isCameraOffsetEnabled = false)
+			{
+				Batch batch;
+				batch.SetTextureStartAddress(0);
+				batch.SetTextureHash(id);
+				batch.SetStartVertex(vertexCount);
+				batch.SetVertexCount(6);
+
+				const int32_t xs[6] = { x, x + width, x + width, x, x + width, x };
+				const int32_t ys[6] = { y, y, y + height, y, y + height, y + height };
+
+				for (int32_t i = 0; i < 6; ++i)
+				{
+					vertices[vertexCount] = Vertex{ xs[i], ys[i], 0, 0, 0xFFFFFFFF, false, (int32_t)id, 0, 0 };
+					vertices[vertexCount++].SetIsCameraOffsetEnabled(isCameraOffsetEnabled);
+				}
+
+				mergeKeys[batchCount] = mergeKey;
+				batches[batchCount++] = batch;
+			}
+
+			bool Reorder(BatchReorderer& reorderer, Offset cameraOffset = { 0, 0 })
+			{
+				return reorderer.Reorder(batches.data(), mergeKeys.data(), batchCount, vertices.data(), { 640, 480 }, cameraOffset);
+			}
+		};
+
+		TEST_METHOD(MovesNonOverlappingBatchesTogether)
+		{
+			BatchReorderer reorderer{ 64, 64 * 6 };
+			Frame frame;
+
+			/* Floor and wall tiles interleaved, none overlapping (nor sharing grid cells). */
+			for (uint32_t i = 0; i < 8; ++i)
+			{
+				frame.AddQuad(i, i & 1, 128 * (int32_t)(i & 3), 128 * (int32_t)(i >> 2), 64, 64);
+			}
+
+			Assert::IsTrue(frame.Reorder(reorderer));
+			Assert::AreEqual(8U, reorderer.GetDrawCallsBefore());
+			Assert::AreEqual(2U, reorderer.GetDrawCallsAfter());
+			Assert::AreEqual(8U, reorderer.GetBatchCount());
+			Assert::AreEqual(48U, reorderer.GetVertexCount());
+
+			const uint32_t expectedOrder[8] = { 0, 2, 4, 6, 1, 3, 5, 7 };
+
+			for (uint32_t i = 0; i < 8; ++i)
+			{
+				const Batch& batch = reorderer.GetBatches().items[i];
+				Assert::AreEqual(expectedOrder[i], batch.GetHash());
+				Assert::AreEqual(i * 6, batch.GetStartVertex());
+
+				/* The vertices moved along with their batch. */
+				Assert::AreEqual((int32_t)expectedOrder[i], reorderer.GetVertices().items[i * 6].GetAtlasIndex());
+				Assert::AreEqual(128 * (int32_t)(expectedOrder[i] & 3), reorderer.GetVertices().items[i * 6].GetX());
+			}
+		}
+
+		TEST_METHOD(KeepsOrderOfOverlappingBatches)
+		{
+			BatchReorderer reorderer{ 64, 64 * 6 };
+			Frame frame;
+
+			/* A shadow (key 1) between two sprites (key 0) that it overlaps. */
+			frame.AddQuad(0, 0, 100, 100, 32, 32);
+			frame.AddQuad(1, 1, 110, 110, 32, 32);
+			frame.AddQuad(2, 0, 120, 120, 32, 32);
+
+			Assert::IsFalse(frame.Reorder(reorderer));
+			Assert::AreEqual(3U, reorderer.GetDrawCallsBefore());
+			Assert::AreEqual(3U, reorderer.GetDrawCallsAfter());
+		}
+
+		TEST_METHOD(DoesNotMovePastOverlappingRun)
+		{
+			BatchReorderer reorderer{ 64, 64 * 6 };
+			Frame frame;
+
+			frame.AddQuad(0, 0, 0, 0, 32, 32);
+			frame.AddQuad(1, 1, 300, 300, 32, 32);
+			frame.AddQuad(2, 2, 300, 0, 32, 32);
+
+			/* Only overlaps batch 0, so it can move back past batch 2 to join batch 1. */
+			frame.AddQuad(3, 1, 10, 10, 16, 16);
+
+			/* Overlaps batch 2, so it can't move back to batch 0. */
+			frame.AddQuad(4, 0, 310, 10, 16, 16);
+
+			Assert::IsTrue(frame.Reorder(reorderer));
+			Assert::AreEqual(5U, reorderer.GetDrawCallsBefore());
+			Assert::AreEqual(4U, reorderer.GetDrawCallsAfter());
+
+			const uint32_t expectedOrder[5] = { 0, 1, 3, 2, 4 };
+
+			for (uint32_t i = 0; i < 5; ++i)
+			{
+				Assert::AreEqual(expectedOrder[i], reorderer.GetBatches().items[i].GetHash());
+			}
+		}
+
+		TEST_METHOD(TestsOverlapWithCameraOffset)
+		{
+			BatchReorderer reorderer{ 64, 64 * 6 };
+			Frame frame;
+
+			frame.AddQuad(0, 0, 0, 0, 32, 32);
+			frame.AddQuad(1, 1, 300, 300, 32, 32, true);
+			frame.AddQuad(2, 0, 300, 0, 32, 32);
+
+			/* Where the vertices are... */
+			Assert::IsTrue(frame.Reorder(reorderer));
+			Assert::AreEqual(2U, reorderer.GetDrawCallsAfter());
+
+			/* ...and where the camera offset draws batch 1: on top of batch 2. */
+			Assert::IsFalse(frame.Reorder(reorderer, { 0, -300 }));
+			Assert::AreEqual(3U, reorderer.GetDrawCallsAfter());
+		}
+
+		TEST_METHOD(LeavesMergeableFrameAlone)
+		{
+			BatchReorderer reorderer{ 64, 64 * 6 };
+			Frame frame;
+
+			for (uint32_t i = 0; i < 4; ++i)
+			{
+				frame.AddQuad(i, 5, 0, 0, 640, 480);
+			}
+
+			Assert::IsFalse(frame.Reorder(reorderer));
+			Assert::AreEqual(1U, reorderer.GetDrawCallsBefore());
+			Assert::AreEqual(1U, reorderer.GetDrawCallsAfter());
+		}
+	};
+}
@@ -0,0 +1,206 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include "../d2dx/D2Types.h"
+#include "../d2dx/GlideTracePlayer.h"
+#include "../d2dx/GlideTraceRecorder.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	class CountingGlide3x final : public IGlide3x
+	{
+	public:
+		const char* OnGetString(uint32_t pname) override { return nullptr; }
+		uint32_t OnGet(uint32_t pname, uint32_t plength, int32_t* params) override { return 0; }
+		void OnSstWinOpen(uint32_t hWnd, int32_t width, int32_t height) override { ++sstWinOpens; lastWidth = width; }
+		void OnVertexLayout(uint32_t param, int32_t offset) override {}
+		void OnTexDownload(uint32_t tmu, const uint8_t* sourceAddress, uint32_t startAddress, int32_t width, int32_t height) override
+		{
+			++texDownloads;
+			lastPixel = sourceAddress[width * height - 1];
+		}
+		void OnTexSource(uint32_t tmu, uint32_t startAddress, int32_t width, int32_t height) override { ++texSources; }
+		void OnConstantColorValue(uint32_t color) override {}
+		void OnAlphaBlendFunction(GrAlphaBlendFnc_t rgb_sf, GrAlphaBlendFnc_t rgb_df, GrAlphaBlendFnc_t alpha_sf, GrAlphaBlendFnc_t alpha_df) override {}
+		void OnColorCombine(GrCombineFunction_t function, GrCombineFactor_t factor, GrCombineLocal_t local, GrCombineOther_t other, bool invert) override {}
+		void OnAlphaCombine(GrCombineFunction_t function, GrCombineFactor_t factor, GrCombineLocal_t local, GrCombineOther_t other, bool invert) override {}
+		void OnDrawPoint(const void* pt, uint32_t gameContext) override {}
+		void OnDrawLine(const void* v1, const void* v2, uint32_t gameContext) override {}
+		void OnDrawVertexArray(uint32_t mode, uint32_t count, uint8_t** pointers, uint32_t gameContext) override
+		{
+			++drawVertexArrays;
+			lastX = ((const D2::Vertex*)pointers[count - 1])->x;
+		}
+		void OnDrawVertexArrayContiguous(uint32_t mode, uint32_t count, uint8_t* vertex, uint32_t stride, uint32_t gameContext) override { ++drawVertexArrays; }
+		void OnTexDownloadTable(GrTexTable_t type, void* data) override { ++texDownloadTables; lastPaletteEntry = ((const uint32_t*)data)[255]; }
+		void OnLoadGammaTable(uint32_t nentries, uint32_t* red, uint32_t* green, uint32_t* blue) override {}
+		void OnChromakeyMode(GrChromakeyMode_t mode) override {}
+		void OnLfbUnlock(const uint32_t* lfbPtr, uint32_t strideInBytes) override {}
+		void OnGammaCorrectionRGB(float red, float green, float blue) override {}
+		void OnBufferSwap() override { ++bufferSwaps; }
+		void OnBufferClear() override {}
+
+		int32_t sstWinOpens = 0;
+		int32_t texDownloads = 0;
+		int32_t texSources = 0;
+		int32_t texDownloadTables = 0;
+		int32_t drawVertexArrays = 0;
+		int32_t bufferSwaps = 0;
+		int32_t lastWidth = 0;
+		uint8_t lastPixel = 0;
+		uint32_t lastPaletteEntry = 0;
+		float lastX = 0;
+	};
+
+	TEST_CLASS(TestGlideTrace)
+	{
+	public:
+		static void PatchFile(
+			const char* filename,
+			uint32_t offset,
+			uint32_t value)
+		{
+			FILE* file = nullptr;
+			Assert::AreEqual(0, (int)fopen_s(&file, filename, "r+b"));
+			fseek(file, (long)offset, SEEK_SET);
+			fwrite(&value, sizeof(value), 1, file);
+			fclose(file);
+		}
+
+		TEST_METHOD(RecordAndReplay)
+		{
+			const char* filename = "d2dxtests_trace.bin";
+
+			{
+				GlideTraceRecorder recorder{ filename };
+				Assert::IsTrue(recorder.IsRecording());
+
+				uint8_t pixels[3 * 3];
+				memset(pixels, 0, sizeof(pixels));
+				pixels[8] = 0x7F;
+
+				uint32_t palette[256];
+				memset(palette, 0, sizeof(palette));
+				palette[255] = 0xFF00FF00;
+
+				D2::Vertex vertices[4];
+				memset(vertices, 0, sizeof(vertices));
+				vertices[3].x = 123.0f;
+				uint8_t* pointers[4] = { (uint8_t*)&vertices[0], (uint8_t*)&vertices[1], (uint8_t*)&vertices[2], (uint8_t*)&vertices[3] };
+
+				recorder.RecordSstWinOpen(640, 480);
+				recorder.RecordTexDownloadTable(palette);
+				recorder.RecordTexDownload(0, 3, 3, pixels);
+				recorder.RecordTexSource(0, 3, 3);
+				recorder.RecordDrawVertexArray(GR_TRIANGLE_FAN, 4, pointers, 0);
+				recorder.RecordBufferSwap();
+				recorder.RecordDrawVertexArrayContiguous(GR_TRIANGLE_FAN, 4, (const uint8_t*)vertices, sizeof(D2::Vertex), 0);
+				recorder.RecordBufferSwap();
+
+				Assert::AreEqual(2U, recorder.GetFrameCount());
+			}
+
+			GlideTracePlayer player{ filename };
+			Assert::IsTrue(player.IsValid());
+			Assert::AreEqual(2U, player.GetFrameCount());
+
+			CountingGlide3x glide3x;
+			Assert::IsTrue(player.PlayFrame(&glide3x));
+			Assert::AreEqual(1, glide3x.sstWinOpens);
+			Assert::AreEqual(640, glide3x.lastWidth);
+			Assert::AreEqual(1, glide3x.texDownloadTables);
+			Assert::AreEqual(0xFF00FF00U, glide3x.lastPaletteEntry);
+			Assert::AreEqual(1, glide3x.texDownloads);
+			Assert::AreEqual((uint8_t)0x7F, glide3x.lastPixel);
+			Assert::AreEqual(1, glide3x.texSources);
+			Assert::AreEqual(1, glide3x.drawVertexArrays);
+			Assert::AreEqual(123.0f, glide3x.lastX);
+			Assert::AreEqual(1, glide3x.bufferSwaps);
+
+			Assert::IsTrue(player.PlayFrame(&glide3x));
+			Assert::AreEqual(2, glide3x.drawVertexArrays);
+			Assert::AreEqual(2, glide3x.bufferSwaps);
+
+			Assert::IsFalse(player.PlayFrame(&glide3x));
+
+			player.Rewind();
+			Assert::IsTrue(player.PlayFrame(&glide3x));
+			Assert::AreEqual(2, glide3x.sstWinOpens);
+
+			remove(filename);
+		}
+
+		TEST_METHOD(StopsBeforeRecordWithBadPayloadSize)
+		{
+			const char* filename = "d2dxtests_corrupt_trace.bin";
+
+			/* The second frame has a record whose count or size fields don't match its payload size:
+			   they are at offset 44, after the file header, SstWinOpen, BufferSwap, the record's
+			   header and its first field. */
+			for (int32_t test = 0; test < 3; ++test)
+			{
+				{
+					GlideTraceRecorder recorder{ filename };
+
+					uint8_t pixels[4 * 4] = { };
+					D2::Vertex vertices[3] = { };
+					uint8_t* pointers[3] = { (uint8_t*)&vertices[0], (uint8_t*)&vertices[1], (uint8_t*)&vertices[2] };
+
+					recorder.RecordSstWinOpen(640, 480);
+					recorder.RecordBufferSwap();
+
+					if (test == 0)
+					{
+						recorder.RecordTexDownload(0, 4, 4, pixels);
+					}
+					else if (test == 1)
+					{
+						recorder.RecordDrawVertexArray(GR_TRIANGLE_FAN, 3, pointers, 0);
+					}
+					else
+					{
+						recorder.RecordDrawVertexArrayContiguous(GR_TRIANGLE_FAN, 3, (const uint8_t*)vertices, sizeof(D2::Vertex), 0);
+					}
+
+					recorder.RecordBufferSwap();
+				}
+
+				PatchFile(filename, 44, test == 0 ? 8 : 0x10000000);
+
+				GlideTracePlayer player{ filename };
+				Assert::IsTrue(player.IsValid());
+				Assert::AreEqual(1U, player.GetFrameCount());
+
+				CountingGlide3x glide3x;
+				Assert::IsTrue(player.PlayFrame(&glide3x));
+				Assert::IsFalse(player.PlayFrame(&glide3x));
+				Assert::AreEqual(1, glide3x.bufferSwaps);
+				Assert::AreEqual(0, glide3x.texDownloads);
+				Assert::AreEqual(0, glide3x.drawVertexArrays);
+
+				remove(filename);
+			}
+		}
+	};
+}
@@ -0,0 +1,87 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include <array>
+#include "CppUnitTest.h"
+
+#include "../d2dx/Batch.h"
+#include "../d2dx/NullRenderContext.h"
+#include "../d2dx/SimdSse2.h"
+#include "../d2dx/Vertex.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestNullRenderContext)
+	{
+	public:
+		TEST_METHOD(CountsPerFrame)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			NullRenderContext renderContext{ nullptr, { 640, 480 }, { 800, 600 }, ScreenMode::Windowed, nullptr, simd };
+
+			std::array<uint8_t, 2 * 256 * 256> tmuData;
+			std::array<Vertex, 6> vertices;
+			std::array<uint32_t, 256> palette;
+			tmuData.fill(0);
+			palette.fill(0);
+
+			Batch batch;
+			batch.SetTextureStartAddress(256);
+			batch.SetTextureSize(32, 32);
+			batch.SetTextureHash(0x12345678);
+			batch.SetAlphaBlend(AlphaBlend::Opaque);
+			batch.SetVertexCount(3);
+
+			renderContext.SetPalette(0, palette.data());
+			const uint32_t startVertexLocation = renderContext.BulkWriteVertices(vertices.data(), (uint32_t)vertices.size());
+			Assert::AreEqual(0U, startVertexLocation);
+
+			auto tcl = renderContext.UpdateTexture(batch, tmuData.data(), (uint32_t)tmuData.size());
+			Assert::AreEqual((int16_t)0, tcl._textureAtlas);
+
+			/* Same content key again is a cache hit. */
+			renderContext.UpdateTexture(batch, tmuData.data(), (uint32_t)tmuData.size());
+
+			renderContext.Draw(batch, startVertexLocation);
+			batch.SetAlphaBlend(AlphaBlend::Additive);
+			renderContext.Draw(batch, startVertexLocation);
+			renderContext.Present();
+
+			const auto& stats = renderContext.GetLastFrameStats();
+			Assert::AreEqual(2U, stats.drawCalls);
+			Assert::AreEqual(6U, stats.verticesWritten);
+			Assert::AreEqual((uint32_t)(6 * sizeof(Vertex)), stats.vertexBytesUploaded);
+			Assert::AreEqual(1U, stats.textureUploads);
+			Assert::AreEqual(32U * 32U, stats.textureBytesUploaded);
+			Assert::AreEqual(1U, stats.paletteUploads);
+			Assert::AreEqual(3U, stats.stateChanges);
+			Assert::AreEqual(1U, renderContext.GetFrameCount());
+
+			renderContext.Present();
+			Assert::AreEqual(0U, renderContext.GetLastFrameStats().drawCalls);
+			Assert::AreEqual(2U, renderContext.GetTotalStats().drawCalls);
+
+			/* Vertex writes continue where the previous frame left off. */
+			Assert::AreEqual(6U, renderContext.BulkWriteVertices(vertices.data(), (uint32_t)vertices.size()));
+		}
+	};
+}
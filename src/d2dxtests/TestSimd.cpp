@@ -18,7 +18,11 @@
 */
 #include "pch.h"
 #include <array>
+#include <vector>
 #include "CppUnitTest.h"
+#include "../d2dx/Buffer.h"
+#include "../d2dx/SimdAvx2.h"
+#include "../d2dx/SimdAvx512.h"
 #include "../d2dx/SimdSse2.h"
 
 using namespace Microsoft::WRL;
@@ -30,26 +34,524 @@ namespace d2dxtests
 	TEST_CLASS(TestSimd)
 	{
 	public:
+		/* All implementations that can run on this machine; SSE2 is always first. */
+		static std::vector<std::shared_ptr<ISimd>> CreateSupportedSimds()
+		{
+			std::vector<std::shared_ptr<ISimd>> simds;
+			simds.push_back(std::make_shared<SimdSse2>());
+
+			if (SimdAvx2::IsSupported())
+			{
+				simds.push_back(std::make_shared<SimdAvx2>());
+			}
+
+			if (SimdAvx512::IsSupported())
+			{
+				simds.push_back(std::make_shared<SimdAvx512>());
+			}
+
+			return simds;
+		}
+
+		static uint8_t NextByte(uint32_t& state)
+		{
+			state = state * 1664525 + 1013904223;
+			return (uint8_t)(state >> 24);
+		}
+
+		/* The conversion as D2DXContext did it before ISimd::ConvertVertices. */
+		static void ConvertVerticesScalar(
+			const D2::Vertex* const* d2Vertices,
+			uint32_t count,
+			const Vertex& templateVertex,
+			int32_t stShift,
+			int32_t texcoordOffsetS,
+			int32_t texcoordOffsetT,
+			uint32_t iteratedColorMask,
+			uint32_t maskedConstantColor,
+			Vertex* vertices)
+		{
+			Vertex v = templateVertex;
+
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				const D2::Vertex* d2Vertex = d2Vertices[i];
+				v.SetPosition((int32_t)d2Vertex->x, (int32_t)d2Vertex->y);
+				v.SetTexcoord(((int32_t)d2Vertex->s >> stShift) + texcoordOffsetS, ((int32_t)d2Vertex->t >> stShift) + texcoordOffsetT);
+				v.SetColor(maskedConstantColor | (d2Vertex->color & iteratedColorMask));
+				vertices[i] = v;
+			}
+		}
+
+		/* Game vertices with texcoords below 256, so that they stay below 512 with offsets up to 255. */
+		static std::vector<D2::Vertex> CreateD2Vertices(
+			uint32_t count,
+			uint32_t& state)
+		{
+			std::vector<D2::Vertex> d2Vertices(count);
+
+			for (auto& d2Vertex : d2Vertices)
+			{
+				d2Vertex.x = (float)((int32_t)(NextByte(state) | (NextByte(state) << 8)) % 2000 - 500) + NextByte(state) / 256.0f;
+				d2Vertex.y = (float)((int32_t)(NextByte(state) | (NextByte(state) << 8)) % 2000 - 500) + NextByte(state) / 256.0f;
+				d2Vertex.color = NextByte(state) | (NextByte(state) << 8) | (NextByte(state) << 16) | (NextByte(state) << 24);
+				d2Vertex.padding = 0xDEADBEEF;
+				d2Vertex.s = (float)NextByte(state) + NextByte(state) / 256.0f;
+				d2Vertex.t = (float)NextByte(state) + NextByte(state) / 256.0f;
+				d2Vertex.padding2 = 0xDEADBEEF;
+			}
+
+			return d2Vertices;
+		}
+
 		TEST_METHOD(Create)
 		{
 			auto simd = std::make_shared<SimdSse2>();
+
+			if (SimdAvx2::IsSupported())
+			{
+				auto simdAvx2 = std::make_shared<SimdAvx2>();
+			}
+
+			if (SimdAvx512::IsSupported())
+			{
+				Assert::IsTrue(SimdAvx2::IsSupported());
+				auto simdAvx512 = std::make_shared<SimdAvx512>();
+			}
 		}
 
 		TEST_METHOD(FindUInt32)
 		{
-			auto simd = std::make_shared<SimdSse2>();
+			for (auto& simd : CreateSupportedSimds())
+			{
+				alignas(64) std::array<uint32_t, 1024> items;
+
+				for (int32_t i = 0; i < 1024; ++i)
+				{
+					items[i] = 1023 - i;
+				}
+
+				Assert::AreEqual(0, simd->IndexOfUInt32(items.data(), items.size(), 1023));
+				Assert::AreEqual(1023, simd->IndexOfUInt32(items.data(), items.size(), 0));
+				Assert::AreEqual(1009, simd->IndexOfUInt32(items.data(), items.size(), 14));
+				Assert::AreEqual(114, simd->IndexOfUInt32(items.data(), items.size(), 909));
+				Assert::AreEqual(-1, simd->IndexOfUInt32(items.data(), items.size(), 1024));
+
+				/* Every position within a 64-item block. */
+				for (int32_t i = 0; i < 128; ++i)
+				{
+					Assert::AreEqual(i, simd->IndexOfUInt32(items.data(), 128, 1023 - i));
+				}
+			}
+		}
+
+		TEST_METHOD(EqualUInt8MatchesScalar)
+		{
+			std::array<uint8_t, 300> itemsA;
+			std::array<uint8_t, 300> itemsB;
+			uint32_t state = 1;
+
+			for (auto& simd : CreateSupportedSimds())
+			{
+				/* All lengths and offsets around the vector widths, with at most one differing byte. */
+				for (uint32_t count = 0; count < 200; ++count)
+				{
+					for (uint32_t offset = 0; offset < 3; ++offset)
+					{
+						for (auto& item : itemsA)
+						{
+							item = NextByte(state);
+						}
+
+						itemsB = itemsA;
+
+						const uint32_t differingIndex = NextByte(state) % (count + 8);
+						if (differingIndex < count)
+						{
+							itemsB[offset + differingIndex] ^= 1 << (NextByte(state) & 7);
+						}
+
+						const bool expected = memcmp(&itemsA[offset], &itemsB[offset], count) == 0;
+						Assert::AreEqual(expected, simd->EqualUInt8(&itemsA[offset], &itemsB[offset], count));
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(MinMaxUInt8MatchesScalar)
+		{
+			std::array<uint8_t, 300> items;
+			uint32_t state = 2;
+
+			for (auto& simd : CreateSupportedSimds())
+			{
+				for (uint32_t count = 0; count < 200; ++count)
+				{
+					for (uint32_t offset = 0; offset < 3; ++offset)
+					{
+						/* Keep the values in a narrow random band so that min and max vary. */
+						const uint8_t base = NextByte(state) & 0x7F;
+
+						for (auto& item : items)
+						{
+							item = base + (NextByte(state) & 0x7F);
+						}
+
+						uint8_t expectedMin = 255;
+						uint8_t expectedMax = 0;
+
+						for (uint32_t i = 0; i < count; ++i)
+						{
+							expectedMin = min(expectedMin, items[offset + i]);
+							expectedMax = max(expectedMax, items[offset + i]);
+						}
+
+						uint8_t minItem, maxItem;
+						simd->MinMaxUInt8(&items[offset], count, minItem, maxItem);
+						Assert::AreEqual(expectedMin, minItem);
+						Assert::AreEqual(expectedMax, maxItem);
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(FillMaskedUInt32MatchesScalar)
+		{
+			std::array<uint32_t, 300> items;
+			std::array<uint32_t, 300> expected;
+			std::array<uint8_t, 300> mask;
+			uint32_t state = 3;
+
+			for (auto& simd : CreateSupportedSimds())
+			{
+				for (uint32_t count = 0; count < 200; ++count)
+				{
+					for (uint32_t offset = 0; offset < 3; ++offset)
+					{
+						for (uint32_t i = 0; i < items.size(); ++i)
+						{
+							items[i] = i;
+							mask[i] = (NextByte(state) & 1) ? NextByte(state) | 1 : 0;
+						}
+
+						expected = items;
+
+						for (uint32_t i = 0; i < count; ++i)
+						{
+							if (mask[offset + i])
+							{
+								expected[offset + i] = 0xDEADBEEF;
+							}
+						}
+
+						simd->FillMaskedUInt32(&items[offset], &mask[offset], count, 0xDEADBEEF);
+						Assert::IsTrue(items == expected);
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(ConvertVerticesMatchesScalar)
+		{
+			uint32_t state = 4;
+			const std::vector<D2::Vertex> d2Vertices = CreateD2Vertices(64, state);
+
+			for (auto& simd : CreateSupportedSimds())
+			{
+				for (uint32_t count = 0; count < 24; ++count)
+				{
+					/* Vertices are passed by pointer, in any order. */
+					std::vector<const D2::Vertex*> d2VertexPointers(count);
+
+					for (auto& d2VertexPointer : d2VertexPointers)
+					{
+						d2VertexPointer = &d2Vertices[NextByte(state) % d2Vertices.size()];
+					}
+
+					const bool isIteratedColor = NextByte(state) & 1;
+					const uint32_t constantColor = 0x80402010 + NextByte(state);
+					const uint32_t iteratedColorMask = isIteratedColor ? 0x00FFFFFF : 0;
+					const uint32_t maskedConstantColor = constantColor & (isIteratedColor ? 0xFF000000 : 0xFFFFFFFF);
+					const int32_t stShift = NextByte(state) & 3;
+					const int32_t texcoordOffsetS = NextByte(state);
+					const int32_t texcoordOffsetT = NextByte(state);
+
+					Vertex templateVertex{ 0, 0, 0, 0, 0, (NextByte(state) & 1) != 0, NextByte(state) * 16, NextByte(state) & 15, NextByte(state) * 64 };
+					templateVertex.SetTextureSelector(NextByte(state) & 31);
+					const int32_t stripHeight = 8 << (NextByte(state) % 3);
+					templateVertex.SetTexcoordClamp(64, stripHeight, { 0, (NextByte(state) % (64 / stripHeight)) * stripHeight });
 
-			alignas(64) std::array<uint32_t, 1024> items;
+					std::vector<Vertex> expected(count + 1);
+					std::vector<Vertex> vertices(count + 1);
 
-			for (int32_t i = 0; i < 1024; ++i)
+					ConvertVerticesScalar(d2VertexPointers.data(), count, templateVertex, stShift, texcoordOffsetS, texcoordOffsetT,
+						iteratedColorMask, maskedConstantColor, expected.data());
+					simd->ConvertVertices(d2VertexPointers.data(), count, templateVertex, stShift, texcoordOffsetS, texcoordOffsetT,
+						iteratedColorMask, maskedConstantColor, vertices.data());
+
+					/* Includes the vertex past the end, which must be left alone. */
+					Assert::IsTrue(memcmp(expected.data(), vertices.data(), expected.size() * sizeof(Vertex)) == 0);
+				}
+			}
+		}
+
+		TEST_METHOD(BenchmarkConvertVertices)
+		{
+			/* About as many quads as a busy frame. */
+			const uint32_t quadCount = 16384;
+			uint32_t state = 5;
+			const std::vector<D2::Vertex> d2Vertices = CreateD2Vertices(quadCount * 4, state);
+			std::vector<const D2::Vertex*> d2VertexPointers(d2Vertices.size());
+
+			for (uint32_t i = 0; i < d2Vertices.size(); ++i)
+			{
+				d2VertexPointers[i] = &d2Vertices[i];
+			}
+
+			const Vertex templateVertex{ 0, 0, 0, 0, 0, true, 17, 3, 0 };
+			std::vector<Vertex> expected(d2Vertices.size());
+			std::vector<Vertex> vertices(d2Vertices.size());
+
+			/* One call per quad, as the game draws them. */
+			int64_t startTime = TimeStart();
+
+			for (uint32_t i = 0; i < quadCount; ++i)
+			{
+				ConvertVerticesScalar(&d2VertexPointers[i * 4], 4, templateVertex, 2, 64, 0, 0x00FFFFFF, 0xFF000000, &expected[i * 4]);
+			}
+
+			const float scalarTimeMs = TimeEndMs(startTime);
+
+			for (auto& simd : CreateSupportedSimds())
+			{
+				startTime = TimeStart();
+
+				for (uint32_t i = 0; i < quadCount; ++i)
+				{
+					simd->ConvertVertices(&d2VertexPointers[i * 4], 4, templateVertex, 2, 64, 0, 0x00FFFFFF, 0xFF000000, &vertices[i * 4]);
+				}
+
+				const float timeMs = TimeEndMs(startTime);
+
+				Assert::IsTrue(memcmp(expected.data(), vertices.data(), expected.size() * sizeof(Vertex)) == 0);
+
+				char message[256];
+				sprintf_s(message, "%u quads: scalar %.3f ms, SIMD %.3f ms", quadCount, scalarTimeMs, timeMs);
+				Logger::WriteMessage(message);
+			}
+		}
+
+		struct UnitMotionScalar
+		{
+			Offset lastPos = { 0, 0 };
+			Offset velocity = { 0, 0 };
+			Offset predictedPos = { 0, 0 };
+			Offset correctedPos = { 0, 0 };
+			int64_t dtLastPosChange = 0;
+		};
+
+		/* The update as UnitMotionPredictor::Update did it before ISimd::UpdateUnitMotions. */
+		static void UpdateUnitMotionScalar(
+			UnitMotionScalar& um,
+			Offset pos,
+			int32_t dt)
+		{
+			Offset posWhole{ pos.x >> 16, pos.y >> 16 };
+			Offset lastPosWhole{ um.lastPos.x >> 16, um.lastPos.y >> 16 };
+			Offset predictedPosWhole{ um.predictedPos.x >> 16, um.predictedPos.y >> 16 };
+
+			int32_t lastPosMd = max(abs(posWhole.x - lastPosWhole.x), abs(posWhole.y - lastPosWhole.y));
+			int32_t predictedPosMd = max(abs(posWhole.x - predictedPosWhole.x), abs(posWhole.y - predictedPosWhole.y));
+
+			if (lastPosMd > 2 || predictedPosMd > 2)
+			{
+				um.predictedPos = pos;
+				um.correctedPos = pos;
+				um.lastPos = pos;
+				um.velocity = { 0,0 };
+			}
+
+			const int32_t dx = pos.x - um.lastPos.x;
+			const int32_t dy = pos.y - um.lastPos.y;
+
+			um.dtLastPosChange += dt;
+
+			if (dx != 0 || dy != 0 || um.dtLastPosChange >= (65536 / 25))
+			{
+				um.correctedPos.x = (int32_t)(((int64_t)pos.x + um.lastPos.x) >> 1);
+				um.correctedPos.y = (int32_t)(((int64_t)pos.y + um.lastPos.y) >> 1);
+
+				um.velocity.x = 25 * dx;
+				um.velocity.y = 25 * dy;
+
+				um.lastPos = pos;
+				um.dtLastPosChange = 0;
+			}
+
+			if ((um.velocity.x != 0 || um.velocity.y != 0) && um.dtLastPosChange < (65536 / 25))
 			{
-				items[i] = 1023 - i;
+				Offset vStep{
+					(int32_t)(((int64_t)dt * um.velocity.x) >> 16),
+					(int32_t)(((int64_t)dt * um.velocity.y) >> 16) };
+
+				const int32_t correctionAmount = 7000;
+				const int32_t oneMinusCorrectionAmount = 65536 - correctionAmount;
+
+				um.predictedPos.x = (int32_t)(((int64_t)um.predictedPos.x * oneMinusCorrectionAmount + (int64_t)um.correctedPos.x * correctionAmount) >> 16);
+				um.predictedPos.y = (int32_t)(((int64_t)um.predictedPos.y * oneMinusCorrectionAmount + (int64_t)um.correctedPos.y * correctionAmount) >> 16);
+
+				um.predictedPos.x += vStep.x;
+				um.predictedPos.y += vStep.y;
+
+				um.correctedPos.x += vStep.x;
+				um.correctedPos.y += vStep.y;
 			}
+		}
+
+		TEST_METHOD(UpdateUnitMotionsMatchesScalar)
+		{
+			const uint32_t unitCount = 61;
+			const int32_t frameCount = 400;
+
+			for (auto& simd : CreateSupportedSimds())
+			{
+				uint32_t state = 6;
+				std::vector<UnitMotionScalar> expected(unitCount);
+				std::vector<Offset> positions(unitCount, { 0, 0 });
+				std::vector<Offset> speeds(unitCount, { 0, 0 });
+
+				Buffer<int32_t> fields{ 11 * 64, true };
+				const UnitMotions unitMotions{
+					fields.items + 0 * 64, fields.items + 1 * 64, fields.items + 2 * 64, fields.items + 3 * 64,
+					fields.items + 4 * 64, fields.items + 5 * 64, fields.items + 6 * 64, fields.items + 7 * 64,
+					fields.items + 8 * 64, fields.items + 9 * 64, fields.items + 10 * 64 };
+
+				/* Some units far out, where adding two positions overflows 32 bits, some at negative
+				   coordinates. Speeds are per server tick, up to just over a tile. */
+				for (uint32_t i = 0; i < unitCount; ++i)
+				{
+					const int32_t tileBase = (i % 3) == 0 ? 32000 : ((i % 3) == 1 ? 5000 : -200);
+					positions[i] = { (tileBase + NextByte(state)) * 65536 + NextByte(state) * 256, (tileBase + NextByte(state)) * 65536 + NextByte(state) };
+					speeds[i] = { ((int32_t)NextByte(state) - 128) * 600, ((int32_t)NextByte(state) - 128) * 600 };
+				}
+
+				/* The script: frame times from nothing to over a second, positions that change at about
+				   25 Hz, units that stop and start, and the occasional teleport. */
+				int32_t dtSinceServerTick = 0;
+
+				for (int32_t frame = 0; frame < frameCount; ++frame)
+				{
+					static const int32_t dts[8] = { 0, 1, 1092, 1093, 2620, 2621, 20000, 65536 };
+					const uint8_t r = NextByte(state);
+					const int32_t dt = (r & 7) < 6 ? 1092 + ((int32_t)r >> 3) : dts[r >> 5];
+
+					dtSinceServerTick += dt;
+
+					if (dtSinceServerTick >= 65536 / 25)
+					{
+						dtSinceServerTick = 0;
+
+						for (uint32_t i = 0; i < unitCount; ++i)
+						{
+							const uint8_t action = NextByte(state);
+
+							if (action < 16)
+							{
+								positions[i].x += 5 * 65536;
+							}
+							else if (action >= 200)
+							{
+								continue;
+							}
+
+							positions[i].x += speeds[i].x;
+							positions[i].y += speeds[i].y;
+						}
+					}
 
-			Assert::AreEqual(0, simd->IndexOfUInt32(items.data(), items.size(), 1023));
-			Assert::AreEqual(1023, simd->IndexOfUInt32(items.data(), items.size(), 0));
-			Assert::AreEqual(1009, simd->IndexOfUInt32(items.data(), items.size(), 14));
-			Assert::AreEqual(114, simd->IndexOfUInt32(items.data(), items.size(), 909));
+					for (uint32_t i = 0; i < unitCount; ++i)
+					{
+						UpdateUnitMotionScalar(expected[i], positions[i], dt);
+						unitMotions.posX[i] = positions[i].x;
+						unitMotions.posY[i] = positions[i].y;
+					}
+
+					simd->UpdateUnitMotions(unitMotions, unitCount, dt);
+
+					/* The offsets are computed from the predicted and last positions. */
+					for (uint32_t i = 0; i < unitCount; ++i)
+					{
+						Assert::AreEqual(expected[i].lastPos.x, unitMotions.lastPosX[i]);
+						Assert::AreEqual(expected[i].lastPos.y, unitMotions.lastPosY[i]);
+						Assert::AreEqual(expected[i].velocity.x, unitMotions.velocityX[i]);
+						Assert::AreEqual(expected[i].velocity.y, unitMotions.velocityY[i]);
+						Assert::AreEqual(expected[i].predictedPos.x, unitMotions.predictedPosX[i]);
+						Assert::AreEqual(expected[i].predictedPos.y, unitMotions.predictedPosY[i]);
+						Assert::AreEqual(expected[i].correctedPos.x, unitMotions.correctedPosX[i]);
+						Assert::AreEqual(expected[i].correctedPos.y, unitMotions.correctedPosY[i]);
+						Assert::AreEqual((int32_t)expected[i].dtLastPosChange, unitMotions.dtLastPosChange[i]);
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(SamplePalettedTexelsMatchesScalar)
+		{
+			/* Texcoords a few texels outside the texture on all sides, and texels at the very end
+			   of the texture, where a wider load would go out of bounds. */
+			const Size textureSize = { 16, 8 };
+			std::vector<uint8_t> texels(textureSize.width * textureSize.height);
+			std::array<uint32_t, 256> palette;
+			std::array<int32_t, 80> s;
+			std::array<int32_t, 80> t;
+			uint32_t state = 7;
+
+			for (auto& texel : texels)
+			{
+				texel = NextByte(state);
+			}
+
+			for (auto& color : palette)
+			{
+				color = NextByte(state) | (NextByte(state) << 8) | (NextByte(state) << 16) | (NextByte(state) << 24);
+			}
+
+			for (auto& simd : CreateSupportedSimds())
+			{
+				for (uint32_t count = 0; count < 70; ++count)
+				{
+					for (uint32_t offset = 0; offset < 3; ++offset)
+					{
+						std::array<uint32_t, 80> indices;
+						std::array<uint32_t, 80> colors;
+						std::array<uint32_t, 80> expectedIndices;
+						std::array<uint32_t, 80> expectedColors;
+						indices.fill(0xDEADBEEF);
+						colors.fill(0xDEADBEEF);
+						expectedIndices.fill(0xDEADBEEF);
+						expectedColors.fill(0xDEADBEEF);
+
+						for (uint32_t i = 0; i < s.size(); ++i)
+						{
+							s[i] = (i & 1) ? textureSize.width - 1 - (NextByte(state) & 3) : (int32_t)(NextByte(state) % 24) - 4;
+							t[i] = (i & 2) ? textureSize.height - 1 : (int32_t)(NextByte(state) % 16) - 4;
+						}
+
+						for (uint32_t i = 0; i < count; ++i)
+						{
+							const int32_t si = s[offset + i];
+							const int32_t ti = t[offset + i];
+							const bool isInside = si >= 0 && ti >= 0 && si < textureSize.width && ti < textureSize.height;
+							expectedIndices[offset + i] = isInside ? texels[ti * textureSize.width + si] : 0;
+							expectedColors[offset + i] = palette[expectedIndices[offset + i]];
+						}
+
+						simd->SamplePalettedTexels(&s[offset], &t[offset], count, texels.data(), textureSize, palette.data(), &indices[offset], &colors[offset]);
+						Assert::IsTrue(indices == expectedIndices);
+						Assert::IsTrue(colors == expectedColors);
+					}
+				}
+			}
 		}
 	};
 }
@@ -0,0 +1,321 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include <algorithm>
+#include <array>
+#include "CppUnitTest.h"
+
+#include "../d2dx/Batch.h"
+#include "../d2dx/SimdSse2.h"
+#include "../d2dx/SoftwareRenderContext.h"
+#include "../d2dx/SpriteEncoder.h"
+#include "../d2dx/TextureAtlasPacker.h"
+#include "../d2dx/Vertex.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestSoftwareRenderContext)
+	{
+	public:
+		/* Draws a 16x16 textured quad at (x, y), optionally as a sprite record and moved by the camera offset. */
+		static void DrawQuad(
+			SoftwareRenderContext& renderContext,
+			int32_t x,
+			int32_t y,
+			uint32_t color,
+			bool isChromaKeyEnabled,
+			AlphaBlend alphaBlend,
+			int32_t surfaceId,
+			bool isSprite = false,
+			bool isCameraOffsetEnabled = false)
+		{
+			std::array<uint8_t, 2 * 256 * 256> tmuData;
+			tmuData.fill(0);
+
+			/* Texel (s, t) has index s + 1, except for the transparent first row. */
+			for (int32_t t = 1; t < 16; ++t)
+			{
+				for (int32_t s = 0; s < 16; ++s)
+				{
+					tmuData[256 + t * 16 + s] = (uint8_t)(s + 1);
+				}
+			}
+
+			std::array<uint32_t, 256> palette;
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				palette[i] = 0xFF000000 | (i << 16) | (i << 8) | i;
+			}
+
+			Batch batch;
+			batch.SetTextureStartAddress(256);
+			batch.SetTextureSize(16, 16);
+			batch.SetTextureHash(0xCAFEBABE);
+			batch.SetAlphaBlend(alphaBlend);
+			batch.SetPrimitiveType(PrimitiveType::Quads);
+			batch.SetStartVertex(0);
+			batch.SetVertexCount(4);
+
+			renderContext.SetPalette(0, palette.data());
+			auto tcl = renderContext.UpdateTexture(batch, tmuData.data(), (uint32_t)tmuData.size());
+			batch.SetTextureAtlas(tcl._textureAtlas);
+
+			const Vertex v0{ x, y, 0, 0, color, isChromaKeyEnabled, tcl._textureIndex, 0, surfaceId };
+			const Vertex v1{ x + 16, y, 16, 0, color, isChromaKeyEnabled, tcl._textureIndex, 0, surfaceId };
+			const Vertex v2{ x + 16, y + 16, 16, 16, color, isChromaKeyEnabled, tcl._textureIndex, 0, surfaceId };
+			const Vertex v3{ x, y + 16, 0, 16, color, isChromaKeyEnabled, tcl._textureIndex, 0, surfaceId };
+			std::array<Vertex, 4> vertices = { v0, v1, v2, v3 };
+
+			for (auto& vertex : vertices)
+			{
+				vertex.SetIsCameraOffsetEnabled(isCameraOffsetEnabled);
+			}
+
+			if (isSprite)
+			{
+				Assert::IsTrue(SpriteEncoder::Encode(vertices.data(), vertices.data()));
+				batch.SetPrimitiveType(PrimitiveType::Sprites);
+				batch.SetVertexCount(2);
+			}
+
+			const uint32_t startVertexLocation = renderContext.BulkWriteVertices(vertices.data(), (uint32_t)vertices.size());
+			renderContext.Draw(batch, startVertexLocation);
+		}
+
+		TEST_METHOD(QuadCoversExactPixels)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			SoftwareRenderContext renderContext{ nullptr, { 64, 64 }, { 64, 64 }, ScreenMode::Windowed, nullptr, simd };
+
+			DrawQuad(renderContext, 8, 8, 0xFFFFFFFF, false, AlphaBlend::Additive, 1);
+			renderContext.Present();
+
+			const uint32_t* pixels = renderContext.GetPresentedGameFramebuffer();
+
+			/* With additive blending, a pixel on the shared diagonal that was drawn twice would be brighter. */
+			for (int32_t y = 0; y < 64; ++y)
+			{
+				for (int32_t x = 0; x < 64; ++x)
+				{
+					const bool isInside = x >= 8 && x < 24 && y >= 8 && y < 24;
+					const uint32_t expected = !isInside ? 0 : (y == 8 ? 0x00000000 : (uint32_t)(x - 8 + 1) * 0x010101);
+					Assert::AreEqual(expected, pixels[y * 64 + x] & 0x00FFFFFF);
+				}
+			}
+		}
+
+		TEST_METHOD(SpriteMatchesQuad)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			SoftwareRenderContext quadRenderContext{ nullptr, { 64, 64 }, { 64, 64 }, ScreenMode::Windowed, nullptr, simd };
+			SoftwareRenderContext spriteRenderContext{ nullptr, { 64, 64 }, { 64, 64 }, ScreenMode::Windowed, nullptr, simd };
+
+			DrawQuad(quadRenderContext, 8, 8, 0xFFFFFFFF, false, AlphaBlend::Additive, 1);
+			quadRenderContext.Present();
+			DrawQuad(spriteRenderContext, 8, 8, 0xFFFFFFFF, false, AlphaBlend::Additive, 1, true);
+			spriteRenderContext.Present();
+
+			for (int32_t i = 0; i < 64 * 64; ++i)
+			{
+				Assert::AreEqual(quadRenderContext.GetPresentedGameFramebuffer()[i], spriteRenderContext.GetPresentedGameFramebuffer()[i]);
+				Assert::AreEqual(quadRenderContext.GetPresentedSurfaceIdFramebuffer()[i], spriteRenderContext.GetPresentedSurfaceIdFramebuffer()[i]);
+			}
+		}
+
+		TEST_METHOD(CameraOffsetMovesFlaggedVertices)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			SoftwareRenderContext expectedRenderContext{ nullptr, { 64, 64 }, { 64, 64 }, ScreenMode::Windowed, nullptr, simd };
+			SoftwareRenderContext offsetRenderContext{ nullptr, { 64, 64 }, { 64, 64 }, ScreenMode::Windowed, nullptr, simd };
+
+			DrawQuad(expectedRenderContext, 8, 12, 0xFFFFFFFF, false, AlphaBlend::Additive, 1);
+			DrawQuad(expectedRenderContext, 40, 40, 0xFFFFFFFF, false, AlphaBlend::Additive, 2);
+			DrawQuad(expectedRenderContext, 20, 44, 0xFFFFFFFF, false, AlphaBlend::Additive, 3);
+			expectedRenderContext.Present();
+
+			/* The unflagged quad stays where it is. */
+			offsetRenderContext.SetCameraOffset({ 8, 4 });
+			DrawQuad(offsetRenderContext, 0, 8, 0xFFFFFFFF, false, AlphaBlend::Additive, 1, false, true);
+			DrawQuad(offsetRenderContext, 40, 40, 0xFFFFFFFF, false, AlphaBlend::Additive, 2);
+			DrawQuad(offsetRenderContext, 12, 40, 0xFFFFFFFF, false, AlphaBlend::Additive, 3, true, true);
+			offsetRenderContext.Present();
+
+			for (int32_t i = 0; i < 64 * 64; ++i)
+			{
+				Assert::AreEqual(expectedRenderContext.GetPresentedGameFramebuffer()[i], offsetRenderContext.GetPresentedGameFramebuffer()[i]);
+				Assert::AreEqual(expectedRenderContext.GetPresentedSurfaceIdFramebuffer()[i], offsetRenderContext.GetPresentedSurfaceIdFramebuffer()[i]);
+			}
+		}
+
+		TEST_METHOD(ChromaKeyDiscardsIndexZero)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			SoftwareRenderContext renderContext{ nullptr, { 64, 64 }, { 64, 64 }, ScreenMode::Windowed, nullptr, simd };
+
+			DrawQuad(renderContext, 0, 0, 0xFFFFFFFF, true, AlphaBlend::Opaque, 5);
+			renderContext.Present();
+
+			const uint32_t* pixels = renderContext.GetPresentedGameFramebuffer();
+			const uint16_t* surfaceIds = renderContext.GetPresentedSurfaceIdFramebuffer();
+
+			Assert::AreEqual(0U, pixels[3]);
+			Assert::AreEqual((uint16_t)0, surfaceIds[3]);
+			Assert::AreEqual(0xFF040404U, pixels[1 * 64 + 3]);
+			Assert::AreEqual((uint16_t)5, surfaceIds[1 * 64 + 3]);
+		}
+
+		TEST_METHOD(VertexColorModulatesAndBlends)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			SoftwareRenderContext renderContext{ nullptr, { 64, 64 }, { 64, 64 }, ScreenMode::Windowed, nullptr, simd };
+
+			DrawQuad(renderContext, 0, 0, 0xFFFFFFFF, false, AlphaBlend::Opaque, 7);
+			DrawQuad(renderContext, 0, 0, 0x00FF0000, false, AlphaBlend::Multiplicative, 9);
+			renderContext.Present();
+
+			const uint32_t* pixels = renderContext.GetPresentedGameFramebuffer();
+			const uint16_t* surfaceIds = renderContext.GetPresentedSurfaceIdFramebuffer();
+
+			/* dst * (red-only vertex color * texel): 16/255 * 16/255 rounds to 1/255 in red, the rest is 0. */
+			Assert::AreEqual(0x00010000U, pixels[4 * 64 + 15]);
+
+			/* Multiplicative blending leaves the surface id alone. */
+			Assert::AreEqual((uint16_t)7, surfaceIds[4 * 64 + 15]);
+		}
+
+		TEST_METHOD(TexcoordsStayInTile)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			SoftwareRenderContext renderContext{ nullptr, { 64, 64 }, { 64, 64 }, ScreenMode::Windowed, nullptr, simd };
+
+			std::array<uint32_t, 256> palette;
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				palette[i] = 0xFF000000 | i;
+			}
+
+			renderContext.SetPalette(0, palette.data());
+
+			/* Two 16x8 strips, all index 1 and all index 2, packed on top of each other into one 16x16 slot. */
+			std::array<uint8_t, 16 * 8> tmuData;
+			TextureCacheLocation tcls[2];
+
+			for (int32_t i = 0; i < 2; ++i)
+			{
+				Batch batch;
+				batch.SetTextureStartAddress(0);
+				batch.SetTextureSize(16, 8);
+				batch.SetTextureHash(0x100 + i);
+				tmuData.fill((uint8_t)(i + 1));
+				tcls[i] = renderContext.UpdateTexture(batch, tmuData.data(), (uint32_t)tmuData.size());
+			}
+
+			Assert::AreEqual(tcls[0]._textureIndex, tcls[1]._textureIndex);
+			Assert::AreEqual((int16_t)1, tcls[1]._textureTile);
+
+			/* The first strip, drawn with texcoords that reach twice as far as it goes. */
+			Batch batch;
+			batch.SetTextureSize(16, 8);
+			batch.SetTextureAtlas(tcls[0]._textureAtlas);
+			batch.SetAlphaBlend(AlphaBlend::Opaque);
+			batch.SetPrimitiveType(PrimitiveType::Quads);
+			batch.SetStartVertex(0);
+			batch.SetVertexCount(4);
+
+			std::array<Vertex, 4> vertices =
+			{
+				Vertex{ 0, 0, 0, 0, 0xFFFFFFFF, false, tcls[0]._textureIndex, 0, 1 },
+				Vertex{ 16, 0, 16, 0, 0xFFFFFFFF, false, tcls[0]._textureIndex, 0, 1 },
+				Vertex{ 16, 16, 16, 16, 0xFFFFFFFF, false, tcls[0]._textureIndex, 0, 1 },
+				Vertex{ 0, 16, 0, 16, 0xFFFFFFFF, false, tcls[0]._textureIndex, 0, 1 }
+			};
+
+			for (auto& vertex : vertices)
+			{
+				vertex.SetTexcoordClamp(16, 8, TextureAtlasPacker::GetTileOffset(16, 8, tcls[0]._textureTile));
+			}
+
+			const uint32_t startVertexLocation = renderContext.BulkWriteVertices(vertices.data(), (uint32_t)vertices.size());
+			renderContext.Draw(batch, startVertexLocation);
+			renderContext.Present();
+
+			const uint32_t* pixels = renderContext.GetPresentedGameFramebuffer();
+
+			for (int32_t y = 0; y < 16; ++y)
+			{
+				Assert::AreEqual(0xFF000001U, pixels[y * 64 + 8]);
+			}
+		}
+
+		TEST_METHOD(PresentClearsAndHashesFrames)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			SoftwareRenderContext renderContext{ nullptr, { 64, 64 }, { 64, 64 }, ScreenMode::Windowed, nullptr, simd };
+
+			DrawQuad(renderContext, 8, 8, 0xFFFFFFFF, false, AlphaBlend::Opaque, 1);
+			renderContext.Present();
+			const uint32_t firstHash = renderContext.GetPresentedFrameHash();
+
+			renderContext.Present();
+			Assert::AreNotEqual(firstHash, renderContext.GetPresentedFrameHash());
+			Assert::AreEqual(0U, renderContext.GetPresentedGameFramebuffer()[10 * 64 + 10]);
+
+			DrawQuad(renderContext, 8, 8, 0xFFFFFFFF, false, AlphaBlend::Opaque, 1);
+			renderContext.Present();
+			Assert::AreEqual(firstHash, renderContext.GetPresentedFrameHash());
+			Assert::AreEqual(2U, renderContext.GetFrameCount() - 1);
+		}
+
+		TEST_METHOD(MultithreadedMatchesSingleThreaded)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			SoftwareRenderContext singleThreaded{ nullptr, { 200, 150 }, { 200, 150 }, ScreenMode::Windowed, nullptr, simd, 1 };
+			SoftwareRenderContext multithreaded{ nullptr, { 200, 150 }, { 200, 150 }, ScreenMode::Windowed, nullptr, simd, 4 };
+			Assert::AreEqual(1U, singleThreaded.GetThreadCount());
+			Assert::AreEqual(4U, multithreaded.GetThreadCount());
+
+			/* Overlapping quads in all blend modes, many of them straddling tile and screen edges. */
+			for (int32_t frame = 0; frame < 3; ++frame)
+			{
+				for (int32_t i = 0; i < 64; ++i)
+				{
+					const int32_t x = (i * 37 + frame * 11) % 200 - 8;
+					const int32_t y = (i * 23 + frame * 7) % 150 - 8;
+					const uint32_t color = 0x80000000 | (i * 0x0F1F2F);
+					const AlphaBlend alphaBlend = (AlphaBlend)(i % (int32_t)AlphaBlend::Count);
+
+					DrawQuad(singleThreaded, x, y, color, (i & 1) != 0, alphaBlend, i);
+					DrawQuad(multithreaded, x, y, color, (i & 1) != 0, alphaBlend, i);
+				}
+
+				singleThreaded.Present();
+				multithreaded.Present();
+
+				Assert::AreEqual(0, memcmp(singleThreaded.GetPresentedGameFramebuffer(), multithreaded.GetPresentedGameFramebuffer(), 200 * 150 * sizeof(uint32_t)));
+				Assert::AreEqual(0, memcmp(singleThreaded.GetPresentedSurfaceIdFramebuffer(), multithreaded.GetPresentedSurfaceIdFramebuffer(), 200 * 150 * sizeof(uint16_t)));
+
+				const uint32_t* pixels = singleThreaded.GetPresentedGameFramebuffer();
+				Assert::IsTrue(std::any_of(pixels, pixels + 200 * 150, [](uint32_t pixel) { return pixel != 0; }));
+			}
+		}
+	};
+}
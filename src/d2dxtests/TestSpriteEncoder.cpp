@@ -0,0 +1,166 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include <array>
+#include "CppUnitTest.h"
+
+#include "../d2dx/SpriteEncoder.h"
+#include "../d2dx/Vertex.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestSpriteEncoder)
+	{
+	public:
+		static Vertex MakeVertex(
+			int32_t x,
+			int32_t y,
+			int32_t s,
+			int32_t t,
+			uint32_t color = 0xFF808080)
+		{
+			Vertex v{ x, y, s, t, color, true, 123, 4, 567 };
+			v.SetTextureSelector(9);
+			v.SetTexcoordClamp(64, 16, { 0, 32 });
+			return v;
+		}
+
+		static void AssertSameVertex(
+			const Vertex& expected,
+			const Vertex& actual)
+		{
+			Assert::AreEqual(expected.GetX(), actual.GetX());
+			Assert::AreEqual(expected.GetY(), actual.GetY());
+			Assert::AreEqual(expected.GetS(), actual.GetS());
+			Assert::AreEqual(expected.GetT(), actual.GetT());
+			Assert::AreEqual(expected.GetColor(), actual.GetColor());
+			Assert::AreEqual(expected.IsChromaKeyEnabled(), actual.IsChromaKeyEnabled());
+			Assert::AreEqual(expected.GetAtlasIndex(), actual.GetAtlasIndex());
+			Assert::AreEqual(expected.GetPaletteIndex(), actual.GetPaletteIndex());
+			Assert::AreEqual(expected.GetSurfaceId(), actual.GetSurfaceId());
+			Assert::AreEqual(expected.GetTextureSelector(), actual.GetTextureSelector());
+			Assert::IsTrue(expected.HasSameTexcoordClamp(actual));
+		}
+
+		TEST_METHOD(EncodesRectangle)
+		{
+			const std::array<Vertex, 4> quad =
+			{
+				MakeVertex(100, 50, 0, 0),
+				MakeVertex(132, 50, 32, 0),
+				MakeVertex(132, 66, 32, 16),
+				MakeVertex(100, 66, 0, 16)
+			};
+
+			std::array<Vertex, 2> sprite;
+			Assert::IsTrue(SpriteEncoder::Encode(quad.data(), sprite.data()));
+			AssertSameVertex(quad[0], sprite[0]);
+			AssertSameVertex(quad[2], sprite[1]);
+
+			std::array<Vertex, 4> decoded;
+			SpriteEncoder::Decode(sprite.data(), decoded.data());
+
+			for (int32_t i = 0; i < 4; ++i)
+			{
+				AssertSameVertex(quad[i], decoded[i]);
+			}
+		}
+
+		TEST_METHOD(EncodesEitherWindingAndMirroring)
+		{
+			/* Counter-clockwise, and with the texture flipped horizontally. */
+			const std::array<Vertex, 4> quad =
+			{
+				MakeVertex(10, 20, 32, 0),
+				MakeVertex(10, 36, 32, 16),
+				MakeVertex(-22, 36, 0, 16),
+				MakeVertex(-22, 20, 0, 0)
+			};
+
+			std::array<Vertex, 2> sprite;
+			Assert::IsTrue(SpriteEncoder::Encode(quad.data(), sprite.data()));
+
+			/* The decoded corners are the same, with 1 and 3 in the order GameSpriteVS uses. */
+			std::array<Vertex, 4> decoded;
+			SpriteEncoder::Decode(sprite.data(), decoded.data());
+			AssertSameVertex(quad[0], decoded[0]);
+			AssertSameVertex(quad[3], decoded[1]);
+			AssertSameVertex(quad[2], decoded[2]);
+			AssertSameVertex(quad[1], decoded[3]);
+		}
+
+		TEST_METHOD(EncodesInPlace)
+		{
+			std::array<Vertex, 4> quad =
+			{
+				MakeVertex(0, 0, 0, 0),
+				MakeVertex(8, 0, 8, 0),
+				MakeVertex(8, 8, 8, 8),
+				MakeVertex(0, 8, 0, 8)
+			};
+
+			const std::array<Vertex, 4> original = quad;
+			Assert::IsTrue(SpriteEncoder::Encode(quad.data(), quad.data()));
+			AssertSameVertex(original[0], quad[0]);
+			AssertSameVertex(original[2], quad[1]);
+		}
+
+		TEST_METHOD(RejectsNonRectangles)
+		{
+			/* Skewed, as the game draws some floor tiles. */
+			const std::array<Vertex, 4> skewed =
+			{
+				MakeVertex(0, 0, 0, 0),
+				MakeVertex(32, 16, 32, 0),
+				MakeVertex(0, 32, 32, 32),
+				MakeVertex(-32, 16, 0, 32)
+			};
+
+			/* A rectangle, but with the texture rotated by 90 degrees. */
+			const std::array<Vertex, 4> rotated =
+			{
+				MakeVertex(0, 0, 0, 16),
+				MakeVertex(16, 0, 0, 0),
+				MakeVertex(16, 16, 16, 0),
+				MakeVertex(0, 16, 16, 16)
+			};
+
+			std::array<Vertex, 2> sprite;
+			Assert::IsFalse(SpriteEncoder::Encode(skewed.data(), sprite.data()));
+			Assert::IsFalse(SpriteEncoder::Encode(rotated.data(), sprite.data()));
+		}
+
+		TEST_METHOD(RejectsIteratedColor)
+		{
+			const std::array<Vertex, 4> quad =
+			{
+				MakeVertex(0, 0, 0, 0),
+				MakeVertex(8, 0, 8, 0),
+				MakeVertex(8, 8, 8, 8, 0xFF000000),
+				MakeVertex(0, 8, 0, 8)
+			};
+
+			std::array<Vertex, 2> sprite;
+			Assert::IsFalse(SpriteEncoder::Encode(quad.data(), sprite.data()));
+		}
+	};
+}
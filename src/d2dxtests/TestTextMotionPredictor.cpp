@@ -0,0 +1,208 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include <string>
+#include <vector>
+#include "CppUnitTest.h"
+
+#include "../d2dx/IGameHelper.h"
+#include "../d2dx/NullRenderContext.h"
+#include "../d2dx/SimdSse2.h"
+#include "../d2dx/TextMotionPredictor.h"
+#include "../d2dx/TextureHasher.h"
+#include "../d2dx/Utils.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestTextMotionPredictor)
+	{
+	public:
+		/* A game with no panels open. */
+		class FakeGameHelper final : public IGameHelper
+		{
+		public:
+			virtual GameVersion GetVersion() const override { return GameVersion::Unsupported; }
+			virtual const char* GetVersionString() const override { return "fake"; }
+			virtual uint32_t ScreenOpenMode() const override { return 0; }
+			virtual Size GetConfiguredGameSize() const override { return { 800, 600 }; }
+			virtual GameAddress IdentifyGameAddress(uint32_t returnAddress) const override { return GameAddress::Unknown; }
+			virtual TextureCategory GetTextureCategoryFromHash(uint32_t textureHash) const override { return TextureCategory::Unknown; }
+			virtual TextureCategory RefineTextureCategoryFromGameAddress(TextureCategory previousCategory, GameAddress gameAddress) const override { return previousCategory; }
+			virtual bool TryApplyInGameFpsFix() override { return false; }
+			virtual bool TryApplyMenuFpsFix() override { return false; }
+			virtual bool TryApplyInGameSleepFixes() override { return false; }
+			virtual void* GetFunction(D2Function function) const override { return nullptr; }
+			virtual DrawParameters GetDrawParameters(const D2::CellContext* cellContext) const override { return { 0, 0, 0 }; }
+			virtual D2::UnitAny* GetPlayerUnit() const override { return nullptr; }
+			virtual Offset GetUnitPos(const D2::UnitAny* unit) const override { return { 0, 0 }; }
+			virtual D2::UnitType GetUnitType(const D2::UnitAny* unit) const override { return D2::UnitType::Monster; }
+			virtual uint32_t GetUnitId(const D2::UnitAny* unit) const override { return 0; }
+			virtual int32_t GetCurrentAct() const override { return 0; }
+			virtual bool IsGameMenuOpen() const override { return false; }
+			virtual bool IsInGame() const override { return true; }
+			virtual bool IsProjectDiablo2() const override { return false; }
+			virtual D2::UnitAny* FindUnit(uint32_t unitId, D2::UnitType unitType) const override { return nullptr; }
+		};
+
+		static std::vector<std::wstring> CreateLabels(
+			uint32_t labelCount)
+		{
+			std::vector<std::wstring> labels(labelCount);
+			wchar_t label[64];
+
+			for (uint32_t i = 0; i < labelCount; ++i)
+			{
+				swprintf_s(label, 64, L"Superior Crystal Sword of the Fox (%u)", i);
+				labels[i] = label;
+			}
+
+			return labels;
+		}
+
+		/* The text id as D2DXContext::BeginDrawText makes it. */
+		static uint64_t GetTextId(
+			const TextureHasher& textureHasher,
+			const wchar_t* str,
+			uint32_t returnAddress)
+		{
+			const uint32_t hash = textureHasher.CalculateHash((const uint8_t*)str, (uint32_t)(wcslen(str) * sizeof(wchar_t)));
+			return TextMotionPredictor::GetTextId(str, hash, returnAddress);
+		}
+
+		/* Item labels as the game draws them when Alt is held: each one copied into the same
+		   buffer and drawn from the same call site. */
+		static void DrawLabels(
+			TextMotionPredictor& textMotionPredictor,
+			const TextureHasher& textureHasher,
+			const std::vector<std::wstring>& labels,
+			wchar_t* buffer,
+			uint32_t firstLabel,
+			uint32_t labelCount,
+			Offset labelsOffset,
+			std::vector<Offset>* offsets)
+		{
+			for (uint32_t i = firstLabel; i < firstLabel + labelCount; ++i)
+			{
+				wmemcpy(buffer, labels[i].c_str(), labels[i].size() + 1);
+				const uint64_t textId = GetTextId(textureHasher, buffer, 0x6FB12345);
+				const Offset offset = textMotionPredictor.GetOffset(textId, { (int32_t)(i % 20) * 40 + labelsOffset.x, (int32_t)(i / 20) * 12 + labelsOffset.y });
+
+				if (offsets)
+				{
+					offsets->push_back(offset);
+				}
+			}
+		}
+
+		TEST_METHOD(TracksThousandLabels)
+		{
+			auto gameHelper = std::make_shared<FakeGameHelper>();
+			auto simd = std::make_shared<SimdSse2>();
+			NullRenderContext renderContext{ nullptr, { 640, 480 }, { 800, 600 }, ScreenMode::Windowed, nullptr, simd };
+			TextMotionPredictor textMotionPredictor{ gameHelper };
+			TextureHasher textureHasher{ simd };
+			const auto labels = CreateLabels(2000);
+			wchar_t buffer[64];
+
+			textMotionPredictor.Update(&renderContext);
+			DrawLabels(textMotionPredictor, textureHasher, labels, buffer, 0, 1000, { 0, 0 }, nullptr);
+			renderContext.Present();
+
+			/* The labels jump to the left. Each one should still be drawn where it was, on its way
+			   to the new position. */
+			std::vector<Offset> offsets;
+			textMotionPredictor.Update(&renderContext);
+			DrawLabels(textMotionPredictor, textureHasher, labels, buffer, 0, 1000, { -10, 0 }, &offsets);
+			renderContext.Present();
+
+			for (const Offset& offset : offsets)
+			{
+				Assert::IsTrue(offset.x > 0);
+				Assert::AreEqual(0, offset.y);
+			}
+
+			/* Labels that are no longer drawn expire, and new ones are tracked in their place. */
+			for (int32_t frame = 0; frame < 1000; ++frame)
+			{
+				textMotionPredictor.Update(&renderContext);
+				DrawLabels(textMotionPredictor, textureHasher, labels, buffer, 500, 500, { -10, 0 }, nullptr);
+				renderContext.Present();
+			}
+
+			textMotionPredictor.Update(&renderContext);
+			DrawLabels(textMotionPredictor, textureHasher, labels, buffer, 1000, 1000, { 0, 0 }, nullptr);
+			renderContext.Present();
+
+			offsets.clear();
+			textMotionPredictor.Update(&renderContext);
+			DrawLabels(textMotionPredictor, textureHasher, labels, buffer, 500, 1500, { 0, 0 }, &offsets);
+			renderContext.Present();
+
+			for (uint32_t i = 0; i < 1500; ++i)
+			{
+				if (i < 500)
+				{
+					Assert::IsTrue(offsets[i].x < 0);
+				}
+				else
+				{
+					Assert::AreEqual(0, offsets[i].x);
+				}
+			}
+		}
+
+		TEST_METHOD(BenchmarkThousandLabels)
+		{
+			auto gameHelper = std::make_shared<FakeGameHelper>();
+			auto simd = std::make_shared<SimdSse2>();
+			NullRenderContext renderContext{ nullptr, { 640, 480 }, { 800, 600 }, ScreenMode::Windowed, nullptr, simd };
+			const int32_t frameCount = 1000;
+			const auto labels = CreateLabels(1000);
+			wchar_t buffer[64];
+
+			/* The text hash is calculated with whichever engine the texture hasher uses. */
+			const TextureHashEngine engines[2] = { TextureHashEngine::Fnv1a, TextureHasher::GetFastestEngine() };
+			float timeMs[2];
+
+			for (int32_t engine = 0; engine < 2; ++engine)
+			{
+				TextMotionPredictor textMotionPredictor{ gameHelper };
+				TextureHasher textureHasher{ simd, engines[engine] };
+
+				const int64_t startTime = TimeStart();
+
+				for (int32_t frame = 0; frame < frameCount; ++frame)
+				{
+					textMotionPredictor.Update(&renderContext);
+					DrawLabels(textMotionPredictor, textureHasher, labels, buffer, 0, 1000, { frame & 7, 0 }, nullptr);
+				}
+
+				timeMs[engine] = TimeEndMs(startTime);
+			}
+
+			char message[256];
+			sprintf_s(message, "1000 labels: %.3f ms per frame with FNV-1a, %.3f ms with %s",
+				timeMs[0] / frameCount, timeMs[1] / frameCount, engines[1] == TextureHashEngine::Crc32c ? "CRC32C" : "FNV-1a");
+			Logger::WriteMessage(message);
+		}
+	};
+}
@@ -0,0 +1,227 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include <array>
+#include "CppUnitTest.h"
+
+#include "../d2dx/Batch.h"
+#include "../d2dx/SimdSse2.h"
+#include "../d2dx/TextureAtlasPacker.h"
+#include "../d2dx/TextureCache.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestTextureAtlasPacker)
+	{
+	public:
+		TEST_METHOD(TileOffsets)
+		{
+			Assert::AreEqual(0, TextureAtlasPacker::GetTileOffset(256, 8, 3).x);
+			Assert::AreEqual(24, TextureAtlasPacker::GetTileOffset(256, 8, 3).y);
+			Assert::AreEqual(48, TextureAtlasPacker::GetTileOffset(16, 128, 3).x);
+			Assert::AreEqual(0, TextureAtlasPacker::GetTileOffset(16, 128, 3).y);
+		}
+
+		TEST_METHOD(PacksStripsIntoOneSlot)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			std::array<uint8_t, 256 * 8> tmuData{};
+
+			Batch batch;
+			batch.SetTextureStartAddress(0);
+			batch.SetTextureSize(256, 8);
+
+			TextureCache textureCache{ 256, 256, 64, 64, (ID3D11Device*)nullptr, simd };
+
+			for (uint32_t i = 0; i < 32; ++i)
+			{
+				auto tcl = textureCache.InsertTexture(0x1000 + i, batch, tmuData.data(), (uint32_t)tmuData.size());
+				Assert::AreEqual((int16_t)0, tcl._textureIndex);
+				Assert::AreEqual((int16_t)i, tcl._textureTile);
+			}
+
+			Assert::AreEqual(1U, textureCache.GetUsedCount());
+			Assert::AreEqual(1.0f, textureCache.GetPackingEfficiency());
+
+			/* The 33rd strip opens a second page, which is 1/32 full. */
+			auto tcl = textureCache.InsertTexture(0x2000, batch, tmuData.data(), (uint32_t)tmuData.size());
+			Assert::AreEqual((int16_t)1, tcl._textureIndex);
+			Assert::AreEqual((int16_t)0, tcl._textureTile);
+			Assert::AreEqual(33.0f / 64.0f, textureCache.GetPackingEfficiency());
+
+			for (uint32_t i = 0; i < 32; ++i)
+			{
+				tcl = textureCache.FindTexture(0x1000 + i, -1);
+				Assert::AreEqual((int16_t)0, tcl._textureIndex);
+				Assert::AreEqual((int16_t)i, tcl._textureTile);
+			}
+		}
+
+		TEST_METHOD(ContentKeysNeverFindPages)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			std::array<uint8_t, 256 * 8> tmuData{};
+
+			Batch stripBatch;
+			stripBatch.SetTextureStartAddress(0);
+			stripBatch.SetTextureSize(256, 8);
+
+			Batch fullBatch;
+			fullBatch.SetTextureStartAddress(0);
+			fullBatch.SetTextureSize(256, 256);
+
+			TextureCache textureCache{ 256, 256, 64, 64, (ID3D11Device*)nullptr, simd };
+
+			textureCache.InsertTexture(0x1000, stripBatch, tmuData.data(), (uint32_t)tmuData.size());
+
+			/* Pages have no content key, so no hash can find one, not even those at the top of the range. */
+			for (uint32_t key = 0xFFFFFFF0; key != 0; ++key)
+			{
+				Assert::AreEqual((int16_t)-1, textureCache.FindTexture(key, -1)._textureAtlas);
+			}
+
+			auto tcl = textureCache.InsertTexture(0xFFFFFFFF, fullBatch, tmuData.data(), (uint32_t)tmuData.size());
+			Assert::AreEqual((int16_t)1, tcl._textureIndex);
+			Assert::AreEqual((int16_t)1, textureCache.FindTexture(0xFFFFFFFF, -1)._textureIndex);
+			Assert::AreEqual((int16_t)0, textureCache.FindTexture(0x1000, -1)._textureIndex);
+
+			/* Both the page and the full-size texture stay where they are when the next strip goes in. */
+			tcl = textureCache.InsertTexture(0x1001, stripBatch, tmuData.data(), (uint32_t)tmuData.size());
+			Assert::AreEqual((int16_t)0, tcl._textureIndex);
+			Assert::AreEqual((int16_t)1, tcl._textureTile);
+			Assert::AreEqual(2U, textureCache.GetUsedCount());
+		}
+
+		TEST_METHOD(KeepsShapesApart)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			std::array<uint8_t, 128 * 128> tmuData{};
+
+			TextureCache textureCache{ 128, 128, 64, 64, (ID3D11Device*)nullptr, simd };
+
+			const int32_t sizes[][2] = { { 128, 16 }, { 16, 128 }, { 128, 128 }, { 64, 128 }, { 128, 16 } };
+			int16_t indices[ARRAYSIZE(sizes)];
+
+			for (int32_t i = 0; i < ARRAYSIZE(sizes); ++i)
+			{
+				Batch batch;
+				batch.SetTextureStartAddress(0);
+				batch.SetTextureSize(sizes[i][0], sizes[i][1]);
+				indices[i] = textureCache.InsertTexture(0x100 + i, batch, tmuData.data(), (uint32_t)tmuData.size())._textureIndex;
+			}
+
+			/* One page per packed shape, plus the full-size texture. */
+			Assert::AreEqual(4U, textureCache.GetUsedCount());
+			Assert::AreEqual(indices[0], indices[4]);
+			Assert::AreEqual((int16_t)1, textureCache.FindTexture(0x104, -1)._textureTile);
+			Assert::AreEqual((int16_t)0, textureCache.FindTexture(0x102, -1)._textureTile);
+		}
+
+		TEST_METHOD(EvictingPageEvictsItsTiles)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			std::array<uint8_t, 64 * 64> tmuData{};
+
+			Batch stripBatch;
+			stripBatch.SetTextureStartAddress(0);
+			stripBatch.SetTextureSize(64, 8);
+
+			Batch fullBatch;
+			fullBatch.SetTextureStartAddress(0);
+			fullBatch.SetTextureSize(64, 64);
+
+			TextureCache textureCache{ 64, 64, 64, 64, (ID3D11Device*)nullptr, simd };
+
+			for (uint32_t i = 0; i < 8; ++i)
+			{
+				textureCache.InsertTexture(0x100 + i, stripBatch, tmuData.data(), (uint32_t)tmuData.size());
+			}
+
+			textureCache.OnNewFrame();
+
+			for (uint32_t i = 0; i < 63; ++i)
+			{
+				textureCache.InsertTexture(0x200 + i, fullBatch, tmuData.data(), (uint32_t)tmuData.size());
+			}
+
+			textureCache.OnNewFrame();
+
+			for (uint32_t i = 0; i < 63; ++i)
+			{
+				textureCache.FindTexture(0x200 + i, -1);
+			}
+
+			textureCache.InsertTexture(0x300, fullBatch, tmuData.data(), (uint32_t)tmuData.size());
+
+			/* Only the page could go, and all eight strips went with it. */
+			Assert::AreEqual(8U, textureCache.GetStats().evictions);
+
+			for (uint32_t i = 0; i < 8; ++i)
+			{
+				Assert::AreEqual((int16_t)-1, textureCache.FindTexture(0x100 + i, -1)._textureAtlas);
+			}
+		}
+
+		TEST_METHOD(SetAtlasCountDropsPagesInReleasedAtlases)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			std::array<uint8_t, 32 * 32> tmuData{};
+
+			Batch fullBatch;
+			fullBatch.SetTextureStartAddress(0);
+			fullBatch.SetTextureSize(32, 32);
+
+			Batch stripBatch;
+			stripBatch.SetTextureStartAddress(0);
+			stripBatch.SetTextureSize(8, 32);
+
+			TextureCache textureCache{ 32, 32, 128, 64, (ID3D11Device*)nullptr, simd };
+
+			for (uint32_t i = 0; i < 64; ++i)
+			{
+				textureCache.InsertTexture(0x100 + i, fullBatch, tmuData.data(), (uint32_t)tmuData.size());
+			}
+
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				Assert::AreEqual((int16_t)1, textureCache.InsertTexture(0x200 + i, stripBatch, tmuData.data(), (uint32_t)tmuData.size())._textureAtlas);
+			}
+
+			Assert::AreEqual(68U, textureCache.GetUsedCount());
+
+			textureCache.SetAtlasCount(1);
+
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				Assert::AreEqual((int16_t)-1, textureCache.FindTexture(0x200 + i, -1)._textureAtlas);
+			}
+
+			Assert::AreEqual(1.0f, textureCache.GetPackingEfficiency());
+
+			/* Strips inserted after the resize get a fresh page. */
+			textureCache.OnNewFrame();
+			auto tcl = textureCache.InsertTexture(0x300, stripBatch, tmuData.data(), (uint32_t)tmuData.size());
+			Assert::AreEqual((int16_t)0, tcl._textureTile);
+			Assert::AreEqual((int16_t)0, textureCache.FindTexture(0x300, -1)._textureTile);
+		}
+	};
+}
@@ -33,6 +33,34 @@ namespace d2dxtests
 	TEST_CLASS(TestTextureCache)
 	{
 	public:
+		TEST_METHOD(MapsSizesToCaches)
+		{
+			Assert::AreEqual(0, TextureCache::GetCacheIndex(8, 8));
+			Assert::AreEqual(2, TextureCache::GetCacheIndex(32, 8));
+			Assert::AreEqual(5, TextureCache::GetCacheIndex(128, 256));
+			Assert::AreEqual(6, TextureCache::GetCacheIndex(256, 128));
+			Assert::AreEqual(-1, TextureCache::GetCacheIndex(4, 8));
+			Assert::AreEqual(-1, TextureCache::GetCacheIndex(24, 8));
+
+			/* Batch keeps its own copy of the mapping, for speed; it must agree. Each cache's own
+			   texture size must map to it. */
+			for (int32_t width = 8; width <= 256; width *= 2)
+			{
+				for (int32_t height = 8; height <= 256; height *= 2)
+				{
+					Batch batch;
+					batch.SetTextureSize(width, height);
+					Assert::AreEqual(TextureCache::GetCacheIndex(width, height), batch.GetTextureCacheIndex());
+				}
+			}
+
+			for (int32_t i = 0; i < D2DX_TEXTURE_CACHE_COUNT; ++i)
+			{
+				const Size size = TextureCache::GetCacheTextureSize(i);
+				Assert::AreEqual(i, TextureCache::GetCacheIndex(size.width, size.height));
+			}
+		}
+
 		TEST_METHOD(CreateAtlas)
 		{
 			auto simd = std::make_shared<SimdSse2>();
@@ -0,0 +1,170 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include "../d2dx/Batch.h"
+#include "../d2dx/SimdSse2.h"
+#include "../d2dx/TextureCache.h"
+#include "../d2dx/TextureCacheManager.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestTextureCacheManager)
+	{
+	public:
+		/* Looks up textureCount distinct textures, inserting the ones that are missing. */
+		static void UseTextures(TextureCache& textureCache, uint32_t firstKey, uint32_t textureCount)
+		{
+			static uint8_t tmuData[32 * 32];
+
+			Batch batch;
+			batch.SetTextureStartAddress(0);
+			batch.SetTextureSize(32, 32);
+
+			for (uint32_t i = 0; i < textureCount; ++i)
+			{
+				if (textureCache.FindTexture(firstKey + i, -1)._textureAtlas < 0)
+				{
+					textureCache.InsertTexture(firstKey + i, batch, tmuData, sizeof(tmuData));
+				}
+			}
+		}
+
+		static void EndFrame(TextureCacheManager& textureCacheManager, TextureCache& a, TextureCache& b)
+		{
+			textureCacheManager.OnNewFrame();
+			a.OnNewFrame();
+			b.OnNewFrame();
+		}
+
+		TEST_METHOD(SetAtlasCountKeepsTexturesInRemainingAtlases)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			TextureCache textureCache{ 32, 32, 128, 64, (ID3D11Device*)nullptr, simd };
+			Assert::AreEqual(2U, textureCache.GetAtlasCount());
+
+			UseTextures(textureCache, 1, 128);
+			textureCache.SetAtlasCount(1);
+			Assert::AreEqual(64U, textureCache.GetCapacity());
+			Assert::AreEqual(64U, textureCache.GetUsedCount());
+
+			for (uint32_t i = 0; i < 128; ++i)
+			{
+				const auto tcl = textureCache.FindTexture(1 + i, -1);
+				Assert::AreEqual((int16_t)(i < 64 ? 0 : -1), tcl._textureAtlas);
+			}
+
+			textureCache.SetAtlasCount(3);
+			Assert::AreEqual(192U, textureCache.GetCapacity());
+			Assert::AreEqual(32U * 32U * 192U, textureCache.GetMemoryFootprint());
+
+			/* New textures go into the new atlases, leaving the old ones alone. */
+			UseTextures(textureCache, 1000, 128);
+			Assert::AreEqual(192U, textureCache.GetUsedCount());
+			Assert::AreEqual(0U, textureCache.GetStats().evictions);
+		}
+
+		TEST_METHOD(GrowsThrashingCacheWithinBudget)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			TextureCache hot{ 32, 32, 64, 64, (ID3D11Device*)nullptr, simd };
+			TextureCache idle{ 32, 32, 64, 64, (ID3D11Device*)nullptr, simd };
+
+			/* Room for two more atlases. */
+			TextureCacheManager textureCacheManager{ 4 * 32 * 32 * 64, 8 };
+			textureCacheManager.AddTextureCache(&hot);
+			textureCacheManager.AddTextureCache(&idle);
+
+			for (int32_t frame = 0; frame < 64; ++frame)
+			{
+				/* A working set of 150 textures: needs three atlases. */
+				UseTextures(hot, 1, 150);
+				UseTextures(idle, 1, 16);
+				EndFrame(textureCacheManager, hot, idle);
+			}
+
+			Assert::AreEqual(3U, hot.GetAtlasCount());
+			Assert::AreEqual(1U, idle.GetAtlasCount());
+			Assert::IsTrue(textureCacheManager.GetMemoryFootprint() <= textureCacheManager.GetMemoryBudget());
+
+			/* Once the working set fits, the cache stops evicting. */
+			const uint32_t evictions = hot.GetStats().evictions;
+			UseTextures(hot, 1, 150);
+			Assert::AreEqual(evictions, hot.GetStats().evictions);
+		}
+
+		TEST_METHOD(DoesNotGrowPastBudget)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			TextureCache hot{ 32, 32, 64, 64, (ID3D11Device*)nullptr, simd };
+			TextureCache idle{ 32, 32, 64, 64, (ID3D11Device*)nullptr, simd };
+
+			TextureCacheManager textureCacheManager{ 3 * 32 * 32 * 64, 8 };
+			textureCacheManager.AddTextureCache(&hot);
+			textureCacheManager.AddTextureCache(&idle);
+
+			for (int32_t frame = 0; frame < 64; ++frame)
+			{
+				UseTextures(hot, 1, 1000);
+				EndFrame(textureCacheManager, hot, idle);
+			}
+
+			Assert::AreEqual(2U, hot.GetAtlasCount());
+			Assert::AreEqual(1U, idle.GetAtlasCount());
+		}
+
+		TEST_METHOD(MovesAtlasFromColdCacheToHotCache)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			TextureCache a{ 32, 32, 64, 64, (ID3D11Device*)nullptr, simd };
+			TextureCache b{ 32, 32, 64, 64, (ID3D11Device*)nullptr, simd };
+
+			TextureCacheManager textureCacheManager{ 3 * 32 * 32 * 64, 8 };
+			textureCacheManager.AddTextureCache(&a);
+			textureCacheManager.AddTextureCache(&b);
+
+			/* First a needs the extra atlas... */
+			for (int32_t frame = 0; frame < 64; ++frame)
+			{
+				UseTextures(a, 1, 100);
+				UseTextures(b, 1, 16);
+				EndFrame(textureCacheManager, a, b);
+			}
+
+			Assert::AreEqual(2U, a.GetAtlasCount());
+			Assert::AreEqual(1U, b.GetAtlasCount());
+
+			/* ...then a goes quiet and b needs it. */
+			for (int32_t frame = 0; frame < 128; ++frame)
+			{
+				UseTextures(a, 1, 16);
+				UseTextures(b, 1, 100);
+				EndFrame(textureCacheManager, a, b);
+			}
+
+			Assert::AreEqual(1U, a.GetAtlasCount());
+			Assert::AreEqual(2U, b.GetAtlasCount());
+			Assert::IsTrue(textureCacheManager.GetMemoryFootprint() <= textureCacheManager.GetMemoryBudget());
+		}
+	};
+}
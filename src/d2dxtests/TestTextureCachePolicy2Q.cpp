@@ -0,0 +1,249 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include <vector>
+#include "CppUnitTest.h"
+
+#include "../d2dx/SimdSse2.h"
+#include "../d2dx/TextureCachePolicy2Q.h"
+#include "../d2dx/TextureCachePolicyBitPmru.h"
+#include "../d2dx/Utils.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestTextureCachePolicy2Q)
+	{
+	public:
+		static uint32_t NextKey(uint32_t& state)
+		{
+			/* xorshift32; never returns 0, which is not a valid content key. */
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		}
+
+		static bool Use(ITextureCachePolicy& policy, uint32_t key)
+		{
+			if (policy.Find(key, -1) >= 0)
+			{
+				return true;
+			}
+
+			bool evicted;
+			policy.Insert(key, evicted);
+			return false;
+		}
+
+		/* Returns how many of the hot keys miss right after a series of frames full of one-off keys. */
+		static uint32_t CountHotMissesAfterFlood(ITextureCachePolicy& policy)
+		{
+			std::vector<uint32_t> hotKeys(256);
+			uint32_t state = 0x2468ACE1;
+
+			for (auto& key : hotKeys)
+			{
+				key = NextKey(state);
+			}
+
+			for (int32_t frame = 0; frame < 16; ++frame)
+			{
+				policy.OnNewFrame();
+
+				for (const uint32_t key : hotKeys)
+				{
+					Use(policy, key);
+				}
+			}
+
+			/* E.g. running through a new area with the inventory closed: floor tiles that are each
+			   seen in only one frame. */
+			for (int32_t frame = 0; frame < 16; ++frame)
+			{
+				policy.OnNewFrame();
+
+				for (int32_t i = 0; i < 128; ++i)
+				{
+					Use(policy, NextKey(state));
+				}
+			}
+
+			policy.OnNewFrame();
+
+			uint32_t misses = 0;
+
+			for (const uint32_t key : hotKeys)
+			{
+				misses += Use(policy, key) ? 0 : 1;
+			}
+
+			return misses;
+		}
+
+		TEST_METHOD(FindsInsertedKeys)
+		{
+			TextureCachePolicy2Q policy{ 512, std::make_shared<SimdSse2>() };
+			std::vector<int32_t> indices;
+			uint32_t state = 0x12345678;
+
+			for (int32_t i = 0; i < 512; ++i)
+			{
+				bool evicted;
+				indices.push_back(policy.Insert(NextKey(state), evicted));
+				Assert::IsFalse(evicted);
+				Assert::AreEqual(i, indices.back());
+			}
+
+			Assert::AreEqual(512U, policy.GetUsedCount());
+			Assert::AreEqual(512U, policy.GetUsedInFrameCount());
+
+			state = 0x12345678;
+
+			for (int32_t i = 0; i < 512; ++i)
+			{
+				Assert::AreEqual(indices[i], policy.Find(NextKey(state), -1));
+			}
+
+			Assert::AreEqual(-1, policy.Find(NextKey(state), -1));
+		}
+
+		TEST_METHOD(DoesNotEvictEntriesUsedInFrame)
+		{
+			TextureCachePolicy2Q policy{ 512, std::make_shared<SimdSse2>() };
+			uint32_t state = 0xDEADBEEF;
+
+			for (int32_t frame = 0; frame < 8; ++frame)
+			{
+				policy.OnNewFrame();
+
+				std::vector<uint32_t> keys;
+
+				for (int32_t i = 0; i < 384; ++i)
+				{
+					keys.push_back(NextKey(state));
+					Use(policy, keys.back());
+				}
+
+				for (const uint32_t key : keys)
+				{
+					Assert::IsTrue(policy.Find(key, -1) >= 0);
+				}
+			}
+		}
+
+		TEST_METHOD(KeepsHotSetThroughFlood)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			TextureCachePolicy2Q twoQueuePolicy{ 512, simd };
+			TextureCachePolicyBitPmru bitPmruPolicy{ 512, simd };
+
+			const uint32_t twoQueueMisses = CountHotMissesAfterFlood(twoQueuePolicy);
+			const uint32_t bitPmruMisses = CountHotMissesAfterFlood(bitPmruPolicy);
+
+			char message[256];
+			sprintf_s(message, "hot set misses after flood: 2Q %u, BitPmru %u (of 256)", twoQueueMisses, bitPmruMisses);
+			Logger::WriteMessage(message);
+
+			Assert::AreEqual(0U, twoQueueMisses);
+			Assert::IsTrue(bitPmruMisses > 0);
+		}
+
+		TEST_METHOD(BenchmarkFloodInOneFrame)
+		{
+			/* A waypoint jump: the main queue holds textures from earlier frames, and one frame brings
+			   more new textures than the probation queue holds. Once the probation queue has nothing
+			   but entries used in this frame, victims have to come from the main queue. */
+			auto simd = std::make_shared<SimdSse2>();
+			const int32_t floodCount = 1500;
+			uint32_t state = 0x13579BDF;
+			float timeMs = 0;
+
+			for (int32_t run = 0; run < 20; ++run)
+			{
+				TextureCachePolicy2Q policy{ 2048, simd };
+				std::vector<uint32_t> keys(2048);
+
+				policy.OnNewFrame();
+
+				for (auto& key : keys)
+				{
+					key = NextKey(state);
+					Use(policy, key);
+				}
+
+				policy.OnNewFrame();
+
+				for (int32_t i = 0; i < 1536; ++i)
+				{
+					Use(policy, keys[i]);
+				}
+
+				policy.OnNewFrame();
+
+				const int64_t startTime = TimeStart();
+
+				for (int32_t i = 0; i < floodCount; ++i)
+				{
+					Use(policy, NextKey(state));
+				}
+
+				timeMs += TimeEndMs(startTime);
+
+				Assert::AreEqual((uint32_t)floodCount, policy.GetUsedInFrameCount());
+			}
+
+			char message[256];
+			sprintf_s(message, "flood of %d textures: %.3f ms", floodCount, timeMs / 20);
+			Logger::WriteMessage(message);
+		}
+
+		TEST_METHOD(SetCapacityKeepsLowSlots)
+		{
+			TextureCachePolicy2Q policy{ 512, std::make_shared<SimdSse2>() };
+			std::vector<uint32_t> keys;
+			uint32_t state = 0x0BADF00D;
+
+			for (int32_t i = 0; i < 512; ++i)
+			{
+				bool evicted;
+				keys.push_back(NextKey(state));
+				policy.Insert(keys.back(), evicted);
+			}
+
+			policy.SetCapacity(256);
+			Assert::AreEqual(256U, policy.GetCapacity());
+			Assert::AreEqual(256U, policy.GetUsedCount());
+
+			for (int32_t i = 0; i < 512; ++i)
+			{
+				Assert::AreEqual(i < 256 ? i : -1, policy.Find(keys[i], -1));
+			}
+
+			policy.SetCapacity(1024);
+			Assert::AreEqual(256U, policy.GetUsedCount());
+
+			bool evicted;
+			Assert::AreEqual(256, policy.Insert(NextKey(state), evicted));
+			Assert::IsFalse(evicted);
+		}
+	};
+}
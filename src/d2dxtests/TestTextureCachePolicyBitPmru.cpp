@@ -0,0 +1,136 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include <array>
+#include "CppUnitTest.h"
+
+#include "../d2dx/SimdSse2.h"
+#include "../d2dx/TextureCache.h"
+#include "../d2dx/TextureCachePolicyBitPmru.h"
+#include "../d2dx/Utils.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestTextureCachePolicyBitPmru)
+	{
+	public:
+		static uint32_t NextKey(uint32_t& state)
+		{
+			/* xorshift32; never returns 0, which is not a valid content key. */
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		}
+
+		TEST_METHOD(HashIndexMatchesSimdScan)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+			TextureCachePolicyBitPmru hashIndexPolicy{ 512, simd, TextureCacheLookup::HashIndex };
+			TextureCachePolicyBitPmru simdScanPolicy{ 512, simd, TextureCacheLookup::SimdScan };
+
+			std::array<uint32_t, 1024> keys;
+			uint32_t state = 0x12345678;
+
+			for (auto& key : keys)
+			{
+				key = NextKey(state);
+			}
+
+			/* A working set larger than the capacity, so that slots keep getting evicted and reused. */
+			for (int32_t frame = 0; frame < 64; ++frame)
+			{
+				hashIndexPolicy.OnNewFrame();
+				simdScanPolicy.OnNewFrame();
+
+				for (int32_t i = 0; i < 256; ++i)
+				{
+					const uint32_t key = keys[NextKey(state) % keys.size()];
+					const int32_t hashIndexResult = hashIndexPolicy.Find(key, -1);
+					Assert::AreEqual(simdScanPolicy.Find(key, -1), hashIndexResult);
+
+					if (hashIndexResult < 0)
+					{
+						bool hashIndexEvicted, simdScanEvicted;
+						Assert::AreEqual(
+							simdScanPolicy.Insert(key, simdScanEvicted),
+							hashIndexPolicy.Insert(key, hashIndexEvicted));
+						Assert::AreEqual(simdScanEvicted, hashIndexEvicted);
+					}
+				}
+			}
+
+			Assert::AreEqual(512U, hashIndexPolicy.GetUsedCount());
+
+			for (const uint32_t key : keys)
+			{
+				Assert::AreEqual(simdScanPolicy.Find(key, -1), hashIndexPolicy.Find(key, -1));
+			}
+		}
+
+		TEST_METHOD(BenchmarkFindAtAtlasCapacities)
+		{
+			const int32_t findCount = 100000;
+
+			auto simd = std::make_shared<SimdSse2>();
+
+			for (int32_t cacheIndex = 0; cacheIndex < D2DX_TEXTURE_CACHE_COUNT; ++cacheIndex)
+			{
+				const uint32_t capacity = TextureCache::GetInitialCapacity(cacheIndex);
+				float timeMs[2];
+				int32_t checksum[2] = { 0, 0 };
+
+				for (int32_t lookup = 0; lookup < 2; ++lookup)
+				{
+					TextureCachePolicyBitPmru policy{ capacity, simd, (TextureCacheLookup)lookup };
+					std::vector<uint32_t> keys(capacity);
+					uint32_t state = 0xCAFEBABE;
+
+					for (auto& key : keys)
+					{
+						bool evicted;
+						key = NextKey(state);
+						policy.Insert(key, evicted);
+					}
+
+					/* Look up resident keys without a hint and, every fourth time, a missing one. */
+					const int64_t startTime = TimeStart();
+
+					for (int32_t i = 0; i < findCount; ++i)
+					{
+						const uint32_t key = (i & 3) == 3 ? NextKey(state) : keys[((uint32_t)i * 7919U) % capacity];
+						checksum[lookup] += policy.Find(key, -1);
+					}
+
+					timeMs[lookup] = TimeEndMs(startTime);
+				}
+
+				Assert::AreEqual(checksum[1], checksum[0]);
+
+				char message[256];
+				sprintf_s(message, "capacity %4u: hash index %.3f ms, SIMD scan %.3f ms for %d finds",
+					capacity, timeMs[0], timeMs[1], findCount);
+				Logger::WriteMessage(message);
+			}
+		}
+	};
+}
@@ -0,0 +1,114 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include <vector>
+#include "CppUnitTest.h"
+
+#include "../d2dx/SimdSse2.h"
+#include "../d2dx/TextureBindRecorder.h"
+#include "../d2dx/TextureCacheSimulator.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestTextureCacheSimulator)
+	{
+	public:
+		TEST_METHOD(LoadsRecordedLog)
+		{
+			const char* filename = "d2dxtests_texturebinds.bin";
+
+			{
+				TextureBindRecorder recorder{ filename };
+				Assert::IsTrue(recorder.IsRecording());
+
+				recorder.RecordBind(0, 0x1234, 32, 32);
+				recorder.RecordBind(0, 0x5678, 256, 128);
+				recorder.RecordBind(1, 0x1234, 32, 32);
+				recorder.RecordBind(1, 0x9ABC, 512, 8);
+			}
+
+			std::vector<TextureBindRecord> records;
+			Assert::IsTrue(TextureCacheSimulator::LoadLog(filename, records));
+			remove(filename);
+
+			/* The 512x8 texture can't be in any cache and is skipped. */
+			Assert::AreEqual((size_t)3, records.size());
+			Assert::AreEqual(0U, records[1].frame);
+			Assert::AreEqual(0x5678U, records[1].contentKey);
+			Assert::AreEqual((uint16_t)256, records[1].width);
+			Assert::AreEqual((uint16_t)128, records[1].height);
+			Assert::AreEqual(1U, records[2].frame);
+			Assert::AreEqual(0x1234U, records[2].contentKey);
+		}
+
+		TEST_METHOD(RejectsOtherFiles)
+		{
+			std::vector<TextureBindRecord> records;
+			Assert::IsFalse(TextureCacheSimulator::LoadLog("d2dxtests_does_not_exist.bin", records));
+			Assert::IsTrue(records.empty());
+		}
+
+		TEST_METHOD(CountsMissesEvictionsAndUploads)
+		{
+			/* 100 frames of the same 96 64x64 textures, and 16 new 32x32 textures per frame. */
+			std::vector<TextureBindRecord> records;
+
+			for (uint32_t frame = 0; frame < 100; ++frame)
+			{
+				for (uint32_t i = 0; i < 96; ++i)
+				{
+					records.push_back({ frame, 0x10000 + i, 64, 64 });
+				}
+
+				for (uint32_t i = 0; i < 16; ++i)
+				{
+					records.push_back({ frame, 0x20000 + frame * 16 + i, 32, 32 });
+				}
+			}
+
+			TextureCacheSimulator simulator{ std::make_shared<SimdSse2>() };
+			TextureCacheSimulatorConfig config;
+			config.capacities[2] = 512;
+			config.isResizeEnabled = false;
+
+			for (int32_t policy = 0; policy < (int32_t)TextureCachePolicyOption::Count; ++policy)
+			{
+				config.policy = (TextureCachePolicyOption)policy;
+
+				const auto result = simulator.Run(records.data(), (uint32_t)records.size(), config);
+
+				Assert::AreEqual(100U, result.frameCount);
+				Assert::AreEqual((uint64_t)records.size(), result.bindCount);
+				Assert::AreEqual((uint64_t)(96 + 1600), result.misses);
+				Assert::AreEqual(result.bindCount - result.misses, result.hits);
+				Assert::AreEqual((uint64_t)(1600 - 512), result.evictions);
+				Assert::AreEqual(16U, result.maxEvictionsInFrame);
+				Assert::AreEqual((uint64_t)(96 * 64 * 64 + 1600 * 32 * 32), result.uploadBytes);
+				Assert::AreEqual(96U * 64 * 64 + 16 * 32 * 32, result.maxUploadBytesInFrame);
+				Assert::AreEqual(0U, result.maxUploadBytesFrame);
+				Assert::AreEqual((uint64_t)96, result.cacheMisses[3]);
+				Assert::AreEqual(result.initialMemoryFootprint, result.finalMemoryFootprint);
+				Assert::AreEqual(512U, result.finalCapacities[2]);
+			}
+		}
+	};
+}
@@ -0,0 +1,271 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include <algorithm>
+#include "CppUnitTest.h"
+
+#include "../d2dx/SimdSse2.h"
+#include "../d2dx/TextureHasher.h"
+#include "../d2dx/Utils.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestTextureHasher)
+	{
+	public:
+		static void FillPixels(std::vector<uint8_t>& pixels, uint32_t seed)
+		{
+			for (auto& pixel : pixels)
+			{
+				seed = seed * 1664525U + 1013904223U;
+				pixel = (uint8_t)(seed >> 24);
+			}
+		}
+
+		TEST_METHOD(Fnv1aEngineMatchesFnv1a)
+		{
+			TextureHasher textureHasher{ std::make_shared<SimdSse2>(), TextureHashEngine::Fnv1a };
+			std::vector<uint8_t> pixels(256 * 128);
+			FillPixels(pixels, 1);
+
+			const uint32_t expectedHash = fnv_32a_buf(pixels.data(), (uint32_t)pixels.size(), FNV1_32A_INIT);
+			const uint32_t hash = textureHasher.GetHash(0, pixels.data(), (uint32_t)pixels.size());
+			Assert::AreEqual(expectedHash, hash);
+			Assert::AreEqual(expectedHash, textureHasher.GetCompatibilityHash(hash, pixels.data(), (uint32_t)pixels.size()));
+		}
+
+		TEST_METHOD(CompatibilityHashIsFnv1a)
+		{
+			if (TextureHasher::GetFastestEngine() != TextureHashEngine::Crc32c)
+			{
+				Logger::WriteMessage("SSE4.2 not supported, skipping.");
+				return;
+			}
+
+			TextureHasher textureHasher{ std::make_shared<SimdSse2>(), TextureHashEngine::Crc32c };
+
+			for (uint32_t size = 1; size <= 4096; size = size * 3 + 1)
+			{
+				std::vector<uint8_t> pixels(size);
+				FillPixels(pixels, size);
+
+				const uint32_t hash = textureHasher.GetHash(0, pixels.data(), size);
+				Assert::AreEqual(TextureHasher::GetCrc32cHash(pixels.data(), size), hash);
+
+				/* Asked twice so that the second answer comes from the memo. */
+				const uint32_t expectedHash = fnv_32a_buf(pixels.data(), size, FNV1_32A_INIT);
+				Assert::AreEqual(expectedHash, textureHasher.GetCompatibilityHash(hash, pixels.data(), size));
+				Assert::AreEqual(expectedHash, textureHasher.GetCompatibilityHash(hash, pixels.data(), size));
+			}
+		}
+
+		TEST_METHOD(Crc32cHashChangesWithEveryByte)
+		{
+			if (TextureHasher::GetFastestEngine() != TextureHashEngine::Crc32c)
+			{
+				Logger::WriteMessage("SSE4.2 not supported, skipping.");
+				return;
+			}
+
+			std::vector<uint8_t> pixels(16 * 16 + 3);
+			FillPixels(pixels, 7);
+			const uint32_t hash = TextureHasher::GetCrc32cHash(pixels.data(), (uint32_t)pixels.size());
+
+			/* Every byte position, including the tail, must affect the hash. */
+			for (uint32_t i = 0; i < pixels.size(); ++i)
+			{
+				pixels[i] ^= 1;
+				Assert::AreNotEqual(hash, TextureHasher::GetCrc32cHash(pixels.data(), (uint32_t)pixels.size()));
+				pixels[i] ^= 1;
+			}
+
+			/* Neither must equal changes to two nearby bytes cancel out, whichever streams they are in;
+			   e.g. swapping two digits in a string. */
+			for (uint32_t i = 0; i < pixels.size(); ++i)
+			{
+				for (uint32_t j = i + 1; j < pixels.size() && j <= i + 24; ++j)
+				{
+					pixels[i] ^= 1;
+					pixels[j] ^= 1;
+					Assert::AreNotEqual(hash, TextureHasher::GetCrc32cHash(pixels.data(), (uint32_t)pixels.size()));
+					pixels[i] ^= 1;
+					pixels[j] ^= 1;
+				}
+			}
+
+			/* The size is part of the hash, so zero-filled textures of different sizes differ. */
+			std::vector<uint8_t> zeros(512, 0);
+			Assert::AreNotEqual(
+				TextureHasher::GetCrc32cHash(zeros.data(), 256),
+				TextureHasher::GetCrc32cHash(zeros.data(), 512));
+		}
+
+		TEST_METHOD(CopyAndHashFillsCache)
+		{
+			for (int32_t engine = 0; engine < 2; ++engine)
+			{
+				if ((TextureHashEngine)engine == TextureHashEngine::Crc32c &&
+					TextureHasher::GetFastestEngine() != TextureHashEngine::Crc32c)
+				{
+					continue;
+				}
+
+				auto simd = std::make_shared<SimdSse2>();
+				TextureHasher textureHasher{ simd, (TextureHashEngine)engine };
+				TextureHasher referenceHasher{ simd, (TextureHashEngine)engine };
+				std::vector<uint8_t> src(64 * 33 + 5);
+				std::vector<uint8_t> tmuMemory(8192);
+				FillPixels(src, 5);
+
+				const uint32_t hash = textureHasher.CopyAndHash(256, tmuMemory.data(), (uint32_t)tmuMemory.size(), src.data(), (uint32_t)src.size());
+				Assert::IsTrue(std::equal(src.begin(), src.end(), tmuMemory.begin() + 256));
+				Assert::AreEqual(referenceHasher.GetHash(256, src.data(), (uint32_t)src.size()), hash);
+
+				/* The cached hash is returned without looking at the pixels. */
+				std::vector<uint8_t> garbage(src.size(), 0xCD);
+				Assert::AreEqual(hash, textureHasher.GetHash(256, garbage.data(), (uint32_t)garbage.size()));
+
+				/* So is the compatibility hash, which was calculated in the same pass. */
+				Assert::AreEqual(
+					fnv_32a_buf(src.data(), (uint32_t)src.size(), FNV1_32A_INIT),
+					textureHasher.GetCompatibilityHash(hash, garbage.data(), (uint32_t)garbage.size()));
+
+				/* Sourcing a different size at the same address rehashes. */
+				Assert::AreEqual(
+					referenceHasher.GetHash(512, src.data(), 64 * 32),
+					textureHasher.GetHash(256, src.data(), 64 * 32));
+			}
+		}
+
+		TEST_METHOD(CopyAndHashRecognizesRedownloads)
+		{
+			for (int32_t engine = 0; engine < 2; ++engine)
+			{
+				if ((TextureHashEngine)engine == TextureHashEngine::Crc32c &&
+					TextureHasher::GetFastestEngine() != TextureHashEngine::Crc32c)
+				{
+					continue;
+				}
+
+				auto simd = std::make_shared<SimdSse2>();
+				TextureHasher textureHasher{ simd, (TextureHashEngine)engine };
+				TextureHasher referenceHasher{ simd, (TextureHashEngine)engine };
+				std::vector<uint8_t> src(32 * 32);
+				std::vector<uint8_t> tmuMemory(16384);
+				FillPixels(src, 9);
+
+				const uint32_t hash = textureHasher.CopyAndHash(0, tmuMemory.data(), (uint32_t)tmuMemory.size(), src.data(), (uint32_t)src.size());
+
+				/* Same content at another address: same hash, and the pixels must still be copied. */
+				Assert::AreEqual(hash, textureHasher.CopyAndHash(4096, tmuMemory.data(), (uint32_t)tmuMemory.size(), src.data(), (uint32_t)src.size()));
+				Assert::IsTrue(std::equal(src.begin(), src.end(), tmuMemory.begin() + 4096));
+
+				/* Same fingerprint (the prefix is unchanged) but different content must be hashed. */
+				src.back() ^= 0xFF;
+				const uint32_t changedHash = textureHasher.CopyAndHash(8192, tmuMemory.data(), (uint32_t)tmuMemory.size(), src.data(), (uint32_t)src.size());
+				Assert::AreNotEqual(hash, changedHash);
+				Assert::AreEqual(referenceHasher.GetHash(0, src.data(), (uint32_t)src.size()), changedHash);
+				Assert::IsTrue(std::equal(src.begin(), src.end(), tmuMemory.begin() + 8192));
+
+				/* The known content was overwritten in TMU memory, so it can't be used for comparison. */
+				std::vector<uint8_t> other(src.size(), 0x11);
+				textureHasher.CopyAndHash(8192, tmuMemory.data(), (uint32_t)tmuMemory.size(), other.data(), (uint32_t)other.size());
+				Assert::AreEqual(changedHash, textureHasher.CopyAndHash(12288, tmuMemory.data(), (uint32_t)tmuMemory.size(), src.data(), (uint32_t)src.size()));
+			}
+		}
+
+		TEST_METHOD(BenchmarkHashEngines)
+		{
+			if (TextureHasher::GetFastestEngine() != TextureHashEngine::Crc32c)
+			{
+				Logger::WriteMessage("SSE4.2 not supported, skipping.");
+				return;
+			}
+
+			std::vector<uint8_t> pixels(256 * 256);
+			FillPixels(pixels, 3);
+			const int32_t iterationCount = 200;
+			uint32_t checksum = 0;
+
+			int64_t startTime = TimeStart();
+			for (int32_t i = 0; i < iterationCount; ++i)
+			{
+				checksum += fnv_32a_buf(pixels.data(), (uint32_t)pixels.size(), FNV1_32A_INIT);
+			}
+			const float fnv1aTimeMs = TimeEndMs(startTime);
+
+			startTime = TimeStart();
+			for (int32_t i = 0; i < iterationCount; ++i)
+			{
+				checksum += TextureHasher::GetCrc32cHash(pixels.data(), (uint32_t)pixels.size());
+			}
+			const float crc32cTimeMs = TimeEndMs(startTime);
+
+			/* Copy then hash, as OnTexDownload and OnTexSource used to, against the fused pass. The first
+			   byte changes every time so that the downloads aren't recognized as already known. */
+			TextureHasher textureHasher{ std::make_shared<SimdSse2>(), TextureHashEngine::Crc32c };
+			std::vector<uint8_t> tmuMemory(pixels.size() * 2);
+
+			startTime = TimeStart();
+			for (int32_t i = 0; i < iterationCount; ++i)
+			{
+				pixels[0] = (uint8_t)i;
+				memcpy(tmuMemory.data(), pixels.data(), pixels.size());
+				checksum += TextureHasher::GetCrc32cHash(tmuMemory.data(), (uint32_t)pixels.size());
+			}
+			const float copyThenHashTimeMs = TimeEndMs(startTime);
+
+			startTime = TimeStart();
+			for (int32_t i = 0; i < iterationCount; ++i)
+			{
+				pixels[0] = (uint8_t)(i + 128);
+				checksum += textureHasher.CopyAndHash(0, tmuMemory.data(), (uint32_t)tmuMemory.size(), pixels.data(), (uint32_t)pixels.size());
+			}
+			const float copyAndHashTimeMs = TimeEndMs(startTime);
+
+			/* The fused pass of the FNV-1a engine, which is what new content costs without CRC32C. */
+			TextureHasher fnv1aTextureHasher{ std::make_shared<SimdSse2>(), TextureHashEngine::Fnv1a };
+
+			startTime = TimeStart();
+			for (int32_t i = 0; i < iterationCount; ++i)
+			{
+				pixels[0] = (uint8_t)i;
+				checksum += fnv1aTextureHasher.CopyAndHash(0, tmuMemory.data(), (uint32_t)tmuMemory.size(), pixels.data(), (uint32_t)pixels.size());
+			}
+			const float fnv1aCopyAndHashTimeMs = TimeEndMs(startTime);
+
+			/* The same content downloaded over and over, alternating between two addresses. */
+			startTime = TimeStart();
+			for (int32_t i = 0; i < iterationCount; ++i)
+			{
+				checksum += textureHasher.CopyAndHash((i & 1) ? (uint32_t)pixels.size() : 0, tmuMemory.data(), (uint32_t)tmuMemory.size(), pixels.data(), (uint32_t)pixels.size());
+			}
+			const float redownloadTimeMs = TimeEndMs(startTime);
+
+			char message[256];
+			sprintf_s(message, "%d x 256x256 texture: FNV-1a %.3f ms, CRC32C %.3f ms, copy then CRC32C %.3f ms, "
+				"fused CRC32C and FNV-1a %.3f ms, fused FNV-1a %.3f ms, known %.3f ms (checksum %08x)",
+				iterationCount, fnv1aTimeMs, crc32cTimeMs, copyThenHashTimeMs, copyAndHashTimeMs, fnv1aCopyAndHashTimeMs, redownloadTimeMs, checksum);
+			Logger::WriteMessage(message);
+		}
+	};
+}
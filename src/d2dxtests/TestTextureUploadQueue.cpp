@@ -0,0 +1,133 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include <array>
+#include "CppUnitTest.h"
+
+#include "../d2dx/TextureUploadQueue.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestTextureUploadQueue)
+	{
+	public:
+		/* Only compared, never dereferenced without a device. */
+		static ID3D11Texture2D* FakeTexture(uintptr_t id)
+		{
+			return (ID3D11Texture2D*)(id << 8);
+		}
+
+		TEST_METHOD(QueuesUntilFlush)
+		{
+			std::array<uint8_t, 64 * 64> pixels;
+
+			for (uint32_t i = 0; i < pixels.size(); ++i)
+			{
+				pixels[i] = (uint8_t)i;
+			}
+
+			TextureUploadQueue queue{ 256, nullptr };
+
+			queue.Enqueue(FakeTexture(1), 3, { 0, 0 }, 64, 64, pixels.data(), 64);
+			queue.Enqueue(FakeTexture(1), 4, { 0, 0 }, 64, 64, pixels.data(), 64);
+
+			Assert::AreEqual(2U, queue.GetPendingCount());
+			Assert::AreEqual(3U, queue.GetPendingUploads()[0].dstSlice);
+			Assert::AreEqual((int16_t)64, queue.GetPendingUploads()[1].srcX);
+			Assert::AreEqual((uint64_t)(2 * 64 * 64), queue.GetStats().queuedBytes);
+
+			/* The texels are in the staging segment, at the upload's source offset. */
+			const uint8_t* staging = queue.GetStagingPixels();
+			const uint32_t pitch = queue.GetStagingPitch();
+			Assert::AreEqual(pixels[5 * 64 + 7], staging[5 * pitch + 64 + 7]);
+
+			queue.Flush();
+
+			Assert::AreEqual(0U, queue.GetPendingCount());
+			Assert::AreEqual(1U, queue.GetStats().flushes);
+			Assert::AreEqual(2U, queue.GetStats().copies);
+
+			/* Nothing queued, nothing to do. */
+			queue.Flush();
+			Assert::AreEqual(1U, queue.GetStats().flushes);
+		}
+
+		TEST_METHOD(DropsOverwrittenUploads)
+		{
+			std::array<uint8_t, 32 * 32> pixels{};
+			TextureUploadQueue queue{ 256, nullptr };
+
+			queue.Enqueue(FakeTexture(1), 0, { 0, 0 }, 32, 8, pixels.data(), 32);
+			queue.Enqueue(FakeTexture(2), 0, { 0, 0 }, 32, 32, pixels.data(), 32);
+			queue.Enqueue(FakeTexture(1), 0, { 0, 0 }, 32, 32, pixels.data(), 32);
+
+			Assert::AreEqual(2U, queue.GetPendingCount());
+			Assert::AreEqual(1U, queue.GetStats().coalescedUploads);
+			Assert::IsTrue(FakeTexture(2) == queue.GetPendingUploads()[0].dstTexture);
+			Assert::AreEqual((int16_t)32, queue.GetPendingUploads()[1].height);
+		}
+
+		TEST_METHOD(MergesConsecutiveTiles)
+		{
+			std::array<uint8_t, 256 * 8> pixels{};
+			TextureUploadQueue queue{ 256, nullptr };
+
+			/* Wide strips stack vertically in both the slice and the segment. */
+			for (int32_t tile = 0; tile < 4; ++tile)
+			{
+				queue.Enqueue(FakeTexture(1), 7, { 0, tile * 8 }, 256, 8, pixels.data(), 256);
+			}
+
+			/* Tall strips lie side by side. */
+			for (int32_t tile = 0; tile < 4; ++tile)
+			{
+				queue.Enqueue(FakeTexture(1), 8, { tile * 8, 0 }, 8, 64, pixels.data(), 8);
+			}
+
+			Assert::AreEqual(2U, queue.GetPendingCount());
+			Assert::AreEqual((int16_t)256, queue.GetPendingUploads()[0].width);
+			Assert::AreEqual((int16_t)32, queue.GetPendingUploads()[0].height);
+			Assert::AreEqual((int16_t)32, queue.GetPendingUploads()[1].width);
+			Assert::AreEqual((int16_t)64, queue.GetPendingUploads()[1].height);
+			Assert::AreEqual(6U, queue.GetStats().coalescedUploads);
+
+			queue.Flush();
+			Assert::AreEqual(2U, queue.GetStats().copies);
+		}
+
+		TEST_METHOD(FlushesWhenRingIsFull)
+		{
+			std::array<uint8_t, 256 * 256> pixels{};
+			TextureUploadQueue queue{ 512, nullptr };
+
+			for (uint32_t slice = 0; slice < 3; ++slice)
+			{
+				queue.Enqueue(FakeTexture(1), slice, { 0, 0 }, 256, 256, pixels.data(), 256);
+			}
+
+			Assert::AreEqual(1U, queue.GetStats().ringStalls);
+			Assert::AreEqual(1U, queue.GetStats().flushes);
+			Assert::AreEqual(1U, queue.GetPendingCount());
+			Assert::AreEqual((int16_t)0, queue.GetPendingUploads()[0].srcY);
+		}
+	};
+}
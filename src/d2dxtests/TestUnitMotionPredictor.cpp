@@ -0,0 +1,376 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include <vector>
+#include "CppUnitTest.h"
+
+#include "../d2dx/IGameHelper.h"
+#include "../d2dx/NullRenderContext.h"
+#include "../d2dx/SimdSse2.h"
+#include "../d2dx/UnitMotionPredictor.h"
+#include "../d2dx/Utils.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestUnitMotionPredictor)
+	{
+	public:
+		/* A game with only monsters, with random unique ids so that the index sees collisions. */
+		class FakeGameHelper final : public IGameHelper
+		{
+		public:
+			struct Unit
+			{
+				uint32_t id;
+				Offset pos;
+				int32_t speed;
+				bool isAlive;
+			};
+
+			std::vector<Unit> units;
+			std::vector<int32_t> unitIndices = std::vector<int32_t>(65536, -1);
+			uint32_t randomState = 0x12345678;
+			mutable uint32_t findUnitCount = 0;
+
+			void AddUnits(uint32_t count)
+			{
+				for (uint32_t i = 0; i < count; ++i)
+				{
+					uint32_t id;
+
+					do
+					{
+						/* xorshift32 */
+						randomState ^= randomState << 13;
+						randomState ^= randomState >> 17;
+						randomState ^= randomState << 5;
+						id = randomState & 0xFFFF;
+					} while (id == 0 || unitIndices[id] >= 0);
+
+					unitIndices[id] = (int32_t)units.size();
+					units.push_back({ id, { 100 << 16, 100 << 16 }, 65536, true });
+				}
+			}
+
+			D2::UnitAny* GetUnit(uint32_t index) { return reinterpret_cast<D2::UnitAny*>(&units[index]); }
+
+			/* By default every unit walks one tile per frame from the same spot, so all have the same motion. */
+			void MoveUnits()
+			{
+				for (auto& unit : units)
+				{
+					unit.pos.x += unit.speed;
+				}
+			}
+
+			virtual GameVersion GetVersion() const override { return GameVersion::Unsupported; }
+			virtual const char* GetVersionString() const override { return "fake"; }
+			virtual uint32_t ScreenOpenMode() const override { return 0; }
+			virtual Size GetConfiguredGameSize() const override { return { 800, 600 }; }
+			virtual GameAddress IdentifyGameAddress(uint32_t returnAddress) const override { return GameAddress::Unknown; }
+			virtual TextureCategory GetTextureCategoryFromHash(uint32_t textureHash) const override { return TextureCategory::Unknown; }
+			virtual TextureCategory RefineTextureCategoryFromGameAddress(TextureCategory previousCategory, GameAddress gameAddress) const override { return previousCategory; }
+			virtual bool TryApplyInGameFpsFix() override { return false; }
+			virtual bool TryApplyMenuFpsFix() override { return false; }
+			virtual bool TryApplyInGameSleepFixes() override { return false; }
+			virtual void* GetFunction(D2Function function) const override { return nullptr; }
+			virtual DrawParameters GetDrawParameters(const D2::CellContext* cellContext) const override { return { 0, 0, 0 }; }
+			virtual D2::UnitAny* GetPlayerUnit() const override { return nullptr; }
+			virtual Offset GetUnitPos(const D2::UnitAny* unit) const override { return reinterpret_cast<const Unit*>(unit)->pos; }
+			virtual D2::UnitType GetUnitType(const D2::UnitAny* unit) const override { return D2::UnitType::Monster; }
+			virtual uint32_t GetUnitId(const D2::UnitAny* unit) const override { return reinterpret_cast<const Unit*>(unit)->id; }
+			virtual int32_t GetCurrentAct() const override { return 0; }
+			virtual bool IsGameMenuOpen() const override { return false; }
+			virtual bool IsInGame() const override { return true; }
+			virtual bool IsProjectDiablo2() const override { return false; }
+
+			virtual D2::UnitAny* FindUnit(uint32_t unitId, D2::UnitType unitType) const override
+			{
+				++findUnitCount;
+				const int32_t unitIndex = unitId < unitIndices.size() ? unitIndices[unitId] : -1;
+
+				if (unitType != D2::UnitType::Monster || unitIndex < 0 || !units[unitIndex].isAlive)
+				{
+					return nullptr;
+				}
+
+				return reinterpret_cast<D2::UnitAny*>(const_cast<Unit*>(&units[unitIndex]));
+			}
+		};
+
+		/* One frame as D2DXContext does it: update, then look up each unit as it is drawn. */
+		static void RunFrame(
+			UnitMotionPredictor& unitMotionPredictor,
+			FakeGameHelper& gameHelper,
+			NullRenderContext& renderContext,
+			uint32_t firstUnit)
+		{
+			gameHelper.MoveUnits();
+			unitMotionPredictor.Update(&renderContext);
+
+			const Offset expectedOffset = unitMotionPredictor.GetOffset(gameHelper.GetUnit(firstUnit));
+
+			for (uint32_t i = firstUnit; i < gameHelper.units.size(); ++i)
+			{
+				if (gameHelper.units[i].isAlive)
+				{
+					auto unit = gameHelper.GetUnit(i);
+					const Offset offset = unitMotionPredictor.GetOffset(unit);
+					Assert::AreEqual(expectedOffset.x, offset.x);
+					Assert::AreEqual(expectedOffset.y, offset.y);
+					unitMotionPredictor.SetUnitScreenPos(unit, (int32_t)i, 0);
+				}
+			}
+
+			renderContext.Present();
+		}
+
+		TEST_METHOD(TracksUnitsThroughCompaction)
+		{
+			auto gameHelper = std::make_shared<FakeGameHelper>();
+			auto simd = std::make_shared<SimdSse2>();
+			NullRenderContext renderContext{ nullptr, { 640, 480 }, { 800, 600 }, ScreenMode::Windowed, nullptr, simd };
+			UnitMotionPredictor unitMotionPredictor{ gameHelper, simd };
+
+			gameHelper->AddUnits(1000);
+
+			for (int32_t frame = 0; frame < 10; ++frame)
+			{
+				RunFrame(unitMotionPredictor, *gameHelper, renderContext, 1);
+			}
+
+			const Offset offset = unitMotionPredictor.GetOffset(gameHelper->GetUnit(1));
+			Assert::IsTrue(offset.x != 0 || offset.y != 0);
+
+			/* Entries are compacted one per frame. A unit that got lost in the index on the way
+			   would be tracked anew, and its offset would no longer match the others. */
+			for (uint32_t i = 0; i < 1000; i += 3)
+			{
+				gameHelper->units[i].isAlive = false;
+			}
+
+			for (int32_t frame = 0; frame < 400; ++frame)
+			{
+				RunFrame(unitMotionPredictor, *gameHelper, renderContext, 1);
+			}
+
+			/* Only fits if the expired entries were actually freed. */
+			gameHelper->AddUnits(300);
+
+			for (int32_t frame = 0; frame < 10; ++frame)
+			{
+				RunFrame(unitMotionPredictor, *gameHelper, renderContext, 1000);
+			}
+
+			const Offset newOffset = unitMotionPredictor.GetOffset(gameHelper->GetUnit(1000));
+			Assert::IsTrue(newOffset.x != 0 || newOffset.y != 0);
+		}
+
+		/* Units 20 pixels apart, so that no point is within 8 pixels of two of them. */
+		static Offset GetScreenPos(uint32_t unitIndex)
+		{
+			return { (int32_t)(unitIndex % 20) * 20 - 100, (int32_t)(unitIndex / 20) * 20 - 50 };
+		}
+
+		static void AssertShadowsMatchUnits(
+			UnitMotionPredictor& unitMotionPredictor,
+			FakeGameHelper& gameHelper)
+		{
+			for (uint32_t i = 0; i < gameHelper.units.size(); ++i)
+			{
+				if (!gameHelper.units[i].isAlive)
+				{
+					continue;
+				}
+
+				auto unit = gameHelper.GetUnit(i);
+				const Offset screenPos = GetScreenPos(i);
+				const Offset expectedOffset = unitMotionPredictor.GetOffset(unit);
+
+				for (int32_t dy = -7; dy <= 7; dy += 7)
+				{
+					for (int32_t dx = -7; dx <= 7; dx += 7)
+					{
+						const Offset offset = unitMotionPredictor.GetOffsetForShadow(screenPos.x + dx, screenPos.y + dy);
+						Assert::AreEqual(expectedOffset.x, offset.x);
+						Assert::AreEqual(expectedOffset.y, offset.y);
+					}
+				}
+
+				const Offset missOffset = unitMotionPredictor.GetOffsetForShadow(screenPos.x + 10, screenPos.y);
+				Assert::AreEqual(0, missOffset.x);
+				Assert::AreEqual(0, missOffset.y);
+
+				Assert::IsTrue(unitMotionPredictor.IsShadowOfUnit(unit, screenPos.x + 3, screenPos.y - 3));
+				Assert::IsFalse(unitMotionPredictor.IsShadowOfUnit(unit, screenPos.x + 8, screenPos.y));
+			}
+		}
+
+		TEST_METHOD(ShadowsMatchNearbyUnits)
+		{
+			auto gameHelper = std::make_shared<FakeGameHelper>();
+			auto simd = std::make_shared<SimdSse2>();
+			NullRenderContext renderContext{ nullptr, { 640, 480 }, { 800, 600 }, ScreenMode::Windowed, nullptr, simd };
+			UnitMotionPredictor unitMotionPredictor{ gameHelper, simd };
+
+			gameHelper->AddUnits(200);
+
+			/* Different speeds, so that the offsets tell the units apart. */
+			for (uint32_t i = 0; i < 200; ++i)
+			{
+				gameHelper->units[i].speed = (int32_t)(1 + i % 4) * 16384;
+			}
+
+			/* Positions are set by the first draw, before GetOffset has seen the unit, and move across cells. */
+			for (int32_t frame = 0; frame < 10; ++frame)
+			{
+				gameHelper->MoveUnits();
+				unitMotionPredictor.Update(&renderContext);
+
+				for (uint32_t i = 0; i < 200; ++i)
+				{
+					if (gameHelper->units[i].isAlive)
+					{
+						const Offset screenPos = GetScreenPos(i);
+						unitMotionPredictor.SetUnitScreenPos(gameHelper->GetUnit(i), screenPos.x + 36 - 4 * frame, screenPos.y);
+					}
+				}
+
+				renderContext.Present();
+			}
+
+			AssertShadowsMatchUnits(unitMotionPredictor, *gameHelper);
+
+			/* Expire units, and let compaction move the others around in the list. */
+			for (uint32_t i = 0; i < 200; i += 3)
+			{
+				gameHelper->units[i].isAlive = false;
+			}
+
+			for (int32_t frame = 0; frame < 100; ++frame)
+			{
+				gameHelper->MoveUnits();
+				unitMotionPredictor.Update(&renderContext);
+				renderContext.Present();
+			}
+
+			AssertShadowsMatchUnits(unitMotionPredictor, *gameHelper);
+
+			const Offset expiredOffset = unitMotionPredictor.GetOffsetForShadow(GetScreenPos(0).x, GetScreenPos(0).y);
+			Assert::AreEqual(0, expiredOffset.x);
+			Assert::AreEqual(0, expiredOffset.y);
+		}
+
+		TEST_METHOD(UsesPointersOfUnitsDrawnLastFrame)
+		{
+			auto gameHelper = std::make_shared<FakeGameHelper>();
+			auto simd = std::make_shared<SimdSse2>();
+			NullRenderContext renderContext{ nullptr, { 640, 480 }, { 800, 600 }, ScreenMode::Windowed, nullptr, simd };
+			UnitMotionPredictor unitMotionPredictor{ gameHelper, simd };
+
+			gameHelper->AddUnits(500);
+			RunFrame(unitMotionPredictor, *gameHelper, renderContext, 0);
+
+			/* Every unit is drawn every frame, so the game never has to be asked. */
+			gameHelper->findUnitCount = 0;
+
+			for (int32_t frame = 0; frame < 10; ++frame)
+			{
+				RunFrame(unitMotionPredictor, *gameHelper, renderContext, 0);
+			}
+
+			Assert::AreEqual(0U, gameHelper->findUnitCount);
+			Assert::AreEqual(5000U, unitMotionPredictor.GetUnitPointerCacheHits());
+			Assert::AreEqual(0U, unitMotionPredictor.GetUnitPointerCacheMisses());
+
+			/* A unit whose memory now holds another unit is looked up, found gone and expired. The
+			   new unit is tracked from scratch. */
+			const uint32_t oldUnitId = gameHelper->units[7].id;
+			const uint32_t newUnitId = oldUnitId ^ 0x8000;
+			Assert::AreEqual(-1, gameHelper->unitIndices[newUnitId]);
+			gameHelper->unitIndices[oldUnitId] = -1;
+			gameHelper->unitIndices[newUnitId] = 7;
+			gameHelper->units[7].id = newUnitId;
+
+			gameHelper->MoveUnits();
+			unitMotionPredictor.Update(&renderContext);
+			renderContext.Present();
+
+			Assert::AreEqual(1U, gameHelper->findUnitCount);
+			Assert::AreEqual(1U, unitMotionPredictor.GetUnitPointerCacheMisses());
+
+			const Offset newUnitOffset = unitMotionPredictor.GetOffset(gameHelper->GetUnit(7));
+			Assert::AreEqual(0, newUnitOffset.x);
+			Assert::AreEqual(0, newUnitOffset.y);
+
+			/* Units that were not drawn in the last frame are looked up in the game. */
+			gameHelper->findUnitCount = 0;
+			gameHelper->MoveUnits();
+			unitMotionPredictor.Update(&renderContext);
+			renderContext.Present();
+
+			Assert::AreEqual(499U, gameHelper->findUnitCount);
+			Assert::AreEqual(500U, unitMotionPredictor.GetUnitPointerCacheMisses());
+
+			const Offset offset = unitMotionPredictor.GetOffset(gameHelper->GetUnit(8));
+			Assert::IsTrue(offset.x != 0 || offset.y != 0);
+		}
+
+		TEST_METHOD(BenchmarkThousandMovingUnits)
+		{
+			auto gameHelper = std::make_shared<FakeGameHelper>();
+			auto simd = std::make_shared<SimdSse2>();
+			NullRenderContext renderContext{ nullptr, { 640, 480 }, { 800, 600 }, ScreenMode::Windowed, nullptr, simd };
+			UnitMotionPredictor unitMotionPredictor{ gameHelper, simd };
+			const int32_t frameCount = 1000;
+
+			gameHelper->AddUnits(1000);
+
+			/* Each unit is drawn with its shadow, as D2DXContext::BeginDrawImage sees them. */
+			int32_t checksum = 0;
+			const int64_t startTime = TimeStart();
+
+			for (int32_t frame = 0; frame < frameCount; ++frame)
+			{
+				gameHelper->MoveUnits();
+				unitMotionPredictor.Update(&renderContext);
+
+				for (uint32_t i = 0; i < 1000; ++i)
+				{
+					auto unit = gameHelper->GetUnit(i);
+					const Offset screenPos = { (int32_t)(i % 40) * 20, (int32_t)(i / 40) * 24 };
+					unitMotionPredictor.SetUnitScreenPos(unit, screenPos.x, screenPos.y);
+					const Offset offset = unitMotionPredictor.GetOffset(unit);
+					const Offset shadowOffset = unitMotionPredictor.GetOffsetForShadow(screenPos.x + 2, screenPos.y + 3);
+					checksum += offset.x + shadowOffset.y;
+				}
+			}
+
+			const float timeMs = TimeEndMs(startTime);
+
+			char message[256];
+			sprintf_s(message, "1000 units: %.3f ms per frame (checksum %d, %u unit pointer cache hits, %u misses)",
+				timeMs / frameCount, checksum, unitMotionPredictor.GetUnitPointerCacheHits(), unitMotionPredictor.GetUnitPointerCacheMisses());
+			Logger::WriteMessage(message);
+		}
+	};
+}